@@ -0,0 +1,217 @@
+#include "pl_modbus.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+
+//==============================================================================
+
+// Frame and data conversion kernels of ModbusBase (CRC, LRC, ASCII encoding/decoding, bit copying, register byte swapping)
+// are run over realistic payload sizes and compared with simple reference implementations.
+// Results are printed as CSV lines (kernel,size,equivalent,ns_per_byte,reference_ns_per_byte).
+
+const size_t payloadSizes[] = {8, 64, 256, 512};
+const size_t maxPayloadSize = 512;
+const int64_t minMeasurementDuration = 20000;
+const int numberOfEquivalenceChecks = 200;
+
+uint8_t src[maxPayloadSize * 2 + 2];
+uint8_t dest[maxPayloadSize * 2 + 2];
+uint8_t referenceDest[maxPayloadSize * 2 + 2];
+// Prevents the measured calls from being optimized away
+volatile uint32_t sink;
+
+//==============================================================================
+
+uint16_t ReferenceCrc(const uint8_t* data, size_t size);
+uint8_t ReferenceLrc(const uint8_t* data, size_t size);
+void ReferenceEncodeAscii(const uint8_t* data, size_t size, uint8_t* ascii);
+bool ReferenceDecodeAscii(const uint8_t* ascii, uint8_t& value);
+void ReferenceCopyBits(const uint8_t* src, size_t srcOffset, uint8_t* dest, size_t destOffset, size_t numberOfBits);
+void ReferenceCopySwappedRegisters(const uint8_t* src, uint8_t* dest, size_t numberOfRegisters);
+template <class Function>
+float Measure(size_t size, Function function);
+void PrintResult(const char* kernel, size_t size, bool equivalent, float nsPerByte, float referenceNsPerByte);
+
+//==============================================================================
+
+extern "C" void app_main(void) {
+  printf("kernel,size,equivalent,ns_per_byte,reference_ns_per_byte\n");
+
+  for (auto size : payloadSizes) {
+    bool equivalent = true;
+    for (int i = 0; i < numberOfEquivalenceChecks; i++) {
+      esp_fill_random(src, size);
+      equivalent &= PL::ModbusBase::Crc(src, size) == ReferenceCrc(src, size);
+    }
+    PrintResult("crc", size, equivalent, Measure(size, [size] { sink = PL::ModbusBase::Crc(src, size); }),
+      Measure(size, [size] { sink = ReferenceCrc(src, size); }));
+  }
+
+  for (auto size : payloadSizes) {
+    bool equivalent = true;
+    for (int i = 0; i < numberOfEquivalenceChecks; i++) {
+      esp_fill_random(src, size);
+      equivalent &= PL::ModbusBase::Lrc(src, size) == ReferenceLrc(src, size);
+    }
+    PrintResult("lrc", size, equivalent, Measure(size, [size] { sink = PL::ModbusBase::Lrc(src, size); }),
+      Measure(size, [size] { sink = ReferenceLrc(src, size); }));
+  }
+
+  for (auto size : payloadSizes) {
+    bool equivalent = true;
+    for (int i = 0; i < numberOfEquivalenceChecks; i++) {
+      esp_fill_random(src, size);
+      memcpy(dest, src, size);
+      PL::ModbusBase::EncodeAscii(dest, size);
+      ReferenceEncodeAscii(src, size, referenceDest);
+      equivalent &= memcmp(dest + 1, referenceDest + 1, size * 2) == 0;
+    }
+    // The encoding is in place: the source is copied on each iteration (memcpy cost is included in both results).
+    PrintResult("ascii_encode", size, equivalent, Measure(size, [size] { memcpy(dest, src, size); PL::ModbusBase::EncodeAscii(dest, size); }),
+      Measure(size, [size] { memcpy(dest, src, size); ReferenceEncodeAscii(dest, size, referenceDest); }));
+  }
+
+  {
+    // All character pairs are checked.
+    bool equivalent = true;
+    for (int i = 0; i < 0x10000; i++) {
+      uint8_t ascii[2] = {(uint8_t)(i >> 8), (uint8_t)i};
+      uint8_t value = 0, referenceValue = 0;
+      bool valid = PL::ModbusBase::DecodeAscii(ascii, value);
+      bool referenceValid = ReferenceDecodeAscii(ascii, referenceValue);
+      equivalent &= valid == referenceValid && (!valid || value == referenceValue);
+    }
+    for (auto size : payloadSizes) {
+      esp_fill_random(src, size);
+      ReferenceEncodeAscii(src, size, referenceDest);
+      PrintResult("ascii_decode", size, equivalent, Measure(size, [size] {
+          for (size_t i = 0; i < size; i++)
+            PL::ModbusBase::DecodeAscii(referenceDest + 1 + i * 2, dest[i]);
+          sink = dest[0];
+        }),
+        Measure(size, [size] {
+          for (size_t i = 0; i < size; i++)
+            ReferenceDecodeAscii(referenceDest + 1 + i * 2, dest[i]);
+          sink = dest[0];
+        }));
+    }
+  }
+
+  for (auto size : payloadSizes) {
+    // Aligned copies (memory area and request at byte boundaries) and copies with random bit offsets are checked.
+    bool equivalent = true;
+    for (int i = 0; i < numberOfEquivalenceChecks; i++) {
+      esp_fill_random(src, size);
+      esp_fill_random(dest, size + 1);
+      memcpy(referenceDest, dest, size + 1);
+      size_t srcOffset = i ? esp_random() % 8 : 0;
+      size_t destOffset = i ? esp_random() % 8 : 0;
+      size_t numberOfBits = size * 8 - srcOffset - esp_random() % 8;
+      PL::ModbusBase::CopyBits(src, srcOffset, dest, destOffset, numberOfBits);
+      ReferenceCopyBits(src, srcOffset, referenceDest, destOffset, numberOfBits);
+      equivalent &= memcmp(dest, referenceDest, size + 1) == 0;
+    }
+    PrintResult("copy_bits_aligned", size, equivalent, Measure(size, [size] { PL::ModbusBase::CopyBits(src, 0, dest, 0, size * 8); sink = dest[0]; }),
+      Measure(size, [size] { ReferenceCopyBits(src, 0, dest, 0, size * 8); sink = dest[0]; }));
+    PrintResult("copy_bits_unaligned", size, equivalent, Measure(size, [size] { PL::ModbusBase::CopyBits(src, 3, dest, 5, size * 8 - 8); sink = dest[0]; }),
+      Measure(size, [size] { ReferenceCopyBits(src, 3, dest, 5, size * 8 - 8); sink = dest[0]; }));
+  }
+
+  for (auto size : payloadSizes) {
+    bool equivalent = true;
+    for (int i = 0; i < numberOfEquivalenceChecks; i++) {
+      esp_fill_random(src, size);
+      PL::ModbusBase::CopySwappedRegisters(src, dest, size / 2);
+      ReferenceCopySwappedRegisters(src, referenceDest, size / 2);
+      equivalent &= memcmp(dest, referenceDest, size) == 0;
+    }
+    PrintResult("copy_swapped_registers", size, equivalent, Measure(size, [size] { PL::ModbusBase::CopySwappedRegisters(src, dest, size / 2); sink = dest[0]; }),
+      Measure(size, [size] { ReferenceCopySwappedRegisters(src, dest, size / 2); sink = dest[0]; }));
+  }
+}
+
+//==============================================================================
+
+uint16_t ReferenceCrc(const uint8_t* data, size_t size) {
+  // Bitwise CRC-16 (polynomial 0xA001 reflected, initial value 0xFFFF)
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < size; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++)
+      crc = (crc & 1) ? ((crc >> 1) ^ 0xA001) : (crc >> 1);
+  }
+  return crc;
+}
+
+//==============================================================================
+
+uint8_t ReferenceLrc(const uint8_t* data, size_t size) {
+  // Two's complement of the sum modulo 256
+  unsigned int sum = 0;
+  for (size_t i = 0; i < size; i++)
+    sum += data[i];
+  return (uint8_t)(-(int)(sum & 0xFF));
+}
+
+//==============================================================================
+
+void ReferenceEncodeAscii(const uint8_t* data, size_t size, uint8_t* ascii) {
+  // Same layout as ModbusBase::EncodeAscii: byte i is encoded into characters 2i+1 and 2i+2.
+  char characters[3];
+  for (size_t i = 0; i < size; i++) {
+    snprintf(characters, sizeof(characters), "%02X", data[i]);
+    ascii[i * 2 + 1] = characters[0];
+    ascii[i * 2 + 2] = characters[1];
+  }
+}
+
+//==============================================================================
+
+bool ReferenceDecodeAscii(const uint8_t* ascii, uint8_t& value) {
+  const char* digits = "0123456789ABCDEF";
+  const char* high = ascii[0] ? strchr(digits, ascii[0]) : NULL;
+  const char* low = ascii[1] ? strchr(digits, ascii[1]) : NULL;
+  if (!high || !low)
+    return false;
+  value = (high - digits) * 16 + (low - digits);
+  return true;
+}
+
+//==============================================================================
+
+void ReferenceCopyBits(const uint8_t* src, size_t srcOffset, uint8_t* dest, size_t destOffset, size_t numberOfBits) {
+  for (size_t i = 0; i < numberOfBits; i++) {
+    bool bit = (src[(srcOffset + i) / 8] >> ((srcOffset + i) % 8)) & 1;
+    uint8_t mask = 1 << ((destOffset + i) % 8);
+    dest[(destOffset + i) / 8] = bit ? (dest[(destOffset + i) / 8] | mask) : (dest[(destOffset + i) / 8] & ~mask);
+  }
+}
+
+//==============================================================================
+
+void ReferenceCopySwappedRegisters(const uint8_t* src, uint8_t* dest, size_t numberOfRegisters) {
+  for (size_t i = 0; i < numberOfRegisters; i++) {
+    dest[i * 2] = src[i * 2 + 1];
+    dest[i * 2 + 1] = src[i * 2];
+  }
+}
+
+//==============================================================================
+
+template <class Function>
+float Measure(size_t size, Function function) {
+  // The number of iterations is doubled until the measurement takes long enough for the timer resolution.
+  for (uint32_t numberOfIterations = 16;; numberOfIterations *= 2) {
+    int64_t startTime = esp_timer_get_time();
+    for (uint32_t i = 0; i < numberOfIterations; i++)
+      function();
+    int64_t duration = esp_timer_get_time() - startTime;
+    if (duration >= minMeasurementDuration)
+      return duration * 1000.0f / numberOfIterations / size;
+  }
+}
+
+//==============================================================================
+
+void PrintResult(const char* kernel, size_t size, bool equivalent, float nsPerByte, float referenceNsPerByte) {
+  printf("%s,%d,%s,%.3f,%.3f\n", kernel, (int)size, equivalent ? "yes" : "NO", nsPerByte, referenceNsPerByte);
+}
@@ -0,0 +1,108 @@
+#include "pl_modbus.h"
+#include <atomic>
+
+//==============================================================================
+
+// One producer task updates the whole memory area in a loop while several TCP clients read it through two servers.
+// Every producer update writes the same value to all registers, so a read with different register values is inconsistent.
+
+const uint16_t firstPort = 502;
+const int numberOfServers = 2;
+const int numberOfReaders = 4;
+const uint16_t numberOfRegisters = PL::ModbusBase::maxNumberOfModbusRegistersToRead;
+const TickType_t testDuration = 5000 / portTICK_PERIOD_MS;
+const size_t taskStackDepth = 4096;
+
+std::shared_ptr<PL::ModbusMemoryArea> memoryArea;
+std::atomic<bool> running;
+std::atomic<int> numberOfRunningTasks;
+std::atomic<uint32_t> numberOfUpdates;
+std::atomic<uint32_t> numberOfReads;
+std::atomic<uint32_t> numberOfInconsistentReads;
+
+//==============================================================================
+
+void Run(const char* name, std::shared_ptr<PL::ModbusMemoryArea> testMemoryArea);
+void ProducerTask(void* parameters);
+void ReaderTask(void* parameters);
+
+//==============================================================================
+
+extern "C" void app_main(void) {
+  ESP_ERROR_CHECK(esp_netif_init());
+
+  Run("ModbusMemoryArea", std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::holdingRegisters, 0, numberOfRegisters * 2));
+  Run("ModbusSeqLockMemoryArea", std::make_shared<PL::ModbusSeqLockMemoryArea>(PL::ModbusMemoryType::holdingRegisters, 0, numberOfRegisters * 2));
+}
+
+//==============================================================================
+
+void Run(const char* name, std::shared_ptr<PL::ModbusMemoryArea> testMemoryArea) {
+  memoryArea = testMemoryArea;
+  std::vector<std::shared_ptr<PL::ModbusServer>> servers;
+  for (int i = 0; i < numberOfServers; i++) {
+    auto server = std::make_shared<PL::ModbusServer>(firstPort + i);
+    server->AddMemoryArea(memoryArea);
+    ESP_ERROR_CHECK(server->Enable());
+    servers.push_back(server);
+  }
+  vTaskDelay(10);
+
+  numberOfUpdates = 0;
+  numberOfReads = 0;
+  numberOfInconsistentReads = 0;
+  running = true;
+  numberOfRunningTasks = numberOfReaders + 1;
+  xTaskCreate(ProducerTask, "producer", taskStackDepth, NULL, tskIDLE_PRIORITY + 1, NULL);
+  for (int i = 0; i < numberOfReaders; i++)
+    xTaskCreate(ReaderTask, "reader", taskStackDepth, (void*)(uintptr_t)(firstPort + i % numberOfServers), tskIDLE_PRIORITY + 1, NULL);
+
+  vTaskDelay(testDuration);
+  running = false;
+  while (numberOfRunningTasks)
+    vTaskDelay(1);
+
+  for (auto& server : servers)
+    server->Disable();
+
+  float seconds = (float)testDuration * portTICK_PERIOD_MS / 1000;
+  printf("%s (%d servers, %d readers, %d registers):\n", name, numberOfServers, numberOfReaders, numberOfRegisters);
+  printf("  updates/s: %.0f\n", numberOfUpdates / seconds);
+  printf("  reads/s: %.0f\n", numberOfReads / seconds);
+  printf("  inconsistent reads: %lu\n", (unsigned long)numberOfInconsistentReads);
+}
+
+//==============================================================================
+
+void ProducerTask(void* parameters) {
+  uint16_t value = 0;
+  while (running) {
+    PL::LockGuard lg(*memoryArea);
+    value++;
+    for (int i = 0; i < numberOfRegisters; i++)
+      ((uint16_t*)memoryArea->data)[i] = value;
+    numberOfUpdates++;
+  }
+  numberOfRunningTasks--;
+  vTaskDelete(NULL);
+}
+
+//==============================================================================
+
+void ReaderTask(void* parameters) {
+  PL::ModbusClient client(PL::IpV4Address(127, 0, 0, 1), (uint16_t)(uintptr_t)parameters);
+  uint16_t registers[numberOfRegisters];
+  while (running) {
+    if (client.ReadHoldingRegisters(0, numberOfRegisters, registers, NULL) == ESP_OK) {
+      numberOfReads++;
+      for (int i = 1; i < numberOfRegisters; i++) {
+        if (registers[i] != registers[0]) {
+          numberOfInconsistentReads++;
+          break;
+        }
+      }
+    }
+  }
+  numberOfRunningTasks--;
+  vTaskDelete(NULL);
+}
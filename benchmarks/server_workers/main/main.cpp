@@ -0,0 +1,101 @@
+#include "pl_modbus.h"
+#include "esp_timer.h"
+#include <atomic>
+
+//==============================================================================
+
+// Several TCP clients read a memory area with a slow OnRead callback (busy wait that simulates computation or a sensor read).
+// The number of requests per second is measured for the server task only and for 1..N worker tasks.
+// The memory area has lock-free reads, so the workers do not wait for each other.
+
+class SlowMemoryArea : public PL::ModbusSeqLockMemoryArea {
+public:
+  using PL::ModbusSeqLockMemoryArea::ModbusSeqLockMemoryArea;
+
+  esp_err_t OnRead(uint16_t address, uint16_t numberOfItems) override;
+};
+
+//==============================================================================
+
+const uint16_t port = 502;
+const int numberOfClients = 8;
+const uint16_t numberOfRegisters = 10;
+const int64_t onReadDuration = 500;
+const TickType_t testDuration = 5000 / portTICK_PERIOD_MS;
+const size_t taskStackDepth = 4096;
+const int maxNumberOfWorkers = 4;
+
+std::atomic<bool> running;
+std::atomic<int> numberOfRunningTasks;
+std::atomic<uint32_t> numberOfReads;
+
+//==============================================================================
+
+void Run(int numberOfWorkers);
+void ClientTask(void* parameters);
+
+//==============================================================================
+
+extern "C" void app_main(void) {
+  ESP_ERROR_CHECK(esp_netif_init());
+
+  printf("%d clients, OnRead duration %lld us\n", numberOfClients, (long long)onReadDuration);
+  for (int numberOfWorkers = 0; numberOfWorkers <= maxNumberOfWorkers; numberOfWorkers = numberOfWorkers ? numberOfWorkers * 2 : 1)
+    Run(numberOfWorkers);
+}
+
+//==============================================================================
+
+void Run(int numberOfWorkers) {
+  PL::ModbusServer server(port);
+  server.AddMemoryArea(std::make_shared<SlowMemoryArea>(PL::ModbusMemoryType::holdingRegisters, 0, numberOfRegisters * 2));
+  // Workers are distributed between the cores.
+  std::vector<PL::TaskParameters> workerTaskParameters;
+  for (int i = 0; i < numberOfWorkers; i++)
+    workerTaskParameters.push_back({taskStackDepth, tskIDLE_PRIORITY + 5, i % portNUM_PROCESSORS});
+  ESP_ERROR_CHECK(server.SetWorkerTaskParameters(workerTaskParameters));
+  if (auto baseServer = server.GetBaseServer().lock())
+    ((PL::TcpServer&)*baseServer).SetMaxNumberOfClients(numberOfClients);
+  ESP_ERROR_CHECK(server.Enable());
+  vTaskDelay(10);
+
+  numberOfReads = 0;
+  running = true;
+  numberOfRunningTasks = numberOfClients;
+  for (int i = 0; i < numberOfClients; i++)
+    xTaskCreate(ClientTask, "client", taskStackDepth, NULL, tskIDLE_PRIORITY + 1, NULL);
+
+  vTaskDelay(testDuration);
+  running = false;
+  while (numberOfRunningTasks)
+    vTaskDelay(1);
+
+  server.Disable();
+
+  float seconds = (float)testDuration * portTICK_PERIOD_MS / 1000;
+  if (numberOfWorkers)
+    printf("%d workers: %.0f requests/s\n", numberOfWorkers, numberOfReads / seconds);
+  else
+    printf("server task: %.0f requests/s\n", numberOfReads / seconds);
+}
+
+//==============================================================================
+
+void ClientTask(void* parameters) {
+  PL::ModbusClient client(PL::IpV4Address(127, 0, 0, 1), port);
+  uint16_t registers[numberOfRegisters];
+  while (running) {
+    if (client.ReadHoldingRegisters(0, numberOfRegisters, registers, NULL) == ESP_OK)
+      numberOfReads++;
+  }
+  numberOfRunningTasks--;
+  vTaskDelete(NULL);
+}
+
+//==============================================================================
+
+esp_err_t SlowMemoryArea::OnRead(uint16_t address, uint16_t numberOfItems) {
+  int64_t endTime = esp_timer_get_time() + onReadDuration;
+  while (esp_timer_get_time() < endTime);
+  return ESP_OK;
+}
\ No newline at end of file
@@ -0,0 +1,273 @@
+#include "pl_modbus.h"
+#include "esp_timer.h"
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <stdlib.h>
+#include <tuple>
+
+//==============================================================================
+
+// Transactions per second and latency percentiles of every implemented function code for each protocol (TCP, RTU over TCP, ASCII over TCP),
+// request size (1 to the maximum number of bits/registers) and number of concurrent clients.
+// Results are printed as CSV lines (protocol,function_code,size,clients,transactions,errors,transactions_per_second,p50_us,p99_us,max_us).
+// Linux host build: results are written to the file from the PL_MODBUS_BENCHMARK_OUTPUT environment variable (throughput_latency.csv by default)
+// and compared with the baseline file from the PL_MODBUS_BENCHMARK_BASELINE environment variable (if set).
+
+const uint16_t port = 502;
+const int numberOfClients[] = {1, 4};
+const TickType_t caseDuration = 200 / portTICK_PERIOD_MS;
+const size_t taskStackDepth = 4096;
+// Throughput decrease or p99 latency increase relative to the baseline that is reported as a regression
+const float regressionThreshold = 0.2;
+
+// Coils, discrete inputs, holding registers and input registers are all mapped to the same buffer.
+const size_t memorySize = PL::ModbusBase::maxNumberOfModbusBitsToRead / 8;
+// Transaction buffer for the maximum ASCII frame (2 characters per byte)
+const size_t bufferSize = PL::ModbusBase::defaultBufferSize * 2;
+
+struct Case {
+  PL::ModbusProtocol protocol;
+  PL::ModbusFunctionCode functionCode;
+  uint16_t size;
+  int numberOfClients;
+};
+
+struct Result {
+  Case testCase;
+  uint32_t numberOfTransactions;
+  uint32_t numberOfErrors;
+  float transactionsPerSecond;
+  uint32_t p50;
+  uint32_t p99;
+  uint32_t max;
+};
+
+struct ClientContext {
+  Case testCase;
+  std::vector<uint32_t> latencies;
+  uint32_t numberOfErrors;
+};
+
+// Result key: protocol name, function code, size, number of clients
+using ResultKey = std::tuple<std::string, int, int, int>;
+
+std::atomic<bool> running;
+std::atomic<int> numberOfRunningTasks;
+
+//==============================================================================
+
+Result Run(const Case& testCase);
+void ClientTask(void* parameters);
+esp_err_t Execute(PL::ModbusClient& client, PL::ModbusFunctionCode functionCode, uint16_t size, uint8_t* data);
+std::vector<uint16_t> GetSizes(uint16_t maxSize);
+const char* GetProtocolName(PL::ModbusProtocol protocol);
+void PrintResult(FILE* file, const Result& result);
+std::map<ResultKey, Result> ReadBaseline(const char* fileName);
+
+//==============================================================================
+
+extern "C" void app_main(void) {
+  ESP_ERROR_CHECK(esp_netif_init());
+
+  std::vector<std::pair<PL::ModbusFunctionCode, uint16_t>> functionCodes = {
+    {PL::ModbusFunctionCode::readCoils, PL::ModbusBase::maxNumberOfModbusBitsToRead},
+    {PL::ModbusFunctionCode::readDiscreteInputs, PL::ModbusBase::maxNumberOfModbusBitsToRead},
+    {PL::ModbusFunctionCode::readHoldingRegisters, PL::ModbusBase::maxNumberOfModbusRegistersToRead},
+    {PL::ModbusFunctionCode::readInputRegisters, PL::ModbusBase::maxNumberOfModbusRegistersToRead},
+    {PL::ModbusFunctionCode::writeSingleCoil, 1},
+    {PL::ModbusFunctionCode::writeSingleHoldingRegister, 1},
+    {PL::ModbusFunctionCode::writeMultipleCoils, PL::ModbusBase::maxNumberOfModbusBitsToWrite},
+    {PL::ModbusFunctionCode::writeMultipleHoldingRegisters, PL::ModbusBase::maxNumberOfModbusRegistersToWrite}};
+
+  std::vector<Result> results;
+  printf("protocol,function_code,size,clients,transactions,errors,transactions_per_second,p50_us,p99_us,max_us\n");
+  for (auto protocol : {PL::ModbusProtocol::tcp, PL::ModbusProtocol::rtu, PL::ModbusProtocol::ascii}) {
+    for (auto& functionCode : functionCodes) {
+      for (auto size : GetSizes(functionCode.second)) {
+        for (auto clients : numberOfClients) {
+          results.push_back(Run({protocol, functionCode.first, size, clients}));
+          PrintResult(stdout, results.back());
+        }
+      }
+    }
+  }
+
+#if CONFIG_IDF_TARGET_LINUX
+  const char* outputFileName = getenv("PL_MODBUS_BENCHMARK_OUTPUT");
+  if (!outputFileName)
+    outputFileName = "throughput_latency.csv";
+  if (FILE* file = fopen(outputFileName, "w")) {
+    fprintf(file, "protocol,function_code,size,clients,transactions,errors,transactions_per_second,p50_us,p99_us,max_us\n");
+    for (auto& result : results)
+      PrintResult(file, result);
+    fclose(file);
+    printf("Results are written to %s\n", outputFileName);
+  }
+  else
+    printf("Cannot create %s\n", outputFileName);
+
+  if (const char* baselineFileName = getenv("PL_MODBUS_BENCHMARK_BASELINE")) {
+    auto baseline = ReadBaseline(baselineFileName);
+    printf("Comparison with %s (%zu results):\n", baselineFileName, baseline.size());
+    int numberOfRegressions = 0;
+    for (auto& result : results) {
+      auto baselineResult = baseline.find({GetProtocolName(result.testCase.protocol), (int)result.testCase.functionCode, result.testCase.size, result.testCase.numberOfClients});
+      if (baselineResult == baseline.end() || !baselineResult->second.transactionsPerSecond || !baselineResult->second.p99)
+        continue;
+      float throughputChange = result.transactionsPerSecond / baselineResult->second.transactionsPerSecond - 1;
+      float latencyChange = (float)result.p99 / baselineResult->second.p99 - 1;
+      bool regression = throughputChange < -regressionThreshold || latencyChange > regressionThreshold;
+      numberOfRegressions += regression;
+      printf("  %s FC%d size %d clients %d: transactions/s %+.1f%%, p99 %+.1f%%%s\n", GetProtocolName(result.testCase.protocol),
+        (int)result.testCase.functionCode, result.testCase.size, result.testCase.numberOfClients, throughputChange * 100, latencyChange * 100, regression ? " REGRESSION" : "");
+    }
+    printf("%d regressions\n", numberOfRegressions);
+  }
+#endif
+}
+
+//==============================================================================
+
+Result Run(const Case& testCase) {
+  auto memoryBuffer = std::make_shared<PL::Buffer>(memorySize);
+  PL::ModbusServer server(port, testCase.protocol, bufferSize);
+  server.AddMemoryArea(PL::ModbusMemoryType::coils, 0, memoryBuffer);
+  server.AddMemoryArea(PL::ModbusMemoryType::discreteInputs, 0, memoryBuffer);
+  server.AddMemoryArea(PL::ModbusMemoryType::holdingRegisters, 0, memoryBuffer);
+  server.AddMemoryArea(PL::ModbusMemoryType::inputRegisters, 0, memoryBuffer);
+  if (auto baseServer = server.GetBaseServer().lock())
+    ((PL::TcpServer&)*baseServer).SetMaxNumberOfClients(testCase.numberOfClients);
+  ESP_ERROR_CHECK(server.Enable());
+  vTaskDelay(10);
+
+  std::vector<ClientContext> contexts(testCase.numberOfClients);
+  running = false;
+  numberOfRunningTasks = testCase.numberOfClients;
+  for (auto& context : contexts) {
+    context.testCase = testCase;
+    context.numberOfErrors = 0;
+    xTaskCreate(ClientTask, "client", taskStackDepth, &context, tskIDLE_PRIORITY + 1, NULL);
+  }
+  // Clients connect before the measurement.
+  vTaskDelay(10);
+
+  int64_t startTime = esp_timer_get_time();
+  running = true;
+  vTaskDelay(caseDuration);
+  running = false;
+  while (numberOfRunningTasks)
+    vTaskDelay(1);
+  float seconds = (esp_timer_get_time() - startTime) / 1000000.0f;
+
+  server.Disable();
+
+  Result result = {testCase, 0, 0, 0, 0, 0, 0};
+  std::vector<uint32_t> latencies;
+  for (auto& context : contexts) {
+    latencies.insert(latencies.end(), context.latencies.begin(), context.latencies.end());
+    result.numberOfErrors += context.numberOfErrors;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  result.numberOfTransactions = latencies.size();
+  result.transactionsPerSecond = latencies.size() / seconds;
+  if (latencies.size()) {
+    result.p50 = latencies[latencies.size() * 50 / 100];
+    result.p99 = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+    result.max = latencies.back();
+  }
+  return result;
+}
+
+//==============================================================================
+
+void ClientTask(void* parameters) {
+  ClientContext& context = *(ClientContext*)parameters;
+  PL::ModbusClient client(PL::IpV4Address(127, 0, 0, 1), port, context.testCase.protocol, bufferSize);
+  uint8_t data[memorySize] = {};
+  // The first transaction connects the client.
+  Execute(client, context.testCase.functionCode, context.testCase.size, data);
+
+  while (!running)
+    vTaskDelay(1);
+  while (running) {
+    int64_t startTime = esp_timer_get_time();
+    if (Execute(client, context.testCase.functionCode, context.testCase.size, data) == ESP_OK)
+      context.latencies.push_back(esp_timer_get_time() - startTime);
+    else
+      context.numberOfErrors++;
+  }
+  numberOfRunningTasks--;
+  vTaskDelete(NULL);
+}
+
+//==============================================================================
+
+esp_err_t Execute(PL::ModbusClient& client, PL::ModbusFunctionCode functionCode, uint16_t size, uint8_t* data) {
+  PL::ModbusException exception;
+  switch (functionCode) {
+    case PL::ModbusFunctionCode::readCoils: return client.ReadCoils(0, size, data, &exception);
+    case PL::ModbusFunctionCode::readDiscreteInputs: return client.ReadDiscreteInputs(0, size, data, &exception);
+    case PL::ModbusFunctionCode::readHoldingRegisters: return client.ReadHoldingRegisters(0, size, data, &exception);
+    case PL::ModbusFunctionCode::readInputRegisters: return client.ReadInputRegisters(0, size, data, &exception);
+    case PL::ModbusFunctionCode::writeSingleCoil: return client.WriteSingleCoil(0, true, &exception);
+    case PL::ModbusFunctionCode::writeSingleHoldingRegister: return client.WriteSingleHoldingRegister(0, 0x1234, &exception);
+    case PL::ModbusFunctionCode::writeMultipleCoils: return client.WriteMultipleCoils(0, size, data, &exception);
+    case PL::ModbusFunctionCode::writeMultipleHoldingRegisters: return client.WriteMultipleHoldingRegisters(0, size, data, &exception);
+    default: return ESP_ERR_NOT_SUPPORTED;
+  }
+}
+
+//==============================================================================
+
+std::vector<uint16_t> GetSizes(uint16_t maxSize) {
+  // 1, 8, 64, 512 up to the maximum number of items and the maximum number of items
+  std::vector<uint16_t> sizes;
+  for (uint16_t size = 1; size < maxSize; size *= 8)
+    sizes.push_back(size);
+  sizes.push_back(maxSize);
+  return sizes;
+}
+
+//==============================================================================
+
+const char* GetProtocolName(PL::ModbusProtocol protocol) {
+  switch (protocol) {
+    case PL::ModbusProtocol::rtu: return "rtu";
+    case PL::ModbusProtocol::ascii: return "ascii";
+    case PL::ModbusProtocol::tcp: return "tcp";
+    default: return "unknown";
+  }
+}
+
+//==============================================================================
+
+void PrintResult(FILE* file, const Result& result) {
+  fprintf(file, "%s,%d,%d,%d,%lu,%lu,%.0f,%lu,%lu,%lu\n", GetProtocolName(result.testCase.protocol), (int)result.testCase.functionCode, result.testCase.size,
+    result.testCase.numberOfClients, (unsigned long)result.numberOfTransactions, (unsigned long)result.numberOfErrors, result.transactionsPerSecond,
+    (unsigned long)result.p50, (unsigned long)result.p99, (unsigned long)result.max);
+}
+
+//==============================================================================
+
+std::map<ResultKey, Result> ReadBaseline(const char* fileName) {
+  std::map<ResultKey, Result> baseline;
+  FILE* file = fopen(fileName, "r");
+  if (!file)
+    return baseline;
+  char line[256];
+  while (fgets(line, sizeof(line), file)) {
+    char protocolName[16];
+    int functionCode, size, clients;
+    unsigned long numberOfTransactions, numberOfErrors, p50, p99, max;
+    float transactionsPerSecond;
+    if (sscanf(line, "%15[^,],%d,%d,%d,%lu,%lu,%f,%lu,%lu,%lu", protocolName, &functionCode, &size, &clients, &numberOfTransactions, &numberOfErrors,
+        &transactionsPerSecond, &p50, &p99, &max) != 10)
+      continue;
+    Result result = {{PL::ModbusProtocol::tcp, (PL::ModbusFunctionCode)functionCode, (uint16_t)size, clients}, (uint32_t)numberOfTransactions,
+      (uint32_t)numberOfErrors, transactionsPerSecond, (uint32_t)p50, (uint32_t)p99, (uint32_t)max};
+    baseline[{protocolName, functionCode, size, clients}] = result;
+  }
+  fclose(file);
+  return baseline;
+}
@@ -1,7 +1,13 @@
 #pragma once
 #include "pl_modbus_types.h"
+#include "pl_modbus_capture.h"
 #include "pl_modbus_base.h"
 #include "pl_modbus_memory_area.h"
 #include "pl_modbus_typed_memory_area.h"
+#include "pl_modbus_seqlock_memory_area.h"
+#include "pl_modbus_refreshed_memory_area.h"
+#include "pl_modbus_register_map.h"
 #include "pl_modbus_client.h"
-#include "pl_modbus_server.h"
\ No newline at end of file
+#include "pl_modbus_concentrator_memory_area.h"
+#include "pl_modbus_server.h"
+#include "pl_modbus_monitor.h"
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 #include "pl_modbus_types.h"
+#include "pl_modbus_capture.h"
 #include "pl_common.h"
 #include "pl_network.h"
 
@@ -29,6 +30,10 @@ public:
   /// @brief Maximum number of holding registers that can be written in one request
   static constexpr uint16_t maxNumberOfModbusRegistersToWrite = 123;
 
+  /// @brief Gets Modbus interface
+  /// @return interface
+  ModbusInterface GetInterface();
+
   /// @brief Gets Modbus protocol
   /// @return protocol
   ModbusProtocol GetProtocol();
@@ -65,9 +70,55 @@ public:
   /// @return error code
   esp_err_t SetDelayAfterRead(TickType_t delay);
 
+  /// @brief Gets the frame capture
+  /// @return capture (NULL if the frames are not captured)
+  std::shared_ptr<ModbusCapture> GetCapture();
+
+  /// @brief Sets the frame capture that records all read and written frames (the same capture can be used by several clients and servers)
+  /// @param capture capture (NULL to stop capturing)
+  /// @return error code
+  esp_err_t SetCapture(std::shared_ptr<ModbusCapture> capture);
+
+  /// @brief Calculates the RTU frame CRC
+  /// @param data data
+  /// @param size data size
+  /// @return CRC (low byte first in memory)
+  static uint16_t Crc(const void* data, size_t size);
+
+  /// @brief Calculates the ASCII frame LRC
+  /// @param data data
+  /// @param size data size
+  /// @return LRC
+  static uint8_t Lrc(const void* data, size_t size);
+
+  /// @brief Encodes the bytes into uppercase hexadecimal characters in place (byte i is encoded into characters 2i+1 and 2i+2, character 0 is not changed)
+  /// @param data data (2 * size + 1 bytes)
+  /// @param size number of bytes to encode
+  static void EncodeAscii(void* data, size_t size);
+
+  /// @brief Decodes two uppercase hexadecimal characters
+  /// @param ascii characters
+  /// @param value decoded byte
+  /// @return true if both characters are valid
+  static bool DecodeAscii(const uint8_t* ascii, uint8_t& value);
+
+  /// @brief Copies the bits (bit 0 of byte 0 is the first bit)
+  /// @param src source
+  /// @param srcOffset source bit offset
+  /// @param dest destination
+  /// @param destOffset destination bit offset
+  /// @param numberOfBits number of bits
+  static void CopyBits(const void* src, size_t srcOffset, void* dest, size_t destOffset, size_t numberOfBits);
+
+  /// @brief Copies the 16-bit registers swapping their bytes (host byte order to Modbus big-endian and back)
+  /// @param src source
+  /// @param dest destination
+  /// @param numberOfRegisters number of registers
+  static void CopySwappedRegisters(const void* src, void* dest, size_t numberOfRegisters);
+
 protected:
-  ModbusBase(ModbusProtocol protocol, std::shared_ptr<Buffer> buffer, TickType_t readTimeout, TickType_t writeTimeout);
-  ModbusBase(ModbusProtocol protocol, size_t bufferSize, TickType_t readTimeout, TickType_t writeTimeout);
+  ModbusBase(ModbusInterface interface, ModbusProtocol protocol, std::shared_ptr<Buffer> buffer, TickType_t readTimeout, TickType_t writeTimeout);
+  ModbusBase(ModbusInterface interface, ModbusProtocol protocol, size_t bufferSize, TickType_t readTimeout, TickType_t writeTimeout);
 
   /// @brief Reads the Modbus frame
   /// @param stream stream to read from
@@ -77,6 +128,16 @@ protected:
   /// @param transactionId frame transaction ID (for Modbus TCP protocol)
   /// @return error code
   esp_err_t ReadFrame(Stream& stream, uint8_t& stationAddress, ModbusFunctionCode& functionCode, size_t& dataSize, uint16_t& transactionId);
+
+  /// @brief Reads the Modbus frame with the specified read timeout instead of the read operation timeout
+  /// @param stream stream to read from
+  /// @param stationAddress frame station address
+  /// @param functionCode frame function code
+  /// @param dataSize frame data size
+  /// @param transactionId frame transaction ID (for Modbus TCP protocol)
+  /// @param timeout read timeout in FreeRTOS ticks
+  /// @return error code
+  esp_err_t ReadFrame(Stream& stream, uint8_t& stationAddress, ModbusFunctionCode& functionCode, size_t& dataSize, uint16_t& transactionId, TickType_t timeout);
   
   /// @brief Writes the Modbus frame
   /// @param stream stream to write to
@@ -87,6 +148,11 @@ protected:
   /// @return error code
   esp_err_t WriteFrame(Stream& stream, uint8_t stationAddress, ModbusFunctionCode functionCode, size_t dataSize, uint16_t transactionId);
 
+  /// @brief Gets the size of the frame with the specified data size for the protocol of the calling task transaction buffer (does not lock the object)
+  /// @param dataSize frame data size
+  /// @return frame size in bytes
+  size_t GetFrameSize(size_t dataSize);
+
   /// @brief Reads data from the stream (overriden in ModbusServer to read one byte at a time)
   /// @param stream stream to read from
   /// @param dest destination (can be NULL)
@@ -108,6 +174,17 @@ protected:
   /// @return error code
   virtual esp_err_t StreamReadUntil(Stream& stream, char termChar);
 
+  /// @brief Checks if the RTU frame is addressed to another station and can be skipped without reading and CRC check (overriden in ModbusServer)
+  /// @param stationAddress frame station address
+  /// @return true if the frame is to be skipped
+  virtual bool IsForeignRtuFrame(uint8_t stationAddress);
+
+  /// @brief Skips the rest of the RTU frame addressed to another station (overriden in ModbusServer)
+  /// @param stream stream to read from
+  /// @param stationAddress frame station address
+  /// @return error code
+  virtual esp_err_t SkipRtuFrame(Stream& stream, uint8_t stationAddress);
+
   /// @brief Reads the data for the specified function code (for Modbus RTU protocol)
   /// @param stream stream to read from
   /// @param functionCode frame function code
@@ -115,21 +192,63 @@ protected:
   /// @return error code
   virtual esp_err_t ReadRtuData(Stream& stream, ModbusFunctionCode functionCode, size_t& dataSize) = 0;
 
+  /// @brief Checks if the frame is transmitted by a server (captured frame source, overriden in ModbusServer and ModbusMonitor)
+  /// @param direction frame direction
+  /// @return true for a server frame
+  virtual bool IsServerFrame(ModbusCaptureDirection direction);
+
+  /// @brief Gets the capture connection ID of the stream (overriden in ModbusServer for the client connections)
+  /// @param stream stream
+  /// @return connection ID (assigned when the first frame of the connection is captured)
+  virtual uint32_t GetCaptureConnectionId(Stream& stream);
+
+  /// @brief Makes the next captured frame get a new connection ID (called when the client connection is opened)
+  void ResetCaptureConnectionId();
+
   /// @brief Gets the data part of the transaction buffer with offset and size based on the Modbus protocol
   /// @return data buffer
   Buffer& GetDataBuffer();
+
+  /// @brief Transaction buffer of a task that handles transactions in parallel with the task that reads the frames
+  struct TaskBuffer {
+    /// @brief transaction buffer
+    std::shared_ptr<Buffer> buffer;
+    /// @brief data part of the transaction buffer
+    std::shared_ptr<Buffer> dataBuffer;
+    /// @brief protocol of the data part
+    ModbusProtocol protocol;
+    /// @brief object that uses the buffer
+    ModbusBase* owner;
+  };
+
+  /// @brief Allocates the task transaction buffer (same size as the transaction buffer) and updates its data part for the current protocol
+  /// @param taskBuffer task transaction buffer
+  /// @return error code
+  esp_err_t InitializeTaskBuffer(TaskBuffer& taskBuffer);
+
+  /// @brief Makes the calling task use the task transaction buffer instead of the transaction buffer (GetDataBuffer and WriteFrame)
+  /// @param taskBuffer task transaction buffer (NULL to use the transaction buffer)
+  void SetTaskBuffer(TaskBuffer* taskBuffer);
   
 private:
+  const ModbusInterface interface;
   ModbusProtocol protocol;
   std::shared_ptr<Buffer> buffer;
   std::shared_ptr<Buffer> dataBuffer;
   TickType_t readTimeout;
   TickType_t writeTimeout;
   TickType_t delayAfterRead = 0;
+  static thread_local TaskBuffer* taskBuffer;
+  // Frame reads and writes of all tasks copy the capture pointer (not under the object lock) and record the frame with the copy.
+  std::atomic<std::shared_ptr<ModbusCapture>> capture;
+  std::atomic<bool> captureEnabled = false;
+  // Connection ID of the stream (0 - not assigned yet)
+  std::atomic<uint32_t> captureConnectionId = 0;
 
-  uint16_t Crc(size_t size);
-  uint8_t Lrc(size_t size);
+  Buffer& GetBuffer();
   void InitializeDataBuffer();
+  void CaptureFrame(ModbusCaptureDirection direction, Stream& stream, const void* data, size_t size, const void* data2 = NULL, size_t size2 = 0);
+  std::shared_ptr<Buffer> CreateDataBuffer(std::shared_ptr<Buffer> buffer);
 };
 
 //==============================================================================
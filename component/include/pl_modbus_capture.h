@@ -0,0 +1,130 @@
+#pragma once
+#include "pl_modbus_types.h"
+#include "pl_common.h"
+#include <atomic>
+#include <vector>
+
+//==============================================================================
+
+namespace PL {
+
+//==============================================================================
+
+/// @brief Modbus frame direction
+enum class ModbusCaptureDirection : uint8_t {
+  /// @brief frame received by the client or the server
+  received = 0,
+  /// @brief frame transmitted by the client or the server
+  transmitted = 1
+};
+
+/// @brief Modbus capture pcap format
+enum class ModbusCapturePcapFormat {
+  /// @brief DLT_USER0 link type: 8-byte header (direction, protocol, server frame flag, 0, connection ID big-endian) and the frame as on the wire
+  user,
+  /// @brief raw IPv4 link type: each frame is a Modbus TCP segment between pseudo addresses
+  /// (server 10.0.0.1:502, client 10.0.0.2 with a port for each connection ID), RTU and ASCII frames are converted to Modbus TCP
+  modbusTcp
+};
+
+//==============================================================================
+
+/// @brief Captured Modbus frame
+struct ModbusCaptureRecord {
+  /// @brief Frame number since the capture has been created or cleared
+  uint32_t number;
+  /// @brief Time at which the frame has been read or written (esp_timer_get_time, microseconds)
+  int64_t time;
+  /// @brief Direction
+  ModbusCaptureDirection direction;
+  /// @brief Protocol
+  ModbusProtocol protocol;
+  /// @brief True if the frame has been transmitted by the server (response), false if by the client (request)
+  bool serverFrame;
+  /// @brief Connection ID (each connection of each client and server recording to the capture has its own ID)
+  uint32_t connectionId;
+  /// @brief Frame size
+  uint16_t size;
+  /// @brief Frame (station address/MBAP header, function code, data, CRC/LRC).
+  /// ASCII frames are captured without the ASCII encoding (':', hexadecimal characters and CR LF are restored by the pcap export).
+  std::vector<uint8_t> data;
+};
+
+//==============================================================================
+
+/// @brief Wire-level Modbus frame capture (fixed-size lock-free ring buffer)
+/// @details Frames are recorded by ModbusClient and ModbusServer (ModbusBase::SetCapture) from any number of tasks without locks:
+/// each frame claims the next slot and overwrites the oldest frame when the ring buffer is full.
+/// Readers copy the slots and skip the ones that are being overwritten.
+class ModbusCapture {
+public:
+  /// @brief Default number of frames in the ring buffer
+  static constexpr size_t defaultNumberOfRecords = 256;
+  /// @brief Default maximum captured frame size (longer frames are truncated)
+  static constexpr size_t defaultMaxFrameSize = 260;
+
+  /// @brief Creates a capture and allocates the ring buffer
+  /// @param numberOfRecords number of frames in the ring buffer
+  /// @param maxFrameSize maximum captured frame size
+  ModbusCapture(size_t numberOfRecords = defaultNumberOfRecords, size_t maxFrameSize = defaultMaxFrameSize);
+
+  /// @brief Records the frame (the frame is a concatenation of two parts)
+  /// @param direction direction
+  /// @param protocol protocol
+  /// @param serverFrame true if the frame has been transmitted by the server
+  /// @param connectionId connection ID
+  /// @param data first part of the frame
+  /// @param size first part size
+  /// @param data2 second part of the frame
+  /// @param size2 second part size
+  void Record(ModbusCaptureDirection direction, ModbusProtocol protocol, bool serverFrame, uint32_t connectionId,
+    const void* data, size_t size, const void* data2 = NULL, size_t size2 = 0);
+
+  /// @brief Gets the captured frames from the oldest one
+  /// @param records frames
+  void Read(std::vector<ModbusCaptureRecord>& records);
+
+  /// @brief Removes the captured frames
+  void Clear();
+
+  /// @brief Gets the number of frames recorded since the capture has been created or cleared (including the overwritten ones)
+  /// @return number of frames
+  uint32_t GetNumberOfFrames();
+
+  /// @brief Gets the number of frames that have not been recorded because their slot was being written by another task
+  /// @return number of frames
+  uint32_t GetNumberOfDroppedFrames();
+
+  /// @brief Writes the captured frames in the pcap format
+  /// @param stream stream
+  /// @param format pcap format
+  /// @return error code
+  esp_err_t WritePcap(Stream& stream, ModbusCapturePcapFormat format);
+
+  /// @brief Creates a connection ID that is unique among all clients and servers (IDs start from 1)
+  /// @return connection ID
+  static uint32_t CreateConnectionId();
+
+private:
+  struct Slot {
+    // 2 * number + 1 - the frame is being written, 2 * number + 2 - the frame is consistent, 0 - empty
+    std::atomic<uint32_t> sequence = 0;
+    int64_t time;
+    ModbusCaptureDirection direction;
+    ModbusProtocol protocol;
+    bool serverFrame;
+    uint32_t connectionId;
+    uint16_t size;
+  };
+
+  const size_t maxFrameSize;
+  std::vector<Slot> slots;
+  std::vector<uint8_t> frames;
+  std::atomic<uint32_t> numberOfFrames = 0;
+  std::atomic<uint32_t> numberOfDroppedFrames = 0;
+  static std::atomic<uint32_t> lastConnectionId;
+};
+
+//==============================================================================
+
+}
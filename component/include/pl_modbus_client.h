@@ -1,5 +1,6 @@
 #pragma once
 #include "pl_modbus_base.h"
+#include "pl_modbus_statistics.h"
 
 //==============================================================================
 
@@ -15,6 +16,78 @@ public:
   /// @brief Default write operation timeout in FreeRTOS ticks
   static constexpr TickType_t defaultWriteTimeout = 300 / portTICK_PERIOD_MS;
 
+  /// @brief Station retry and timeout policy
+  struct StationPolicy {
+    /// @brief maximum number of retries of a transaction without a valid response (timeout, CRC error, invalid response)
+    uint8_t maxNumberOfRetries;
+    /// @brief delay before the first retry in FreeRTOS ticks (doubled for each next retry)
+    TickType_t retryDelay;
+    /// @brief adapt the response timeout from the smoothed round-trip time (SRTT + 4 * RTTVAR as in TCP) instead of using the read operation timeout
+    bool adaptiveTimeout;
+    /// @brief minimum adaptive response timeout in FreeRTOS ticks
+    TickType_t minTimeout;
+    /// @brief maximum adaptive response timeout in FreeRTOS ticks (0 - read operation timeout)
+    TickType_t maxTimeout;
+    /// @brief number of consecutive failed transactions after which the station is marked offline (0 - never)
+    uint16_t offlineThreshold;
+    /// @brief interval between the probe transactions to an offline station in FreeRTOS ticks (other requests fail immediately)
+    TickType_t offlineProbeInterval;
+  };
+
+  /// @brief Station timeout and availability state
+  struct StationState {
+    /// @brief smoothed round-trip time in microseconds (0 - no measurements yet)
+    uint32_t smoothedRoundTripTime;
+    /// @brief round-trip time variation in microseconds
+    uint32_t roundTripTimeVariation;
+    /// @brief current response timeout in FreeRTOS ticks
+    TickType_t timeout;
+    /// @brief number of consecutive failed transactions
+    uint16_t numberOfFailures;
+    /// @brief station is offline
+    bool offline;
+  };
+
+  /// @brief TCP connection policy
+  struct ConnectionPolicy {
+    /// @brief delay before the first reconnection attempt in FreeRTOS ticks (doubled for each next attempt)
+    TickType_t minReconnectDelay;
+    /// @brief maximum delay between the reconnection attempts in FreeRTOS ticks
+    TickType_t maxReconnectDelay;
+    /// @brief interval between the connection checks of an idle connection in FreeRTOS ticks (0 - no checks)
+    TickType_t idleCheckInterval;
+    /// @brief number of consecutive response timeouts after which the connection is considered half-open and closed (0 - never)
+    uint16_t maxNumberOfTimeouts;
+    /// @brief TCP keep-alive idle time in seconds (0 - keep-alive is not enabled)
+    int keepAliveIdleTime;
+    /// @brief TCP keep-alive probe interval in seconds
+    int keepAliveInterval;
+    /// @brief number of unanswered TCP keep-alive probes after which the connection is closed
+    int keepAliveCount;
+  };
+
+  /// @brief Memory address range
+  struct AddressRange {
+    /// @brief first item address
+    uint16_t address;
+    /// @brief number of items
+    uint16_t numberOfItems;
+  };
+
+  /// @brief Change subscription (report by exception, see ModbusServer::EnableChangeSubscriptions)
+  struct ChangeSubscription {
+    /// @brief subscription ID assigned by the server
+    uint8_t id;
+    /// @brief memory type
+    ModbusMemoryType memoryType;
+    /// @brief first item address
+    uint16_t address;
+    /// @brief number of items
+    uint16_t numberOfItems;
+    /// @brief sequence number of the last received changes (acknowledged by the next ReadChanges request)
+    uint8_t sequence;
+  };
+
   /// @brief Creates a stream Modbus client
   /// @param stream stream
   /// @param protocol Modbus protocol
@@ -39,6 +112,28 @@ public:
   /// @param bufferSize transaction buffer size
   ModbusClient(std::shared_ptr<TcpClient> tcpClient, size_t bufferSize = defaultBufferSize);
 
+  /// @brief Creates a network Modbus client with IPv4 remote address and specified protocol (e.g. RTU over TCP)
+  /// @param address remote IPv4 address
+  /// @param port remote port
+  /// @param protocol Modbus protocol
+  /// @param bufferSize transaction buffer size
+  ModbusClient(IpV4Address address, uint16_t port, ModbusProtocol protocol, size_t bufferSize = defaultBufferSize);
+
+  /// @brief Creates a network Modbus client with IPv6 remote address and specified protocol (e.g. RTU over TCP)
+  /// @param address remote IPv6 address
+  /// @param port remote port
+  /// @param protocol Modbus protocol
+  /// @param bufferSize transaction buffer size
+  ModbusClient(IpV6Address address, uint16_t port, ModbusProtocol protocol, size_t bufferSize = defaultBufferSize);
+
+  /// @brief Creates a network Modbus client using shared TCP client and specified protocol (e.g. RTU over TCP)
+  /// @param tcpClient TCP client
+  /// @param protocol Modbus protocol
+  /// @param bufferSize transaction buffer size
+  ModbusClient(std::shared_ptr<TcpClient> tcpClient, ModbusProtocol protocol, size_t bufferSize = defaultBufferSize);
+
+  ~ModbusClient();
+
   esp_err_t Lock(TickType_t timeout = portMAX_DELAY) override;
   esp_err_t Unlock() override;
 
@@ -85,6 +180,60 @@ public:
   /// @return error code
   esp_err_t ReadInputRegisters(uint16_t address, uint16_t numberOfItems, void* responseData, ModbusException* exception);
 
+  /// @brief Reads 32-bit float values from pairs of holding registers
+  /// @param address first holding register address
+  /// @param numberOfValues number of values (two holding registers per value)
+  /// @param values values
+  /// @param wordOrder word order of the values
+  /// @param exception Modbus exception
+  /// @return error code
+  esp_err_t ReadHoldingRegisters(uint16_t address, uint16_t numberOfValues, float* values, ModbusWordOrder wordOrder, ModbusException* exception);
+
+  /// @brief Reads 32-bit signed integer values from pairs of holding registers
+  /// @param address first holding register address
+  /// @param numberOfValues number of values (two holding registers per value)
+  /// @param values values
+  /// @param wordOrder word order of the values
+  /// @param exception Modbus exception
+  /// @return error code
+  esp_err_t ReadHoldingRegisters(uint16_t address, uint16_t numberOfValues, int32_t* values, ModbusWordOrder wordOrder, ModbusException* exception);
+
+  /// @brief Reads 32-bit unsigned integer values from pairs of holding registers
+  /// @param address first holding register address
+  /// @param numberOfValues number of values (two holding registers per value)
+  /// @param values values
+  /// @param wordOrder word order of the values
+  /// @param exception Modbus exception
+  /// @return error code
+  esp_err_t ReadHoldingRegisters(uint16_t address, uint16_t numberOfValues, uint32_t* values, ModbusWordOrder wordOrder, ModbusException* exception);
+
+  /// @brief Reads 32-bit float values from pairs of input registers
+  /// @param address first input register address
+  /// @param numberOfValues number of values (two input registers per value)
+  /// @param values values
+  /// @param wordOrder word order of the values
+  /// @param exception Modbus exception
+  /// @return error code
+  esp_err_t ReadInputRegisters(uint16_t address, uint16_t numberOfValues, float* values, ModbusWordOrder wordOrder, ModbusException* exception);
+
+  /// @brief Reads 32-bit signed integer values from pairs of input registers
+  /// @param address first input register address
+  /// @param numberOfValues number of values (two input registers per value)
+  /// @param values values
+  /// @param wordOrder word order of the values
+  /// @param exception Modbus exception
+  /// @return error code
+  esp_err_t ReadInputRegisters(uint16_t address, uint16_t numberOfValues, int32_t* values, ModbusWordOrder wordOrder, ModbusException* exception);
+
+  /// @brief Reads 32-bit unsigned integer values from pairs of input registers
+  /// @param address first input register address
+  /// @param numberOfValues number of values (two input registers per value)
+  /// @param values values
+  /// @param wordOrder word order of the values
+  /// @param exception Modbus exception
+  /// @return error code
+  esp_err_t ReadInputRegisters(uint16_t address, uint16_t numberOfValues, uint32_t* values, ModbusWordOrder wordOrder, ModbusException* exception);
+
   /// @brief Writes single coil
   /// @param address coil address
   /// @param value coil value
@@ -115,6 +264,31 @@ public:
   /// @return error code  
   esp_err_t WriteMultipleHoldingRegisters(uint16_t address, uint16_t numberOfItems, const void* requestData, ModbusException* exception);
 
+  /// @brief Subscribes to the changes of the memory items (user-defined function code supported by ModbusServer with change subscriptions)
+  /// @param memoryType memory type
+  /// @param address first item address
+  /// @param numberOfItems number of items (up to ModbusServer::maxNumberOfSubscribedItems)
+  /// @param deadband minimum register value change that is reported (0 - any change, ignored for coils and discrete inputs)
+  /// @param subscription subscription
+  /// @param exception Modbus exception
+  /// @return error code
+  esp_err_t Subscribe(ModbusMemoryType memoryType, uint16_t address, uint16_t numberOfItems, uint16_t deadband, ChangeSubscription& subscription, ModbusException* exception);
+
+  /// @brief Reads the items that have changed since the last call (all items on the first call) and acknowledges the previous changes
+  /// @param subscription subscription
+  /// @param data values of the subscribed items (coils/discrete inputs: 8 values per byte, registers: 16-bit values) updated with the changed items
+  /// @param changedRanges address ranges of the changed items
+  /// @param moreChanges the changes did not fit into one response (the rest is returned by the next call)
+  /// @param exception Modbus exception (illegal data value if the subscription has been removed or replaced on the server)
+  /// @return error code
+  esp_err_t ReadChanges(ChangeSubscription& subscription, void* data, std::vector<AddressRange>& changedRanges, bool& moreChanges, ModbusException* exception);
+
+  /// @brief Removes the subscription
+  /// @param subscription subscription
+  /// @param exception Modbus exception
+  /// @return error code
+  esp_err_t Unsubscribe(const ChangeSubscription& subscription, ModbusException* exception);
+
   /// @brief Gets the Modbus station address
   /// @return station address
   uint8_t GetStationAddress();
@@ -124,28 +298,135 @@ public:
   /// @return error code
   esp_err_t SetStationAddress(uint8_t address);
 
+  /// @brief Sets the station retry and timeout policy (stations without a policy use the read operation timeout without retries)
+  /// @param stationAddress station address (1..255)
+  /// @param policy policy
+  /// @return error code
+  esp_err_t SetStationPolicy(uint8_t stationAddress, const StationPolicy& policy);
+
+  /// @brief Removes the station retry and timeout policy
+  /// @param stationAddress station address
+  /// @return error code
+  esp_err_t RemoveStationPolicy(uint8_t stationAddress);
+
+  /// @brief Gets the station timeout and availability state
+  /// @param stationAddress station address
+  /// @param state state
+  /// @return error code (ESP_ERR_NOT_FOUND if the station has no policy)
+  esp_err_t GetStationState(uint8_t stationAddress, StationState& state);
+
+  /// @brief Checks if the station is marked offline (the requests to it fail with ESP_ERR_INVALID_STATE until the next probe succeeds)
+  /// @param stationAddress station address
+  /// @return true if the station is offline
+  bool IsStationOffline(uint8_t stationAddress);
+
+  /// @brief Resets the station round-trip time estimate and marks it online
+  /// @param stationAddress station address
+  /// @return error code (ESP_ERR_NOT_FOUND if the station has no policy)
+  esp_err_t ResetStationState(uint8_t stationAddress);
+
+  /// @brief Starts the connection task that keeps the TCP connection open (requests fail immediately with ESP_ERR_INVALID_STATE while disconnected)
+  /// @param taskParameters connection task parameters
+  /// @param policy connection policy
+  /// @return error code
+  esp_err_t EnableConnectionManagement(const TaskParameters& taskParameters, const ConnectionPolicy& policy);
+
+  /// @brief Stops the connection task (the requests connect the TCP client as before)
+  /// @return error code
+  esp_err_t DisableConnectionManagement();
+
+  /// @brief Checks if the TCP connection is open (always true for a stream client)
+  /// @return true if the connection is open
+  bool IsConnected();
+
+  /// @brief Gets the client statistics (requests to all stations)
+  /// @param statistics statistics
+  /// @return error code (ESP_ERR_NOT_SUPPORTED if the statistics are disabled in the configuration)
+  esp_err_t GetStatistics(ModbusClientStatistics& statistics);
+
+  /// @brief Gets the statistics of the requests to the station
+  /// @param stationAddress station address
+  /// @param statistics statistics
+  /// @return error code (ESP_ERR_NOT_FOUND if there have been no requests to the station)
+  esp_err_t GetStatistics(uint8_t stationAddress, ModbusClientStatistics& statistics);
+
+  /// @brief Resets the client statistics (all stations)
+  void ResetStatistics();
+
 protected:
   esp_err_t ReadRtuData(Stream& stream, ModbusFunctionCode functionCode, size_t& dataSize) override;
 
 private:
   Mutex mutex;
-  ModbusInterface interface;
   std::shared_ptr<Stream> stream;
   std::shared_ptr<TcpClient> tcpClient;
   uint8_t stationAddress;
   std::shared_ptr<Buffer> buffer;
   uint16_t transactionId = 0;
+
+  struct Station {
+    uint8_t stationAddress;
+    StationPolicy policy;
+    StationState state;
+    TickType_t lastAttemptTime;
+  };
+  std::vector<Station> stations;
+  // Request data saved for the retries (the transaction buffer is overwritten by the response)
+  std::vector<uint8_t> retryRequestData;
+
+  ConnectionPolicy connectionPolicy = {};
+  TaskHandle_t connectionTask = NULL;
+  std::atomic<bool> stopConnectionTask = false;
+  std::atomic<bool> connectionTaskStopped = false;
+  // Set by the requests and by the connection task, cleared by the connection task after the reconnection.
+  std::atomic<bool> connectionLost = false;
+  uint16_t numberOfConnectionTimeouts = 0;
+
+  // Counters are updated by the transactions (under the client lock) and read without the lock.
+  struct StatisticsRecorder {
+    std::atomic<uint32_t> numberOfRequests;
+    std::atomic<uint32_t> numberOfResponses;
+    std::atomic<uint32_t> numberOfExceptions[modbusExceptionCounterSize];
+    std::atomic<uint32_t> numberOfTimeouts;
+    std::atomic<uint32_t> numberOfCrcErrors;
+    std::atomic<uint32_t> numberOfInvalidResponses;
+    std::atomic<uint32_t> numberOfDiscardedResponses;
+    std::atomic<uint32_t> numberOfConnections;
+    std::atomic<uint32_t> numberOfBytesSent;
+    std::atomic<uint32_t> numberOfBytesReceived;
+    ModbusLatencyHistogramRecorder roundTripTime;
+
+    void Get(ModbusClientStatistics& statistics) const;
+    void Reset();
+  };
+  // Station statistics list (nodes are added by the transactions and never removed, so the list can be read without the lock)
+  struct StationStatisticsRecorder {
+    uint8_t stationAddress;
+    StatisticsRecorder statistics;
+    std::atomic<StationStatisticsRecorder*> next;
+  };
+#if CONFIG_PL_MODBUS_STATISTICS
+  StatisticsRecorder statistics;
+  std::atomic<StationStatisticsRecorder*> stationStatistics = NULL;
+  StationStatisticsRecorder* lastStationStatistics = NULL;
+#endif
   
   esp_err_t Command(ModbusFunctionCode functionCode, size_t requestDataSize, size_t& responseDataSize, ModbusException* exception);
+  esp_err_t Transaction(ModbusFunctionCode functionCode, size_t requestDataSize, size_t& responseDataSize, ModbusException* exception, TickType_t timeout);
+  void CloseConnection();
+  Station* FindStation(uint8_t stationAddress);
+  void UpdateStationTimeout(Station& station, int64_t roundTripTime);
+  void RecordStatistics(std::atomic<uint32_t> StatisticsRecorder::* counter, uint32_t value = 1);
+  void RecordException(uint8_t exception);
+  void RecordRoundTripTime(uint32_t time);
+  StationStatisticsRecorder* FindStationStatistics(uint8_t stationAddress);
   esp_err_t ReadBits(ModbusFunctionCode functionCode, uint16_t address, uint16_t numberOfItems, void* responseData, ModbusException* exception);
   esp_err_t ReadRegisters(ModbusFunctionCode functionCode, uint16_t address, uint16_t numberOfItems, void* responseData, ModbusException* exception);
-
-  struct AddressRange {
-    uint16_t address;
-    uint16_t numberOfItems;
-  };
+  esp_err_t Read32BitRegisterValues(ModbusFunctionCode functionCode, uint16_t address, uint16_t numberOfValues, void* values, ModbusWordOrder wordOrder, ModbusException* exception);
 
   std::vector<AddressRange> SplitAddressRange(uint16_t address, uint16_t numberOfItems, uint16_t maxNumberOfItems);
+
+  static void ConnectionTask(void* parameters);
 };
 
 //==============================================================================
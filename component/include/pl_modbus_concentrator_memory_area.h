@@ -0,0 +1,97 @@
+#pragma once
+#include "pl_modbus_refreshed_memory_area.h"
+#include "pl_modbus_client.h"
+
+//==============================================================================
+
+namespace PL {
+
+//==============================================================================
+
+/// @brief Action for the requests to the concentrator memory area with stale data
+enum class ModbusStaleDataAction : uint8_t {
+  /// @brief requests are answered with the gateway target device failed to respond exception
+  exception = 0,
+  /// @brief requests are answered with the last data and the quality flag is cleared
+  qualityFlag = 1
+};
+
+//==============================================================================
+
+/// @brief Modbus memory area that mirrors the memory of a downstream station (data concentrator)
+/// @details The refresh task reads the downstream station memory with the client (e.g. an RTU client on a slow serial line)
+/// and the server (e.g. a TCP server with many clients) answers the read requests from the latest data without downstream transactions.
+/// Several memory areas can share the client: the client station address is set for each downstream transaction.
+/// Data older than the stale data limit is answered with an exception or with a cleared quality flag.
+/// Modbus write requests are written through to the downstream station before the response is sent
+/// (a downstream timeout results in the gateway target device failed to respond exception, a downstream exception is forwarded to the client)
+/// and a refresh is requested. The write-through is never deferred by the server (ModbusServer::EnableDeferredOnWrite).
+/// Items that the downstream station has not accepted are restored to their previous values.
+/// The memory area stays locked during the write-through, so read requests to it wait for the downstream transaction.
+class ModbusConcentratorMemoryArea : public ModbusRefreshedMemoryArea {
+public:
+  /// @brief Creates a concentrator memory area with the same address as the downstream station memory
+  /// @param type memory area type
+  /// @param address memory area address
+  /// @param size memory area data size (in bytes)
+  /// @param client downstream client
+  /// @param stationAddress downstream station address
+  ModbusConcentratorMemoryArea(ModbusMemoryType type, uint16_t address, size_t size, std::shared_ptr<ModbusClient> client, uint8_t stationAddress);
+
+  /// @brief Creates a concentrator memory area
+  /// @param type memory area type
+  /// @param address memory area address
+  /// @param size memory area data size (in bytes)
+  /// @param client downstream client
+  /// @param stationAddress downstream station address
+  /// @param downstreamAddress downstream station memory address
+  ModbusConcentratorMemoryArea(ModbusMemoryType type, uint16_t address, size_t size, std::shared_ptr<ModbusClient> client, uint8_t stationAddress, uint16_t downstreamAddress);
+  ~ModbusConcentratorMemoryArea();
+
+  esp_err_t Lock(TickType_t timeout = portMAX_DELAY) override;
+
+  esp_err_t OnRead(uint16_t address, uint16_t numberOfItems) override;
+  esp_err_t OnWrite(uint16_t address, uint16_t numberOfItems) override;
+  bool IsOnWriteDeferrable() override;
+
+  /// @brief Sets the stale data limit
+  /// @param maxAge maximum time since the last successful refresh in FreeRTOS ticks (0 - no limit)
+  /// @param action action for the requests with stale data
+  /// @return error code
+  esp_err_t SetStaleDataLimit(TickType_t maxAge, ModbusStaleDataAction action);
+
+  /// @brief Sets the quality flag item (1 - valid data, 0 - stale data) that is updated on each refresh and each request
+  /// @note The quality flag has to be set before the refresh is enabled and the memory area is added to a server.
+  /// @param qualityMemoryArea memory area of the quality flag (coils, discrete inputs or registers)
+  /// @param qualityAddress quality flag address (Modbus address, not an offset in the memory area)
+  /// @return error code
+  esp_err_t SetQualityFlag(std::shared_ptr<ModbusMemoryArea> qualityMemoryArea, uint16_t qualityAddress);
+
+  /// @brief Checks if the data is stale (not refreshed yet or older than the stale data limit)
+  /// @return true if the data is stale
+  bool IsStale();
+
+  /// @brief Gets the number of write-through transactions that returned an error
+  /// @return number of errors
+  uint32_t GetNumberOfWriteErrors();
+
+protected:
+  esp_err_t OnRefresh(void* snapshot) override;
+
+private:
+  std::shared_ptr<ModbusClient> client;
+  const uint8_t stationAddress;
+  const uint16_t downstreamAddress;
+  std::atomic<TickType_t> maxAge = 0;
+  std::atomic<ModbusStaleDataAction> staleDataAction = ModbusStaleDataAction::exception;
+  std::shared_ptr<ModbusMemoryArea> qualityMemoryArea;
+  uint16_t qualityAddress = 0;
+  std::atomic<uint32_t> numberOfWriteErrors = 0;
+  Buffer backup;
+
+  void UpdateQualityFlag(bool valid);
+};
+
+//==============================================================================
+
+}
\ No newline at end of file
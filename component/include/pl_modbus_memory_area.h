@@ -11,6 +11,8 @@ namespace PL {
 /// @brief Modbus memory area
 class ModbusMemoryArea : public Buffer {
 public:
+  /// @brief Base of the callback error codes that answer the request with a specific Modbus exception (error code = base + exception code)
+  static constexpr esp_err_t exceptionErrorBase = 0x4D4200;
   /// @brief Memory area type
   const ModbusMemoryType type;
   /// @brief Memory area address
@@ -44,6 +46,39 @@ public:
   /// @brief Callback method that is called when memory area has just been written
   virtual esp_err_t OnWrite();
 
+  /// @brief Callback method that is called when memory area items are about to be read (calls OnRead() by default)
+  /// @param address first item address (Modbus address, not an offset in the memory area)
+  /// @param numberOfItems number of items
+  /// @return error code (the request is answered with the gateway target device failed to respond exception for ESP_ERR_TIMEOUT,
+  /// with the exception of ExceptionError and with the server device failure exception for other errors)
+  virtual esp_err_t OnRead(uint16_t address, uint16_t numberOfItems);
+  /// @brief Callback method that is called when memory area items have just been written (calls OnWrite() by default)
+  /// @param address first item address (Modbus address, not an offset in the memory area)
+  /// @param numberOfItems number of items
+  /// @return error code (the request is answered with the gateway target device failed to respond exception for ESP_ERR_TIMEOUT,
+  /// with the exception of ExceptionError and with the server device failure exception for other errors)
+  virtual esp_err_t OnWrite(uint16_t address, uint16_t numberOfItems);
+
+  /// @brief Checks if the server can call OnWrite after the response has been sent (ModbusServer::EnableDeferredOnWrite)
+  /// @return true by default, false if the OnWrite result has to be reported to the client
+  virtual bool IsOnWriteDeferrable();
+
+  /// @brief Begins reading the memory area data (locks the memory area by default)
+  /// @param sequence read sequence number to be passed to EndRead
+  /// @return error code
+  virtual esp_err_t BeginRead(uint32_t& sequence);
+  /// @brief Ends reading the memory area data (unlocks the memory area by default)
+  /// @param sequence read sequence number returned by BeginRead
+  /// @return true if the read data is consistent, false if the data has been modified during the read and has to be read again
+  virtual bool EndRead(uint32_t sequence);
+
+  /// @brief Gets the callback error code that answers the request with the Modbus exception (e.g. the exception of a downstream station)
+  /// @param exception Modbus exception
+  /// @return error code
+  static constexpr esp_err_t ExceptionError(ModbusException exception) {
+    return exceptionErrorBase + (uint8_t)exception;
+  }
+
 private:
   size_t GetNumberOfItems();
 };
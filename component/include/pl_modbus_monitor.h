@@ -0,0 +1,204 @@
+#pragma once
+#include "pl_modbus_base.h"
+#include "pl_modbus_statistics.h"
+#include <vector>
+
+//==============================================================================
+
+namespace PL {
+
+//==============================================================================
+
+/// @brief Monitored transaction status
+enum class ModbusMonitorTransactionStatus : uint8_t {
+  /// @brief response received
+  response = 0,
+  /// @brief exception response received
+  exception = 1,
+  /// @brief no response (the next request has been sent or the response timeout has expired)
+  timeout = 2,
+  /// @brief broadcast request (no response is expected)
+  broadcast = 3
+};
+
+//==============================================================================
+
+/// @brief Monitored transaction (request and response pair)
+struct ModbusMonitorTransaction {
+  /// @brief Time at which the request frame has been read (esp_timer_get_time, microseconds)
+  int64_t time;
+  /// @brief Station address
+  uint8_t stationAddress;
+  /// @brief Function code
+  ModbusFunctionCode functionCode;
+  /// @brief Status
+  ModbusMonitorTransactionStatus status;
+  /// @brief Exception (for the exception status)
+  ModbusException exception;
+  /// @brief Memory address of the request (0 for the function codes without an address)
+  uint16_t address;
+  /// @brief Number of memory items of the request (0 for the function codes without an address)
+  uint16_t numberOfItems;
+  /// @brief Time between the request frame read and the response frame read in microseconds (0 without response)
+  uint32_t responseTime;
+};
+
+//==============================================================================
+
+/// @brief Modbus monitor statistics of one station
+struct ModbusMonitorStationStatistics {
+  /// @brief Number of requests
+  uint32_t numberOfRequests;
+  /// @brief Number of responses (including the exception responses)
+  uint32_t numberOfResponses;
+  /// @brief Number of exception responses (indexed by the exception code)
+  uint32_t numberOfExceptions[modbusExceptionCounterSize];
+  /// @brief Number of requests without response
+  uint32_t numberOfTimeouts;
+  /// @brief Time between the request frame read and the response frame read (including the exception responses)
+  ModbusLatencyHistogram responseTime;
+  /// @brief Response time of the last response in microseconds
+  uint32_t lastResponseTime;
+};
+
+//==============================================================================
+
+/// @brief Modbus monitor statistics of the line
+struct ModbusMonitorStatistics {
+  /// @brief Number of valid frames
+  uint32_t numberOfFrames;
+  /// @brief Number of requests
+  uint32_t numberOfRequests;
+  /// @brief Number of responses (including the exception responses)
+  uint32_t numberOfResponses;
+  /// @brief Number of broadcast requests
+  uint32_t numberOfBroadcasts;
+  /// @brief Number of requests without response
+  uint32_t numberOfTimeouts;
+  /// @brief Number of frames with CRC error
+  uint32_t numberOfCrcErrors;
+  /// @brief Number of invalid frames (unsupported function codes, read timeouts, buffer overflows)
+  uint32_t numberOfFrameErrors;
+  /// @brief Number of bytes in the valid frames
+  uint32_t numberOfBytes;
+};
+
+//==============================================================================
+
+/// @brief Passive Modbus RTU line monitor class
+/// @details The monitor reads every frame on a shared serial line (e.g. RS-485) with the RTU framing of ModbusBase,
+/// matches the requests of the client with the responses of the addressed stations and records the line statistics,
+/// the statistics of each station (response time histogram, exceptions, timeouts) and a log of the last transactions.
+/// A frame from the station that has been addressed by the last request with the same function code is a response, other frames are requests.
+/// The monitor never writes to the stream. Frames can also be recorded with ModbusBase::SetCapture.
+class ModbusMonitor : public ModbusBase, public Server {
+public:
+  /// @brief Default monitor name
+  static const std::string defaultName;
+  /// @brief Default read operation timeout in FreeRTOS ticks (end of frame on the line)
+  static constexpr TickType_t defaultReadTimeout = 3;
+  /// @brief Default response timeout in FreeRTOS ticks
+  static constexpr TickType_t defaultResponseTimeout = 1000 / portTICK_PERIOD_MS;
+  /// @brief Default number of transactions in the log
+  static constexpr size_t defaultLogSize = 64;
+
+  /// @brief Creates a monitor and allocates the transaction buffer
+  /// @param stream stream (only read)
+  /// @param bufferSize transaction buffer size
+  /// @param logSize number of transactions in the log
+  ModbusMonitor(std::shared_ptr<Stream> stream, size_t bufferSize = defaultBufferSize, size_t logSize = defaultLogSize);
+  ~ModbusMonitor();
+
+  esp_err_t Lock(TickType_t timeout = portMAX_DELAY) override;
+  esp_err_t Unlock() override;
+
+  esp_err_t Enable() override;
+  esp_err_t Disable() override;
+  bool IsEnabled() override;
+
+  esp_err_t SetProtocol(ModbusProtocol protocol) override;
+
+  /// @brief Sets the monitor task parameters
+  /// @param taskParameters task parameters
+  /// @return error code
+  esp_err_t SetTaskParameters(const TaskParameters& taskParameters);
+
+  /// @brief Gets the response timeout
+  /// @return timeout in FreeRTOS ticks
+  TickType_t GetResponseTimeout();
+
+  /// @brief Sets the response timeout (a later frame from the addressed station is a request)
+  /// @param timeout timeout in FreeRTOS ticks
+  /// @return error code
+  esp_err_t SetResponseTimeout(TickType_t timeout);
+
+  /// @brief Gets the line statistics
+  /// @param statistics statistics
+  void GetStatistics(ModbusMonitorStatistics& statistics);
+
+  /// @brief Gets the addresses of the stations that have been addressed by the requests
+  /// @param stationAddresses station addresses in ascending order
+  void GetStationAddresses(std::vector<uint8_t>& stationAddresses);
+
+  /// @brief Gets the station statistics
+  /// @param stationAddress station address
+  /// @param statistics statistics
+  /// @return error code (ESP_ERR_NOT_FOUND if the station has not been addressed)
+  esp_err_t GetStationStatistics(uint8_t stationAddress, ModbusMonitorStationStatistics& statistics);
+
+  /// @brief Resets the line and station statistics and clears the log
+  void ResetStatistics();
+
+  /// @brief Gets the logged transactions from the oldest one
+  /// @param transactions transactions
+  void GetLog(std::vector<ModbusMonitorTransaction>& transactions);
+
+protected:
+  esp_err_t StreamRead(Stream& stream, void* dest, size_t size) override;
+  esp_err_t StreamRead(Stream& stream, Buffer& dest, size_t offset, size_t size) override;
+  esp_err_t ReadRtuData(Stream& stream, ModbusFunctionCode functionCode, size_t& dataSize) override;
+  bool IsForeignRtuFrame(uint8_t stationAddress) override;
+  bool IsServerFrame(ModbusCaptureDirection direction) override;
+
+private:
+  class StreamServer : public PL::StreamServer {
+  public:
+    StreamServer(std::shared_ptr<Stream> stream, ModbusMonitor& modbusMonitor);
+    esp_err_t HandleRequest(Stream& stream) override;
+  private:
+    ModbusMonitor& modbusMonitor;
+  };
+
+  // Request waiting for the response
+  struct PendingRequest {
+    bool active;
+    ModbusMonitorTransaction transaction;
+  };
+
+  std::shared_ptr<StreamServer> streamServer;
+  TickType_t responseTimeout = defaultResponseTimeout;
+  // Frame being read (set by the monitor task during ReadFrame)
+  uint8_t frameStationAddress = 0;
+  bool frameIsResponse = false;
+  PendingRequest pendingRequest = {};
+
+  // Statistics and log are updated by the monitor task and read by the application with the statistics mutex.
+  Mutex statisticsMutex;
+  ModbusMonitorStatistics statistics = {};
+  // Station N statistics are stationStatistics[stationStatisticsIndexes[N] - 1] (0 - station has not been addressed).
+  std::vector<ModbusMonitorStationStatistics> stationStatistics;
+  uint8_t stationStatisticsIndexes[256] = {};
+  std::vector<ModbusMonitorTransaction> log;
+  size_t logSize = 0;
+  size_t logIndex = 0;
+
+  esp_err_t HandleRequest(Stream& stream);
+  void HandleFrame(uint8_t stationAddress, ModbusFunctionCode functionCode, size_t dataSize, int64_t time);
+  void CompleteTransaction(ModbusMonitorTransaction& transaction);
+  ModbusMonitorStationStatistics& GetStationStatisticsRecord(uint8_t stationAddress);
+  esp_err_t SkipToIdleLine(Stream& stream);
+};
+
+//==============================================================================
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "pl_modbus_seqlock_memory_area.h"
+#include <atomic>
+
+//==============================================================================
+
+namespace PL {
+
+//==============================================================================
+
+/// @brief Modbus memory area with the data refreshed by a background task
+/// @details The refresh task calls OnRefresh to fill a snapshot buffer without locking the memory area
+/// and publishes the snapshot with a short copy under the lock. Modbus read requests only copy the latest snapshot
+/// (lock-free as in ModbusSeqLockMemoryArea) and never wait for a refresh in progress.
+/// Data written by Modbus write requests or by the application is overwritten by the next refresh.
+class ModbusRefreshedMemoryArea : public ModbusSeqLockMemoryArea {
+public:
+  /// @brief Creates a refreshed Modbus memory area and allocates memory for the data and the snapshot
+  /// @param type memory area type
+  /// @param address memory area address
+  /// @param size memory area data size (in bytes)
+  ModbusRefreshedMemoryArea(ModbusMemoryType type, uint16_t address, size_t size);
+  ~ModbusRefreshedMemoryArea();
+
+  /// @brief Starts the refresh task
+  /// @param taskParameters refresh task parameters
+  /// @param period refresh period (0 - refresh only on RequestRefresh)
+  /// @return error code
+  esp_err_t EnableRefresh(const TaskParameters& taskParameters, TickType_t period);
+
+  /// @brief Stops the refresh task (waits for the refresh in progress)
+  /// @note Derived classes must call it in their destructor, before the OnRefresh implementation is destroyed.
+  /// @return error code
+  esp_err_t DisableRefresh();
+
+  /// @brief Requests a refresh without waiting for it (requests made during a refresh in progress result in one more refresh)
+  /// @note The method does not lock: it can be called with the memory area locked (e.g. from OnWrite).
+  /// @return error code
+  esp_err_t RequestRefresh();
+
+  /// @brief Gets the time since the last successful refresh
+  /// @return time in microseconds (-1 if the data has not been refreshed yet)
+  int64_t GetRefreshAge();
+
+  /// @brief Gets the number of refreshes that returned an error
+  /// @return number of errors
+  uint32_t GetNumberOfRefreshErrors();
+
+protected:
+  /// @brief Callback method that is called by the refresh task to fill the snapshot
+  /// @note The memory area is not locked: the method must not access the memory area data.
+  /// @param snapshot snapshot data (same size as the memory area data, contains the previous snapshot)
+  /// @return error code (the snapshot is not published if there is an error)
+  virtual esp_err_t OnRefresh(void* snapshot) = 0;
+
+private:
+  Buffer snapshot;
+  // Locked by EnableRefresh and DisableRefresh only (RequestRefresh and the refresh task do not lock it)
+  Mutex refreshMutex;
+  std::atomic<TaskHandle_t> refreshTask = NULL;
+  // Number of RequestRefresh calls that are notifying the refresh task (the task is not stopped until they return)
+  std::atomic<int> numberOfRefreshRequests = 0;
+  TickType_t refreshPeriod = 0;
+  std::atomic<bool> stopRefresh = false;
+  std::atomic<bool> refreshStopped = false;
+  std::atomic<int64_t> refreshTime = -1;
+  std::atomic<uint32_t> numberOfRefreshErrors = 0;
+
+  static void RefreshTask(void* parameters);
+};
+
+//==============================================================================
+
+}
\ No newline at end of file
@@ -0,0 +1,209 @@
+#pragma once
+#include "pl_modbus_client.h"
+#include "pl_modbus_memory_area.h"
+#include <type_traits>
+#include <string.h>
+
+//==============================================================================
+
+namespace PL {
+
+//==============================================================================
+
+/// @brief Struct template for a Modbus register map field
+/// @tparam Address field register address
+/// @tparam Type field value type (2, 4 or 8 bytes: int16_t, uint32_t, float, double etc)
+/// @tparam WordOrder field word order
+template <uint16_t Address, class Type, ModbusWordOrder WordOrder = ModbusWordOrder::abcd>
+struct ModbusRegister {
+  static_assert(std::is_trivially_copyable_v<Type>, "register value type must be trivially copyable");
+  static_assert(sizeof(Type) == 2 || sizeof(Type) == 4 || sizeof(Type) == 8, "register value type size must be 2, 4 or 8 bytes");
+
+  /// @brief field value type
+  using ValueType = Type;
+  /// @brief field register address
+  static constexpr uint16_t address = Address;
+  /// @brief field number of registers
+  static constexpr uint16_t numberOfRegisters = sizeof(Type) / 2;
+  /// @brief field word order
+  static constexpr ModbusWordOrder wordOrder = WordOrder;
+
+  static_assert(Address <= 0xFFFF - numberOfRegisters + 1, "register is out of the Modbus address range");
+
+  /// @brief Encodes the value to the registers
+  /// @note Register values are in the host byte order (as in ModbusMemoryArea data and ModbusClient register read/write data).
+  /// @param value value
+  /// @param registers registers
+  static void Encode(Type value, uint16_t* registers) {
+    Bits bits;
+    memcpy(&bits, &value, sizeof(Type));
+    for (uint_fast8_t i = 0; i < numberOfRegisters; i++) {
+      uint16_t registerValue = bits >> (16 * GetWordIndex(i));
+      if constexpr (isByteSwapped)
+        registerValue = __builtin_bswap16(registerValue);
+      registers[i] = registerValue;
+    }
+  }
+
+  /// @brief Decodes the value from the registers
+  /// @note Register values are in the host byte order (as in ModbusMemoryArea data and ModbusClient register read/write data).
+  /// @param registers registers
+  /// @return value
+  static Type Decode(const uint16_t* registers) {
+    Bits bits = 0;
+    for (uint_fast8_t i = 0; i < numberOfRegisters; i++) {
+      uint16_t registerValue = registers[i];
+      if constexpr (isByteSwapped)
+        registerValue = __builtin_bswap16(registerValue);
+      bits |= (Bits)registerValue << (16 * GetWordIndex(i));
+    }
+    Type value;
+    memcpy(&value, &bits, sizeof(Type));
+    return value;
+  }
+
+private:
+  using Bits = std::conditional_t<sizeof(Type) == 2, uint16_t, std::conditional_t<sizeof(Type) == 4, uint32_t, uint64_t>>;
+  static constexpr bool isByteSwapped = (WordOrder == ModbusWordOrder::badc || WordOrder == ModbusWordOrder::dcba);
+  static constexpr bool isMostSignificantWordFirst = (WordOrder == ModbusWordOrder::abcd || WordOrder == ModbusWordOrder::badc);
+
+  // Index of the 16-bit word of the value (from the least significant one) that is stored in the register with the specified index
+  static constexpr uint_fast8_t GetWordIndex(uint_fast8_t registerIndex) {
+    return isMostSignificantWordFirst ? (numberOfRegisters - 1 - registerIndex) : registerIndex;
+  }
+};
+
+//==============================================================================
+
+/// @brief Class template for a Modbus register map: a block of holding or input registers with typed fields
+/// @details The same definition is used by the server (MemoryArea) and by the client (Read, Write, Get).
+/// Fields must not overlap and the whole map must fit in one read request.
+/// @tparam MemoryType memory type (holding registers or input registers)
+/// @tparam Address map register address
+/// @tparam Registers map fields (ModbusRegister)
+template <ModbusMemoryType MemoryType, uint16_t Address, class... Registers>
+class ModbusRegisterMap {
+private:
+  static constexpr uint32_t GetEndAddress() {
+    uint32_t endAddress = Address;
+    for (uint32_t registerEndAddress : {(uint32_t)Registers::address + Registers::numberOfRegisters...})
+      endAddress = (registerEndAddress > endAddress) ? registerEndAddress : endAddress;
+    return endAddress;
+  }
+
+  static constexpr bool HasOverlappingRegisters() {
+    const uint32_t addresses[] = {Registers::address...};
+    const uint32_t endAddresses[] = {(uint32_t)Registers::address + Registers::numberOfRegisters...};
+    for (size_t i = 0; i < sizeof...(Registers); i++) {
+      for (size_t j = i + 1; j < sizeof...(Registers); j++) {
+        if (addresses[i] < endAddresses[j] && addresses[j] < endAddresses[i])
+          return true;
+      }
+    }
+    return false;
+  }
+
+  template <class Register>
+  static constexpr bool isMapRegister = (std::is_same_v<Register, Registers> || ...);
+
+public:
+  static_assert(MemoryType == ModbusMemoryType::holdingRegisters || MemoryType == ModbusMemoryType::inputRegisters, "register map memory type must be holding registers or input registers");
+  static_assert(sizeof...(Registers) > 0, "register map has no registers");
+  static_assert(((Registers::address >= Address) && ...), "register address is lower than the register map address");
+  static_assert(!HasOverlappingRegisters(), "register map registers overlap");
+  static_assert(GetEndAddress() - Address <= ModbusBase::maxNumberOfModbusRegistersToRead, "register map does not fit in one read request");
+
+  /// @brief map memory type
+  static constexpr ModbusMemoryType memoryType = MemoryType;
+  /// @brief map register address
+  static constexpr uint16_t address = Address;
+  /// @brief map number of registers (including unused registers between the fields)
+  static constexpr uint16_t numberOfRegisters = GetEndAddress() - Address;
+
+  /// @brief Modbus server memory area with the register map layout
+  class MemoryArea : public ModbusMemoryArea {
+  public:
+    /// @brief Creates a memory area and allocates memory
+    MemoryArea() : ModbusMemoryArea(MemoryType, Address, numberOfRegisters * 2) {}
+
+    /// @brief Gets the field value
+    /// @tparam Register field
+    /// @return value
+    template <class Register>
+    typename Register::ValueType Get() {
+      LockGuard lg(*this);
+      return ModbusRegisterMap::Get<Register>((const uint16_t*)data);
+    }
+
+    /// @brief Sets the field value
+    /// @tparam Register field
+    /// @param value value
+    template <class Register>
+    void Set(typename Register::ValueType value) {
+      LockGuard lg(*this);
+      ModbusRegisterMap::Set<Register>((uint16_t*)data, value);
+    }
+  };
+
+  /// @brief Gets the field value from the map registers
+  /// @tparam Register field
+  /// @param registers map registers (numberOfRegisters values starting from the map address)
+  /// @return value
+  template <class Register>
+  static typename Register::ValueType Get(const uint16_t* registers) {
+    static_assert(isMapRegister<Register>, "register is not a register map field");
+    return Register::Decode(registers + (Register::address - Address));
+  }
+
+  /// @brief Sets the field value in the map registers
+  /// @tparam Register field
+  /// @param registers map registers (numberOfRegisters values starting from the map address)
+  /// @param value value
+  template <class Register>
+  static void Set(uint16_t* registers, typename Register::ValueType value) {
+    static_assert(isMapRegister<Register>, "register is not a register map field");
+    Register::Encode(value, registers + (Register::address - Address));
+  }
+
+  /// @brief Reads all map registers with one request
+  /// @param client Modbus client
+  /// @param registers map registers (numberOfRegisters values)
+  /// @param exception pointer to Modbus exception (can be NULL)
+  /// @return error code
+  static esp_err_t Read(ModbusClient& client, uint16_t* registers, ModbusException* exception) {
+    if constexpr (MemoryType == ModbusMemoryType::holdingRegisters)
+      return client.ReadHoldingRegisters(Address, numberOfRegisters, registers, exception);
+    else
+      return client.ReadInputRegisters(Address, numberOfRegisters, registers, exception);
+  }
+
+  /// @brief Writes the field value with one request
+  /// @tparam Register field
+  /// @param client Modbus client
+  /// @param value value
+  /// @param exception pointer to Modbus exception (can be NULL)
+  /// @return error code
+  template <class Register>
+  static esp_err_t Write(ModbusClient& client, typename Register::ValueType value, ModbusException* exception) {
+    static_assert(MemoryType == ModbusMemoryType::holdingRegisters, "only holding register maps can be written");
+    static_assert(isMapRegister<Register>, "register is not a register map field");
+    uint16_t registers[Register::numberOfRegisters];
+    Register::Encode(value, registers);
+    return client.WriteMultipleHoldingRegisters(Register::address, Register::numberOfRegisters, registers, exception);
+  }
+
+  /// @brief Writes all map registers with one request
+  /// @param client Modbus client
+  /// @param registers map registers (numberOfRegisters values)
+  /// @param exception pointer to Modbus exception (can be NULL)
+  /// @return error code
+  static esp_err_t Write(ModbusClient& client, const uint16_t* registers, ModbusException* exception) {
+    static_assert(MemoryType == ModbusMemoryType::holdingRegisters, "only holding register maps can be written");
+    static_assert(numberOfRegisters <= ModbusBase::maxNumberOfModbusRegistersToWrite, "register map does not fit in one write request");
+    return client.WriteMultipleHoldingRegisters(Address, numberOfRegisters, registers, exception);
+  }
+};
+
+//==============================================================================
+
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+#include "pl_modbus_memory_area.h"
+#include <atomic>
+
+//==============================================================================
+
+namespace PL {
+
+//==============================================================================
+
+/// @brief Modbus memory area with lock-free reads (sequence lock)
+/// @details Writers (the application and Modbus write requests) lock the memory area as usual and publish the data when it is unlocked.
+/// Modbus read requests do not lock the memory area: they copy the data and retry if it has been modified during the copy,
+/// so readers never block the writer and several servers can read the memory area in parallel.
+/// A read that starts while the memory area is locked waits for the writer.
+class ModbusSeqLockMemoryArea : public ModbusMemoryArea {
+public:
+  /// @brief Creates a sequence lock Modbus memory area and allocates memory 
+  /// @param type memory area type
+  /// @param address memory area address
+  /// @param size memory area data size (in bytes)
+  ModbusSeqLockMemoryArea(ModbusMemoryType type, uint16_t address, size_t size);
+
+  /// @brief Creates a sequence lock Modbus memory area from preallocated memory 
+  /// @param type memory area type
+  /// @param address memory area address
+  /// @param data memory area data pointer
+  /// @param size memory area data size (in bytes)
+  ModbusSeqLockMemoryArea(ModbusMemoryType type, uint16_t address, void* data, size_t size);
+
+  esp_err_t Lock(TickType_t timeout = portMAX_DELAY) override;
+  esp_err_t Unlock() override;
+
+  esp_err_t BeginRead(uint32_t& sequence) override;
+  bool EndRead(uint32_t sequence) override;
+
+private:
+  // Even - data is consistent, odd - data is being written.
+  std::atomic<uint32_t> sequence = 0;
+  int lockDepth = 0;
+};
+
+//==============================================================================
+
+}
@@ -1,6 +1,9 @@
 #pragma once
 #include "pl_modbus_base.h"
 #include "pl_modbus_memory_area.h"
+#include "pl_modbus_statistics.h"
+#include <atomic>
+#include <sys/socket.h>
 
 //==============================================================================
 
@@ -42,6 +45,19 @@ public:
   /// @param bufferSize transaction buffer size
   ModbusServer(uint16_t port, size_t bufferSize = defaultBufferSize);
 
+  /// @brief Creates a network Modbus server with specified protocol (e.g. RTU over TCP) and shared transaction buffer
+  /// @param port network port
+  /// @param protocol Modbus protocol
+  /// @param buffer transaction buffer
+  ModbusServer(uint16_t port, ModbusProtocol protocol, std::shared_ptr<Buffer> buffer);
+
+  /// @brief Creates a network Modbus server with specified protocol (e.g. RTU over TCP) and allocates transaction buffer
+  /// @param port network port
+  /// @param protocol Modbus protocol
+  /// @param bufferSize transaction buffer size
+  ModbusServer(uint16_t port, ModbusProtocol protocol, size_t bufferSize = defaultBufferSize);
+  ~ModbusServer();
+
   esp_err_t Lock(TickType_t timeout = portMAX_DELAY) override;
   esp_err_t Unlock() override;
 
@@ -58,6 +74,21 @@ public:
   /// @param address memory area address
   /// @param buffer buffer
   void AddMemoryArea(ModbusMemoryType type, uint16_t address, std::shared_ptr<Buffer> buffer);
+
+  /// @brief Adds a Modbus memory area to an additional station hosted by the server
+  /// @note Requests to the additional stations share the server transport, task and transaction buffer.
+  /// @param stationAddress station address (1..255)
+  /// @param memoryArea memory area
+  /// @return error code
+  esp_err_t AddMemoryArea(uint8_t stationAddress, std::shared_ptr<ModbusMemoryArea> memoryArea);
+
+  /// @brief Adds buffer as a Modbus memory area to an additional station hosted by the server
+  /// @param stationAddress station address (1..255)
+  /// @param type memory area type
+  /// @param address memory area address
+  /// @param buffer buffer
+  /// @return error code
+  esp_err_t AddMemoryArea(uint8_t stationAddress, ModbusMemoryType type, uint16_t address, std::shared_ptr<Buffer> buffer);
   
   bool IsEnabled() override;
 
@@ -75,6 +106,90 @@ public:
   /// @return error code
   esp_err_t SetTaskParameters(const TaskParameters& taskParameters);
 
+  /// @brief Sets the parameters of the worker tasks that handle the requests of a network server
+  /// @note Frames are read and checked by the server task and the requests are handled and answered by the worker tasks,
+  /// so a slow memory area callback for one client connection does not block the other connections.
+  /// Requests of the same client connection are handled in the order they are received.
+  /// Workers are started when the server is enabled. Workers handle the requests without the server lock:
+  /// the other tasks that lock the server (e.g. to add a memory area or to set the station address or protocol) wait until the dispatched requests are answered.
+  /// The server task waits for the worker of a connection that has received the next request or has been closed.
+  /// HandleRequest overrides are called by the worker tasks and must not call the methods that lock the server.
+  /// @param workerTaskParameters parameters of each worker task (empty to handle the requests in the server task)
+  /// @return error code
+  esp_err_t SetWorkerTaskParameters(const std::vector<TaskParameters>& workerTaskParameters);
+
+  /// @brief Deferred OnWrite notification statistics
+  struct DeferredOnWriteStatistics {
+    /// @brief number of writes
+    uint32_t numberOfWrites;
+    /// @brief number of writes coalesced with a pending notification
+    uint32_t numberOfCoalescedWrites;
+    /// @brief number of writes notified synchronously because the notification queue was full
+    uint32_t numberOfOverflows;
+    /// @brief number of notifications (OnWrite calls by the notification task)
+    uint32_t numberOfNotifications;
+    /// @brief number of notifications with OnWrite error
+    uint32_t numberOfErrors;
+    /// @brief current number of pending notifications
+    uint32_t queueDepth;
+    /// @brief maximum number of pending notifications
+    uint32_t maxQueueDepth;
+    /// @brief time between the first coalesced write and the OnWrite call of the last notification in microseconds
+    uint32_t lastLag;
+    /// @brief maximum time between the first coalesced write and the OnWrite call in microseconds
+    uint32_t maxLag;
+  };
+
+  /// @brief Enables deferred OnWrite notifications
+  /// @note The written data is committed and the response is sent without calling the memory area OnWrite method.
+  /// OnWrite is called later by the notification task with the memory area locked.
+  /// Writes to the same or adjacent items of a memory area are coalesced while the notification is pending,
+  /// so OnWrite sees the latest data. OnWrite errors are not reported to the client.
+  /// Memory areas that report OnWrite errors (ModbusMemoryArea::IsOnWriteDeferrable returns false, e.g. ModbusConcentratorMemoryArea) are always notified before the response.
+  /// @param taskParameters notification task parameters
+  /// @param maxQueueDepth maximum number of pending notifications (OnWrite is called synchronously when the queue is full)
+  /// @return error code
+  esp_err_t EnableDeferredOnWrite(const TaskParameters& taskParameters, size_t maxQueueDepth);
+
+  /// @brief Disables deferred OnWrite notifications (pending notifications are processed first)
+  /// @return error code
+  esp_err_t DisableDeferredOnWrite();
+
+  /// @brief Gets the deferred OnWrite notification statistics
+  /// @return statistics
+  DeferredOnWriteStatistics GetDeferredOnWriteStatistics();
+
+  /// @brief Resets the deferred OnWrite notification statistics (except the current queue depth)
+  void ResetDeferredOnWriteStatistics();
+
+  /// @brief Enables change subscriptions (report by exception with the ModbusClient Subscribe and ReadChanges methods)
+  /// @note Requests with the change subscription function code read the subscribed items (calling OnRead) and return only the items
+  /// that have changed (by more than the deadband for the registers) since the values that the client has confirmed.
+  /// The client confirms the response with the next request, so the changes of a lost response are returned again.
+  /// @param maxNumberOfSubscriptions maximum number of subscriptions (1..255)
+  /// @param timeout time in FreeRTOS ticks after which a subscription without requests can be replaced by a new one (0 - never)
+  /// @return error code
+  esp_err_t EnableChangeSubscriptions(size_t maxNumberOfSubscriptions, TickType_t timeout);
+
+  /// @brief Disables change subscriptions and removes all subscriptions
+  /// @return error code
+  esp_err_t DisableChangeSubscriptions();
+
+  /// @brief Gets the number of change subscriptions
+  /// @return number of subscriptions
+  size_t GetNumberOfChangeSubscriptions();
+
+  /// @brief Maximum number of items of a change subscription
+  static constexpr uint16_t maxNumberOfSubscribedItems = 2000;
+
+  /// @brief Gets the server statistics
+  /// @param statistics statistics
+  /// @return error code (ESP_ERR_NOT_SUPPORTED if the statistics are disabled in the configuration)
+  esp_err_t GetStatistics(ModbusServerStatistics& statistics);
+
+  /// @brief Resets the server statistics
+  void ResetStatistics();
+
   /// @brief Gets the base server (StreamServer or TcpServer)
   /// @return base server
   std::weak_ptr<Server> GetBaseServer();
@@ -84,6 +199,10 @@ protected:
   esp_err_t StreamRead(Stream& stream, Buffer& dest, size_t offset, size_t size) override;
   esp_err_t StreamReadUntil(Stream& stream, char termChar) override;
   esp_err_t ReadRtuData(Stream& stream, ModbusFunctionCode functionCode, size_t& dataSize) override;
+  bool IsServerFrame(ModbusCaptureDirection direction) override;
+  uint32_t GetCaptureConnectionId(Stream& stream) override;
+  bool IsForeignRtuFrame(uint8_t stationAddress) override;
+  esp_err_t SkipRtuFrame(Stream& stream, uint8_t stationAddress) override;
   
   /// @brief Handles the Modbus client request
   /// @param stream client stream
@@ -94,6 +213,15 @@ protected:
   /// @return error code
   virtual esp_err_t HandleRequest(Stream& stream, uint8_t stationAddress, ModbusFunctionCode functionCode, size_t dataSize, uint16_t transactionId);
   
+  /// @brief Writes the Modbus frame and records the response statistics
+  /// @param stream stream to write to
+  /// @param stationAddress frame station address
+  /// @param functionCode frame function code
+  /// @param dataSize frame data size
+  /// @param transactionId frame transaction ID (for Modbus TCP protocol)
+  /// @return error code
+  esp_err_t WriteFrame(Stream& stream, uint8_t stationAddress, ModbusFunctionCode functionCode, size_t dataSize, uint16_t transactionId);
+
   /// @brief Writes the Modbus exception frame
   /// @param stream client stream
   /// @param stationAddress frame station address
@@ -115,19 +243,159 @@ private:
   class TcpServer : public PL::TcpServer {
   public:
     TcpServer(uint16_t port, ModbusServer& modbusServer);
+    esp_err_t Lock(TickType_t timeout = portMAX_DELAY) override;
+    esp_err_t Unlock() override;
     esp_err_t HandleRequest(NetworkStream& stream) override;
   private:
     ModbusServer& modbusServer;
+    // Lock depth of the tasks other than the workers (the workers are not waited for by the nested locks)
+    int lockDepth = 0;
   };
 
-  ModbusInterface interface;
   std::shared_ptr<StreamServer> streamServer;
   std::shared_ptr<TcpServer> tcpServer;
   uint8_t stationAddress;
   std::vector<std::shared_ptr<ModbusMemoryArea>> memoryAreas;
+  // Memory areas of the additional stations. Station N memory areas are stationMemoryAreas[stationMemoryAreasIndexes[N] - 1] (0 - station is not hosted).
+  std::vector<std::vector<std::shared_ptr<ModbusMemoryArea>>> stationMemoryAreas;
+  uint8_t stationMemoryAreasIndexes[256] = {};
+
+  // Last skipped request to another station (to predict the length of the response to it)
+  struct ForeignRequest {
+    uint8_t stationAddress;
+    ModbusFunctionCode functionCode;
+    uint16_t numberOfItems;
+  };
+  ForeignRequest foreignRequest = {};
+  // The next frame on the line is a request (the previous frame was a response or a request to this server)
+  bool rtuRequestExpected = false;
+
+  // Part of the request address range that belongs to one memory area
+  struct MemoryAreaRange {
+    ModbusMemoryArea* memoryArea;
+    uint16_t address;
+    uint16_t numberOfItems;
+    uint32_t sequence;
+  };
+  // Reused between requests to avoid allocations while handling a request
+  std::vector<MemoryAreaRange> memoryAreaRanges;
+
+  // Request handling worker task
+  struct Worker {
+    ModbusServer* modbusServer;
+    TaskParameters taskParameters;
+    TaskHandle_t task = NULL;
+    TaskBuffer taskBuffer = {};
+    std::vector<MemoryAreaRange> memoryAreaRanges;
+    // Stream of the request being handled (NULL if the worker is idle)
+    std::atomic<Stream*> stream = NULL;
+    uint8_t stationAddress;
+    ModbusFunctionCode functionCode;
+    size_t dataSize;
+    uint16_t transactionId;
+    uint32_t captureConnectionId;
+    std::atomic<bool> stop = false;
+    std::atomic<bool> stopped = false;
+  };
+  std::vector<std::unique_ptr<Worker>> workers;
+  QueueHandle_t idleWorkers = NULL;
+  SemaphoreHandle_t workerDone = NULL;
+  static thread_local Worker* currentWorker;
+  // Server that is handling the requests in the current task (server task)
+  static thread_local ModbusServer* currentServer;
+
+  // Capture connection IDs of the client connections (used only by the network server task).
+  // A new connection can reuse the socket of a closed one, so the connection is identified by the socket and the peer address.
+  struct CaptureConnection {
+    int socket;
+    sockaddr_storage peerAddress;
+    uint32_t id;
+  };
+  std::vector<CaptureConnection> captureConnections;
+  // Capture connection ID of the request read by the server task (0 - the request has not been captured)
+  uint32_t requestCaptureConnectionId = 0;
+
+  // Deferred OnWrite notification
+  struct PendingWrite {
+    ModbusMemoryArea* memoryArea;
+    uint16_t address;
+    uint16_t numberOfItems;
+    int64_t time;
+  };
+  struct DeferredOnWrite {
+    Mutex mutex;
+    TaskHandle_t task = NULL;
+    std::vector<PendingWrite> pendingWrites;
+    size_t maxQueueDepth;
+    DeferredOnWriteStatistics statistics = {};
+    bool stop = false;
+    std::atomic<bool> stopped = false;
+  };
+  std::unique_ptr<DeferredOnWrite> deferredOnWrite;
+
+  // Change subscription. Item values are stored in the request format (bits or big-endian registers).
+  struct ChangeSubscription {
+    // 0 - free slot
+    uint8_t id = 0;
+    uint8_t stationAddress;
+    ModbusMemoryType memoryType;
+    uint16_t address;
+    uint16_t numberOfItems;
+    uint16_t deadband;
+    // Sequence number of the last response
+    uint8_t sequence;
+    TickType_t requestTime;
+    // Values confirmed by the client and items that have been confirmed at least once (bits)
+    std::vector<uint8_t> reportedData, reportedItems;
+    // Values and items (bits) of the last response
+    std::vector<uint8_t> sentData, sentItems;
+    std::vector<uint8_t> currentData;
+  };
+  struct ChangeSubscriptions {
+    Mutex mutex;
+    std::vector<ChangeSubscription> subscriptions;
+    TickType_t timeout;
+    uint8_t lastId = 0;
+  };
+  std::unique_ptr<ChangeSubscriptions> changeSubscriptions;
+
+#if CONFIG_PL_MODBUS_STATISTICS
+  struct FunctionCodeStatisticsRecorder {
+    std::atomic<uint32_t> numberOfRequests;
+    std::atomic<uint32_t> numberOfExceptions[modbusExceptionCounterSize];
+    ModbusLatencyHistogramRecorder readFrameTime;
+    ModbusLatencyHistogramRecorder handleTime;
+    ModbusLatencyHistogramRecorder writeFrameTime;
+  };
+  FunctionCodeStatisticsRecorder functionCodeStatistics[ModbusServerStatistics::numberOfFunctionCodes];
+  std::atomic<uint32_t> numberOfCrcErrors = 0;
+  std::atomic<uint32_t> numberOfFrameErrors = 0;
+  std::atomic<uint32_t> numberOfForeignFrames = 0;
+  std::atomic<uint32_t> numberOfBytesReceived = 0;
+  std::atomic<uint32_t> numberOfBytesSent = 0;
+  // Write frame time of the request handled by the calling task (excluded from the handle time)
+  static thread_local uint32_t writeFrameTime;
+#endif
 
   esp_err_t HandleRequest(Stream& stream);
-  std::shared_ptr<ModbusMemoryArea> FindMemoryArea(ModbusMemoryType memoryType, uint16_t memoryAddress, uint16_t numberOfItems);
+  esp_err_t ReadRequestFrame(Stream& stream, uint8_t& stationAddress, ModbusFunctionCode& functionCode, size_t& dataSize, uint16_t& transactionId);
+  esp_err_t HandleAndRecordRequest(Stream& stream, uint8_t stationAddress, ModbusFunctionCode functionCode, size_t dataSize, uint16_t transactionId);
+  esp_err_t DispatchRequest(Stream& stream, uint8_t stationAddress, ModbusFunctionCode functionCode, size_t dataSize, uint16_t transactionId);
+  bool IsWorkerTask();
+  esp_err_t WaitForWorkers(TickType_t timeout, bool pendingStreamsOnly);
+  esp_err_t StartWorkers();
+  void StopWorkers();
+  static void WorkerTask(void* parameters);
+  bool DeferOnWrite(ModbusMemoryArea& memoryArea, uint16_t address, uint16_t numberOfItems);
+  static void DeferredOnWriteTask(void* parameters);
+  bool IsStationHosted(uint8_t stationAddress);
+  esp_err_t SkipRtuData(Stream& stream, size_t size);
+  bool FindMemoryAreas(uint8_t stationAddress, ModbusMemoryType memoryType, uint16_t address, uint16_t numberOfItems, std::vector<MemoryAreaRange>& memoryAreaRanges);
+  esp_err_t ReadMemoryAreas(std::vector<MemoryAreaRange>& memoryAreaRanges, uint16_t address, void* dest);
+  esp_err_t WriteMemoryAreas(std::vector<MemoryAreaRange>& memoryAreaRanges, uint16_t address, const void* src);
+  static ModbusException GetMemoryAreaException(esp_err_t error);
+  esp_err_t HandleChangeSubscriptionRequest(Stream& stream, uint8_t stationAddress, size_t dataSize, uint16_t transactionId, std::vector<MemoryAreaRange>& memoryAreaRanges);
+  size_t ReadChanges(ChangeSubscription& subscription, uint8_t* dest, size_t maxSize, bool& moreChanges);
 };
 
 //==============================================================================
@@ -0,0 +1,142 @@
+#pragma once
+#include "pl_modbus_types.h"
+#include "sdkconfig.h"
+#include <atomic>
+#include <stddef.h>
+
+//==============================================================================
+
+namespace PL {
+
+//==============================================================================
+
+/// @brief Latency histogram with power of two buckets
+struct ModbusLatencyHistogram {
+  /// @brief Number of buckets
+  static constexpr size_t numberOfBuckets = 16;
+
+  /// @brief Number of values in the buckets (bucket 0: less than 2 us, bucket i: from 2^i to 2^(i+1)-1 us, last bucket: 2^15 us and more)
+  uint32_t counts[numberOfBuckets];
+  /// @brief Number of values
+  uint32_t count;
+  /// @brief Maximum value in microseconds
+  uint32_t max;
+
+  /// @brief Gets the bucket index of the value
+  /// @param time value in microseconds
+  /// @return bucket index
+  static size_t GetBucketIndex(uint32_t time);
+
+  /// @brief Gets the upper limit of the bucket that contains the specified percentile
+  /// @param percentile percentile (0..100)
+  /// @return time in microseconds (0 if there are no values)
+  uint32_t GetPercentile(float percentile) const;
+};
+
+//==============================================================================
+
+/// @brief Lock-free latency histogram recorder (relaxed atomic counters: a snapshot taken during an update can be off by one value)
+class ModbusLatencyHistogramRecorder {
+public:
+  /// @brief Adds the value
+  /// @param time value in microseconds
+  void Add(uint32_t time);
+
+  /// @brief Gets the histogram snapshot
+  /// @param histogram histogram
+  void Get(ModbusLatencyHistogram& histogram) const;
+
+  /// @brief Clears the histogram
+  void Reset();
+
+private:
+  std::atomic<uint32_t> counts[ModbusLatencyHistogram::numberOfBuckets] = {};
+  std::atomic<uint32_t> count = 0;
+  std::atomic<uint32_t> max = 0;
+};
+
+//==============================================================================
+
+/// @brief Number of Modbus exception counters (indexed by the exception code)
+static constexpr size_t modbusExceptionCounterSize = (size_t)ModbusException::gatewayTargetDeviceFailedToRespond + 1;
+
+//==============================================================================
+
+/// @brief Modbus server statistics
+struct ModbusServerStatistics {
+  /// @brief Function codes with separate statistics (other function codes are counted in the last function code statistics)
+  static constexpr ModbusFunctionCode functionCodes[] = {ModbusFunctionCode::readCoils, ModbusFunctionCode::readDiscreteInputs,
+    ModbusFunctionCode::readHoldingRegisters, ModbusFunctionCode::readInputRegisters, ModbusFunctionCode::writeSingleCoil,
+    ModbusFunctionCode::writeSingleHoldingRegister, ModbusFunctionCode::writeMultipleCoils, ModbusFunctionCode::writeMultipleHoldingRegisters};
+  /// @brief Number of function code statistics
+  static constexpr size_t numberOfFunctionCodes = sizeof(functionCodes) / sizeof(functionCodes[0]) + 1;
+
+  /// @brief Function code statistics
+  struct FunctionCodeStatistics {
+    /// @brief Number of requests
+    uint32_t numberOfRequests;
+    /// @brief Number of exception responses (indexed by the exception code)
+    uint32_t numberOfExceptions[modbusExceptionCounterSize];
+    /// @brief Request frame read time
+    ModbusLatencyHistogram readFrameTime;
+    /// @brief Request handling time (memory area access and callbacks, without the response frame write)
+    ModbusLatencyHistogram handleTime;
+    /// @brief Response frame write time
+    ModbusLatencyHistogram writeFrameTime;
+  };
+
+  /// @brief Function code statistics (same order as functionCodes, the last one is for the other function codes)
+  FunctionCodeStatistics functionCodeStatistics[numberOfFunctionCodes];
+  /// @brief Number of request frames with CRC/LRC error
+  uint32_t numberOfCrcErrors;
+  /// @brief Number of invalid request frames (format errors, read timeouts, buffer overflows)
+  uint32_t numberOfFrameErrors;
+  /// @brief Number of frames addressed to other stations
+  uint32_t numberOfForeignFrames;
+  /// @brief Number of bytes in the received request frames
+  uint32_t numberOfBytesReceived;
+  /// @brief Number of bytes in the sent response frames
+  uint32_t numberOfBytesSent;
+
+  /// @brief Gets the function code statistics index
+  /// @param functionCode function code
+  /// @return index in functionCodeStatistics
+  static size_t GetFunctionCodeIndex(ModbusFunctionCode functionCode);
+
+  /// @brief Gets the function code statistics
+  /// @param functionCode function code
+  /// @return function code statistics
+  const FunctionCodeStatistics& GetFunctionCodeStatistics(ModbusFunctionCode functionCode) const;
+};
+
+//==============================================================================
+
+/// @brief Modbus client statistics
+struct ModbusClientStatistics {
+  /// @brief Number of requests
+  uint32_t numberOfRequests;
+  /// @brief Number of successful transactions
+  uint32_t numberOfResponses;
+  /// @brief Number of exception responses (indexed by the exception code)
+  uint32_t numberOfExceptions[modbusExceptionCounterSize];
+  /// @brief Number of response timeouts
+  uint32_t numberOfTimeouts;
+  /// @brief Number of response frames with CRC/LRC error
+  uint32_t numberOfCrcErrors;
+  /// @brief Number of invalid response frames (format errors, wrong station address, function code or data)
+  uint32_t numberOfInvalidResponses;
+  /// @brief Number of discarded response frames with a wrong transaction ID (late responses to the previous requests)
+  uint32_t numberOfDiscardedResponses;
+  /// @brief Number of TCP connections (network client)
+  uint32_t numberOfConnections;
+  /// @brief Number of bytes in the sent request frames
+  uint32_t numberOfBytesSent;
+  /// @brief Number of bytes in the received response frames
+  uint32_t numberOfBytesReceived;
+  /// @brief Time between the request frame write and the response frame read (including the exception responses)
+  ModbusLatencyHistogram roundTripTime;
+};
+
+//==============================================================================
+
+}
\ No newline at end of file
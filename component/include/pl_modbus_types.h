@@ -37,6 +37,18 @@ enum class ModbusMemoryType {
   inputRegisters
 };
 
+/// @brief Order of the bytes of a multi-register value in the Modbus registers (ABCD are the bytes of a 32-bit value from the most significant one)
+enum class ModbusWordOrder : uint8_t {
+  /// @brief most significant register first, most significant byte first in the register (big-endian)
+  abcd = 0,
+  /// @brief least significant register first, most significant byte first in the register (word swap)
+  cdab = 1,
+  /// @brief most significant register first, least significant byte first in the register (byte swap)
+  badc = 2,
+  /// @brief least significant register first, least significant byte first in the register (little-endian)
+  dcba = 3
+};
+
 /// @brief Modbus function code
 enum class ModbusFunctionCode : uint8_t {
   /// @brief unknown
@@ -56,7 +68,19 @@ enum class ModbusFunctionCode : uint8_t {
   /// @brief write multiple coils
   writeMultipleCoils = 15,
   /// @brief write multiple holding registers
-  writeMultipleHoldingRegisters = 16
+  writeMultipleHoldingRegisters = 16,
+  /// @brief change subscription (user-defined function code of the ModbusClient and ModbusServer report by exception)
+  changeSubscription = 65
+};
+
+/// @brief Modbus change subscription command (first data byte of the change subscription request and response)
+enum class ModbusChangeSubscriptionCommand : uint8_t {
+  /// @brief subscribe to the changes of a memory address range
+  subscribe = 1,
+  /// @brief remove the subscription
+  unsubscribe = 2,
+  /// @brief read the changed items
+  readChanges = 3
 };
 
 // Modbus exception
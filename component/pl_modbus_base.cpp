@@ -11,6 +11,8 @@ namespace PL {
 
 //==============================================================================
 
+const uint_fast8_t lowerBits[] =  {0, 0b1, 0b11, 0b111, 0b1111, 0b11111, 0b111111, 0b1111111, 0b11111111};
+
 const uint16_t crcTable[] = {
   0X0000, 0XC0C1, 0XC181, 0X0140, 0XC301, 0X03C0, 0X0280, 0XC241,
   0XC601, 0X06C0, 0X0780, 0XC741, 0X0500, 0XC5C1, 0XC481, 0X0440,
@@ -48,6 +50,16 @@ const uint16_t crcTable[] = {
 
 //==============================================================================
 
+thread_local ModbusBase::TaskBuffer* ModbusBase::taskBuffer = NULL;
+
+//==============================================================================
+
+ModbusInterface ModbusBase::GetInterface() {
+  return interface;
+}
+
+//==============================================================================
+
 ModbusProtocol ModbusBase::GetProtocol() {
   LockGuard lg(*this);
   return protocol;
@@ -110,8 +122,23 @@ esp_err_t ModbusBase::SetDelayAfterRead(TickType_t delay) {
 
 //==============================================================================
 
-ModbusBase::ModbusBase(ModbusProtocol protocol, std::shared_ptr<Buffer> buffer, TickType_t readTimeout, TickType_t writeTimeout) :
-    protocol(protocol), buffer(buffer), readTimeout(readTimeout), writeTimeout(writeTimeout) {
+std::shared_ptr<ModbusCapture> ModbusBase::GetCapture() {
+  return capture.load();
+}
+
+//==============================================================================
+
+esp_err_t ModbusBase::SetCapture(std::shared_ptr<ModbusCapture> capture) {
+  // A frame that is being recorded keeps its copy of the previous capture.
+  captureEnabled = capture != NULL;
+  this->capture = capture;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+ModbusBase::ModbusBase(ModbusInterface interface, ModbusProtocol protocol, std::shared_ptr<Buffer> buffer, TickType_t readTimeout, TickType_t writeTimeout) :
+    interface(interface), protocol(protocol), buffer(buffer), readTimeout(readTimeout), writeTimeout(writeTimeout) {
   if (protocol != ModbusProtocol::rtu && protocol != ModbusProtocol::ascii && protocol != ModbusProtocol::tcp)
     this->protocol = ModbusProtocol::rtu;
   InitializeDataBuffer();
@@ -119,18 +146,28 @@ ModbusBase::ModbusBase(ModbusProtocol protocol, std::shared_ptr<Buffer> buffer,
 
 //==============================================================================
 
-ModbusBase::ModbusBase(ModbusProtocol protocol, size_t bufferSize, TickType_t readTimeout, TickType_t writeTimeout) :
-    ModbusBase(protocol, std::make_shared<Buffer>(bufferSize), readTimeout, writeTimeout) {}
+ModbusBase::ModbusBase(ModbusInterface interface, ModbusProtocol protocol, size_t bufferSize, TickType_t readTimeout, TickType_t writeTimeout) :
+    ModbusBase(interface, protocol, std::make_shared<Buffer>(bufferSize), readTimeout, writeTimeout) {}
 
 //==============================================================================
 
 esp_err_t ModbusBase::ReadFrame(Stream& stream, uint8_t& stationAddress, ModbusFunctionCode& functionCode, size_t& dataSize, uint16_t& transactionId) {
+  return ReadFrame(stream, stationAddress, functionCode, dataSize, transactionId, readTimeout);
+}
+
+//==============================================================================
+
+esp_err_t ModbusBase::ReadFrame(Stream& stream, uint8_t& stationAddress, ModbusFunctionCode& functionCode, size_t& dataSize, uint16_t& transactionId, TickType_t timeout) {
   esp_err_t error;
-  stream.SetReadTimeout(readTimeout);
+  stream.SetReadTimeout(timeout);
 
   if (protocol == ModbusProtocol::rtu) {
     transactionId = 0;
     ESP_RETURN_ON_ERROR(StreamRead(stream, &stationAddress, 1), TAG, "read station address failed");
+    if (IsForeignRtuFrame(stationAddress)) {
+      SkipRtuFrame(stream, stationAddress);
+      return ESP_ERR_NOT_FOUND;
+    }
     ESP_RETURN_ON_ERROR(StreamRead(stream, &functionCode, 1), TAG, "read function code failed");
     
     if ((error = ReadRtuData(stream, functionCode, dataSize)) == ESP_OK) {
@@ -140,7 +177,8 @@ esp_err_t ModbusBase::ReadFrame(Stream& stream, uint8_t& stationAddress, ModbusF
       if (buffer->size >= dataSize + 2) {
         ((uint8_t*)buffer->data)[0] = stationAddress;
         ((uint8_t*)buffer->data)[1] = (uint8_t)functionCode;
-        ESP_RETURN_ON_FALSE(Crc(dataSize + 2) == crc, ESP_ERR_INVALID_CRC, TAG, "invalid crc");
+        CaptureFrame(ModbusCaptureDirection::received, stream, buffer->data, dataSize + 2, &crc, 2);
+        ESP_RETURN_ON_FALSE(Crc(buffer->data, dataSize + 2) == crc, ESP_ERR_INVALID_CRC, TAG, "invalid crc");
         return ESP_OK;
       }
       else {
@@ -164,20 +202,18 @@ esp_err_t ModbusBase::ReadFrame(Stream& stream, uint8_t& stationAddress, ModbusF
       ESP_RETURN_ON_ERROR(StreamRead(stream, asciiData, 2), TAG, "read ASCII failed");
       if (asciiData[0] == '\r' && asciiData[1] == '\n') {
         dataSize = (i >= 3) ? (i - 3) : 0;
+        CaptureFrame(ModbusCaptureDirection::received, stream, buffer->data, i);
         vTaskDelay(delayAfterRead);
         ESP_RETURN_ON_FALSE(i >= 3, ESP_ERR_INVALID_RESPONSE, TAG, "invalid request");
-        ESP_RETURN_ON_FALSE(Lrc(i) == 0, ESP_ERR_INVALID_CRC, TAG, "invalid crc");
+        ESP_RETURN_ON_FALSE(Lrc(buffer->data, i) == 0, ESP_ERR_INVALID_CRC, TAG, "invalid crc");
         return ESP_OK;
       }
       else {
-        if (asciiData[0] < '0' || (asciiData[0] > '9' && asciiData[0] < 'A') || asciiData[0] > 'F' ||
-            asciiData[1] < '0' || (asciiData[1] > '9' && asciiData[1] < 'A') || asciiData[1] > 'F') {
+        if (!DecodeAscii(asciiData, ((uint8_t*)buffer->data)[i])) {
           ESP_RETURN_ON_ERROR(StreamReadUntil(stream, '\n'), TAG, "read until \\n failed");
           vTaskDelay(delayAfterRead);
           ESP_RETURN_ON_ERROR(ESP_ERR_INVALID_RESPONSE, TAG, "invalid ASCII data");
         }
-        ((uint8_t*)buffer->data)[i] = ((asciiData[0] - ((asciiData[0] < 'A')?('0'):('A' - 10))) << 4);
-        ((uint8_t*)buffer->data)[i] += (asciiData[1] - ((asciiData[1] < 'A')?('0'):('A' - 10)));
         if (i == 0)
           stationAddress = ((uint8_t*)buffer->data)[0];
         if (i == 1)
@@ -215,6 +251,11 @@ esp_err_t ModbusBase::ReadFrame(Stream& stream, uint8_t& stationAddress, ModbusF
     dataSize = tcpDataLength - 2;
     if (buffer->size >= dataSize + 8) {
       ESP_RETURN_ON_ERROR(StreamRead(stream, *buffer, 8, dataSize), TAG, "read data failed");
+      if (captureEnabled) {
+        uint8_t header[8] = {(uint8_t)(transactionId >> 8), (uint8_t)transactionId, 0, 0, (uint8_t)(tcpDataLength >> 8), (uint8_t)tcpDataLength,
+                             stationAddress, (uint8_t)functionCode};
+        CaptureFrame(ModbusCaptureDirection::received, stream, header, sizeof(header), (uint8_t*)buffer->data + 8, dataSize);
+      }
       vTaskDelay(delayAfterRead);
       return ESP_OK;
     }
@@ -232,54 +273,56 @@ esp_err_t ModbusBase::ReadFrame(Stream& stream, uint8_t& stationAddress, ModbusF
 //==============================================================================
 
 esp_err_t ModbusBase::WriteFrame(Stream& stream, uint8_t stationAddress, ModbusFunctionCode functionCode, size_t dataSize, uint16_t transactionId) {
+  // Frames can be written by several tasks (see SetTaskBuffer).
+  LockGuard lg(stream);
+  Buffer& buffer = GetBuffer();
   stream.SetWriteTimeout(writeTimeout);
 
-  if (protocol != ModbusProtocol::tcp && stream.GetReadableSize())
+  // Pending data on a half-duplex serial line means that the line is busy.
+  // Network streams are full-duplex and can have the next request already queued.
+  if (interface == ModbusInterface::stream && protocol != ModbusProtocol::tcp && stream.GetReadableSize())
     return ESP_ERR_INVALID_STATE;
 
   if (protocol == ModbusProtocol::rtu) {
-    ESP_RETURN_ON_FALSE(buffer->size >= dataSize + 4, ESP_ERR_INVALID_SIZE, TAG, "buffer is too small");
-    ((uint8_t*)buffer->data)[0] = stationAddress;
-    ((uint8_t*)buffer->data)[1] = (uint8_t)functionCode;
+    ESP_RETURN_ON_FALSE(buffer.size >= dataSize + 4, ESP_ERR_INVALID_SIZE, TAG, "buffer is too small");
+    ((uint8_t*)buffer.data)[0] = stationAddress;
+    ((uint8_t*)buffer.data)[1] = (uint8_t)functionCode;
     uint16_t tempUInt16;
-    memcpy((uint8_t*)buffer->data + 2 + dataSize, &(tempUInt16 = Crc(2 + dataSize)), 2);
+    memcpy((uint8_t*)buffer.data + 2 + dataSize, &(tempUInt16 = Crc(buffer.data, 2 + dataSize)), 2);
 
-    ESP_RETURN_ON_ERROR(stream.Write(*buffer, 0, dataSize + 4), TAG, "stream write error");
+    ESP_RETURN_ON_ERROR(stream.Write(buffer, 0, dataSize + 4), TAG, "stream write error");
+    CaptureFrame(ModbusCaptureDirection::transmitted, stream, buffer.data, dataSize + 4);
     return ESP_OK;
   }
 
   if (protocol == ModbusProtocol::ascii) {
-    ESP_RETURN_ON_FALSE(buffer->size >= dataSize * 2 + 9, ESP_ERR_INVALID_SIZE, TAG, "buffer is too small");
-    ((uint8_t*)buffer->data)[0] = stationAddress;
-    ((uint8_t*)buffer->data)[1] = (uint8_t)functionCode;
-    ((uint8_t*)buffer->data)[dataSize + 2] = Lrc(dataSize + 2);
+    ESP_RETURN_ON_FALSE(buffer.size >= dataSize * 2 + 9, ESP_ERR_INVALID_SIZE, TAG, "buffer is too small");
+    ((uint8_t*)buffer.data)[0] = stationAddress;
+    ((uint8_t*)buffer.data)[1] = (uint8_t)functionCode;
+    ((uint8_t*)buffer.data)[dataSize + 2] = Lrc(buffer.data, dataSize + 2);
+    // ASCII frames are captured before the encoding.
+    CaptureFrame(ModbusCaptureDirection::transmitted, stream, buffer.data, dataSize + 3);
     // Expands each raw byte into 2 ASCII hex characters in place.
-    // Goes from the end backwards: iteration i writes to indices 2i+1/2i+2, which are higher
-    // than any index a later iteration will read, so writes never overwrite not-yet-read source bytes.
-    for (int i = dataSize + 2; i >= 0; i--) {
-      uint8_t byteData = ((uint8_t*)buffer->data)[i] >> 4;
-      ((uint8_t*)buffer->data)[i * 2 + 1] = (byteData > 9)?(byteData - 10 + 'A'):(byteData + '0');
-      byteData = ((uint8_t*)buffer->data)[i] & 0x0F;
-      ((uint8_t*)buffer->data)[i * 2 + 2] = (byteData > 9)?(byteData - 10 + 'A'):(byteData + '0');
-    }
-    ((uint8_t*)buffer->data)[0] = ':';
-    ((uint8_t*)buffer->data)[dataSize * 2 + 7] = '\r';
-    ((uint8_t*)buffer->data)[dataSize * 2 + 8] = '\n';
+    EncodeAscii(buffer.data, dataSize + 3);
+    ((uint8_t*)buffer.data)[0] = ':';
+    ((uint8_t*)buffer.data)[dataSize * 2 + 7] = '\r';
+    ((uint8_t*)buffer.data)[dataSize * 2 + 8] = '\n';
 
-    ESP_RETURN_ON_ERROR(stream.Write(*buffer, 0, dataSize * 2 + 9), TAG, "stream write error");
+    ESP_RETURN_ON_ERROR(stream.Write(buffer, 0, dataSize * 2 + 9), TAG, "stream write error");
     return ESP_OK;
   }
 
   if (protocol == ModbusProtocol::tcp) {
-    ESP_RETURN_ON_FALSE(buffer->size >= dataSize + 8 && dataSize <= 0xFFFD, ESP_ERR_INVALID_SIZE, TAG, "buffer is too small");
+    ESP_RETURN_ON_FALSE(buffer.size >= dataSize + 8 && dataSize <= 0xFFFD, ESP_ERR_INVALID_SIZE, TAG, "buffer is too small");
     uint16_t tempUInt16;
-    memcpy((uint8_t*)buffer->data + 0, &(tempUInt16 = __builtin_bswap16(transactionId)), 2);
-    memcpy((uint8_t*)buffer->data + 2, &(tempUInt16 = 0), 2);
-    memcpy((uint8_t*)buffer->data + 4, &(tempUInt16 = __builtin_bswap16((uint16_t)(dataSize + 2))), 2);
-    ((uint8_t*)buffer->data)[6] = stationAddress;
-    ((uint8_t*)buffer->data)[7] = (uint8_t)functionCode;
-
-    ESP_RETURN_ON_ERROR(stream.Write(*buffer, 0, dataSize + 8), TAG, "stream write error");
+    memcpy((uint8_t*)buffer.data + 0, &(tempUInt16 = __builtin_bswap16(transactionId)), 2);
+    memcpy((uint8_t*)buffer.data + 2, &(tempUInt16 = 0), 2);
+    memcpy((uint8_t*)buffer.data + 4, &(tempUInt16 = __builtin_bswap16((uint16_t)(dataSize + 2))), 2);
+    ((uint8_t*)buffer.data)[6] = stationAddress;
+    ((uint8_t*)buffer.data)[7] = (uint8_t)functionCode;
+
+    ESP_RETURN_ON_ERROR(stream.Write(buffer, 0, dataSize + 8), TAG, "stream write error");
+    CaptureFrame(ModbusCaptureDirection::transmitted, stream, buffer.data, dataSize + 8);
     return ESP_OK;
   }
 
@@ -288,6 +331,19 @@ esp_err_t ModbusBase::WriteFrame(Stream& stream, uint8_t stationAddress, ModbusF
 
 //==============================================================================
 
+size_t ModbusBase::GetFrameSize(size_t dataSize) {
+  switch ((taskBuffer && taskBuffer->owner == this) ? taskBuffer->protocol : protocol) {
+    case ModbusProtocol::ascii:
+      return dataSize * 2 + 9;
+    case ModbusProtocol::tcp:
+      return dataSize + 8;
+    default:
+      return dataSize + 4;
+  }
+}
+
+//==============================================================================
+
 esp_err_t ModbusBase::StreamRead(Stream& stream, void* dest, size_t size) {
   return stream.Read(dest, size);
 }
@@ -306,17 +362,65 @@ esp_err_t ModbusBase::StreamReadUntil(Stream& stream, char termChar) {
 
 //==============================================================================
 
+bool ModbusBase::IsForeignRtuFrame(uint8_t stationAddress) {
+  return false;
+}
+
+//==============================================================================
+
+esp_err_t ModbusBase::SkipRtuFrame(Stream& stream, uint8_t stationAddress) {
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+//==============================================================================
+
+bool ModbusBase::IsServerFrame(ModbusCaptureDirection direction) {
+  // Clients receive the frames from the servers.
+  return direction == ModbusCaptureDirection::received;
+}
+
+//==============================================================================
+
 Buffer& ModbusBase::GetDataBuffer() {
-  return *dataBuffer;
+  return (taskBuffer && taskBuffer->owner == this) ? *taskBuffer->dataBuffer : *dataBuffer;
+}
+
+//==============================================================================
+
+esp_err_t ModbusBase::InitializeTaskBuffer(TaskBuffer& taskBuffer) {
+  LockGuard lg(*this);
+  if (!taskBuffer.buffer || taskBuffer.buffer->size != buffer->size) {
+    taskBuffer.buffer = std::make_shared<Buffer>(buffer->size);
+    ESP_RETURN_ON_FALSE(taskBuffer.buffer->data || !buffer->size, ESP_ERR_NO_MEM, TAG, "task buffer allocation failed");
+    taskBuffer.dataBuffer = NULL;
+  }
+  if (!taskBuffer.dataBuffer || taskBuffer.protocol != protocol) {
+    taskBuffer.dataBuffer = CreateDataBuffer(taskBuffer.buffer);
+    taskBuffer.protocol = protocol;
+  }
+  taskBuffer.owner = this;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+void ModbusBase::SetTaskBuffer(TaskBuffer* taskBuffer) {
+  ModbusBase::taskBuffer = taskBuffer;
+}
+
+//==============================================================================
+
+Buffer& ModbusBase::GetBuffer() {
+  return (taskBuffer && taskBuffer->owner == this) ? *taskBuffer->buffer : *buffer;
 }
 
 //==============================================================================
 
-uint16_t ModbusBase::Crc(size_t size) {
+uint16_t ModbusBase::Crc(const void* data, size_t size) {
   uint_fast16_t crc = 0xFFFF;
   uint_fast8_t crcTableIndex;
   for (size_t i = 0; i < size; i++) {
-    crcTableIndex = (crc & 0xFF) ^ (((uint8_t*)buffer->data)[i]);
+    crcTableIndex = (crc & 0xFF) ^ ((const uint8_t*)data)[i];
     crc >>= 8;
     crc ^= crcTable[crcTableIndex];
   }
@@ -325,24 +429,114 @@ uint16_t ModbusBase::Crc(size_t size) {
 
 //==============================================================================
 
-uint8_t ModbusBase::Lrc(size_t size) {
+uint8_t ModbusBase::Lrc(const void* data, size_t size) {
   uint_fast8_t lrc = 0;
   for (size_t i = 0; i < size; i++)
-    lrc += ((uint8_t*)buffer->data)[i];
+    lrc += ((const uint8_t*)data)[i];
   return ~lrc + 1;
 }
 
 //==============================================================================
 
+void ModbusBase::EncodeAscii(void* data, size_t size) {
+  // Goes from the end backwards: iteration i writes to indices 2i+1/2i+2, which are higher
+  // than any index a later iteration will read, so writes never overwrite not-yet-read source bytes.
+  for (size_t i = size; i > 0; i--) {
+    uint8_t byteData = ((uint8_t*)data)[i - 1] >> 4;
+    ((uint8_t*)data)[i * 2 - 1] = (byteData > 9)?(byteData - 10 + 'A'):(byteData + '0');
+    byteData = ((uint8_t*)data)[i - 1] & 0x0F;
+    ((uint8_t*)data)[i * 2] = (byteData > 9)?(byteData - 10 + 'A'):(byteData + '0');
+  }
+}
+
+//==============================================================================
+
+bool ModbusBase::DecodeAscii(const uint8_t* ascii, uint8_t& value) {
+  if (ascii[0] < '0' || (ascii[0] > '9' && ascii[0] < 'A') || ascii[0] > 'F' ||
+      ascii[1] < '0' || (ascii[1] > '9' && ascii[1] < 'A') || ascii[1] > 'F')
+    return false;
+  value = ((ascii[0] - ((ascii[0] < 'A')?('0'):('A' - 10))) << 4) + (ascii[1] - ((ascii[1] < 'A')?('0'):('A' - 10)));
+  return true;
+}
+
+//==============================================================================
+
+void ModbusBase::CopyBits(const void* src, size_t srcOffset, void* dest, size_t destOffset, size_t numberOfBits) {
+  // Copies up to 8 bits at a time so that each iteration writes bits of one destination byte.
+  // The next source byte is only read when the bits span two source bytes, so the source is never read past its last bit.
+  while (numberOfBits) {
+    uint_fast8_t srcBitOffset = srcOffset % 8;
+    uint_fast8_t destBitOffset = destOffset % 8;
+    uint_fast8_t numberOfCopiedBits = std::min(numberOfBits, (size_t)(8 - destBitOffset));
+    const uint8_t* srcByte = (const uint8_t*)src + srcOffset / 8;
+    uint8_t* destByte = (uint8_t*)dest + destOffset / 8;
+
+    uint_fast16_t bits = srcByte[0] >> srcBitOffset;
+    if (srcBitOffset + numberOfCopiedBits > 8)
+      bits |= srcByte[1] << (8 - srcBitOffset);
+    uint_fast8_t mask = lowerBits[numberOfCopiedBits] << destBitOffset;
+    *destByte = (*destByte & ~mask) | ((bits << destBitOffset) & mask);
+
+    srcOffset += numberOfCopiedBits;
+    destOffset += numberOfCopiedBits;
+    numberOfBits -= numberOfCopiedBits;
+  }
+}
+
+//==============================================================================
+
+void ModbusBase::CopySwappedRegisters(const void* src, void* dest, size_t numberOfRegisters) {
+  for (size_t i = 0; i < numberOfRegisters; i++) {
+    uint16_t registerValue;
+    memcpy(&registerValue, (const uint8_t*)src + i * 2, 2);
+    registerValue = __builtin_bswap16(registerValue);
+    memcpy((uint8_t*)dest + i * 2, &registerValue, 2);
+  }
+}
+
+//==============================================================================
+
 void ModbusBase::InitializeDataBuffer() {
-  if (protocol == ModbusProtocol::rtu)
-    dataBuffer = std::make_shared<Buffer>((uint8_t*)buffer->data + 2, buffer->size >= 4 ? (buffer->size - 4) : 0, buffer);
+  dataBuffer = CreateDataBuffer(buffer);
+}
+
+//==============================================================================
+
+std::shared_ptr<Buffer> ModbusBase::CreateDataBuffer(std::shared_ptr<Buffer> buffer) {
   if (protocol == ModbusProtocol::ascii)
-    dataBuffer = std::make_shared<Buffer>((uint8_t*)buffer->data + 2, buffer->size >= 9 ? ((buffer->size - 9) / 2) : 0, buffer);
+    return std::make_shared<Buffer>((uint8_t*)buffer->data + 2, buffer->size >= 9 ? ((buffer->size - 9) / 2) : 0, buffer);
   if (protocol == ModbusProtocol::tcp)
-    dataBuffer = std::make_shared<Buffer>((uint8_t*)buffer->data + 8, buffer->size >= 8 ? (buffer->size - 8) : 0, buffer);
+    return std::make_shared<Buffer>((uint8_t*)buffer->data + 8, buffer->size >= 8 ? (buffer->size - 8) : 0, buffer);
+  return std::make_shared<Buffer>((uint8_t*)buffer->data + 2, buffer->size >= 4 ? (buffer->size - 4) : 0, buffer);
+}
+
+//==============================================================================
+
+void ModbusBase::CaptureFrame(ModbusCaptureDirection direction, Stream& stream, const void* data, size_t size, const void* data2, size_t size2) {
+  if (!captureEnabled.load(std::memory_order_relaxed))
+    return;
+  if (std::shared_ptr<ModbusCapture> capture = this->capture.load())
+    capture->Record(direction, protocol, IsServerFrame(direction), GetCaptureConnectionId(stream), data, size, data2, size2);
+}
+
+//==============================================================================
+
+uint32_t ModbusBase::GetCaptureConnectionId(Stream& stream) {
+  uint32_t connectionId = captureConnectionId.load(std::memory_order_relaxed);
+  if (!connectionId) {
+    uint32_t newConnectionId = ModbusCapture::CreateConnectionId();
+    // Another task could have assigned the ID meanwhile.
+    connectionId = captureConnectionId.compare_exchange_strong(connectionId, newConnectionId, std::memory_order_relaxed) ? newConnectionId : connectionId;
+  }
+  return connectionId;
+}
+
+//==============================================================================
+
+void ModbusBase::ResetCaptureConnectionId() {
+  captureConnectionId = 0;
 }
 
 //==============================================================================
 
-}
\ No newline at end of file
+}
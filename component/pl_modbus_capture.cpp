@@ -0,0 +1,280 @@
+#include "pl_modbus_capture.h"
+#include "pl_modbus_base.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "string.h"
+#include <map>
+
+//==============================================================================
+
+static const char* TAG = "pl_modbus_capture";
+
+//==============================================================================
+
+namespace PL {
+
+//==============================================================================
+
+// pcap link types
+static const uint32_t pcapLinkTypeRaw = 101;
+static const uint32_t pcapLinkTypeUser0 = 147;
+static const uint16_t modbusTcpPort = 502;
+static const uint16_t firstClientPort = 49152;
+static const size_t ipV4HeaderSize = 20;
+static const size_t tcpHeaderSize = 20;
+
+//==============================================================================
+
+static void WriteUInt16(std::vector<uint8_t>& packet, size_t offset, uint16_t value) {
+  packet[offset] = value >> 8;
+  packet[offset + 1] = value;
+}
+
+//==============================================================================
+
+static void WriteUInt32(std::vector<uint8_t>& packet, size_t offset, uint32_t value) {
+  WriteUInt16(packet, offset, value >> 16);
+  WriteUInt16(packet, offset + 2, value);
+}
+
+//==============================================================================
+
+// Internet checksum (RFC 1071) of the data with the initial sum
+static uint16_t GetInternetChecksum(const uint8_t* data, size_t size, uint32_t sum = 0) {
+  for (size_t i = 0; i + 1 < size; i += 2)
+    sum += (data[i] << 8) | data[i + 1];
+  if (size & 1)
+    sum += data[size - 1] << 8;
+  while (sum >> 16)
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  return ~sum;
+}
+
+//==============================================================================
+
+std::atomic<uint32_t> ModbusCapture::lastConnectionId = 0;
+
+//==============================================================================
+
+ModbusCapture::ModbusCapture(size_t numberOfRecords, size_t maxFrameSize) :
+    maxFrameSize(maxFrameSize), slots(std::max(numberOfRecords, (size_t)1)), frames(slots.size() * maxFrameSize) {}
+
+//==============================================================================
+
+void ModbusCapture::Record(ModbusCaptureDirection direction, ModbusProtocol protocol, bool serverFrame, uint32_t connectionId,
+    const void* data, size_t size, const void* data2, size_t size2) {
+  int64_t time = esp_timer_get_time();
+  uint32_t number = numberOfFrames.fetch_add(1, std::memory_order_relaxed);
+  Slot& slot = slots[number % slots.size()];
+
+  // The slot can still be written by a task that has claimed it one ring buffer turn earlier.
+  uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+  if ((sequence & 1) || !slot.sequence.compare_exchange_strong(sequence, number * 2 + 1, std::memory_order_relaxed)) {
+    numberOfDroppedFrames.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot.time = time;
+  slot.direction = direction;
+  slot.protocol = protocol;
+  slot.serverFrame = serverFrame;
+  slot.connectionId = connectionId;
+  slot.size = std::min(size + size2, (size_t)UINT16_MAX);
+  uint8_t* frame = frames.data() + (number % slots.size()) * maxFrameSize;
+  size_t capturedSize = std::min(size, maxFrameSize);
+  memcpy(frame, data, capturedSize);
+  if (data2 && capturedSize < maxFrameSize)
+    memcpy(frame + capturedSize, data2, std::min(size2, maxFrameSize - capturedSize));
+
+  slot.sequence.store(number * 2 + 2, std::memory_order_release);
+}
+
+//==============================================================================
+
+void ModbusCapture::Read(std::vector<ModbusCaptureRecord>& records) {
+  records.clear();
+  uint32_t lastNumber = numberOfFrames.load(std::memory_order_acquire);
+  uint32_t firstNumber = (lastNumber > slots.size()) ? lastNumber - slots.size() : 0;
+  for (uint32_t number = firstNumber; number < lastNumber; number++) {
+    Slot& slot = slots[number % slots.size()];
+    uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence != number * 2 + 2)
+      continue;
+
+    ModbusCaptureRecord record;
+    record.number = number;
+    record.time = slot.time;
+    record.direction = slot.direction;
+    record.protocol = slot.protocol;
+    record.serverFrame = slot.serverFrame;
+    record.connectionId = slot.connectionId;
+    record.size = slot.size;
+    const uint8_t* frame = frames.data() + (number % slots.size()) * maxFrameSize;
+    record.data.assign(frame, frame + std::min((size_t)record.size, maxFrameSize));
+
+    // The slot has been overwritten during the copy.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) == sequence)
+      records.push_back(std::move(record));
+  }
+}
+
+//==============================================================================
+
+void ModbusCapture::Clear() {
+  numberOfFrames = 0;
+  numberOfDroppedFrames = 0;
+  for (auto& slot : slots) {
+    uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    // Slots that are being written are left to their writers (their number does not match the new numbering).
+    if (!(sequence & 1))
+      slot.sequence.compare_exchange_strong(sequence, 0, std::memory_order_relaxed);
+  }
+}
+
+//==============================================================================
+
+uint32_t ModbusCapture::GetNumberOfFrames() {
+  return numberOfFrames;
+}
+
+//==============================================================================
+
+uint32_t ModbusCapture::GetNumberOfDroppedFrames() {
+  return numberOfDroppedFrames;
+}
+
+//==============================================================================
+
+uint32_t ModbusCapture::CreateConnectionId() {
+  return lastConnectionId.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+//==============================================================================
+
+esp_err_t ModbusCapture::WritePcap(Stream& stream, ModbusCapturePcapFormat format) {
+  std::vector<ModbusCaptureRecord> records;
+  Read(records);
+
+  LockGuard lg(stream);
+  // Global header (native byte order, the magic number tells the readers the byte order)
+  uint32_t globalHeader[6] = {0xA1B2C3D4, 2 | (4 << 16), 0, 0, 65535, (format == ModbusCapturePcapFormat::user) ? pcapLinkTypeUser0 : pcapLinkTypeRaw};
+  ESP_RETURN_ON_ERROR(stream.Write(globalHeader, sizeof(globalHeader)), TAG, "stream write failed");
+
+  // Modbus TCP connection state of each connection ID
+  struct Connection {
+    uint16_t clientPort;
+    uint32_t clientSequence;
+    uint32_t serverSequence;
+    uint16_t transactionId;
+  };
+  std::map<uint32_t, Connection> connections;
+  std::vector<uint8_t> packet;
+
+  for (auto& record : records) {
+    const uint8_t* data = record.data.data();
+    size_t capturedSize = record.data.size();
+    size_t size = record.size;
+
+    if (format == ModbusCapturePcapFormat::user) {
+      // Header and the frame as on the wire
+      size_t wireSize = size, capturedWireSize = capturedSize;
+      if (record.protocol == ModbusProtocol::ascii) {
+        wireSize = size * 2 + 3;
+        capturedWireSize = capturedSize * 2 + 3;
+      }
+      packet.assign(8 + capturedWireSize, 0);
+      packet[0] = (uint8_t)record.direction;
+      packet[1] = (uint8_t)record.protocol;
+      packet[2] = record.serverFrame;
+      WriteUInt32(packet, 4, record.connectionId);
+      if (record.protocol == ModbusProtocol::ascii) {
+        memcpy(packet.data() + 8, data, capturedSize);
+        ModbusBase::EncodeAscii(packet.data() + 8, capturedSize);
+        packet[8] = ':';
+        packet[8 + capturedSize * 2 + 1] = '\r';
+        packet[8 + capturedSize * 2 + 2] = '\n';
+      }
+      else
+        memcpy(packet.data() + 8, data, capturedSize);
+      size = 8 + wireSize;
+    }
+
+    else {
+      auto connection = connections.find(record.connectionId);
+      if (connection == connections.end())
+        connection = connections.insert({record.connectionId, {(uint16_t)(firstClientPort + connections.size()), 1, 1, 0}}).first;
+      Connection& state = connection->second;
+
+      // Modbus TCP application data unit: MBAP header (the transaction ID of the request for the response) and protocol data unit
+      const uint8_t* pdu;
+      size_t pduSize, capturedPduSize;
+      uint8_t unitId = capturedSize ? data[0] : 0;
+      if (record.protocol == ModbusProtocol::tcp) {
+        if (!record.serverFrame && capturedSize >= 2)
+          state.transactionId = (data[0] << 8) | data[1];
+        unitId = (capturedSize >= 7) ? data[6] : 0;
+        pdu = data + std::min(capturedSize, (size_t)7);
+        pduSize = (size >= 7) ? size - 7 : 0;
+        capturedPduSize = (capturedSize >= 7) ? capturedSize - 7 : 0;
+      }
+      else {
+        if (!record.serverFrame)
+          state.transactionId++;
+        // RTU: station address and CRC, ASCII: station address and LRC
+        size_t checkSize = (record.protocol == ModbusProtocol::rtu) ? 2 : 1;
+        pdu = data + std::min(capturedSize, (size_t)1);
+        pduSize = (size >= checkSize + 1) ? size - checkSize - 1 : 0;
+        capturedPduSize = std::min(pduSize, (capturedSize >= 1) ? capturedSize - 1 : 0);
+      }
+
+      size_t headerSize = ipV4HeaderSize + tcpHeaderSize + 7;
+      packet.assign(headerSize + capturedPduSize, 0);
+      // IPv4 header
+      packet[0] = 0x45;
+      WriteUInt16(packet, 2, ipV4HeaderSize + tcpHeaderSize + 7 + pduSize);
+      WriteUInt16(packet, 4, record.number);
+      packet[6] = 0x40;
+      packet[8] = 64;
+      packet[9] = 6;
+      uint32_t serverAddress = 0x0A000001, clientAddress = 0x0A000002;
+      WriteUInt32(packet, 12, record.serverFrame ? serverAddress : clientAddress);
+      WriteUInt32(packet, 16, record.serverFrame ? clientAddress : serverAddress);
+      WriteUInt16(packet, 10, GetInternetChecksum(packet.data(), ipV4HeaderSize));
+      // TCP header
+      size_t tcp = ipV4HeaderSize;
+      WriteUInt16(packet, tcp + 0, record.serverFrame ? modbusTcpPort : state.clientPort);
+      WriteUInt16(packet, tcp + 2, record.serverFrame ? state.clientPort : modbusTcpPort);
+      WriteUInt32(packet, tcp + 4, record.serverFrame ? state.serverSequence : state.clientSequence);
+      WriteUInt32(packet, tcp + 8, record.serverFrame ? state.clientSequence : state.serverSequence);
+      packet[tcp + 12] = (tcpHeaderSize / 4) << 4;
+      packet[tcp + 13] = 0x18;
+      WriteUInt16(packet, tcp + 14, 0xFFFF);
+      // MBAP header
+      size_t mbap = tcp + tcpHeaderSize;
+      WriteUInt16(packet, mbap + 0, state.transactionId);
+      WriteUInt16(packet, mbap + 4, pduSize + 1);
+      packet[mbap + 6] = unitId;
+      memcpy(packet.data() + headerSize, pdu, capturedPduSize);
+
+      uint32_t tcpSize = tcpHeaderSize + 7 + pduSize;
+      (record.serverFrame ? state.serverSequence : state.clientSequence) += tcpSize - tcpHeaderSize;
+      // The TCP checksum is only valid for complete frames.
+      if (capturedPduSize == pduSize) {
+        uint32_t pseudoHeaderSum = (serverAddress >> 16) + (serverAddress & 0xFFFF) + (clientAddress >> 16) + (clientAddress & 0xFFFF) + 6 + tcpSize;
+        WriteUInt16(packet, tcp + 16, GetInternetChecksum(packet.data() + tcp, tcpSize, pseudoHeaderSum));
+      }
+      size = headerSize + pduSize;
+    }
+
+    uint32_t recordHeader[4] = {(uint32_t)(record.time / 1000000), (uint32_t)(record.time % 1000000), (uint32_t)packet.size(), (uint32_t)size};
+    ESP_RETURN_ON_ERROR(stream.Write(recordHeader, sizeof(recordHeader)), TAG, "stream write failed");
+    ESP_RETURN_ON_ERROR(stream.Write(packet.data(), packet.size()), TAG, "stream write failed");
+  }
+  return ESP_OK;
+}
+
+//==============================================================================
+
+}
@@ -1,5 +1,7 @@
 #include "pl_modbus_client.h"
 #include "esp_check.h"
+#include "esp_timer.h"
+#include "esp_random.h"
 
 //==============================================================================
 
@@ -7,38 +9,78 @@ static const char* TAG = "pl_modbus_client";
 
 //==============================================================================
 
+// Decodes 32-bit values from the Modbus data (little-endian host).
+// The word order is a template parameter so that each loop is a single branch-free swap of a 32-bit word.
+template <PL::ModbusWordOrder wordOrder>
+static void Decode32BitRegisterValues(const uint8_t* src, void* dest, size_t numberOfValues) {
+  for (size_t i = 0; i < numberOfValues; i++) {
+    uint32_t value;
+    memcpy(&value, src + i * 4, 4);
+    if constexpr (wordOrder == PL::ModbusWordOrder::abcd)
+      value = __builtin_bswap32(value);
+    else if constexpr (wordOrder == PL::ModbusWordOrder::cdab)
+      value = ((value & 0x00FF00FF) << 8) | ((value >> 8) & 0x00FF00FF);
+    else if constexpr (wordOrder == PL::ModbusWordOrder::badc)
+      value = (value << 16) | (value >> 16);
+    memcpy((uint8_t*)dest + i * 4, &value, 4);
+  }
+}
+
+//==============================================================================
+
 namespace PL {
 
 //==============================================================================
 
 ModbusClient::ModbusClient(std::shared_ptr<Stream> stream, ModbusProtocol protocol, uint8_t stationAddress, size_t bufferSize) :
-    ModbusBase(protocol, bufferSize, defaultReadTimeout, defaultWriteTimeout), interface(ModbusInterface::stream), stream(stream),
+    ModbusBase(ModbusInterface::stream, protocol, bufferSize, defaultReadTimeout, defaultWriteTimeout), stream(stream),
     stationAddress(stationAddress) {}
 
 //==============================================================================
 
 ModbusClient::ModbusClient(IpV4Address address, uint16_t port, size_t bufferSize) :
-    ModbusBase(defaultNetworkProtocol, bufferSize, defaultReadTimeout, defaultWriteTimeout), interface(ModbusInterface::network), tcpClient(std::make_shared<TcpClient>(address, port)),
-    stationAddress(defaultNetworkStationAddress) {
-  tcpClient->DisableNagleAlgorithm();
-}
+    ModbusClient(address, port, defaultNetworkProtocol, bufferSize) {}
 
 //==============================================================================
 
 ModbusClient::ModbusClient(IpV6Address address, uint16_t port, size_t bufferSize) :
-    ModbusBase(defaultNetworkProtocol, bufferSize, defaultReadTimeout, defaultWriteTimeout), interface(ModbusInterface::network), tcpClient(std::make_shared<TcpClient>(address, port)),
-    stationAddress(defaultNetworkStationAddress) {
-  tcpClient->DisableNagleAlgorithm();
-}
+    ModbusClient(address, port, defaultNetworkProtocol, bufferSize) {}
 
 //==============================================================================
 
 ModbusClient::ModbusClient(std::shared_ptr<TcpClient> tcpClient, size_t bufferSize) :
-    ModbusBase(defaultNetworkProtocol, bufferSize, defaultReadTimeout, defaultWriteTimeout), interface(ModbusInterface::network), tcpClient(tcpClient),
+    ModbusClient(tcpClient, defaultNetworkProtocol, bufferSize) {}
+
+//==============================================================================
+
+ModbusClient::ModbusClient(IpV4Address address, uint16_t port, ModbusProtocol protocol, size_t bufferSize) :
+    ModbusClient(std::make_shared<TcpClient>(address, port), protocol, bufferSize) {}
+
+//==============================================================================
+
+ModbusClient::ModbusClient(IpV6Address address, uint16_t port, ModbusProtocol protocol, size_t bufferSize) :
+    ModbusClient(std::make_shared<TcpClient>(address, port), protocol, bufferSize) {}
+
+//==============================================================================
+
+ModbusClient::ModbusClient(std::shared_ptr<TcpClient> tcpClient, ModbusProtocol protocol, size_t bufferSize) :
+    ModbusBase(ModbusInterface::network, protocol, bufferSize, defaultReadTimeout, defaultWriteTimeout), tcpClient(tcpClient),
     stationAddress(defaultNetworkStationAddress) {
   tcpClient->DisableNagleAlgorithm();
 }
 
+//==============================================================================
+
+ModbusClient::~ModbusClient() {
+  DisableConnectionManagement();
+#if CONFIG_PL_MODBUS_STATISTICS
+  for (StationStatisticsRecorder* station = stationStatistics; station;) {
+    StationStatisticsRecorder* next = station->next;
+    delete station;
+    station = next;
+  }
+#endif
+}
 
 //==============================================================================
 
@@ -59,7 +101,9 @@ esp_err_t ModbusClient::Unlock() {
 //==============================================================================
 
 esp_err_t ModbusClient::Command(ModbusFunctionCode functionCode, const void* requestData, size_t requestDataSize, void* responseData, size_t maxResponseDataSize, size_t* responseDataSize, ModbusException* exception) {
-  LockGuard lg(*this, (interface == ModbusInterface::stream ? (Lockable&)*stream : (Lockable&)*tcpClient));
+  // Checked before locking: the connection task holds the TCP client lock during the reconnection.
+  ESP_RETURN_ON_FALSE(!connectionLost, ESP_ERR_INVALID_STATE, TAG, "not connected");
+  LockGuard lg(*this, (GetInterface() == ModbusInterface::stream ? (Lockable&)*stream : (Lockable&)*tcpClient));
   Buffer& dataBuffer = GetDataBuffer();
 
   if (exception)
@@ -104,8 +148,45 @@ esp_err_t ModbusClient::ReadInputRegisters(uint16_t address, uint16_t numberOfIt
 
 //==============================================================================
 
+esp_err_t ModbusClient::ReadHoldingRegisters(uint16_t address, uint16_t numberOfValues, float* values, ModbusWordOrder wordOrder, ModbusException* exception) {
+  return Read32BitRegisterValues(ModbusFunctionCode::readHoldingRegisters, address, numberOfValues, values, wordOrder, exception);
+}
+
+//==============================================================================
+
+esp_err_t ModbusClient::ReadHoldingRegisters(uint16_t address, uint16_t numberOfValues, int32_t* values, ModbusWordOrder wordOrder, ModbusException* exception) {
+  return Read32BitRegisterValues(ModbusFunctionCode::readHoldingRegisters, address, numberOfValues, values, wordOrder, exception);
+}
+
+//==============================================================================
+
+esp_err_t ModbusClient::ReadHoldingRegisters(uint16_t address, uint16_t numberOfValues, uint32_t* values, ModbusWordOrder wordOrder, ModbusException* exception) {
+  return Read32BitRegisterValues(ModbusFunctionCode::readHoldingRegisters, address, numberOfValues, values, wordOrder, exception);
+}
+
+//==============================================================================
+
+esp_err_t ModbusClient::ReadInputRegisters(uint16_t address, uint16_t numberOfValues, float* values, ModbusWordOrder wordOrder, ModbusException* exception) {
+  return Read32BitRegisterValues(ModbusFunctionCode::readInputRegisters, address, numberOfValues, values, wordOrder, exception);
+}
+
+//==============================================================================
+
+esp_err_t ModbusClient::ReadInputRegisters(uint16_t address, uint16_t numberOfValues, int32_t* values, ModbusWordOrder wordOrder, ModbusException* exception) {
+  return Read32BitRegisterValues(ModbusFunctionCode::readInputRegisters, address, numberOfValues, values, wordOrder, exception);
+}
+
+//==============================================================================
+
+esp_err_t ModbusClient::ReadInputRegisters(uint16_t address, uint16_t numberOfValues, uint32_t* values, ModbusWordOrder wordOrder, ModbusException* exception) {
+  return Read32BitRegisterValues(ModbusFunctionCode::readInputRegisters, address, numberOfValues, values, wordOrder, exception);
+}
+
+//==============================================================================
+
 esp_err_t ModbusClient::WriteSingleCoil(uint16_t address, bool value, ModbusException* exception) {
-  LockGuard lg(*this, (interface == ModbusInterface::stream ? (Lockable&)*stream : (Lockable&)*tcpClient));
+  ESP_RETURN_ON_FALSE(!connectionLost, ESP_ERR_INVALID_STATE, TAG, "not connected");
+  LockGuard lg(*this, (GetInterface() == ModbusInterface::stream ? (Lockable&)*stream : (Lockable&)*tcpClient));
   Buffer& dataBuffer = GetDataBuffer();
 
   if (exception)
@@ -132,7 +213,8 @@ esp_err_t ModbusClient::WriteSingleCoil(uint16_t address, bool value, ModbusExce
 //==============================================================================
 
 esp_err_t ModbusClient::WriteSingleHoldingRegister(uint16_t address, uint16_t value, ModbusException* exception) {
-  LockGuard lg(*this, (interface == ModbusInterface::stream ? (Lockable&)*stream : (Lockable&)*tcpClient));
+  ESP_RETURN_ON_FALSE(!connectionLost, ESP_ERR_INVALID_STATE, TAG, "not connected");
+  LockGuard lg(*this, (GetInterface() == ModbusInterface::stream ? (Lockable&)*stream : (Lockable&)*tcpClient));
   Buffer& dataBuffer = GetDataBuffer();
 
   if (exception)
@@ -159,7 +241,8 @@ esp_err_t ModbusClient::WriteSingleHoldingRegister(uint16_t address, uint16_t va
 //==============================================================================
 
 esp_err_t ModbusClient::WriteMultipleCoils(uint16_t address, uint16_t numberOfItems, const void* requestData, ModbusException* exception) {
-  LockGuard lg(*this, (interface == ModbusInterface::stream ? (Lockable&)*stream : (Lockable&)*tcpClient));
+  ESP_RETURN_ON_FALSE(!connectionLost, ESP_ERR_INVALID_STATE, TAG, "not connected");
+  LockGuard lg(*this, (GetInterface() == ModbusInterface::stream ? (Lockable&)*stream : (Lockable&)*tcpClient));
   Buffer& dataBuffer = GetDataBuffer();
 
   if (exception)
@@ -195,7 +278,8 @@ esp_err_t ModbusClient::WriteMultipleCoils(uint16_t address, uint16_t numberOfIt
 //==============================================================================
 
 esp_err_t ModbusClient::WriteMultipleHoldingRegisters(uint16_t address, uint16_t numberOfItems, const void* requestData, ModbusException* exception) {
-  LockGuard lg(*this, (interface == ModbusInterface::stream ? (Lockable&)*stream : (Lockable&)*tcpClient));
+  ESP_RETURN_ON_FALSE(!connectionLost, ESP_ERR_INVALID_STATE, TAG, "not connected");
+  LockGuard lg(*this, (GetInterface() == ModbusInterface::stream ? (Lockable&)*stream : (Lockable&)*tcpClient));
   Buffer& dataBuffer = GetDataBuffer();
 
   if (exception)
@@ -213,14 +297,8 @@ esp_err_t ModbusClient::WriteMultipleHoldingRegisters(uint16_t address, uint16_t
     memcpy((uint8_t*)dataBuffer.data + 2, &(tempUInt16 = __builtin_bswap16(addressRange.numberOfItems)), 2);
     ((uint8_t*)dataBuffer.data)[4] = memoryDataSize;
 
-    if (requestData) {
-      for (uint_fast16_t i = 0; i < addressRange.numberOfItems; i++) {
-        uint16_t registerValue;
-        memcpy(&registerValue, (uint8_t*)requestData + (addressRange.address - address + i) * 2, 2);
-        registerValue = __builtin_bswap16(registerValue);
-        memcpy((uint8_t*)dataBuffer.data + 5 + i * 2, &registerValue, 2);
-      }
-    }
+    if (requestData)
+      CopySwappedRegisters((uint8_t*)requestData + (addressRange.address - address) * 2, (uint8_t*)dataBuffer.data + 5, addressRange.numberOfItems);
 
     size_t responseDataSize; 
     ESP_RETURN_ON_ERROR(Command(ModbusFunctionCode::writeMultipleHoldingRegisters, memoryDataSize + 5, responseDataSize, exception), TAG, "command failed");
@@ -237,6 +315,113 @@ esp_err_t ModbusClient::WriteMultipleHoldingRegisters(uint16_t address, uint16_t
 
 //==============================================================================
 
+esp_err_t ModbusClient::Subscribe(ModbusMemoryType memoryType, uint16_t address, uint16_t numberOfItems, uint16_t deadband, ChangeSubscription& subscription, ModbusException* exception) {
+  ESP_RETURN_ON_FALSE(!connectionLost, ESP_ERR_INVALID_STATE, TAG, "not connected");
+  LockGuard lg(*this, (GetInterface() == ModbusInterface::stream ? (Lockable&)*stream : (Lockable&)*tcpClient));
+  Buffer& dataBuffer = GetDataBuffer();
+
+  if (exception)
+    *exception = ModbusException::noException;
+  ESP_RETURN_ON_FALSE(stationAddress != 0, ESP_ERR_INVALID_ARG, TAG, "invalid station address");
+  ESP_RETURN_ON_FALSE(numberOfItems > 0, ESP_ERR_INVALID_ARG, TAG, "invalid number of items");
+  ESP_RETURN_ON_FALSE(dataBuffer.size >= 8, ESP_ERR_INVALID_SIZE, TAG, "buffer is too small");
+
+  uint8_t* data = (uint8_t*)dataBuffer.data;
+  data[0] = (uint8_t)ModbusChangeSubscriptionCommand::subscribe;
+  data[1] = (uint8_t)memoryType;
+  data[2] = address >> 8;
+  data[3] = address;
+  data[4] = numberOfItems >> 8;
+  data[5] = numberOfItems;
+  data[6] = deadband >> 8;
+  data[7] = deadband;
+  size_t responseDataSize;
+  ESP_RETURN_ON_ERROR(Command(ModbusFunctionCode::changeSubscription, 8, responseDataSize, exception), TAG, "command failed");
+  ESP_RETURN_ON_FALSE(responseDataSize == 2 && data[0] == (uint8_t)ModbusChangeSubscriptionCommand::subscribe && data[1] != 0, ESP_ERR_INVALID_RESPONSE, TAG, "invalid response");
+
+  subscription.id = data[1];
+  subscription.memoryType = memoryType;
+  subscription.address = address;
+  subscription.numberOfItems = numberOfItems;
+  subscription.sequence = 0;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t ModbusClient::ReadChanges(ChangeSubscription& subscription, void* data, std::vector<AddressRange>& changedRanges, bool& moreChanges, ModbusException* exception) {
+  ESP_RETURN_ON_FALSE(!connectionLost, ESP_ERR_INVALID_STATE, TAG, "not connected");
+  LockGuard lg(*this, (GetInterface() == ModbusInterface::stream ? (Lockable&)*stream : (Lockable&)*tcpClient));
+  Buffer& dataBuffer = GetDataBuffer();
+
+  if (exception)
+    *exception = ModbusException::noException;
+  changedRanges.clear();
+  moreChanges = false;
+  ESP_RETURN_ON_FALSE(stationAddress != 0, ESP_ERR_INVALID_ARG, TAG, "invalid station address");
+  ESP_RETURN_ON_FALSE(data, ESP_ERR_INVALID_ARG, TAG, "data is null");
+  ESP_RETURN_ON_FALSE(dataBuffer.size >= 5, ESP_ERR_INVALID_SIZE, TAG, "buffer is too small");
+
+  uint8_t* responseData = (uint8_t*)dataBuffer.data;
+  responseData[0] = (uint8_t)ModbusChangeSubscriptionCommand::readChanges;
+  responseData[1] = subscription.id;
+  responseData[2] = subscription.sequence;
+  size_t responseDataSize;
+  ESP_RETURN_ON_ERROR(Command(ModbusFunctionCode::changeSubscription, 3, responseDataSize, exception), TAG, "command failed");
+  ESP_RETURN_ON_FALSE(responseDataSize >= 5 && responseData[0] == (uint8_t)ModbusChangeSubscriptionCommand::readChanges && responseData[1] == subscription.id,
+                      ESP_ERR_INVALID_RESPONSE, TAG, "invalid response");
+  ESP_RETURN_ON_FALSE(responseData[4] == responseDataSize - 5, ESP_ERR_INVALID_RESPONSE, TAG, "invalid response byte size");
+
+  // Blocks are checked before any of them is applied, so an invalid response does not change the data.
+  bool bits = subscription.memoryType == ModbusMemoryType::coils || subscription.memoryType == ModbusMemoryType::discreteInputs;
+  for (int pass = 0; pass < 2; pass++) {
+    for (size_t offset = 5; offset < responseDataSize;) {
+      const uint8_t* block = responseData + offset;
+      ESP_RETURN_ON_FALSE(responseDataSize - offset >= 4, ESP_ERR_INVALID_RESPONSE, TAG, "invalid response block");
+      uint16_t address = (block[0] << 8) | block[1];
+      uint16_t numberOfItems = (block[2] << 8) | block[3];
+      size_t blockDataSize = bits ? (numberOfItems + 7) / 8 : numberOfItems * 2;
+      ESP_RETURN_ON_FALSE(numberOfItems > 0 && address >= subscription.address && address - subscription.address + numberOfItems <= subscription.numberOfItems &&
+                          responseDataSize - offset - 4 >= blockDataSize, ESP_ERR_INVALID_RESPONSE, TAG, "invalid response block");
+      if (pass) {
+        if (bits)
+          CopyBits(block + 4, 0, data, address - subscription.address, numberOfItems);
+        else
+          CopySwappedRegisters(block + 4, (uint16_t*)data + (address - subscription.address), numberOfItems);
+        changedRanges.push_back({address, numberOfItems});
+      }
+      offset += 4 + blockDataSize;
+    }
+  }
+
+  subscription.sequence = responseData[2];
+  moreChanges = responseData[3] & 1;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t ModbusClient::Unsubscribe(const ChangeSubscription& subscription, ModbusException* exception) {
+  ESP_RETURN_ON_FALSE(!connectionLost, ESP_ERR_INVALID_STATE, TAG, "not connected");
+  LockGuard lg(*this, (GetInterface() == ModbusInterface::stream ? (Lockable&)*stream : (Lockable&)*tcpClient));
+  Buffer& dataBuffer = GetDataBuffer();
+
+  if (exception)
+    *exception = ModbusException::noException;
+  ESP_RETURN_ON_FALSE(stationAddress != 0, ESP_ERR_INVALID_ARG, TAG, "invalid station address");
+  ESP_RETURN_ON_FALSE(dataBuffer.size >= 2, ESP_ERR_INVALID_SIZE, TAG, "buffer is too small");
+
+  uint8_t* data = (uint8_t*)dataBuffer.data;
+  data[0] = (uint8_t)ModbusChangeSubscriptionCommand::unsubscribe;
+  data[1] = subscription.id;
+  size_t responseDataSize;
+  ESP_RETURN_ON_ERROR(Command(ModbusFunctionCode::changeSubscription, 2, responseDataSize, exception), TAG, "command failed");
+  ESP_RETURN_ON_FALSE(responseDataSize == 2 && data[0] == (uint8_t)ModbusChangeSubscriptionCommand::unsubscribe && data[1] == subscription.id, ESP_ERR_INVALID_RESPONSE, TAG, "invalid response");
+  return ESP_OK;
+}
+
+//==============================================================================
+
 uint8_t ModbusClient::GetStationAddress() {
   LockGuard lg(*this);
   return stationAddress;
@@ -252,6 +437,146 @@ esp_err_t ModbusClient::SetStationAddress(uint8_t stationAddress) {
 
 //==============================================================================
 
+esp_err_t ModbusClient::SetStationPolicy(uint8_t stationAddress, const StationPolicy& policy) {
+  LockGuard lg(*this);
+  ESP_RETURN_ON_FALSE(stationAddress != 0, ESP_ERR_INVALID_ARG, TAG, "invalid station address");
+  Station* station = FindStation(stationAddress);
+  if (!station) {
+    stations.push_back({stationAddress});
+    station = &stations.back();
+  }
+  station->policy = policy;
+  station->state = {};
+  station->state.timeout = policy.maxTimeout ? policy.maxTimeout : GetReadTimeout();
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t ModbusClient::RemoveStationPolicy(uint8_t stationAddress) {
+  LockGuard lg(*this);
+  for (auto it = stations.begin(); it != stations.end(); it++) {
+    if (it->stationAddress == stationAddress) {
+      stations.erase(it);
+      break;
+    }
+  }
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t ModbusClient::GetStationState(uint8_t stationAddress, StationState& state) {
+  LockGuard lg(*this);
+  Station* station = FindStation(stationAddress);
+  ESP_RETURN_ON_FALSE(station, ESP_ERR_NOT_FOUND, TAG, "station %d has no policy", stationAddress);
+  state = station->state;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+bool ModbusClient::IsStationOffline(uint8_t stationAddress) {
+  LockGuard lg(*this);
+  Station* station = FindStation(stationAddress);
+  return station && station->state.offline;
+}
+
+//==============================================================================
+
+esp_err_t ModbusClient::ResetStationState(uint8_t stationAddress) {
+  LockGuard lg(*this);
+  Station* station = FindStation(stationAddress);
+  ESP_RETURN_ON_FALSE(station, ESP_ERR_NOT_FOUND, TAG, "station %d has no policy", stationAddress);
+  station->state = {};
+  station->state.timeout = station->policy.maxTimeout ? station->policy.maxTimeout : GetReadTimeout();
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t ModbusClient::EnableConnectionManagement(const TaskParameters& taskParameters, const ConnectionPolicy& policy) {
+  ESP_RETURN_ON_FALSE(GetInterface() == ModbusInterface::network, ESP_ERR_NOT_SUPPORTED, TAG, "connection management is not supported by the stream client");
+  ESP_RETURN_ON_ERROR(DisableConnectionManagement(), TAG, "disable connection management failed");
+  LockGuard lg(*this, *tcpClient);
+  if (policy.keepAliveIdleTime > 0) {
+    ESP_RETURN_ON_ERROR(tcpClient->EnableKeepAlive(), TAG, "enable keep-alive failed");
+    ESP_RETURN_ON_ERROR(tcpClient->SetKeepAliveIdleTime(policy.keepAliveIdleTime), TAG, "set keep-alive idle time failed");
+    ESP_RETURN_ON_ERROR(tcpClient->SetKeepAliveInterval(policy.keepAliveInterval), TAG, "set keep-alive interval failed");
+    ESP_RETURN_ON_ERROR(tcpClient->SetKeepAliveCount(policy.keepAliveCount), TAG, "set keep-alive count failed");
+  }
+  connectionPolicy = policy;
+  numberOfConnectionTimeouts = 0;
+  connectionLost = !tcpClient->IsConnected();
+  stopConnectionTask = false;
+  connectionTaskStopped = false;
+  ESP_RETURN_ON_FALSE(xTaskCreatePinnedToCore(ConnectionTask, "modbus_connection", taskParameters.stackDepth, this, taskParameters.priority, &connectionTask, taskParameters.coreId) == pdPASS,
+                      ESP_FAIL, TAG, "task creation failed");
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t ModbusClient::DisableConnectionManagement() {
+  LockGuard lg(*this);
+  if (!connectionTask)
+    return ESP_OK;
+  stopConnectionTask = true;
+  xTaskNotifyGive(connectionTask);
+  while (!connectionTaskStopped)
+    vTaskDelay(1);
+  connectionTask = NULL;
+  connectionLost = false;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+bool ModbusClient::IsConnected() {
+  if (GetInterface() == ModbusInterface::stream)
+    return true;
+  if (connectionTask)
+    return !connectionLost;
+  LockGuard lg(*tcpClient);
+  return tcpClient->IsConnected();
+}
+
+//==============================================================================
+
+esp_err_t ModbusClient::GetStatistics(ModbusClientStatistics& statistics) {
+#if CONFIG_PL_MODBUS_STATISTICS
+  this->statistics.Get(statistics);
+  return ESP_OK;
+#else
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+//==============================================================================
+
+esp_err_t ModbusClient::GetStatistics(uint8_t stationAddress, ModbusClientStatistics& statistics) {
+#if CONFIG_PL_MODBUS_STATISTICS
+  StationStatisticsRecorder* station = FindStationStatistics(stationAddress);
+  ESP_RETURN_ON_FALSE(station, ESP_ERR_NOT_FOUND, TAG, "no requests to station %d", stationAddress);
+  station->statistics.Get(statistics);
+  return ESP_OK;
+#else
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+//==============================================================================
+
+void ModbusClient::ResetStatistics() {
+#if CONFIG_PL_MODBUS_STATISTICS
+  statistics.Reset();
+  for (StationStatisticsRecorder* station = stationStatistics.load(std::memory_order_acquire); station; station = station->next.load(std::memory_order_acquire))
+    station->statistics.Reset();
+#endif
+}
+
+//==============================================================================
+
 esp_err_t ModbusClient::ReadRtuData(Stream& stream, ModbusFunctionCode functionCode, size_t& dataSize) {
   Buffer& dataBuffer = GetDataBuffer();
 
@@ -309,6 +634,26 @@ esp_err_t ModbusClient::ReadRtuData(Stream& stream, ModbusFunctionCode functionC
         return ESP_OK;
       }
       break;
+
+    case ModbusFunctionCode::changeSubscription: {
+      // Command and ID, followed by the sequence number, flags, byte count and changed blocks for the read changes command
+      dataSize = 2;
+      ESP_RETURN_ON_FALSE(dataBuffer.size >= 5, ESP_ERR_INVALID_SIZE, TAG, "buffer is too small");
+      ESP_RETURN_ON_ERROR(StreamRead(stream, dataBuffer, 0, 2), TAG, "read data failed");
+      if (((uint8_t*)dataBuffer.data)[0] != (uint8_t)ModbusChangeSubscriptionCommand::readChanges)
+        return ESP_OK;
+      ESP_RETURN_ON_ERROR(StreamRead(stream, dataBuffer, 2, 3), TAG, "read header failed");
+      dataSize = 5 + ((uint8_t*)dataBuffer.data)[4];
+      if (dataBuffer.size >= dataSize) {
+        ESP_RETURN_ON_ERROR(StreamRead(stream, dataBuffer, 5, dataSize - 5), TAG, "read data failed");
+        return ESP_OK;
+      }
+      else {
+        StreamRead(stream, NULL, dataSize - 5);
+        ESP_RETURN_ON_ERROR(ESP_ERR_INVALID_SIZE, TAG, "buffer is too small");
+        return ESP_OK;
+      }
+    }
             
     default:
       stream.FlushReadBuffer(2);
@@ -320,18 +665,96 @@ esp_err_t ModbusClient::ReadRtuData(Stream& stream, ModbusFunctionCode functionC
 //==============================================================================
 
 esp_err_t ModbusClient::Command(ModbusFunctionCode functionCode, size_t requestDataSize, size_t& responseDataSize, ModbusException* exception) {
-  if (interface == ModbusInterface::network) {
-    ESP_RETURN_ON_ERROR(tcpClient->Connect(), TAG, "TCP client connect failed");
+  Station* station = (stationAddress != 0) ? FindStation(stationAddress) : NULL;
+  if (!station)
+    return Transaction(functionCode, requestDataSize, responseDataSize, exception, GetReadTimeout());
+
+  StationPolicy& policy = station->policy;
+  StationState& state = station->state;
+  // Offline station: one probe transaction without retries per probe interval.
+  bool probe = state.offline;
+  ESP_RETURN_ON_FALSE(!probe || xTaskGetTickCount() - station->lastAttemptTime >= policy.offlineProbeInterval, ESP_ERR_INVALID_STATE, TAG, "station %d is offline", stationAddress);
+
+  uint8_t maxNumberOfRetries = probe ? 0 : policy.maxNumberOfRetries;
+  Buffer& dataBuffer = GetDataBuffer();
+  if (maxNumberOfRetries)
+    retryRequestData.assign((uint8_t*)dataBuffer.data, (uint8_t*)dataBuffer.data + requestDataSize);
+
+  for (uint8_t retry = 0;; retry++) {
+    if (retry) {
+      vTaskDelay(policy.retryDelay << std::min(retry - 1, 8));
+      memcpy(dataBuffer.data, retryRequestData.data(), requestDataSize);
+    }
+
+    ModbusException transactionException = ModbusException::noException;
+    station->lastAttemptTime = xTaskGetTickCount();
+    int64_t startTime = esp_timer_get_time();
+    esp_err_t error = Transaction(functionCode, requestDataSize, responseDataSize, &transactionException, policy.adaptiveTimeout ? state.timeout : GetReadTimeout());
+    if (exception)
+      *exception = transactionException;
+
+    // Any response (including an exception) means that the station is online.
+    if (error == ESP_OK || transactionException != ModbusException::noException) {
+      // The round-trip time of a retry is ambiguous (the response can be to the previous request), so it is not measured (Karn's algorithm).
+      if (!retry)
+        UpdateStationTimeout(*station, esp_timer_get_time() - startTime);
+      state.numberOfFailures = 0;
+      state.offline = false;
+      return error;
+    }
+
+    // A lost connection is not a station failure.
+    if (error == ESP_ERR_INVALID_STATE && connectionLost)
+      return error;
+    if (error == ESP_ERR_TIMEOUT)
+      UpdateStationTimeout(*station, -1);
+    if ((error != ESP_ERR_TIMEOUT && error != ESP_ERR_INVALID_CRC && error != ESP_ERR_INVALID_RESPONSE) || retry >= maxNumberOfRetries) {
+      if (state.numberOfFailures < UINT16_MAX)
+        state.numberOfFailures++;
+      if (policy.offlineThreshold && state.numberOfFailures >= policy.offlineThreshold)
+        state.offline = true;
+      return error;
+    }
+  }
+}
+
+//==============================================================================
+
+esp_err_t ModbusClient::Transaction(ModbusFunctionCode functionCode, size_t requestDataSize, size_t& responseDataSize, ModbusException* exception, TickType_t timeout) {
+  if (GetInterface() == ModbusInterface::network) {
+    // The connection task reconnects the TCP client in the background.
+    if (connectionTask) {
+      if (!connectionLost && !tcpClient->IsConnected())
+        CloseConnection();
+      ESP_RETURN_ON_FALSE(!connectionLost, ESP_ERR_INVALID_STATE, TAG, "not connected");
+    }
+    else {
+      bool isConnected = tcpClient->IsConnected();
+      ESP_RETURN_ON_ERROR(tcpClient->Connect(), TAG, "TCP client connect failed");
+      if (!isConnected) {
+        ResetCaptureConnectionId();
+#if CONFIG_PL_MODBUS_STATISTICS
+        RecordStatistics(&StatisticsRecorder::numberOfConnections);
+#endif
+      }
+    }
   }
   
-  Stream& stream = (interface == ModbusInterface::stream) ? *this->stream : (Stream&)*tcpClient->GetStream();
+  Stream& stream = (GetInterface() == ModbusInterface::stream) ? *this->stream : (Stream&)*tcpClient->GetStream();
 
   Buffer& dataBuffer = GetDataBuffer();
 
   StreamRead(stream, NULL, stream.GetReadableSize());
 
+  int64_t requestTime = esp_timer_get_time();
   transactionId++;
-  ESP_RETURN_ON_ERROR(WriteFrame(stream, stationAddress, functionCode, requestDataSize, transactionId), TAG, "write frame failed");
+  if (esp_err_t error = WriteFrame(stream, stationAddress, functionCode, requestDataSize, transactionId); error != ESP_OK) {
+    if (connectionTask && GetInterface() == ModbusInterface::network)
+      CloseConnection();
+    ESP_RETURN_ON_ERROR(error, TAG, "write frame failed");
+  }
+  RecordStatistics(&StatisticsRecorder::numberOfRequests);
+  RecordStatistics(&StatisticsRecorder::numberOfBytesSent, GetFrameSize(requestDataSize));
   if (stationAddress == 0)
     return ESP_OK;
 
@@ -340,29 +763,62 @@ esp_err_t ModbusClient::Command(ModbusFunctionCode functionCode, size_t requestD
   uint16_t responseTransactionId;
   TimeOut_t xTimeOut;
   vTaskSetTimeOutState(&xTimeOut);
-  TickType_t remainingTimeout = GetReadTimeout();
+  TickType_t remainingTimeout = timeout;
   do {
-    ESP_RETURN_ON_ERROR(ReadFrame(stream, responseStationAddress, responseFunctionCode, responseDataSize, responseTransactionId), TAG, "read frame failed");
+    esp_err_t error = ReadFrame(stream, responseStationAddress, responseFunctionCode, responseDataSize, responseTransactionId, timeout);
+    if (error != ESP_OK) {
+      RecordStatistics((error == ESP_ERR_TIMEOUT) ? &StatisticsRecorder::numberOfTimeouts :
+                       (error == ESP_ERR_INVALID_CRC) ? &StatisticsRecorder::numberOfCrcErrors : &StatisticsRecorder::numberOfInvalidResponses);
+      // A half-open connection (e.g. the server has restarted) only shows as response timeouts.
+      if (connectionTask && GetInterface() == ModbusInterface::network && error == ESP_ERR_TIMEOUT &&
+          connectionPolicy.maxNumberOfTimeouts && ++numberOfConnectionTimeouts >= connectionPolicy.maxNumberOfTimeouts)
+        CloseConnection();
+      ESP_RETURN_ON_ERROR(error, TAG, "read frame failed");
+    }
+    numberOfConnectionTimeouts = 0;
+    RecordStatistics(&StatisticsRecorder::numberOfBytesReceived, GetFrameSize(responseDataSize));
+    if (GetProtocol() == ModbusProtocol::tcp && responseTransactionId != transactionId)
+      RecordStatistics(&StatisticsRecorder::numberOfDiscardedResponses);
   } while (GetProtocol() == ModbusProtocol::tcp && responseTransactionId != transactionId && xTaskCheckForTimeOut(&xTimeOut, &remainingTimeout) == pdFALSE);
 
+  if (GetProtocol() == ModbusProtocol::tcp && responseTransactionId != transactionId)
+    RecordStatistics(&StatisticsRecorder::numberOfTimeouts);
   ESP_RETURN_ON_FALSE(GetProtocol() != ModbusProtocol::tcp || responseTransactionId == transactionId, ESP_ERR_TIMEOUT, TAG, "transaction id match timeout");
+  RecordRoundTripTime(esp_timer_get_time() - requestTime);
+
+  bool isException = (uint8_t)responseFunctionCode & 0x80;
+  if (responseStationAddress != stationAddress || (uint8_t)functionCode != ((uint8_t)responseFunctionCode & 0x7F) || (isException && responseDataSize != 1))
+    RecordStatistics(&StatisticsRecorder::numberOfInvalidResponses);
   ESP_RETURN_ON_FALSE(responseStationAddress == stationAddress, ESP_ERR_INVALID_RESPONSE, TAG, "invalid response station address");
   ESP_RETURN_ON_FALSE((uint8_t)functionCode == ((uint8_t)responseFunctionCode & 0x7F), ESP_ERR_INVALID_RESPONSE, TAG, "invalid response function code");
   
-  if ((uint8_t)responseFunctionCode & 0x80) {
+  if (isException) {
     ESP_RETURN_ON_FALSE(responseDataSize == 1, ESP_ERR_INVALID_RESPONSE, TAG, "invalid exception data size");
+    RecordException(*(uint8_t*)dataBuffer.data);
     if (exception)
       *exception = (ModbusException)(*(uint8_t*)dataBuffer.data);
     ESP_RETURN_ON_ERROR(ESP_FAIL, TAG, "Modbus exception (%d)", *(uint8_t*)dataBuffer.data);
   }
 
+  RecordStatistics(&StatisticsRecorder::numberOfResponses);
   return ESP_OK;
 }
 
 //==============================================================================
 
+void ModbusClient::CloseConnection() {
+  // Called under the client and TCP client locks.
+  tcpClient->Disconnect();
+  numberOfConnectionTimeouts = 0;
+  connectionLost = true;
+  xTaskNotifyGive(connectionTask);
+}
+
+//==============================================================================
+
 esp_err_t ModbusClient::ReadBits(ModbusFunctionCode functionCode, uint16_t address, uint16_t numberOfItems, void* responseData, ModbusException* exception) {
-  LockGuard lg(*this, (interface == ModbusInterface::stream ? (Lockable&)*stream : (Lockable&)*tcpClient));
+  ESP_RETURN_ON_FALSE(!connectionLost, ESP_ERR_INVALID_STATE, TAG, "not connected");
+  LockGuard lg(*this, (GetInterface() == ModbusInterface::stream ? (Lockable&)*stream : (Lockable&)*tcpClient));
   Buffer& dataBuffer = GetDataBuffer();
 
   if (exception)
@@ -390,7 +846,8 @@ esp_err_t ModbusClient::ReadBits(ModbusFunctionCode functionCode, uint16_t addre
 //==============================================================================
 
 esp_err_t ModbusClient::ReadRegisters(ModbusFunctionCode functionCode, uint16_t address, uint16_t numberOfItems, void* responseData, ModbusException* exception) {
-  LockGuard lg(*this, (interface == ModbusInterface::stream ? (Lockable&)*stream : (Lockable&)*tcpClient));
+  ESP_RETURN_ON_FALSE(!connectionLost, ESP_ERR_INVALID_STATE, TAG, "not connected");
+  LockGuard lg(*this, (GetInterface() == ModbusInterface::stream ? (Lockable&)*stream : (Lockable&)*tcpClient));
   Buffer& dataBuffer = GetDataBuffer();
 
   if (exception)
@@ -410,12 +867,50 @@ esp_err_t ModbusClient::ReadRegisters(ModbusFunctionCode functionCode, uint16_t
     ESP_RETURN_ON_FALSE(responseDataSize == memoryDataSize + 1, ESP_ERR_INVALID_RESPONSE, TAG, "invalid response data size");
     ESP_RETURN_ON_FALSE(((uint8_t*)dataBuffer.data)[0] == memoryDataSize, ESP_ERR_INVALID_RESPONSE, TAG, "invalid response byte size"); 
 
-    if (responseData) {
-      for (uint_fast16_t i = 0; i < addressRange.numberOfItems; i++) {
-        uint16_t registerValue;
-        memcpy(&registerValue, (uint8_t*)dataBuffer.data + 1 + i * 2, 2);
-        registerValue = __builtin_bswap16(registerValue);
-        memcpy((uint8_t*)responseData + (addressRange.address - address + i) * 2, &registerValue, 2);
+    if (responseData)
+      CopySwappedRegisters((uint8_t*)dataBuffer.data + 1, (uint8_t*)responseData + (addressRange.address - address) * 2, addressRange.numberOfItems);
+  }
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t ModbusClient::Read32BitRegisterValues(ModbusFunctionCode functionCode, uint16_t address, uint16_t numberOfValues, void* values, ModbusWordOrder wordOrder, ModbusException* exception) {
+  ESP_RETURN_ON_FALSE(!connectionLost, ESP_ERR_INVALID_STATE, TAG, "not connected");
+  LockGuard lg(*this, (GetInterface() == ModbusInterface::stream ? (Lockable&)*stream : (Lockable&)*tcpClient));
+  Buffer& dataBuffer = GetDataBuffer();
+
+  if (exception)
+    *exception = ModbusException::noException;
+  ESP_RETURN_ON_FALSE(stationAddress != 0, ESP_ERR_INVALID_ARG, TAG, "invalid station address");
+  ESP_RETURN_ON_FALSE(numberOfValues > 0, ESP_ERR_INVALID_ARG, TAG, "invalid number of values");
+  ESP_RETURN_ON_FALSE(numberOfValues * 2 <= 0x10000 - address, ESP_ERR_INVALID_ARG, TAG, "invalid number of values");
+  ESP_RETURN_ON_FALSE(dataBuffer.size >= 4, ESP_ERR_INVALID_SIZE, TAG, "buffer is too small");
+
+  // Requests are split on a value boundary so that values are decoded directly from the transaction buffer.
+  const uint16_t maxNumberOfValuesToRead = maxNumberOfModbusRegistersToRead / 2;
+  for (uint32_t valueIndex = 0; valueIndex < numberOfValues; valueIndex += maxNumberOfValuesToRead) {
+    uint16_t requestAddress = address + valueIndex * 2;
+    uint16_t requestNumberOfValues = std::min((uint32_t)maxNumberOfValuesToRead, numberOfValues - valueIndex);
+    uint16_t tempUInt16;
+    memcpy((uint8_t*)dataBuffer.data + 0, &(tempUInt16 = __builtin_bswap16(requestAddress)), 2);
+    memcpy((uint8_t*)dataBuffer.data + 2, &(tempUInt16 = __builtin_bswap16(requestNumberOfValues * 2)), 2);
+
+    size_t responseDataSize; 
+    size_t memoryDataSize = requestNumberOfValues * 4;
+    ESP_RETURN_ON_ERROR(Command(functionCode, 4, responseDataSize, exception), TAG, "command failed");
+    ESP_RETURN_ON_FALSE(responseDataSize == memoryDataSize + 1, ESP_ERR_INVALID_RESPONSE, TAG, "invalid response data size");
+    ESP_RETURN_ON_FALSE(((uint8_t*)dataBuffer.data)[0] == memoryDataSize, ESP_ERR_INVALID_RESPONSE, TAG, "invalid response byte size"); 
+
+    if (values) {
+      const uint8_t* src = (uint8_t*)dataBuffer.data + 1;
+      void* dest = (uint8_t*)values + valueIndex * 4;
+      switch (wordOrder) {
+        case ModbusWordOrder::abcd: Decode32BitRegisterValues<ModbusWordOrder::abcd>(src, dest, requestNumberOfValues); break;
+        case ModbusWordOrder::cdab: Decode32BitRegisterValues<ModbusWordOrder::cdab>(src, dest, requestNumberOfValues); break;
+        case ModbusWordOrder::badc: Decode32BitRegisterValues<ModbusWordOrder::badc>(src, dest, requestNumberOfValues); break;
+        case ModbusWordOrder::dcba: Decode32BitRegisterValues<ModbusWordOrder::dcba>(src, dest, requestNumberOfValues); break;
+        default: return ESP_ERR_INVALID_ARG;
       }
     }
   }
@@ -440,5 +935,180 @@ std::vector<ModbusClient::AddressRange> ModbusClient::SplitAddressRange(uint16_t
 }
 
 //==============================================================================
-  
+
+ModbusClient::Station* ModbusClient::FindStation(uint8_t stationAddress) {
+  for (auto& station : stations) {
+    if (station.stationAddress == stationAddress)
+      return &station;
+  }
+  return NULL;
+}
+
+//==============================================================================
+
+void ModbusClient::UpdateStationTimeout(Station& station, int64_t roundTripTime) {
+  StationState& state = station.state;
+  TickType_t maxTimeout = station.policy.maxTimeout ? station.policy.maxTimeout : GetReadTimeout();
+  TickType_t minTimeout = std::max(station.policy.minTimeout, (TickType_t)1);
+  const uint32_t tickPeriod = portTICK_PERIOD_MS * 1000;
+
+  if (roundTripTime >= 0) {
+    // RFC 6298 estimator
+    uint32_t time = std::min(roundTripTime, (int64_t)UINT32_MAX / 8);
+    if (!state.smoothedRoundTripTime) {
+      state.smoothedRoundTripTime = std::max(time, (uint32_t)1);
+      state.roundTripTimeVariation = time / 2;
+    }
+    else {
+      uint32_t difference = (state.smoothedRoundTripTime > time) ? (state.smoothedRoundTripTime - time) : (time - state.smoothedRoundTripTime);
+      state.roundTripTimeVariation = ((uint64_t)state.roundTripTimeVariation * 3 + difference) / 4;
+      state.smoothedRoundTripTime = std::max((uint32_t)(((uint64_t)state.smoothedRoundTripTime * 7 + time) / 8), (uint32_t)1);
+    }
+    uint64_t timeout = (uint64_t)state.smoothedRoundTripTime + std::max((uint64_t)tickPeriod, (uint64_t)state.roundTripTimeVariation * 4);
+    // Rounded up with one more tick: the wait starts at an arbitrary point of the current tick.
+    state.timeout = std::min((timeout + tickPeriod - 1) / tickPeriod + 1, (uint64_t)maxTimeout);
+  }
+  else {
+    // Timeout: exponential backoff until the next measurement
+    state.timeout = std::min((uint64_t)state.timeout * 2, (uint64_t)maxTimeout);
+  }
+  state.timeout = std::clamp(state.timeout, std::min(minTimeout, maxTimeout), maxTimeout);
+}
+
+//==============================================================================
+
+void ModbusClient::RecordStatistics(std::atomic<uint32_t> StatisticsRecorder::* counter, uint32_t value) {
+#if CONFIG_PL_MODBUS_STATISTICS
+  // Called by the transaction under the client lock: only the transaction adds the station statistics.
+  if (!lastStationStatistics || lastStationStatistics->stationAddress != stationAddress) {
+    if (!(lastStationStatistics = FindStationStatistics(stationAddress))) {
+      lastStationStatistics = new StationStatisticsRecorder();
+      lastStationStatistics->stationAddress = stationAddress;
+      lastStationStatistics->next.store(stationStatistics.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      stationStatistics.store(lastStationStatistics, std::memory_order_release);
+    }
+  }
+  (statistics.*counter).fetch_add(value, std::memory_order_relaxed);
+  (lastStationStatistics->statistics.*counter).fetch_add(value, std::memory_order_relaxed);
+#endif
+}
+
+//==============================================================================
+
+void ModbusClient::RecordException(uint8_t exception) {
+#if CONFIG_PL_MODBUS_STATISTICS
+  if (exception < modbusExceptionCounterSize) {
+    statistics.numberOfExceptions[exception].fetch_add(1, std::memory_order_relaxed);
+    if (lastStationStatistics)
+      lastStationStatistics->statistics.numberOfExceptions[exception].fetch_add(1, std::memory_order_relaxed);
+  }
+#endif
+}
+
+//==============================================================================
+
+void ModbusClient::RecordRoundTripTime(uint32_t time) {
+#if CONFIG_PL_MODBUS_STATISTICS
+  statistics.roundTripTime.Add(time);
+  if (lastStationStatistics)
+    lastStationStatistics->statistics.roundTripTime.Add(time);
+#endif
+}
+
+//==============================================================================
+
+ModbusClient::StationStatisticsRecorder* ModbusClient::FindStationStatistics(uint8_t stationAddress) {
+#if CONFIG_PL_MODBUS_STATISTICS
+  for (StationStatisticsRecorder* station = stationStatistics.load(std::memory_order_acquire); station; station = station->next.load(std::memory_order_acquire)) {
+    if (station->stationAddress == stationAddress)
+      return station;
+  }
+#endif
+  return NULL;
+}
+
+//==============================================================================
+
+void ModbusClient::StatisticsRecorder::Get(ModbusClientStatistics& statistics) const {
+  statistics.numberOfRequests = numberOfRequests.load(std::memory_order_relaxed);
+  statistics.numberOfResponses = numberOfResponses.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < modbusExceptionCounterSize; i++)
+    statistics.numberOfExceptions[i] = numberOfExceptions[i].load(std::memory_order_relaxed);
+  statistics.numberOfTimeouts = numberOfTimeouts.load(std::memory_order_relaxed);
+  statistics.numberOfCrcErrors = numberOfCrcErrors.load(std::memory_order_relaxed);
+  statistics.numberOfInvalidResponses = numberOfInvalidResponses.load(std::memory_order_relaxed);
+  statistics.numberOfDiscardedResponses = numberOfDiscardedResponses.load(std::memory_order_relaxed);
+  statistics.numberOfConnections = numberOfConnections.load(std::memory_order_relaxed);
+  statistics.numberOfBytesSent = numberOfBytesSent.load(std::memory_order_relaxed);
+  statistics.numberOfBytesReceived = numberOfBytesReceived.load(std::memory_order_relaxed);
+  roundTripTime.Get(statistics.roundTripTime);
+}
+
+//==============================================================================
+
+void ModbusClient::StatisticsRecorder::Reset() {
+  for (auto counter : {&numberOfRequests, &numberOfResponses, &numberOfTimeouts, &numberOfCrcErrors, &numberOfInvalidResponses,
+                       &numberOfDiscardedResponses, &numberOfConnections, &numberOfBytesSent, &numberOfBytesReceived})
+    counter->store(0, std::memory_order_relaxed);
+  for (auto& counter : numberOfExceptions)
+    counter.store(0, std::memory_order_relaxed);
+  roundTripTime.Reset();
+}
+
+//==============================================================================
+
+//==============================================================================
+
+void ModbusClient::ConnectionTask(void* parameters) {
+  ModbusClient& client = *(ModbusClient*)parameters;
+  const TickType_t minReconnectDelay = std::max(client.connectionPolicy.minReconnectDelay, (TickType_t)1);
+  const TickType_t maxReconnectDelay = std::max(client.connectionPolicy.maxReconnectDelay, minReconnectDelay);
+  const TickType_t idleCheckInterval = client.connectionPolicy.idleCheckInterval;
+  // The first attempt after the start is not delayed.
+  TickType_t reconnectDelay = 0;
+
+  while (!client.stopConnectionTask) {
+    if (!client.connectionLost) {
+      reconnectDelay = minReconnectDelay;
+      ulTaskNotifyTake(pdTRUE, idleCheckInterval ? idleCheckInterval : portMAX_DELAY);
+      // Idle check (the TCP client is not locked if a request is in progress: the request checks the connection itself).
+      if (!client.stopConnectionTask && !client.connectionLost && client.tcpClient->Lock(0) == ESP_OK) {
+        if (!client.tcpClient->IsConnected()) {
+          client.tcpClient->Disconnect();
+          client.connectionLost = true;
+        }
+        client.tcpClient->Unlock();
+      }
+      continue;
+    }
+
+    // Random delay between a half and the whole backoff delay, so that the clients of a restarted server do not reconnect at once.
+    if (reconnectDelay)
+      ulTaskNotifyTake(pdTRUE, reconnectDelay / 2 + esp_random() % (reconnectDelay - reconnectDelay / 2 + 1));
+    if (client.stopConnectionTask)
+      break;
+
+    client.tcpClient->Lock();
+    // The TCP client can be shared and reconnected by another Modbus client.
+    bool isConnected = client.tcpClient->IsConnected();
+    if (!isConnected && client.tcpClient->Connect() == ESP_OK) {
+      isConnected = true;
+      client.ResetCaptureConnectionId();
+#if CONFIG_PL_MODBUS_STATISTICS
+      client.statistics.numberOfConnections.fetch_add(1, std::memory_order_relaxed);
+#endif
+    }
+    if (isConnected)
+      client.connectionLost = false;
+    else
+      reconnectDelay = reconnectDelay ? std::min(reconnectDelay * 2, maxReconnectDelay) : minReconnectDelay;
+    client.tcpClient->Unlock();
+  }
+
+  client.connectionTaskStopped = true;
+  vTaskDelete(NULL);
+}
+
+//==============================================================================
+
 }
\ No newline at end of file
@@ -0,0 +1,188 @@
+#include "pl_modbus_concentrator_memory_area.h"
+#include "esp_check.h"
+#include "string.h"
+
+//==============================================================================
+
+static const char* TAG = "pl_modbus_concentrator_memory_area";
+
+//==============================================================================
+
+namespace PL {
+
+//==============================================================================
+
+ModbusConcentratorMemoryArea::ModbusConcentratorMemoryArea(ModbusMemoryType type, uint16_t address, size_t size, std::shared_ptr<ModbusClient> client, uint8_t stationAddress) :
+  ModbusConcentratorMemoryArea(type, address, size, client, stationAddress, address) {}
+
+//==============================================================================
+
+ModbusConcentratorMemoryArea::ModbusConcentratorMemoryArea(ModbusMemoryType type, uint16_t address, size_t size, std::shared_ptr<ModbusClient> client, uint8_t stationAddress, uint16_t downstreamAddress) :
+  ModbusRefreshedMemoryArea(type, address, size), client(client), stationAddress(stationAddress), downstreamAddress(downstreamAddress), backup(size) {}
+
+//==============================================================================
+
+ModbusConcentratorMemoryArea::~ModbusConcentratorMemoryArea() {
+  DisableRefresh();
+}
+
+//==============================================================================
+
+esp_err_t ModbusConcentratorMemoryArea::Lock(TickType_t timeout) {
+  ESP_RETURN_ON_ERROR(ModbusRefreshedMemoryArea::Lock(timeout), TAG, "lock failed");
+  // Written items are restored from the backup if the downstream station does not accept them.
+  memcpy(backup.data, data, size);
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t ModbusConcentratorMemoryArea::OnRead(uint16_t address, uint16_t numberOfItems) {
+  if (maxAge || qualityMemoryArea) {
+    bool stale = IsStale();
+    if (stale && staleDataAction == ModbusStaleDataAction::exception)
+      return ESP_ERR_TIMEOUT;
+    UpdateQualityFlag(!stale);
+  }
+  return ModbusRefreshedMemoryArea::OnRead(address, numberOfItems);
+}
+
+//==============================================================================
+
+esp_err_t ModbusConcentratorMemoryArea::OnWrite(uint16_t address, uint16_t numberOfItems) {
+  // The memory area is locked by the server, so the written items can be sent from the memory area data.
+  // The lock is held during the downstream transaction: read requests to the memory area wait for it (up to the client read timeout).
+  size_t offset = address - this->address;
+  ModbusException exception = ModbusException::noException;
+  esp_err_t error;
+  {
+    LockGuard lg(*client);
+    uint8_t clientStationAddress = client->GetStationAddress();
+    client->SetStationAddress(stationAddress);
+    uint16_t writeAddress = downstreamAddress + offset;
+    if (type == ModbusMemoryType::coils) {
+      if (numberOfItems == 1)
+        error = client->WriteSingleCoil(writeAddress, (((uint8_t*)data)[offset / 8] >> (offset % 8)) & 1, &exception);
+      else {
+        uint8_t values[(ModbusBase::maxNumberOfModbusBitsToWrite + 7) / 8] = {};
+        ModbusBase::CopyBits(data, offset, values, 0, numberOfItems);
+        error = client->WriteMultipleCoils(writeAddress, numberOfItems, values, &exception);
+      }
+    }
+    else {
+      if (numberOfItems == 1)
+        error = client->WriteSingleHoldingRegister(writeAddress, ((uint16_t*)data)[offset], &exception);
+      else
+        error = client->WriteMultipleHoldingRegisters(writeAddress, numberOfItems, (uint16_t*)data + offset, &exception);
+    }
+    client->SetStationAddress(clientStationAddress);
+  }
+
+  // A refresh in progress could have read the items before the write and would overwrite them with the old values.
+  RequestRefresh();
+  if (error != ESP_OK) {
+    numberOfWriteErrors++;
+    if (type == ModbusMemoryType::coils)
+      ModbusBase::CopyBits(backup.data, offset, data, offset, numberOfItems);
+    else
+      memcpy((uint16_t*)data + offset, (uint16_t*)backup.data + offset, numberOfItems * 2);
+    // Requests without a valid downstream response (timeout, offline station) are answered with the gateway exception.
+    ESP_RETURN_ON_FALSE(exception != ModbusException::noException, ESP_ERR_TIMEOUT, TAG, "write-through failed");
+    ESP_RETURN_ON_ERROR(ExceptionError(exception), TAG, "write-through exception (%d)", (int)exception);
+  }
+  return ModbusRefreshedMemoryArea::OnWrite(address, numberOfItems);
+}
+
+//==============================================================================
+
+bool ModbusConcentratorMemoryArea::IsOnWriteDeferrable() {
+  // The write-through result is the response to the client and the backup of the written items is made when the server locks the memory area.
+  return false;
+}
+
+//==============================================================================
+
+esp_err_t ModbusConcentratorMemoryArea::SetStaleDataLimit(TickType_t maxAge, ModbusStaleDataAction action) {
+  this->maxAge = maxAge;
+  staleDataAction = action;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t ModbusConcentratorMemoryArea::SetQualityFlag(std::shared_ptr<ModbusMemoryArea> qualityMemoryArea, uint16_t qualityAddress) {
+  ESP_RETURN_ON_FALSE(qualityMemoryArea, ESP_ERR_INVALID_ARG, TAG, "quality memory area is null");
+  ESP_RETURN_ON_FALSE(qualityAddress >= qualityMemoryArea->address && qualityAddress < qualityMemoryArea->address + qualityMemoryArea->numberOfItems,
+                      ESP_ERR_INVALID_ARG, TAG, "invalid quality address");
+  this->qualityMemoryArea = qualityMemoryArea;
+  this->qualityAddress = qualityAddress;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+bool ModbusConcentratorMemoryArea::IsStale() {
+  int64_t age = GetRefreshAge();
+  TickType_t maxAge = this->maxAge;
+  return age < 0 || (maxAge && age > (int64_t)maxAge * portTICK_PERIOD_MS * 1000);
+}
+
+//==============================================================================
+
+uint32_t ModbusConcentratorMemoryArea::GetNumberOfWriteErrors() {
+  return numberOfWriteErrors;
+}
+
+//==============================================================================
+
+esp_err_t ModbusConcentratorMemoryArea::OnRefresh(void* snapshot) {
+  esp_err_t error;
+  {
+    LockGuard lg(*client);
+    uint8_t clientStationAddress = client->GetStationAddress();
+    client->SetStationAddress(stationAddress);
+    switch (type) {
+      case ModbusMemoryType::coils:
+        error = client->ReadCoils(downstreamAddress, numberOfItems, snapshot, NULL);
+        break;
+      case ModbusMemoryType::discreteInputs:
+        error = client->ReadDiscreteInputs(downstreamAddress, numberOfItems, snapshot, NULL);
+        break;
+      case ModbusMemoryType::holdingRegisters:
+        error = client->ReadHoldingRegisters(downstreamAddress, numberOfItems, snapshot, NULL);
+        break;
+      default:
+        error = client->ReadInputRegisters(downstreamAddress, numberOfItems, snapshot, NULL);
+        break;
+    }
+    client->SetStationAddress(clientStationAddress);
+  }
+
+  // The refresh time of a successful refresh is updated after this method returns.
+  UpdateQualityFlag(error == ESP_OK || !IsStale());
+  return error;
+}
+
+//==============================================================================
+
+void ModbusConcentratorMemoryArea::UpdateQualityFlag(bool valid) {
+  if (!qualityMemoryArea)
+    return;
+  ModbusMemoryArea& memoryArea = *qualityMemoryArea;
+  size_t offset = qualityAddress - memoryArea.address;
+  bool bits = memoryArea.type == ModbusMemoryType::coils || memoryArea.type == ModbusMemoryType::discreteInputs;
+  // The flag is locked and written only when it changes: locking a sequence lock memory area makes its readers (e.g. the request being answered) retry.
+  if ((bits ? ((((uint8_t*)memoryArea.data)[offset / 8] >> (offset % 8)) & 1) : ((uint16_t*)memoryArea.data)[offset]) == valid)
+    return;
+  LockGuard lg(memoryArea);
+  if (bits) {
+    uint8_t value = valid;
+    ModbusBase::CopyBits(&value, 0, memoryArea.data, offset, 1);
+  }
+  else
+    ((uint16_t*)memoryArea.data)[offset] = valid;
+}
+
+//==============================================================================
+
+}
\ No newline at end of file
@@ -36,6 +36,38 @@ esp_err_t ModbusMemoryArea::OnWrite() {
 
 //==============================================================================
 
+esp_err_t ModbusMemoryArea::OnRead(uint16_t address, uint16_t numberOfItems) {
+  return OnRead();
+}
+
+//==============================================================================
+
+esp_err_t ModbusMemoryArea::OnWrite(uint16_t address, uint16_t numberOfItems) {
+  return OnWrite();
+}
+
+//==============================================================================
+
+bool ModbusMemoryArea::IsOnWriteDeferrable() {
+  return true;
+}
+
+//==============================================================================
+
+esp_err_t ModbusMemoryArea::BeginRead(uint32_t& sequence) {
+  sequence = 0;
+  return Lock();
+}
+
+//==============================================================================
+
+bool ModbusMemoryArea::EndRead(uint32_t sequence) {
+  Unlock();
+  return true;
+}
+
+//==============================================================================
+
 size_t ModbusMemoryArea::GetNumberOfItems() {
   if (type == ModbusMemoryType::coils || type == ModbusMemoryType::discreteInputs)
     return std::min(size * 8, (size_t)(0xFFFF - address) + 1);
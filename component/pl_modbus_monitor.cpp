@@ -0,0 +1,396 @@
+#include "pl_modbus_monitor.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "string.h"
+#include <algorithm>
+
+//==============================================================================
+
+static const char* TAG = "pl_modbus_monitor";
+
+//==============================================================================
+
+namespace PL {
+
+//==============================================================================
+
+const std::string ModbusMonitor::defaultName = "Modbus Monitor";
+
+//==============================================================================
+
+ModbusMonitor::ModbusMonitor(std::shared_ptr<Stream> stream, size_t bufferSize, size_t logSize) :
+    ModbusBase(ModbusInterface::stream, ModbusProtocol::rtu, bufferSize, defaultReadTimeout, 0), streamServer(std::make_shared<StreamServer>(stream, *this)),
+    log(logSize) {
+  SetName(defaultName);
+}
+
+//==============================================================================
+
+ModbusMonitor::~ModbusMonitor() {
+  Disable();
+}
+
+//==============================================================================
+
+esp_err_t ModbusMonitor::Lock(TickType_t timeout) {
+  return streamServer->Lock(timeout);
+}
+
+//==============================================================================
+
+esp_err_t ModbusMonitor::Unlock() {
+  return streamServer->Unlock();
+}
+
+//==============================================================================
+
+esp_err_t ModbusMonitor::Enable() {
+  return streamServer->Enable();
+}
+
+//==============================================================================
+
+esp_err_t ModbusMonitor::Disable() {
+  return streamServer->Disable();
+}
+
+//==============================================================================
+
+bool ModbusMonitor::IsEnabled() {
+  return streamServer->IsEnabled();
+}
+
+//==============================================================================
+
+esp_err_t ModbusMonitor::SetProtocol(ModbusProtocol protocol) {
+  ESP_RETURN_ON_FALSE(protocol == ModbusProtocol::rtu, ESP_ERR_NOT_SUPPORTED, TAG, "only RTU protocol is supported");
+  return ModbusBase::SetProtocol(protocol);
+}
+
+//==============================================================================
+
+esp_err_t ModbusMonitor::SetTaskParameters(const TaskParameters& taskParameters) {
+  return streamServer->SetTaskParameters(taskParameters);
+}
+
+//==============================================================================
+
+TickType_t ModbusMonitor::GetResponseTimeout() {
+  LockGuard lg(*this);
+  return responseTimeout;
+}
+
+//==============================================================================
+
+esp_err_t ModbusMonitor::SetResponseTimeout(TickType_t timeout) {
+  LockGuard lg(*this);
+  responseTimeout = timeout;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+void ModbusMonitor::GetStatistics(ModbusMonitorStatistics& statistics) {
+  LockGuard lg(statisticsMutex);
+  statistics = this->statistics;
+}
+
+//==============================================================================
+
+void ModbusMonitor::GetStationAddresses(std::vector<uint8_t>& stationAddresses) {
+  LockGuard lg(statisticsMutex);
+  stationAddresses.clear();
+  for (int i = 1; i < 256; i++) {
+    if (stationStatisticsIndexes[i])
+      stationAddresses.push_back(i);
+  }
+}
+
+//==============================================================================
+
+esp_err_t ModbusMonitor::GetStationStatistics(uint8_t stationAddress, ModbusMonitorStationStatistics& statistics) {
+  LockGuard lg(statisticsMutex);
+  ESP_RETURN_ON_FALSE(stationStatisticsIndexes[stationAddress], ESP_ERR_NOT_FOUND, TAG, "station has not been addressed");
+  statistics = stationStatistics[stationStatisticsIndexes[stationAddress] - 1];
+  return ESP_OK;
+}
+
+//==============================================================================
+
+void ModbusMonitor::ResetStatistics() {
+  LockGuard lg(statisticsMutex);
+  statistics = {};
+  stationStatistics.clear();
+  memset(stationStatisticsIndexes, 0, sizeof(stationStatisticsIndexes));
+  logSize = 0;
+  logIndex = 0;
+}
+
+//==============================================================================
+
+void ModbusMonitor::GetLog(std::vector<ModbusMonitorTransaction>& transactions) {
+  LockGuard lg(statisticsMutex);
+  transactions.clear();
+  for (size_t i = 0; i < logSize; i++)
+    transactions.push_back(log[(logIndex + log.size() - logSize + i) % log.size()]);
+}
+
+//==============================================================================
+
+esp_err_t ModbusMonitor::StreamRead(Stream& stream, void* dest, size_t size) {
+  // Reads all the data that is already received in one call and waits for the next byte with the inter-character read timeout.
+  while (size) {
+    size_t readSize = std::clamp(stream.GetReadableSize(), (size_t)1, size);
+    ESP_RETURN_ON_ERROR(stream.Read(dest, readSize), TAG, "stream read failed");
+    if (dest)
+      dest = (uint8_t*)dest + readSize;
+    size -= readSize;
+  }
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t ModbusMonitor::StreamRead(Stream& stream, Buffer& dest, size_t offset, size_t size) {
+  while (size) {
+    size_t readSize = std::clamp(stream.GetReadableSize(), (size_t)1, size);
+    ESP_RETURN_ON_ERROR(stream.Read(dest, offset, readSize), TAG, "stream read failed");
+    offset += readSize;
+    size -= readSize;
+  }
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t ModbusMonitor::ReadRtuData(Stream& stream, ModbusFunctionCode functionCode, size_t& dataSize) {
+  Buffer& dataBuffer = GetDataBuffer();
+
+  // A frame from the station addressed by the pending request with its function code (or exception code) is the response.
+  frameIsResponse = pendingRequest.active && frameStationAddress == pendingRequest.transaction.stationAddress &&
+    ((uint8_t)functionCode & 0x7F) == (uint8_t)pendingRequest.transaction.functionCode &&
+    esp_timer_get_time() - pendingRequest.transaction.time <= (int64_t)responseTimeout * portTICK_PERIOD_MS * 1000;
+
+  // Fixed part of the data and the index of the byte count of the variable part
+  size_t headerSize = 0;
+  size_t byteCountIndex = SIZE_MAX;
+  if (frameIsResponse) {
+    if ((uint8_t)functionCode & 0x80)
+      headerSize = 1;
+    else {
+      switch (functionCode) {
+        case ModbusFunctionCode::readCoils:
+        case ModbusFunctionCode::readDiscreteInputs:
+        case ModbusFunctionCode::readHoldingRegisters:
+        case ModbusFunctionCode::readInputRegisters:
+          headerSize = 1;
+          byteCountIndex = 0;
+          break;
+        case ModbusFunctionCode::writeSingleCoil:
+        case ModbusFunctionCode::writeSingleHoldingRegister:
+        case ModbusFunctionCode::writeMultipleCoils:
+        case ModbusFunctionCode::writeMultipleHoldingRegisters:
+          headerSize = 4;
+          break;
+        default:
+          break;
+      }
+    }
+  }
+  else {
+    switch (functionCode) {
+      case ModbusFunctionCode::readCoils:
+      case ModbusFunctionCode::readDiscreteInputs:
+      case ModbusFunctionCode::readHoldingRegisters:
+      case ModbusFunctionCode::readInputRegisters:
+      case ModbusFunctionCode::writeSingleCoil:
+      case ModbusFunctionCode::writeSingleHoldingRegister:
+        headerSize = 4;
+        break;
+      case ModbusFunctionCode::writeMultipleCoils:
+      case ModbusFunctionCode::writeMultipleHoldingRegisters:
+        headerSize = 5;
+        byteCountIndex = 4;
+        break;
+      default:
+        break;
+    }
+  }
+  ESP_RETURN_ON_FALSE(headerSize, ESP_ERR_NOT_SUPPORTED, TAG, "function code (%d) is not supported", (int)functionCode);
+
+  // The rest of an invalid frame is skipped by the monitor task.
+  dataSize = headerSize;
+  ESP_RETURN_ON_FALSE(dataBuffer.size >= dataSize, ESP_ERR_INVALID_SIZE, TAG, "buffer is too small");
+  ESP_RETURN_ON_ERROR(StreamRead(stream, dataBuffer, 0, headerSize), TAG, "read header failed");
+  if (byteCountIndex != SIZE_MAX)
+    dataSize += ((uint8_t*)dataBuffer.data)[byteCountIndex];
+  ESP_RETURN_ON_FALSE(dataBuffer.size >= dataSize, ESP_ERR_INVALID_SIZE, TAG, "buffer is too small");
+  ESP_RETURN_ON_ERROR(StreamRead(stream, dataBuffer, headerSize, dataSize - headerSize), TAG, "read data failed");
+  return ESP_OK;
+}
+
+//==============================================================================
+
+bool ModbusMonitor::IsForeignRtuFrame(uint8_t stationAddress) {
+  // All frames are monitored. The station address is used by ReadRtuData to tell the responses from the requests.
+  frameStationAddress = stationAddress;
+  return false;
+}
+
+//==============================================================================
+
+bool ModbusMonitor::IsServerFrame(ModbusCaptureDirection direction) {
+  return frameIsResponse;
+}
+
+//==============================================================================
+
+esp_err_t ModbusMonitor::HandleRequest(Stream& stream) {
+  // Every frame is handled (the server skips to the last received frame, the monitor must not lose the pairs).
+  do {
+    uint8_t stationAddress;
+    ModbusFunctionCode functionCode;
+    size_t dataSize;
+    uint16_t transactionId;
+    esp_err_t error = ReadFrame(stream, stationAddress, functionCode, dataSize, transactionId);
+    int64_t time = esp_timer_get_time();
+
+    if (error == ESP_OK)
+      HandleFrame(stationAddress, functionCode, dataSize, time);
+    else {
+      {
+        LockGuard lg(statisticsMutex);
+        if (error == ESP_ERR_INVALID_CRC)
+          statistics.numberOfCrcErrors++;
+        else
+          statistics.numberOfFrameErrors++;
+      }
+      // The frame format is unknown after an error: the next frame starts after the line is idle.
+      SkipToIdleLine(stream);
+    }
+  } while (stream.GetReadableSize());
+  return ESP_OK;
+}
+
+//==============================================================================
+
+void ModbusMonitor::HandleFrame(uint8_t stationAddress, ModbusFunctionCode functionCode, size_t dataSize, int64_t time) {
+  uint8_t* data = (uint8_t*)GetDataBuffer().data;
+  LockGuard lg(statisticsMutex);
+  statistics.numberOfFrames++;
+  statistics.numberOfBytes += GetFrameSize(dataSize);
+
+  if (frameIsResponse) {
+    ModbusMonitorTransaction& transaction = pendingRequest.transaction;
+    pendingRequest.active = false;
+    transaction.responseTime = time - transaction.time;
+    if ((uint8_t)functionCode & 0x80) {
+      transaction.status = ModbusMonitorTransactionStatus::exception;
+      transaction.exception = (ModbusException)data[0];
+    }
+    else
+      transaction.status = ModbusMonitorTransactionStatus::response;
+    CompleteTransaction(transaction);
+    return;
+  }
+
+  // Request: the previous request has not been answered.
+  if (pendingRequest.active) {
+    pendingRequest.active = false;
+    pendingRequest.transaction.status = ModbusMonitorTransactionStatus::timeout;
+    CompleteTransaction(pendingRequest.transaction);
+  }
+
+  ModbusMonitorTransaction transaction = {time, stationAddress, functionCode, ModbusMonitorTransactionStatus::timeout, ModbusException::noException, 0, 0, 0};
+  transaction.address = (data[0] << 8) | data[1];
+  switch (functionCode) {
+    case ModbusFunctionCode::writeSingleCoil:
+    case ModbusFunctionCode::writeSingleHoldingRegister:
+      transaction.numberOfItems = 1;
+      break;
+    default:
+      transaction.numberOfItems = (data[2] << 8) | data[3];
+      break;
+  }
+  statistics.numberOfRequests++;
+
+  if (stationAddress == 0) {
+    transaction.status = ModbusMonitorTransactionStatus::broadcast;
+    CompleteTransaction(transaction);
+    return;
+  }
+  GetStationStatisticsRecord(stationAddress).numberOfRequests++;
+  pendingRequest = {true, transaction};
+}
+
+//==============================================================================
+
+void ModbusMonitor::CompleteTransaction(ModbusMonitorTransaction& transaction) {
+  switch (transaction.status) {
+    case ModbusMonitorTransactionStatus::broadcast:
+      statistics.numberOfBroadcasts++;
+      break;
+
+    case ModbusMonitorTransactionStatus::timeout:
+      statistics.numberOfTimeouts++;
+      GetStationStatisticsRecord(transaction.stationAddress).numberOfTimeouts++;
+      break;
+
+    case ModbusMonitorTransactionStatus::response:
+    case ModbusMonitorTransactionStatus::exception: {
+      auto& stationStatistics = GetStationStatisticsRecord(transaction.stationAddress);
+      statistics.numberOfResponses++;
+      stationStatistics.numberOfResponses++;
+      if (transaction.status == ModbusMonitorTransactionStatus::exception && (size_t)transaction.exception < modbusExceptionCounterSize)
+        stationStatistics.numberOfExceptions[(size_t)transaction.exception]++;
+      ModbusLatencyHistogram& responseTime = stationStatistics.responseTime;
+      responseTime.counts[ModbusLatencyHistogram::GetBucketIndex(transaction.responseTime)]++;
+      responseTime.count++;
+      responseTime.max = std::max(responseTime.max, transaction.responseTime);
+      stationStatistics.lastResponseTime = transaction.responseTime;
+      break;
+    }
+  }
+
+  if (log.size()) {
+    log[logIndex] = transaction;
+    logIndex = (logIndex + 1) % log.size();
+    logSize = std::min(logSize + 1, log.size());
+  }
+}
+
+//==============================================================================
+
+ModbusMonitorStationStatistics& ModbusMonitor::GetStationStatisticsRecord(uint8_t stationAddress) {
+  if (!stationStatisticsIndexes[stationAddress]) {
+    stationStatistics.push_back({});
+    stationStatisticsIndexes[stationAddress] = stationStatistics.size();
+  }
+  return stationStatistics[stationStatisticsIndexes[stationAddress] - 1];
+}
+
+//==============================================================================
+
+esp_err_t ModbusMonitor::SkipToIdleLine(Stream& stream) {
+  // Reads all the data that is already received in one call and waits for the next byte with the inter-character read timeout.
+  while (true) {
+    if (size_t readSize = stream.GetReadableSize())
+      ESP_RETURN_ON_ERROR(stream.Read(NULL, readSize), TAG, "stream read failed");
+    else if (stream.Read(NULL, 1) != ESP_OK)
+      return ESP_OK;
+  }
+}
+
+//==============================================================================
+
+ModbusMonitor::StreamServer::StreamServer(std::shared_ptr<Stream> stream, ModbusMonitor& modbusMonitor) : PL::StreamServer(stream), modbusMonitor(modbusMonitor) {}
+
+//==============================================================================
+
+esp_err_t ModbusMonitor::StreamServer::HandleRequest(Stream& stream) {
+  return modbusMonitor.HandleRequest(stream);
+}
+
+//==============================================================================
+
+}
@@ -0,0 +1,114 @@
+#include "pl_modbus_refreshed_memory_area.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "string.h"
+
+//==============================================================================
+
+static const char* TAG = "pl_modbus_refreshed_memory_area";
+
+//==============================================================================
+
+namespace PL {
+
+//==============================================================================
+
+ModbusRefreshedMemoryArea::ModbusRefreshedMemoryArea(ModbusMemoryType type, uint16_t address, size_t size) :
+    ModbusSeqLockMemoryArea(type, address, size), snapshot(size) {
+  memset(snapshot.data, 0, size);
+}
+
+//==============================================================================
+
+ModbusRefreshedMemoryArea::~ModbusRefreshedMemoryArea() {
+  DisableRefresh();
+}
+
+//==============================================================================
+
+esp_err_t ModbusRefreshedMemoryArea::EnableRefresh(const TaskParameters& taskParameters, TickType_t period) {
+  LockGuard lg(refreshMutex);
+  ESP_RETURN_ON_ERROR(DisableRefresh(), TAG, "disable refresh failed");
+  // The task stopped by a concurrent DisableRefresh call can still be running.
+  while (stopRefresh && !refreshStopped)
+    vTaskDelay(1);
+  refreshPeriod = period;
+  stopRefresh = false;
+  refreshStopped = false;
+  TaskHandle_t task;
+  ESP_RETURN_ON_FALSE(xTaskCreatePinnedToCore(RefreshTask, "modbus_refresh", taskParameters.stackDepth, this, taskParameters.priority, &task, taskParameters.coreId) == pdPASS,
+                      ESP_FAIL, TAG, "task creation failed");
+  refreshTask = task;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t ModbusRefreshedMemoryArea::DisableRefresh() {
+  {
+    LockGuard lg(refreshMutex);
+    TaskHandle_t task = refreshTask.exchange(NULL);
+    if (!task)
+      return ESP_OK;
+    // The requests that have read the task handle notify the task before it is stopped.
+    while (numberOfRefreshRequests)
+      vTaskDelay(1);
+    stopRefresh = true;
+    xTaskNotifyGive(task);
+  }
+  // The mutex is not held while waiting: the refresh task can be waiting for the memory area lock.
+  while (!refreshStopped)
+    vTaskDelay(1);
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t ModbusRefreshedMemoryArea::RequestRefresh() {
+  numberOfRefreshRequests++;
+  TaskHandle_t task = refreshTask;
+  if (task)
+    xTaskNotifyGive(task);
+  numberOfRefreshRequests--;
+  ESP_RETURN_ON_FALSE(task, ESP_ERR_INVALID_STATE, TAG, "refresh is not enabled");
+  return ESP_OK;
+}
+
+//==============================================================================
+
+int64_t ModbusRefreshedMemoryArea::GetRefreshAge() {
+  int64_t time = refreshTime;
+  return (time < 0) ? -1 : esp_timer_get_time() - time;
+}
+
+//==============================================================================
+
+uint32_t ModbusRefreshedMemoryArea::GetNumberOfRefreshErrors() {
+  return numberOfRefreshErrors;
+}
+
+//==============================================================================
+
+void ModbusRefreshedMemoryArea::RefreshTask(void* parameters) {
+  ModbusRefreshedMemoryArea& memoryArea = *(ModbusRefreshedMemoryArea*)parameters;
+
+  while (!memoryArea.stopRefresh) {
+    // The snapshot is filled without locking the memory area, so the requests are served from the previous data meanwhile.
+    if (memoryArea.OnRefresh(memoryArea.snapshot.data) == ESP_OK) {
+      memoryArea.Lock();
+      memcpy(memoryArea.data, memoryArea.snapshot.data, memoryArea.size);
+      memoryArea.refreshTime = esp_timer_get_time();
+      memoryArea.Unlock();
+    }
+    else
+      memoryArea.numberOfRefreshErrors++;
+    ulTaskNotifyTake(pdTRUE, memoryArea.refreshPeriod ? memoryArea.refreshPeriod : portMAX_DELAY);
+  }
+
+  memoryArea.refreshStopped = true;
+  vTaskDelete(NULL);
+}
+
+//==============================================================================
+
+}
\ No newline at end of file
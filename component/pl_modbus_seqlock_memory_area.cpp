@@ -0,0 +1,60 @@
+#include "pl_modbus_seqlock_memory_area.h"
+
+//==============================================================================
+
+namespace PL {
+
+//==============================================================================
+
+ModbusSeqLockMemoryArea::ModbusSeqLockMemoryArea(ModbusMemoryType type, uint16_t address, size_t size) :
+  ModbusMemoryArea(type, address, size) {}
+
+//==============================================================================
+
+ModbusSeqLockMemoryArea::ModbusSeqLockMemoryArea(ModbusMemoryType type, uint16_t address, void* data, size_t size) :
+  ModbusMemoryArea(type, address, data, size) {}
+
+//==============================================================================
+
+esp_err_t ModbusSeqLockMemoryArea::Lock(TickType_t timeout) {
+  esp_err_t error = ModbusMemoryArea::Lock(timeout);
+  if (error == ESP_OK && lockDepth++ == 0) {
+    sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+  return error;
+}
+
+//==============================================================================
+
+esp_err_t ModbusSeqLockMemoryArea::Unlock() {
+  if (--lockDepth == 0)
+    sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  return ModbusMemoryArea::Unlock();
+}
+
+//==============================================================================
+
+esp_err_t ModbusSeqLockMemoryArea::BeginRead(uint32_t& sequence) {
+  sequence = this->sequence.load(std::memory_order_acquire);
+  // Spinning on a write in progress can starve a lower priority writer, so the reader waits for it on the mutex instead.
+  // Odd sequence tells EndRead that the data has been read under the lock.
+  if (sequence & 1)
+    return ModbusMemoryArea::Lock();
+  return ESP_OK;
+}
+
+//==============================================================================
+
+bool ModbusSeqLockMemoryArea::EndRead(uint32_t sequence) {
+  if (sequence & 1) {
+    ModbusMemoryArea::Unlock();
+    return true;
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return this->sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+//==============================================================================
+
+}
@@ -1,5 +1,6 @@
 #include "pl_modbus_server.h"
 #include "esp_check.h"
+#include "esp_timer.h"
 
 //==============================================================================
 
@@ -11,14 +12,17 @@ namespace PL {
 
 //==============================================================================
 
-const uint_fast8_t lowerBits[] =  {0, 0b1, 0b11, 0b111, 0b1111, 0b11111, 0b111111, 0b1111111, 0b11111111};
-
 const std::string ModbusServer::defaultName = "Modbus Server";
+thread_local ModbusServer::Worker* ModbusServer::currentWorker = NULL;
+thread_local ModbusServer* ModbusServer::currentServer = NULL;
+#if CONFIG_PL_MODBUS_STATISTICS
+thread_local uint32_t ModbusServer::writeFrameTime = 0;
+#endif
 
 //==============================================================================
 
 ModbusServer::ModbusServer(std::shared_ptr<Stream> stream, ModbusProtocol protocol, uint8_t stationAddress, std::shared_ptr<Buffer> buffer) :
-    ModbusBase(protocol, buffer, defaultReadTimeout, defaultWriteTimeout), interface(ModbusInterface::stream), streamServer(std::make_shared<StreamServer>(stream, *this)),
+    ModbusBase(ModbusInterface::stream, protocol, buffer, defaultReadTimeout, defaultWriteTimeout), streamServer(std::make_shared<StreamServer>(stream, *this)),
     stationAddress(stationAddress) {
   SetName(defaultName);
 }
@@ -26,7 +30,7 @@ ModbusServer::ModbusServer(std::shared_ptr<Stream> stream, ModbusProtocol protoc
 //==============================================================================
 
 ModbusServer::ModbusServer(std::shared_ptr<Stream> stream, ModbusProtocol protocol, uint8_t stationAddress, size_t bufferSize) :
-    ModbusBase(protocol, bufferSize, defaultReadTimeout, defaultWriteTimeout), interface(ModbusInterface::stream), streamServer(std::make_shared<StreamServer>(stream, *this)),
+    ModbusBase(ModbusInterface::stream, protocol, bufferSize, defaultReadTimeout, defaultWriteTimeout), streamServer(std::make_shared<StreamServer>(stream, *this)),
     stationAddress(stationAddress) {
   SetName(defaultName);
 }
@@ -34,41 +38,62 @@ ModbusServer::ModbusServer(std::shared_ptr<Stream> stream, ModbusProtocol protoc
 //==============================================================================
 
 ModbusServer::ModbusServer(uint16_t port, std::shared_ptr<Buffer> buffer) :
-    ModbusBase(defaultNetworkProtocol, buffer, defaultReadTimeout, defaultWriteTimeout), interface(ModbusInterface::network), tcpServer(std::make_shared<TcpServer>(port, *this)),
+    ModbusServer(port, defaultNetworkProtocol, buffer) {}
+
+//==============================================================================
+
+ModbusServer::ModbusServer(uint16_t port, size_t bufferSize) :
+    ModbusServer(port, defaultNetworkProtocol, bufferSize) {}
+
+//==============================================================================
+
+ModbusServer::ModbusServer(uint16_t port, ModbusProtocol protocol, std::shared_ptr<Buffer> buffer) :
+    ModbusBase(ModbusInterface::network, protocol, buffer, defaultReadTimeout, defaultWriteTimeout), tcpServer(std::make_shared<TcpServer>(port, *this)),
     stationAddress(defaultNetworkStationAddress) {
   SetName(defaultName);
 }
 
 //==============================================================================
 
-ModbusServer::ModbusServer(uint16_t port, size_t bufferSize) :
-    ModbusBase(defaultNetworkProtocol, bufferSize, defaultReadTimeout, defaultWriteTimeout), interface(ModbusInterface::network), tcpServer(std::make_shared<TcpServer>(port, *this)),
+ModbusServer::ModbusServer(uint16_t port, ModbusProtocol protocol, size_t bufferSize) :
+    ModbusBase(ModbusInterface::network, protocol, bufferSize, defaultReadTimeout, defaultWriteTimeout), tcpServer(std::make_shared<TcpServer>(port, *this)),
     stationAddress(defaultNetworkStationAddress) {
   SetName(defaultName);
 }
 
 //==============================================================================
 
+ModbusServer::~ModbusServer() {
+  Disable();
+  DisableDeferredOnWrite();
+  DisableChangeSubscriptions();
+}
+
+//==============================================================================
+
 esp_err_t ModbusServer::Lock(TickType_t timeout) {
-  return interface == ModbusInterface::stream ? streamServer->Lock(timeout) : tcpServer->Lock(timeout);
+  return GetInterface() == ModbusInterface::stream ? streamServer->Lock(timeout) : tcpServer->Lock(timeout);
 }
 
 //==============================================================================
 
 esp_err_t ModbusServer::Unlock() {
-  return interface == ModbusInterface::stream ? streamServer->Unlock() : tcpServer->Unlock();
+  return GetInterface() == ModbusInterface::stream ? streamServer->Unlock() : tcpServer->Unlock();
 }
 
 //==============================================================================
 
 esp_err_t ModbusServer::Enable() {
-  return interface == ModbusInterface::stream ? streamServer->Enable() : tcpServer->Enable();
+  ESP_RETURN_ON_ERROR(StartWorkers(), TAG, "start workers failed");
+  return GetInterface() == ModbusInterface::stream ? streamServer->Enable() : tcpServer->Enable();
 }
 
 //==============================================================================
 
 esp_err_t ModbusServer::Disable() {
-  return interface == ModbusInterface::stream ? streamServer->Disable() : tcpServer->Disable();
+  ESP_RETURN_ON_ERROR(GetInterface() == ModbusInterface::stream ? streamServer->Disable() : tcpServer->Disable(), TAG, "disable failed");
+  StopWorkers();
+  return ESP_OK;
 }
 
 //==============================================================================
@@ -86,8 +111,27 @@ void ModbusServer::AddMemoryArea(ModbusMemoryType type, uint16_t address, std::s
 
 //==============================================================================
 
+esp_err_t ModbusServer::AddMemoryArea(uint8_t stationAddress, std::shared_ptr<ModbusMemoryArea> memoryArea) {
+  LockGuard lg(*this);
+  ESP_RETURN_ON_FALSE(stationAddress != 0, ESP_ERR_INVALID_ARG, TAG, "invalid station address");
+  if (!stationMemoryAreasIndexes[stationAddress]) {
+    stationMemoryAreas.emplace_back();
+    stationMemoryAreasIndexes[stationAddress] = stationMemoryAreas.size();
+  }
+  stationMemoryAreas[stationMemoryAreasIndexes[stationAddress] - 1].push_back(memoryArea);
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t ModbusServer::AddMemoryArea(uint8_t stationAddress, ModbusMemoryType type, uint16_t address, std::shared_ptr<Buffer> buffer) {
+  return AddMemoryArea(stationAddress, std::make_shared<ModbusMemoryArea>(type, address, buffer->data, buffer->size, buffer));
+}
+
+//==============================================================================
+
 bool ModbusServer::IsEnabled() {
-  return interface == ModbusInterface::stream ? streamServer->IsEnabled() : tcpServer->IsEnabled();
+  return GetInterface() == ModbusInterface::stream ? streamServer->IsEnabled() : tcpServer->IsEnabled();
 }
 
 //==============================================================================
@@ -108,13 +152,167 @@ esp_err_t ModbusServer::SetStationAddress(uint8_t stationAddress) {
 //==============================================================================
 
 esp_err_t ModbusServer::SetTaskParameters(const TaskParameters& taskParameters) {
-  return interface == ModbusInterface::stream ? streamServer->SetTaskParameters(taskParameters) : tcpServer->SetTaskParameters(taskParameters);
+  return GetInterface() == ModbusInterface::stream ? streamServer->SetTaskParameters(taskParameters) : tcpServer->SetTaskParameters(taskParameters);
+}
+
+//==============================================================================
+
+esp_err_t ModbusServer::SetWorkerTaskParameters(const std::vector<TaskParameters>& workerTaskParameters) {
+  LockGuard lg(*this);
+  ESP_RETURN_ON_FALSE(GetInterface() == ModbusInterface::network || workerTaskParameters.empty(), ESP_ERR_NOT_SUPPORTED, TAG, "workers are not supported by the stream server");
+  ESP_RETURN_ON_FALSE(!IsEnabled(), ESP_ERR_INVALID_STATE, TAG, "server is enabled");
+  workers.clear();
+  for (auto& taskParameters : workerTaskParameters) {
+    workers.push_back(std::make_unique<Worker>());
+    workers.back()->modbusServer = this;
+    workers.back()->taskParameters = taskParameters;
+  }
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t ModbusServer::EnableDeferredOnWrite(const TaskParameters& taskParameters, size_t maxQueueDepth) {
+  LockGuard lg(*this);
+  ESP_RETURN_ON_FALSE(!IsEnabled(), ESP_ERR_INVALID_STATE, TAG, "server is enabled");
+  ESP_RETURN_ON_FALSE(maxQueueDepth > 0, ESP_ERR_INVALID_ARG, TAG, "invalid queue depth");
+  ESP_RETURN_ON_ERROR(DisableDeferredOnWrite(), TAG, "disable deferred OnWrite failed");
+
+  auto newDeferredOnWrite = std::make_unique<DeferredOnWrite>();
+  newDeferredOnWrite->pendingWrites.reserve(maxQueueDepth);
+  newDeferredOnWrite->maxQueueDepth = maxQueueDepth;
+  ESP_RETURN_ON_FALSE(xTaskCreatePinnedToCore(DeferredOnWriteTask, GetName().c_str(), taskParameters.stackDepth, newDeferredOnWrite.get(), taskParameters.priority, &newDeferredOnWrite->task, taskParameters.coreId) == pdPASS,
+                      ESP_FAIL, TAG, "task creation failed");
+  deferredOnWrite = std::move(newDeferredOnWrite);
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t ModbusServer::DisableDeferredOnWrite() {
+  LockGuard lg(*this);
+  ESP_RETURN_ON_FALSE(!IsEnabled(), ESP_ERR_INVALID_STATE, TAG, "server is enabled");
+  if (!deferredOnWrite)
+    return ESP_OK;
+
+  {
+    LockGuard lgDeferredOnWrite(deferredOnWrite->mutex);
+    deferredOnWrite->stop = true;
+  }
+  xTaskNotifyGive(deferredOnWrite->task);
+  while (!deferredOnWrite->stopped)
+    vTaskDelay(1);
+  deferredOnWrite = NULL;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+ModbusServer::DeferredOnWriteStatistics ModbusServer::GetDeferredOnWriteStatistics() {
+  LockGuard lg(*this);
+  if (!deferredOnWrite)
+    return {};
+  LockGuard lgDeferredOnWrite(deferredOnWrite->mutex);
+  return deferredOnWrite->statistics;
+}
+
+//==============================================================================
+
+void ModbusServer::ResetDeferredOnWriteStatistics() {
+  LockGuard lg(*this);
+  if (!deferredOnWrite)
+    return;
+  LockGuard lgDeferredOnWrite(deferredOnWrite->mutex);
+  uint32_t queueDepth = deferredOnWrite->statistics.queueDepth;
+  deferredOnWrite->statistics = {};
+  deferredOnWrite->statistics.queueDepth = queueDepth;
+  deferredOnWrite->statistics.maxQueueDepth = queueDepth;
+}
+
+//==============================================================================
+
+esp_err_t ModbusServer::EnableChangeSubscriptions(size_t maxNumberOfSubscriptions, TickType_t timeout) {
+  LockGuard lg(*this);
+  ESP_RETURN_ON_FALSE(!IsEnabled(), ESP_ERR_INVALID_STATE, TAG, "server is enabled");
+  ESP_RETURN_ON_FALSE(maxNumberOfSubscriptions > 0 && maxNumberOfSubscriptions <= 255, ESP_ERR_INVALID_ARG, TAG, "invalid number of subscriptions");
+  auto newChangeSubscriptions = std::make_unique<ChangeSubscriptions>();
+  newChangeSubscriptions->subscriptions.resize(maxNumberOfSubscriptions);
+  newChangeSubscriptions->timeout = timeout;
+  changeSubscriptions = std::move(newChangeSubscriptions);
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t ModbusServer::DisableChangeSubscriptions() {
+  LockGuard lg(*this);
+  ESP_RETURN_ON_FALSE(!IsEnabled(), ESP_ERR_INVALID_STATE, TAG, "server is enabled");
+  changeSubscriptions = NULL;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+size_t ModbusServer::GetNumberOfChangeSubscriptions() {
+  LockGuard lg(*this);
+  if (!changeSubscriptions)
+    return 0;
+  LockGuard lgChangeSubscriptions(changeSubscriptions->mutex);
+  size_t numberOfSubscriptions = 0;
+  for (auto& subscription : changeSubscriptions->subscriptions)
+    numberOfSubscriptions += subscription.id != 0;
+  return numberOfSubscriptions;
+}
+
+//==============================================================================
+
+esp_err_t ModbusServer::GetStatistics(ModbusServerStatistics& statistics) {
+#if CONFIG_PL_MODBUS_STATISTICS
+  for (size_t i = 0; i < ModbusServerStatistics::numberOfFunctionCodes; i++) {
+    auto& functionCodeStatisticsRecorder = functionCodeStatistics[i];
+    auto& functionCodeStatistics = statistics.functionCodeStatistics[i];
+    functionCodeStatistics.numberOfRequests = functionCodeStatisticsRecorder.numberOfRequests.load(std::memory_order_relaxed);
+    for (size_t j = 0; j < modbusExceptionCounterSize; j++)
+      functionCodeStatistics.numberOfExceptions[j] = functionCodeStatisticsRecorder.numberOfExceptions[j].load(std::memory_order_relaxed);
+    functionCodeStatisticsRecorder.readFrameTime.Get(functionCodeStatistics.readFrameTime);
+    functionCodeStatisticsRecorder.handleTime.Get(functionCodeStatistics.handleTime);
+    functionCodeStatisticsRecorder.writeFrameTime.Get(functionCodeStatistics.writeFrameTime);
+  }
+  statistics.numberOfCrcErrors = numberOfCrcErrors.load(std::memory_order_relaxed);
+  statistics.numberOfFrameErrors = numberOfFrameErrors.load(std::memory_order_relaxed);
+  statistics.numberOfForeignFrames = numberOfForeignFrames.load(std::memory_order_relaxed);
+  statistics.numberOfBytesReceived = numberOfBytesReceived.load(std::memory_order_relaxed);
+  statistics.numberOfBytesSent = numberOfBytesSent.load(std::memory_order_relaxed);
+  return ESP_OK;
+#else
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+//==============================================================================
+
+void ModbusServer::ResetStatistics() {
+#if CONFIG_PL_MODBUS_STATISTICS
+  for (auto& functionCodeStatisticsRecorder : functionCodeStatistics) {
+    functionCodeStatisticsRecorder.numberOfRequests.store(0, std::memory_order_relaxed);
+    for (auto& numberOfExceptions : functionCodeStatisticsRecorder.numberOfExceptions)
+      numberOfExceptions.store(0, std::memory_order_relaxed);
+    functionCodeStatisticsRecorder.readFrameTime.Reset();
+    functionCodeStatisticsRecorder.handleTime.Reset();
+    functionCodeStatisticsRecorder.writeFrameTime.Reset();
+  }
+  numberOfCrcErrors.store(0, std::memory_order_relaxed);
+  numberOfFrameErrors.store(0, std::memory_order_relaxed);
+  numberOfForeignFrames.store(0, std::memory_order_relaxed);
+  numberOfBytesReceived.store(0, std::memory_order_relaxed);
+  numberOfBytesSent.store(0, std::memory_order_relaxed);
+#endif
 }
 
 //==============================================================================
 
 std::weak_ptr<Server> ModbusServer::GetBaseServer() {
-  if (interface == ModbusInterface::stream)
+  if (GetInterface() == ModbusInterface::stream)
     return streamServer;
   else
     return tcpServer;
@@ -150,6 +348,38 @@ esp_err_t ModbusServer::StreamReadUntil(Stream& stream, char termChar) {
 
 //==============================================================================
 
+bool ModbusServer::IsServerFrame(ModbusCaptureDirection direction) {
+  return direction == ModbusCaptureDirection::transmitted;
+}
+
+//==============================================================================
+
+uint32_t ModbusServer::GetCaptureConnectionId(Stream& stream) {
+  if (GetInterface() == ModbusInterface::stream)
+    return ModbusBase::GetCaptureConnectionId(stream);
+  if (IsWorkerTask())
+    return currentWorker->captureConnectionId;
+
+  int socket = static_cast<NetworkStream&>(stream).GetSocket();
+  sockaddr_storage peerAddress = {};
+  socklen_t peerAddressSize = sizeof(peerAddress);
+  getpeername(socket, (sockaddr*)&peerAddress, &peerAddressSize);
+  CaptureConnection* connection = NULL;
+  for (auto& captureConnection : captureConnections) {
+    if (captureConnection.socket == socket) {
+      connection = &captureConnection;
+      break;
+    }
+  }
+  if (!connection)
+    connection = &captureConnections.emplace_back();
+  if (!connection->id || connection->socket != socket || memcmp(&connection->peerAddress, &peerAddress, sizeof(peerAddress)))
+    *connection = {socket, peerAddress, ModbusCapture::CreateConnectionId()};
+  return requestCaptureConnectionId = connection->id;
+}
+
+//==============================================================================
+
 esp_err_t ModbusServer::ReadRtuData(Stream& stream, ModbusFunctionCode functionCode, size_t& dataSize) {
   Buffer& dataBuffer = GetDataBuffer();
 
@@ -194,6 +424,38 @@ esp_err_t ModbusServer::ReadRtuData(Stream& stream, ModbusFunctionCode functionC
         return ESP_OK;
       }
 
+    case ModbusFunctionCode::changeSubscription:
+      if (changeSubscriptions) {
+        uint8_t command;
+        ESP_RETURN_ON_ERROR(StreamRead(stream, &command, 1), TAG, "read command failed");
+        switch ((ModbusChangeSubscriptionCommand)command) {
+          case ModbusChangeSubscriptionCommand::subscribe:
+            dataSize = 8;
+            break;
+          case ModbusChangeSubscriptionCommand::unsubscribe:
+            dataSize = 2;
+            break;
+          case ModbusChangeSubscriptionCommand::readChanges:
+            dataSize = 3;
+            break;
+          default:
+            stream.FlushReadBuffer(2);
+            ESP_RETURN_ON_ERROR(ESP_ERR_NOT_SUPPORTED, TAG, "change subscription command (%d) is not supported", (int)command);
+            return ESP_OK;
+        }
+        if (dataBuffer.size >= dataSize) {
+          ((uint8_t*)dataBuffer.data)[0] = command;
+          ESP_RETURN_ON_ERROR(StreamRead(stream, dataBuffer, 1, dataSize - 1), TAG, "read data failed");
+          return ESP_OK;
+        }
+        else {
+          StreamRead(stream, NULL, dataSize - 1);
+          ESP_RETURN_ON_ERROR(ESP_ERR_INVALID_SIZE, TAG, "buffer is too small");
+          return ESP_OK;
+        }
+      }
+      [[fallthrough]];
+
     default:
       stream.FlushReadBuffer(2);
       ESP_RETURN_ON_ERROR(ESP_ERR_NOT_SUPPORTED, TAG, "function code (%d) is not supported", (int)functionCode);
@@ -203,8 +465,131 @@ esp_err_t ModbusServer::ReadRtuData(Stream& stream, ModbusFunctionCode functionC
 
 //==============================================================================
 
+bool ModbusServer::IsForeignRtuFrame(uint8_t stationAddress) {
+  // Frames can only be skipped by their length on a serial line: the end of a frame with an unknown length is detected by the read timeout.
+  if (GetInterface() != ModbusInterface::stream)
+    return false;
+  if (IsStationHosted(stationAddress)) {
+    // Request to this server: the request to another station has not been answered and the frame after the response is a request.
+    foreignRequest.functionCode = ModbusFunctionCode::unknown;
+    rtuRequestExpected = true;
+    return false;
+  }
+  return true;
+}
+
+//==============================================================================
+
+esp_err_t ModbusServer::SkipRtuFrame(Stream& stream, uint8_t stationAddress) {
+  ModbusFunctionCode functionCode;
+  ESP_RETURN_ON_ERROR(StreamRead(stream, &functionCode, 1), TAG, "read function code failed");
+
+  // Unknown frame format: skip until the line is idle.
+  size_t size = SIZE_MAX;
+
+  if ((uint8_t)functionCode & 0x80) {
+    // Exception response
+    foreignRequest.functionCode = ModbusFunctionCode::unknown;
+    rtuRequestExpected = true;
+    size = 1 + 2;
+  }
+  
+  else if (stationAddress == foreignRequest.stationAddress && functionCode == foreignRequest.functionCode) {
+    // Response to the last skipped request
+    foreignRequest.functionCode = ModbusFunctionCode::unknown;
+    rtuRequestExpected = true;
+    switch (functionCode) {
+      case ModbusFunctionCode::readCoils:
+      case ModbusFunctionCode::readDiscreteInputs:
+        size = 1 + (foreignRequest.numberOfItems + 7) / 8 + 2;
+        break;
+      case ModbusFunctionCode::readHoldingRegisters:
+      case ModbusFunctionCode::readInputRegisters:
+        size = 1 + foreignRequest.numberOfItems * 2 + 2;
+        break;
+      case ModbusFunctionCode::writeSingleCoil:
+      case ModbusFunctionCode::writeSingleHoldingRegister:
+      case ModbusFunctionCode::writeMultipleCoils:
+      case ModbusFunctionCode::writeMultipleHoldingRegisters:
+        size = 4 + 2;
+        break;
+      default:
+        break;
+    }
+  }
+
+  else {
+    // Request, if the previous frame was a response or a request to this server or the frame is not from the station with the pending request.
+    // Otherwise the frame can also be the response to a request that has not been seen (e.g. after the server start).
+    bool request = rtuRequestExpected || (foreignRequest.functionCode != ModbusFunctionCode::unknown && stationAddress != foreignRequest.stationAddress);
+    foreignRequest.functionCode = ModbusFunctionCode::unknown;
+    rtuRequestExpected = false;
+    uint8_t frame[2 + 5 + 255 + 2] = {stationAddress, (uint8_t)functionCode};
+    uint8_t* header = frame + 2;
+    size_t headerSize;
+    switch (functionCode) {
+      case ModbusFunctionCode::readCoils:
+      case ModbusFunctionCode::readDiscreteInputs:
+      case ModbusFunctionCode::readHoldingRegisters:
+      case ModbusFunctionCode::readInputRegisters:
+      case ModbusFunctionCode::writeSingleCoil:
+      case ModbusFunctionCode::writeSingleHoldingRegister:
+        headerSize = 4;
+        break;
+      case ModbusFunctionCode::writeMultipleCoils:
+      case ModbusFunctionCode::writeMultipleHoldingRegisters:
+        headerSize = 5;
+        break;
+      default:
+        return SkipRtuData(stream, size);
+    }
+    if (StreamRead(stream, header, headerSize) != ESP_OK) {
+      // Frame shorter than the request header: response
+      rtuRequestExpected = true;
+      return ESP_OK;
+    }
+    size_t requestSize = 2 + headerSize + (headerSize == 5 ? header[4] : 0) + 2;
+    // Read responses have the byte count, write responses have the address and the value or quantity.
+    size_t responseSize = functionCode <= ModbusFunctionCode::readInputRegisters ? 3 + header[0] + 2 : 8;
+
+    if (!request) {
+      // The frame type is found by the CRC of the shorter and then of the longer frame. The frame has an unknown format if both CRCs are invalid.
+      size_t frameSize = 2 + headerSize;
+      bool found = false;
+      for (size_t candidateSize : {std::min(requestSize, responseSize), std::max(requestSize, responseSize)}) {
+        if (candidateSize < frameSize)
+          continue;
+        if (StreamRead(stream, frame + frameSize, candidateSize - frameSize) != ESP_OK)
+          break;
+        frameSize = candidateSize;
+        uint16_t crc;
+        memcpy(&crc, frame + frameSize - 2, 2);
+        if ((found = Crc(frame, frameSize - 2) == crc))
+          break;
+      }
+      if (!found)
+        return SkipRtuData(stream, size);
+      if (frameSize != requestSize) {
+        rtuRequestExpected = true;
+        return ESP_OK;
+      }
+      foreignRequest = {stationAddress, functionCode, (uint16_t)((header[2] << 8) | header[3])};
+      return ESP_OK;
+    }
+
+    foreignRequest = {stationAddress, functionCode, (uint16_t)((header[2] << 8) | header[3])};
+    size = requestSize - 2 - headerSize;
+  }
+
+  return SkipRtuData(stream, size);
+}
+
+//==============================================================================
+
 esp_err_t ModbusServer::HandleRequest(Stream& stream, uint8_t stationAddress, ModbusFunctionCode functionCode, size_t dataSize, uint16_t transactionId) {
   Buffer& dataBuffer = GetDataBuffer();
+  auto& memoryAreaRanges = (currentWorker && currentWorker->modbusServer == this) ? currentWorker->memoryAreaRanges : this->memoryAreaRanges;
+  esp_err_t error;
 
   if (functionCode == ModbusFunctionCode::readCoils || functionCode == ModbusFunctionCode::readDiscreteInputs) {
     ESP_RETURN_ON_FALSE(stationAddress != 0, ESP_ERR_INVALID_RESPONSE, TAG, "read request with station address 0 is not supported");
@@ -228,34 +613,21 @@ esp_err_t ModbusServer::HandleRequest(Stream& stream, uint8_t stationAddress, Mo
     }
     
     ModbusMemoryType memoryType = (functionCode == ModbusFunctionCode::readCoils)?(ModbusMemoryType::coils):(ModbusMemoryType::discreteInputs);
-    if (auto memoryArea = FindMemoryArea(memoryType, memoryAddress, numberOfMemoryItems)) {
-      LockGuard lg(*memoryArea);
-      if (memoryArea->OnRead() != ESP_OK) {
-        ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::serverDeviceFailure, transactionId), TAG, "write exception frame failed");
-        return ESP_OK;
-      }
-
-      uint8_t* memoryData = (uint8_t*)memoryArea->data + (memoryAddress - memoryArea->address) / 8;
-      uint8_t* memoryAreaEnd = (uint8_t*)memoryArea->data + memoryArea->size;
-      uint_fast8_t memoryBitOffset = (memoryAddress - memoryArea->address) % 8;
-      uint_fast8_t memorySize = (numberOfMemoryItems - 1) / 8 + 1;
-      ((uint8_t*)dataBuffer.data)[0] = memorySize;
-      for (uint_fast8_t i = 0; i < memorySize; i++) {
-        uint_fast8_t byte = memoryData[i] >> memoryBitOffset;
-        if (memoryData + i + 1 < memoryAreaEnd)
-          byte |= memoryData[i + 1] << (8 - memoryBitOffset);
-        if (i == (memorySize - 1) && (numberOfMemoryItems % 8))
-          byte &= lowerBits[numberOfMemoryItems % 8];
-        ((uint8_t*)dataBuffer.data)[i + 1] = byte;
-      }
-
-      ESP_RETURN_ON_ERROR(WriteFrame(stream, stationAddress, functionCode, memorySize + 1, transactionId), TAG, "write frame failed");
+    if (!FindMemoryAreas(stationAddress, memoryType, memoryAddress, numberOfMemoryItems, memoryAreaRanges)) {
+      ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::illegalDataAddress, transactionId), TAG, "write exception frame failed");
       return ESP_OK;
     }
-    else {
-      ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::illegalDataAddress, transactionId), TAG, "write exception frame failed");
+
+    uint_fast8_t memorySize = (numberOfMemoryItems - 1) / 8 + 1;
+    ((uint8_t*)dataBuffer.data)[0] = memorySize;
+    memset((uint8_t*)dataBuffer.data + 1, 0, memorySize);
+    if ((error = ReadMemoryAreas(memoryAreaRanges, memoryAddress, (uint8_t*)dataBuffer.data + 1)) != ESP_OK) {
+      ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, GetMemoryAreaException(error), transactionId), TAG, "write exception frame failed");
       return ESP_OK;
     }
+
+    ESP_RETURN_ON_ERROR(WriteFrame(stream, stationAddress, functionCode, memorySize + 1, transactionId), TAG, "write frame failed");
+    return ESP_OK;
   }
 
   if (functionCode == ModbusFunctionCode::readHoldingRegisters || functionCode == ModbusFunctionCode::readInputRegisters) {
@@ -280,29 +652,19 @@ esp_err_t ModbusServer::HandleRequest(Stream& stream, uint8_t stationAddress, Mo
     }
     
     ModbusMemoryType memoryType = (functionCode == ModbusFunctionCode::readHoldingRegisters)?(ModbusMemoryType::holdingRegisters):(ModbusMemoryType::inputRegisters);
-    if (auto memoryArea = FindMemoryArea(memoryType, memoryAddress, numberOfMemoryItems)) {
-      LockGuard lg(*memoryArea);
-      if (memoryArea->OnRead() != ESP_OK) {
-        ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::serverDeviceFailure, transactionId), TAG, "write exception frame failed");
-        return ESP_OK;
-      }
-
-      uint8_t* memoryData = (uint8_t*)memoryArea->data + (memoryAddress - memoryArea->address) * 2;
-      ((uint8_t*)dataBuffer.data)[0] = numberOfMemoryItems * 2;
-      for (uint_fast16_t i = 0; i < numberOfMemoryItems; i++) {
-        uint16_t registerValue;
-        memcpy(&registerValue, memoryData + i * 2, 2);
-        registerValue = __builtin_bswap16(registerValue);
-        memcpy((uint8_t*)dataBuffer.data + 1 + i * 2, &registerValue, 2);
-      }
-
-      ESP_RETURN_ON_ERROR(WriteFrame(stream, stationAddress, functionCode, numberOfMemoryItems * 2 + 1, transactionId), TAG, "write frame failed");
+    if (!FindMemoryAreas(stationAddress, memoryType, memoryAddress, numberOfMemoryItems, memoryAreaRanges)) {
+      ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::illegalDataAddress, transactionId), TAG, "write exception frame failed");
       return ESP_OK;
     }
-    else {
-      ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::illegalDataAddress, transactionId), TAG, "write exception frame failed");
+
+    ((uint8_t*)dataBuffer.data)[0] = numberOfMemoryItems * 2;
+    if ((error = ReadMemoryAreas(memoryAreaRanges, memoryAddress, (uint8_t*)dataBuffer.data + 1)) != ESP_OK) {
+      ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, GetMemoryAreaException(error), transactionId), TAG, "write exception frame failed");
       return ESP_OK;
     }
+
+    ESP_RETURN_ON_ERROR(WriteFrame(stream, stationAddress, functionCode, numberOfMemoryItems * 2 + 1, transactionId), TAG, "write frame failed");
+    return ESP_OK;
   }
 
   if (functionCode == ModbusFunctionCode::writeSingleCoil || functionCode == ModbusFunctionCode::writeSingleHoldingRegister) {
@@ -322,36 +684,19 @@ esp_err_t ModbusServer::HandleRequest(Stream& stream, uint8_t stationAddress, Mo
     }
     
     ModbusMemoryType memoryType = (functionCode == ModbusFunctionCode::writeSingleCoil)?(ModbusMemoryType::coils):(ModbusMemoryType::holdingRegisters);
-    if (auto memoryArea = FindMemoryArea(memoryType, memoryAddress, 1)) {
-      LockGuard lg(*memoryArea);
-      if (memoryArea->OnRead() != ESP_OK) {
-        ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::serverDeviceFailure, transactionId), TAG, "write exception frame failed");
-        return ESP_OK;
-      }
-
-      if (memoryType == ModbusMemoryType::coils) {
-        void* memoryData = (uint8_t*)memoryArea->data + (memoryAddress - memoryArea->address) / 8;
-        uint_fast8_t memoryBitOffset = (memoryAddress - memoryArea->address) % 8;
-        if (memoryValue == 0xFF00)
-          *(uint8_t*)memoryData |= (1 << memoryBitOffset);
-        else
-          *(uint8_t*)memoryData &= ~(1 << memoryBitOffset);
-      }        
-      else {
-        uint16_t registerValue = memoryValue;
-        memcpy((uint8_t*)memoryArea->data + (memoryAddress - memoryArea->address) * 2, &registerValue, 2);
-      }
-    
-      if (memoryArea->OnWrite() == ESP_OK)
-        ESP_RETURN_ON_ERROR(stationAddress == 0 ? ESP_OK : WriteFrame(stream, stationAddress, functionCode, 4, transactionId), TAG, "write frame failed");
-      else
-        ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::serverDeviceFailure, transactionId), TAG, "write exception frame failed");
-      return ESP_OK;
-    }
-    else {
-      ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::illegalDataAddress, transactionId), TAG, "write frame failed");
+    if (!FindMemoryAreas(stationAddress, memoryType, memoryAddress, 1, memoryAreaRanges)) {
+      ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::illegalDataAddress, transactionId), TAG, "write exception frame failed");
       return ESP_OK;
     }
+
+    // Coil value is bit 0, register value is the big-endian request value.
+    uint8_t coilValue = (memoryValue == 0xFF00) ? 1 : 0;
+    const void* src = (memoryType == ModbusMemoryType::coils) ? (const void*)&coilValue : (const void*)((uint8_t*)dataBuffer.data + 2);
+    if ((error = WriteMemoryAreas(memoryAreaRanges, memoryAddress, src)) == ESP_OK)
+      ESP_RETURN_ON_ERROR(stationAddress == 0 ? ESP_OK : WriteFrame(stream, stationAddress, functionCode, 4, transactionId), TAG, "write frame failed");
+    else
+      ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, GetMemoryAreaException(error), transactionId), TAG, "write exception frame failed");
+    return ESP_OK;
   }
 
   if (functionCode == ModbusFunctionCode::writeMultipleCoils) {
@@ -375,45 +720,16 @@ esp_err_t ModbusServer::HandleRequest(Stream& stream, uint8_t stationAddress, Mo
       return ESP_OK;
     }
     
-    ModbusMemoryType memoryType = ModbusMemoryType::coils;
-    if (auto memoryArea = FindMemoryArea(memoryType, memoryAddress, numberOfMemoryItems)) {
-      LockGuard lg(*memoryArea);
-      if (memoryArea->OnRead() != ESP_OK) {
-        ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::serverDeviceFailure, transactionId), TAG, "write exception frame failed");
-        return ESP_OK;
-      }
-
-      uint8_t* memoryData = (uint8_t*)memoryArea->data + (memoryAddress - memoryArea->address) / 8;
-      uint8_t* dataBufferEnd = (uint8_t*)dataBuffer.data + dataBuffer.size;
-      uint_fast8_t memoryBitOffset = (memoryAddress - memoryArea->address) % 8;
-      memorySize = (memoryBitOffset + numberOfMemoryItems - 1) / 8 + 1;
-      for (uint_fast8_t i = 0; i < memorySize; i++) {
-        uint_fast8_t memoryValue = 0;
-        if (i) {
-          uint8_t* dataBufferPtr = (uint8_t*)dataBuffer.data + i + 4;
-          memoryValue = dataBufferPtr[0] >> (8 - memoryBitOffset);
-          if (dataBufferPtr + 1 < dataBufferEnd)
-            memoryValue |= dataBufferPtr[1] << memoryBitOffset;
-        }
-        else
-          memoryValue = (((uint8_t*)dataBuffer.data)[5] << memoryBitOffset) | (*memoryData & lowerBits[memoryBitOffset]);
-        if (i == memorySize - 1 && (memoryBitOffset + numberOfMemoryItems) % 8) {
-          memoryValue &= lowerBits[(memoryBitOffset + numberOfMemoryItems) % 8];
-          memoryValue |= (memoryData[i] & ~(lowerBits[(memoryBitOffset + numberOfMemoryItems) % 8]));
-        }
-        memoryData[i] = memoryValue;
-      }
-
-      if (memoryArea->OnWrite() == ESP_OK)
-        ESP_RETURN_ON_ERROR(stationAddress == 0 ? ESP_OK : WriteFrame(stream, stationAddress, functionCode, 4, transactionId), TAG, "write frame failed");
-      else
-        ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::serverDeviceFailure, transactionId), TAG, "write exception frame failed");
-      return ESP_OK;
-    }
-    else {
-      ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::illegalDataAddress, transactionId), TAG, "write frame failed");
+    if (!FindMemoryAreas(stationAddress, ModbusMemoryType::coils, memoryAddress, numberOfMemoryItems, memoryAreaRanges)) {
+      ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::illegalDataAddress, transactionId), TAG, "write exception frame failed");
       return ESP_OK;
     }
+
+    if ((error = WriteMemoryAreas(memoryAreaRanges, memoryAddress, (uint8_t*)dataBuffer.data + 5)) == ESP_OK)
+      ESP_RETURN_ON_ERROR(stationAddress == 0 ? ESP_OK : WriteFrame(stream, stationAddress, functionCode, 4, transactionId), TAG, "write frame failed");
+    else
+      ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, GetMemoryAreaException(error), transactionId), TAG, "write exception frame failed");
+    return ESP_OK;
   }
 
   if (functionCode == ModbusFunctionCode::writeMultipleHoldingRegisters) {
@@ -437,40 +753,49 @@ esp_err_t ModbusServer::HandleRequest(Stream& stream, uint8_t stationAddress, Mo
       return ESP_OK;
     }
     
-    ModbusMemoryType memoryType = ModbusMemoryType::holdingRegisters;
-    if (auto memoryArea = FindMemoryArea(memoryType, memoryAddress, numberOfMemoryItems)) {
-      LockGuard lg(*memoryArea);
-      if (memoryArea->OnRead() != ESP_OK) {
-        ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::serverDeviceFailure, transactionId), TAG, "write exception frame failed");
-        return ESP_OK;
-      }
-
-      uint8_t* memoryData = (uint8_t*)memoryArea->data + (memoryAddress - memoryArea->address) * 2;
-      for (uint_fast16_t i = 0; i < numberOfMemoryItems; i++) {
-        uint16_t registerValue;
-        memcpy(&registerValue, (uint8_t*)dataBuffer.data + 5 + i * 2, 2);
-        registerValue = __builtin_bswap16(registerValue);
-        memcpy(memoryData + i * 2, &registerValue, 2);
-      }
-
-      if (memoryArea->OnWrite() == ESP_OK)
-        ESP_RETURN_ON_ERROR(stationAddress == 0 ? ESP_OK : WriteFrame(stream, stationAddress, functionCode, 4, transactionId), TAG, "write frame failed");
-      else
-        ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::serverDeviceFailure, transactionId), TAG, "write exception frame failed");
-      return ESP_OK;
-    }
-    else {
-      ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::illegalDataAddress, transactionId), TAG, "write frame failed");
+    if (!FindMemoryAreas(stationAddress, ModbusMemoryType::holdingRegisters, memoryAddress, numberOfMemoryItems, memoryAreaRanges)) {
+      ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::illegalDataAddress, transactionId), TAG, "write exception frame failed");
       return ESP_OK;
     }
+
+    if ((error = WriteMemoryAreas(memoryAreaRanges, memoryAddress, (uint8_t*)dataBuffer.data + 5)) == ESP_OK)
+      ESP_RETURN_ON_ERROR(stationAddress == 0 ? ESP_OK : WriteFrame(stream, stationAddress, functionCode, 4, transactionId), TAG, "write frame failed");
+    else
+      ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, GetMemoryAreaException(error), transactionId), TAG, "write exception frame failed");
+    return ESP_OK;
   }
 
+  if (functionCode == ModbusFunctionCode::changeSubscription && changeSubscriptions)
+    return HandleChangeSubscriptionRequest(stream, stationAddress, dataSize, transactionId, memoryAreaRanges);
+
   ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::illegalFunction, transactionId), TAG, "write exception frame failed");
   return ESP_OK;
 }
 
 //==============================================================================
 
+esp_err_t ModbusServer::WriteFrame(Stream& stream, uint8_t stationAddress, ModbusFunctionCode functionCode, size_t dataSize, uint16_t transactionId) {
+#if CONFIG_PL_MODBUS_STATISTICS
+  auto& statistics = functionCodeStatistics[ModbusServerStatistics::GetFunctionCodeIndex(functionCode)];
+  // The exception code is read before the write: ASCII frames are encoded in place.
+  uint8_t exception = ((uint8_t)functionCode & 0x80) ? *(uint8_t*)GetDataBuffer().data : 0;
+  int64_t startTime = esp_timer_get_time();
+  esp_err_t error = ModbusBase::WriteFrame(stream, stationAddress, functionCode, dataSize, transactionId);
+  writeFrameTime = esp_timer_get_time() - startTime;
+  statistics.writeFrameTime.Add(writeFrameTime);
+  if (error == ESP_OK) {
+    numberOfBytesSent.fetch_add(GetFrameSize(dataSize), std::memory_order_relaxed);
+    if (exception && exception < modbusExceptionCounterSize)
+      statistics.numberOfExceptions[exception].fetch_add(1, std::memory_order_relaxed);
+  }
+  return error;
+#else
+  return ModbusBase::WriteFrame(stream, stationAddress, functionCode, dataSize, transactionId);
+#endif
+}
+
+//==============================================================================
+
 esp_err_t ModbusServer::WriteExceptionFrame(Stream& stream, uint8_t stationAddress, ModbusFunctionCode functionCode, ModbusException exception, uint16_t transactionId) {
   if (stationAddress == 0)
     return ESP_OK;
@@ -489,6 +814,7 @@ ModbusServer::StreamServer::StreamServer(std::shared_ptr<Stream> stream, ModbusS
 //==============================================================================
 
 esp_err_t ModbusServer::StreamServer::HandleRequest(Stream& stream) {
+  currentServer = &modbusServer;
   return modbusServer.HandleRequest(stream);
 }
 
@@ -498,7 +824,33 @@ ModbusServer::TcpServer::TcpServer(uint16_t port, ModbusServer& modbusServer) :
 
 //==============================================================================
 
+esp_err_t ModbusServer::TcpServer::Lock(TickType_t timeout) {
+  ESP_RETURN_ON_ERROR(PL::TcpServer::Lock(timeout), TAG, "lock failed");
+  if (modbusServer.IsWorkerTask() || lockDepth++)
+    return ESP_OK;
+  // Workers use the configuration and the client streams without the lock and no requests are dispatched while the server is locked.
+  // The other tasks wait until the dispatched requests are answered. The server task waits only for the connections with pending data
+  // (the next request or the closed connection that it would remove), so a slow request does not block the other connections.
+  esp_err_t error = modbusServer.WaitForWorkers(timeout, currentServer == &modbusServer);
+  if (error != ESP_OK) {
+    Unlock();
+    ESP_RETURN_ON_ERROR(error, TAG, "wait for workers failed");
+  }
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t ModbusServer::TcpServer::Unlock() {
+  if (!modbusServer.IsWorkerTask())
+    lockDepth--;
+  return PL::TcpServer::Unlock();
+}
+
+//==============================================================================
+
 esp_err_t ModbusServer::TcpServer::HandleRequest(NetworkStream& stream) {
+  currentServer = &modbusServer;
   return modbusServer.HandleRequest(stream);
 }
 
@@ -510,16 +862,31 @@ esp_err_t ModbusServer::HandleRequest(Stream& stream) {
   size_t dataSize;
   uint16_t transactionId;
 
+  // Requests of the same connection are handled in order: the server task has waited for the worker of the connection when it locked the server.
+  requestCaptureConnectionId = 0;
   esp_err_t error;
-  do {
-    error = ReadFrame(stream, stationAddress, functionCode, dataSize, transactionId);
-  } while (stream.GetReadableSize() && GetProtocol() != ModbusProtocol::tcp);
+  if (GetInterface() == ModbusInterface::stream && GetProtocol() != ModbusProtocol::tcp) {
+    // Serial line: skip to the last received frame.
+    do {
+      error = ReadRequestFrame(stream, stationAddress, functionCode, dataSize, transactionId);
+    } while (stream.GetReadableSize());
+  }
+  else {
+    // Network: frames are delimited by their length (MBAP header or RTU/ASCII frame format), so every frame is handled.
+    error = ReadRequestFrame(stream, stationAddress, functionCode, dataSize, transactionId);
+    // RTU/ASCII frames cannot be resynchronized on a byte stream after a framing error.
+    if (error != ESP_OK && error != ESP_ERR_INVALID_SIZE && GetProtocol() != ModbusProtocol::tcp)
+      stream.Read(NULL, stream.GetReadableSize());
+  }
 
-  if ((error == ESP_OK || error == ESP_ERR_INVALID_SIZE) && stationAddress != this->stationAddress && stationAddress != 0)
+  if (error == ESP_ERR_NOT_FOUND || ((error == ESP_OK || error == ESP_ERR_INVALID_SIZE) && !IsStationHosted(stationAddress)))
     return ESP_OK;
 
   if (error == ESP_OK) {
-    ESP_RETURN_ON_ERROR(HandleRequest(stream, stationAddress, functionCode, dataSize, transactionId), TAG, "handle request failed");
+    if (idleWorkers)
+      ESP_RETURN_ON_ERROR(DispatchRequest(stream, stationAddress, functionCode, dataSize, transactionId), TAG, "dispatch request failed");
+    else
+      ESP_RETURN_ON_ERROR(HandleAndRecordRequest(stream, stationAddress, functionCode, dataSize, transactionId), TAG, "handle request failed");
     return ESP_OK;
   }
   ESP_RETURN_ON_ERROR(error, TAG, "read frame error");
@@ -528,12 +895,608 @@ esp_err_t ModbusServer::HandleRequest(Stream& stream) {
 
 //==============================================================================
 
-std::shared_ptr<ModbusMemoryArea> ModbusServer::FindMemoryArea(ModbusMemoryType memoryType, uint16_t address, uint16_t numberOfItems) {
+esp_err_t ModbusServer::ReadRequestFrame(Stream& stream, uint8_t& stationAddress, ModbusFunctionCode& functionCode, size_t& dataSize, uint16_t& transactionId) {
+#if CONFIG_PL_MODBUS_STATISTICS
+  int64_t startTime = esp_timer_get_time();
+  esp_err_t error = ReadFrame(stream, stationAddress, functionCode, dataSize, transactionId);
+  uint32_t readFrameTime = esp_timer_get_time() - startTime;
+
+  if (error == ESP_ERR_NOT_FOUND || ((error == ESP_OK || error == ESP_ERR_INVALID_SIZE) && !IsStationHosted(stationAddress)))
+    numberOfForeignFrames.fetch_add(1, std::memory_order_relaxed);
+  else if (error == ESP_ERR_INVALID_CRC)
+    numberOfCrcErrors.fetch_add(1, std::memory_order_relaxed);
+  else if (error != ESP_OK)
+    numberOfFrameErrors.fetch_add(1, std::memory_order_relaxed);
+  else {
+    auto& statistics = functionCodeStatistics[ModbusServerStatistics::GetFunctionCodeIndex(functionCode)];
+    statistics.numberOfRequests.fetch_add(1, std::memory_order_relaxed);
+    statistics.readFrameTime.Add(readFrameTime);
+    numberOfBytesReceived.fetch_add(GetFrameSize(dataSize), std::memory_order_relaxed);
+  }
+  return error;
+#else
+  return ReadFrame(stream, stationAddress, functionCode, dataSize, transactionId);
+#endif
+}
+
+//==============================================================================
+
+esp_err_t ModbusServer::HandleAndRecordRequest(Stream& stream, uint8_t stationAddress, ModbusFunctionCode functionCode, size_t dataSize, uint16_t transactionId) {
+#if CONFIG_PL_MODBUS_STATISTICS
+  int64_t startTime = esp_timer_get_time();
+  writeFrameTime = 0;
+  esp_err_t error = HandleRequest(stream, stationAddress, functionCode, dataSize, transactionId);
+  uint32_t handleTime = esp_timer_get_time() - startTime - writeFrameTime;
+  functionCodeStatistics[ModbusServerStatistics::GetFunctionCodeIndex(functionCode)].handleTime.Add(handleTime);
+  return error;
+#else
+  return HandleRequest(stream, stationAddress, functionCode, dataSize, transactionId);
+#endif
+}
+
+//==============================================================================
+
+esp_err_t ModbusServer::DispatchRequest(Stream& stream, uint8_t stationAddress, ModbusFunctionCode functionCode, size_t dataSize, uint16_t transactionId) {
+  Worker* worker;
+  xQueueReceive(idleWorkers, &worker, portMAX_DELAY);
+  esp_err_t error = InitializeTaskBuffer(worker->taskBuffer);
+  if (error != ESP_OK) {
+    xQueueSend(idleWorkers, &worker, 0);
+    ESP_RETURN_ON_ERROR(error, TAG, "initialize worker buffer failed");
+  }
+
+  memcpy(worker->taskBuffer.dataBuffer->data, GetDataBuffer().data, dataSize);
+  worker->stationAddress = stationAddress;
+  worker->functionCode = functionCode;
+  worker->dataSize = dataSize;
+  worker->transactionId = transactionId;
+  worker->captureConnectionId = requestCaptureConnectionId;
+  worker->stream = &stream;
+  xTaskNotifyGive(worker->task);
+  return ESP_OK;
+}
+
+//==============================================================================
+
+bool ModbusServer::IsWorkerTask() {
+  return currentWorker && currentWorker->modbusServer == this;
+}
+
+//==============================================================================
+
+esp_err_t ModbusServer::WaitForWorkers(TickType_t timeout, bool pendingStreamsOnly) {
+  if (!idleWorkers)
+    return ESP_OK;
+  // Streams are removed only by the server task with the server locked, so the stream of a worker that has just become idle is still valid.
+  // The data received from a stream is read only by the server task, so a stream without pending data has not been readable for the server task either.
+  auto isWaitNeeded = [&]() {
+    for (auto& worker : workers) {
+      Stream* stream = worker->stream;
+      // Workers are only used by the network server.
+      if (stream && (!pendingStreamsOnly || stream->GetReadableSize() || static_cast<NetworkStream*>(stream)->IsPeerClosed()))
+        return true;
+    }
+    return false;
+  };
+
+  TickType_t startTime = xTaskGetTickCount();
+  // Each worker gives workerDone when it becomes idle (the semaphore can also have the counts of the earlier requests).
+  while (isWaitNeeded()) {
+    TickType_t time = xTaskGetTickCount() - startTime;
+    if (timeout != portMAX_DELAY && time >= timeout)
+      return ESP_ERR_TIMEOUT;
+    xSemaphoreTake(workerDone, timeout == portMAX_DELAY ? portMAX_DELAY : timeout - time);
+  }
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t ModbusServer::StartWorkers() {
+  if (workers.empty() || idleWorkers)
+    return ESP_OK;
+
+  // The server is locked only before the worker queue is created (Lock waits for the queued workers).
+  for (auto& worker : workers)
+    ESP_RETURN_ON_ERROR(InitializeTaskBuffer(worker->taskBuffer), TAG, "worker buffer allocation failed");
+  std::string name = GetName();
+
+  idleWorkers = xQueueCreate(workers.size(), sizeof(Worker*));
+  workerDone = xSemaphoreCreateCounting(workers.size(), 0);
+  if (!idleWorkers || !workerDone) {
+    StopWorkers();
+    ESP_RETURN_ON_ERROR(ESP_ERR_NO_MEM, TAG, "worker queue allocation failed");
+  }
+
+  for (auto& worker : workers) {
+    worker->stream = NULL;
+    worker->stop = false;
+    worker->stopped = false;
+    if (xTaskCreatePinnedToCore(WorkerTask, name.c_str(), worker->taskParameters.stackDepth, worker.get(), worker->taskParameters.priority, &worker->task, worker->taskParameters.coreId) != pdPASS) {
+      worker->task = NULL;
+      StopWorkers();
+      ESP_RETURN_ON_ERROR(ESP_FAIL, TAG, "worker task creation failed");
+    }
+    Worker* workerPointer = worker.get();
+    xQueueSend(idleWorkers, &workerPointer, 0);
+  }
+  return ESP_OK;
+}
+
+//==============================================================================
+
+void ModbusServer::StopWorkers() {
+  for (auto& worker : workers) {
+    if (worker->task) {
+      // Waits for the request being handled to be answered.
+      while (worker->stream)
+        vTaskDelay(1);
+      worker->stop = true;
+      xTaskNotifyGive(worker->task);
+      while (!worker->stopped)
+        vTaskDelay(1);
+      worker->task = NULL;
+    }
+  }
+
+  if (idleWorkers) {
+    vQueueDelete(idleWorkers);
+    idleWorkers = NULL;
+  }
+  if (workerDone) {
+    vSemaphoreDelete(workerDone);
+    workerDone = NULL;
+  }
+}
+
+//==============================================================================
+
+void ModbusServer::WorkerTask(void* parameters) {
+  Worker& worker = *(Worker*)parameters;
+  ModbusServer& modbusServer = *worker.modbusServer;
+  currentWorker = &worker;
+  modbusServer.SetTaskBuffer(&worker.taskBuffer);
+
+  while (!worker.stop) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (Stream* stream = worker.stream) {
+      modbusServer.HandleAndRecordRequest(*stream, worker.stationAddress, worker.functionCode, worker.dataSize, worker.transactionId);
+      worker.stream = NULL;
+      Worker* workerPointer = &worker;
+      xQueueSend(modbusServer.idleWorkers, &workerPointer, 0);
+      xSemaphoreGive(modbusServer.workerDone);
+    }
+  }
+
+  worker.stopped = true;
+  vTaskDelete(NULL);
+}
+
+//==============================================================================
+
+bool ModbusServer::DeferOnWrite(ModbusMemoryArea& memoryArea, uint16_t address, uint16_t numberOfItems) {
+  if (!memoryArea.IsOnWriteDeferrable())
+    return false;
+  LockGuard lg(deferredOnWrite->mutex);
+  DeferredOnWriteStatistics& statistics = deferredOnWrite->statistics;
+  statistics.numberOfWrites++;
+
+  // Coalesces with a pending notification for the same or adjacent items of the memory area.
+  uint32_t endAddress = (uint32_t)address + numberOfItems;
+  for (auto& pendingWrite : deferredOnWrite->pendingWrites) {
+    uint32_t pendingEndAddress = (uint32_t)pendingWrite.address + pendingWrite.numberOfItems;
+    if (pendingWrite.memoryArea == &memoryArea && address <= pendingEndAddress && pendingWrite.address <= endAddress) {
+      uint16_t newAddress = std::min(address, pendingWrite.address);
+      pendingWrite.numberOfItems = std::max(endAddress, pendingEndAddress) - newAddress;
+      pendingWrite.address = newAddress;
+      statistics.numberOfCoalescedWrites++;
+      return true;
+    }
+  }
+
+  if (deferredOnWrite->pendingWrites.size() >= deferredOnWrite->maxQueueDepth) {
+    statistics.numberOfOverflows++;
+    return false;
+  }
+
+  deferredOnWrite->pendingWrites.push_back({&memoryArea, address, numberOfItems, esp_timer_get_time()});
+  statistics.queueDepth = deferredOnWrite->pendingWrites.size();
+  statistics.maxQueueDepth = std::max(statistics.maxQueueDepth, statistics.queueDepth);
+  xTaskNotifyGive(deferredOnWrite->task);
+  return true;
+}
+
+//==============================================================================
+
+void ModbusServer::DeferredOnWriteTask(void* parameters) {
+  DeferredOnWrite& deferredOnWrite = *(DeferredOnWrite*)parameters;
+
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    while (true) {
+      PendingWrite pendingWrite;
+      {
+        LockGuard lg(deferredOnWrite.mutex);
+        if (deferredOnWrite.pendingWrites.empty())
+          break;
+        pendingWrite = deferredOnWrite.pendingWrites.front();
+        deferredOnWrite.pendingWrites.erase(deferredOnWrite.pendingWrites.begin());
+        DeferredOnWriteStatistics& statistics = deferredOnWrite.statistics;
+        statistics.queueDepth = deferredOnWrite.pendingWrites.size();
+        statistics.numberOfNotifications++;
+      }
+
+      esp_err_t error;
+      int64_t lag;
+      {
+        LockGuard lg(*pendingWrite.memoryArea);
+        lag = esp_timer_get_time() - pendingWrite.time;
+        error = pendingWrite.memoryArea->OnWrite(pendingWrite.address, pendingWrite.numberOfItems);
+      }
+      LockGuard lg(deferredOnWrite.mutex);
+      DeferredOnWriteStatistics& statistics = deferredOnWrite.statistics;
+      statistics.lastLag = lag;
+      statistics.maxLag = std::max(statistics.maxLag, statistics.lastLag);
+      if (error != ESP_OK)
+        statistics.numberOfErrors++;
+    }
+
+    LockGuard lg(deferredOnWrite.mutex);
+    if (deferredOnWrite.stop && deferredOnWrite.pendingWrites.empty())
+      break;
+  }
+
+  deferredOnWrite.stopped = true;
+  vTaskDelete(NULL);
+}
+
+//==============================================================================
+
+bool ModbusServer::IsStationHosted(uint8_t stationAddress) {
+  return stationAddress == this->stationAddress || stationAddress == 0 || stationMemoryAreasIndexes[stationAddress];
+}
+
+//==============================================================================
+
+esp_err_t ModbusServer::SkipRtuData(Stream& stream, size_t size) {
+  // Reads all the data that is already received in one call and waits for the next byte with the inter-character read timeout.
+  while (size) {
+    if (size_t readSize = std::min(size, stream.GetReadableSize())) {
+      ESP_RETURN_ON_ERROR(stream.Read(NULL, readSize), TAG, "stream read failed");
+      size -= readSize;
+    }
+    else {
+      // Read timeout: the line is idle, so the frame has ended.
+      if (stream.Read(NULL, 1) != ESP_OK)
+        return ESP_OK;
+      size--;
+    }
+  }
+  return ESP_OK;
+}
+
+//==============================================================================
+
+bool ModbusServer::FindMemoryAreas(uint8_t stationAddress, ModbusMemoryType memoryType, uint16_t address, uint16_t numberOfItems, std::vector<MemoryAreaRange>& memoryAreaRanges) {
+  // Additional stations take precedence over the main station with the same address. Broadcast requests go to the main station.
+  auto& memoryAreas = stationMemoryAreasIndexes[stationAddress] ? stationMemoryAreas[stationMemoryAreasIndexes[stationAddress] - 1] : this->memoryAreas;
+  memoryAreaRanges.clear();
+
+  // Single memory area that contains the whole range
   for (auto& memoryArea : memoryAreas) {
-    if (memoryArea->type == memoryType && memoryArea->address <= address && memoryArea->address + memoryArea->numberOfItems >= address + numberOfItems)
-      return memoryArea;
+    if (memoryArea->type == memoryType && memoryArea->address <= address && memoryArea->address + memoryArea->numberOfItems >= address + numberOfItems) {
+      memoryAreaRanges.push_back({memoryArea.get(), address, numberOfItems, 0});
+      return true;
+    }
   }
-  return NULL;
+
+  // Adjacent memory areas in ascending address order (which is also the locking order)
+  uint32_t rangeAddress = address;
+  uint32_t rangeEnd = (uint32_t)address + numberOfItems;
+  while (rangeAddress < rangeEnd) {
+    ModbusMemoryArea* rangeMemoryArea = NULL;
+    for (auto& memoryArea : memoryAreas) {
+      if (memoryArea->type == memoryType && memoryArea->address <= rangeAddress && memoryArea->address + memoryArea->numberOfItems > rangeAddress) {
+        rangeMemoryArea = memoryArea.get();
+        break;
+      }
+    }
+    if (!rangeMemoryArea)
+      return false;
+    uint32_t rangeNumberOfItems = std::min(rangeEnd, (uint32_t)(rangeMemoryArea->address + rangeMemoryArea->numberOfItems)) - rangeAddress;
+    memoryAreaRanges.push_back({rangeMemoryArea, (uint16_t)rangeAddress, (uint16_t)rangeNumberOfItems, 0});
+    rangeAddress += rangeNumberOfItems;
+  }
+  return true;
+}
+
+//==============================================================================
+
+esp_err_t ModbusServer::ReadMemoryAreas(std::vector<MemoryAreaRange>& memoryAreaRanges, uint16_t address, void* dest) {
+  bool consistent;
+  esp_err_t error;
+
+  do {
+    error = ESP_OK;
+    size_t numberOfReadMemoryAreas = 0;
+    for (; numberOfReadMemoryAreas < memoryAreaRanges.size() && error == ESP_OK; numberOfReadMemoryAreas++)
+      error = memoryAreaRanges[numberOfReadMemoryAreas].memoryArea->BeginRead(memoryAreaRanges[numberOfReadMemoryAreas].sequence);
+    if (error != ESP_OK)
+      numberOfReadMemoryAreas--;
+
+    for (size_t i = 0; i < numberOfReadMemoryAreas && error == ESP_OK; i++) {
+      auto& memoryAreaRange = memoryAreaRanges[i];
+      ModbusMemoryArea& memoryArea = *memoryAreaRange.memoryArea;
+      if ((error = memoryArea.OnRead(memoryAreaRange.address, memoryAreaRange.numberOfItems)) != ESP_OK)
+        break;
+      if (memoryArea.type == ModbusMemoryType::coils || memoryArea.type == ModbusMemoryType::discreteInputs)
+        CopyBits(memoryArea.data, memoryAreaRange.address - memoryArea.address, dest, memoryAreaRange.address - address, memoryAreaRange.numberOfItems);
+      else
+        CopySwappedRegisters((uint8_t*)memoryArea.data + (memoryAreaRange.address - memoryArea.address) * 2, (uint8_t*)dest + (memoryAreaRange.address - address) * 2, memoryAreaRange.numberOfItems);
+    }
+
+    consistent = true;
+    for (size_t i = numberOfReadMemoryAreas; i > 0; i--)
+      consistent &= memoryAreaRanges[i - 1].memoryArea->EndRead(memoryAreaRanges[i - 1].sequence);
+  } while (!consistent && error == ESP_OK);
+
+  return error;
+}
+
+//==============================================================================
+
+esp_err_t ModbusServer::WriteMemoryAreas(std::vector<MemoryAreaRange>& memoryAreaRanges, uint16_t address, const void* src) {
+  esp_err_t error = ESP_OK;
+  size_t numberOfLockedMemoryAreas = 0;
+  for (; numberOfLockedMemoryAreas < memoryAreaRanges.size() && error == ESP_OK; numberOfLockedMemoryAreas++)
+    error = memoryAreaRanges[numberOfLockedMemoryAreas].memoryArea->Lock();
+  if (error != ESP_OK)
+    numberOfLockedMemoryAreas--;
+
+  // Read callbacks for all areas are called before writing any data.
+  for (size_t i = 0; i < numberOfLockedMemoryAreas && error == ESP_OK; i++)
+    error = memoryAreaRanges[i].memoryArea->OnRead(memoryAreaRanges[i].address, memoryAreaRanges[i].numberOfItems);
+
+  if (error == ESP_OK) {
+    for (auto& memoryAreaRange : memoryAreaRanges) {
+      ModbusMemoryArea& memoryArea = *memoryAreaRange.memoryArea;
+      if (memoryArea.type == ModbusMemoryType::coils || memoryArea.type == ModbusMemoryType::discreteInputs)
+        CopyBits(src, memoryAreaRange.address - address, memoryArea.data, memoryAreaRange.address - memoryArea.address, memoryAreaRange.numberOfItems);
+      else
+        CopySwappedRegisters((uint8_t*)src + (memoryAreaRange.address - address) * 2, (uint8_t*)memoryArea.data + (memoryAreaRange.address - memoryArea.address) * 2, memoryAreaRange.numberOfItems);
+    }
+
+    for (auto& memoryAreaRange : memoryAreaRanges) {
+      if (deferredOnWrite && DeferOnWrite(*memoryAreaRange.memoryArea, memoryAreaRange.address, memoryAreaRange.numberOfItems))
+        continue;
+      esp_err_t onWriteError = memoryAreaRange.memoryArea->OnWrite(memoryAreaRange.address, memoryAreaRange.numberOfItems);
+      if (error == ESP_OK)
+        error = onWriteError;
+    }
+  }
+
+  for (size_t i = numberOfLockedMemoryAreas; i > 0; i--)
+    memoryAreaRanges[i - 1].memoryArea->Unlock();
+  return error;
+}
+
+//==============================================================================
+
+esp_err_t ModbusServer::HandleChangeSubscriptionRequest(Stream& stream, uint8_t stationAddress, size_t dataSize, uint16_t transactionId, std::vector<MemoryAreaRange>& memoryAreaRanges) {
+  const ModbusFunctionCode functionCode = ModbusFunctionCode::changeSubscription;
+  ESP_RETURN_ON_FALSE(stationAddress != 0, ESP_ERR_INVALID_RESPONSE, TAG, "change subscription request with station address 0 is not supported");
+  uint8_t* data = (uint8_t*)GetDataBuffer().data;
+  if (dataSize < 2) {
+    ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::illegalDataValue, transactionId), TAG, "write exception frame failed");
+    return ESP_OK;
+  }
+  ModbusChangeSubscriptionCommand command = (ModbusChangeSubscriptionCommand)data[0];
+  LockGuard lg(changeSubscriptions->mutex);
+  auto& subscriptions = changeSubscriptions->subscriptions;
+  TickType_t time = xTaskGetTickCount();
+
+  if (command == ModbusChangeSubscriptionCommand::subscribe) {
+    if (dataSize != 8 || data[1] > (uint8_t)ModbusMemoryType::inputRegisters) {
+      ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::illegalDataValue, transactionId), TAG, "write exception frame failed");
+      return ESP_OK;
+    }
+    ModbusMemoryType memoryType = (ModbusMemoryType)data[1];
+    uint_fast16_t memoryAddress = (data[2] << 8) | data[3];
+    uint_fast16_t numberOfMemoryItems = (data[4] << 8) | data[5];
+    uint16_t deadband = (data[6] << 8) | data[7];
+    if (numberOfMemoryItems == 0 || numberOfMemoryItems > maxNumberOfSubscribedItems) {
+      ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::illegalDataValue, transactionId), TAG, "write exception frame failed");
+      return ESP_OK;
+    }
+    if (memoryAddress > 0xFFFF - numberOfMemoryItems + 1 || !FindMemoryAreas(stationAddress, memoryType, memoryAddress, numberOfMemoryItems, memoryAreaRanges)) {
+      ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::illegalDataAddress, transactionId), TAG, "write exception frame failed");
+      return ESP_OK;
+    }
+
+    // Free slot or the subscription that has not been requested for the longest time beyond the timeout
+    ChangeSubscription* subscription = NULL;
+    for (auto& s : subscriptions) {
+      if (!s.id) {
+        subscription = &s;
+        break;
+      }
+      if (changeSubscriptions->timeout && time - s.requestTime > changeSubscriptions->timeout && (!subscription || time - s.requestTime > time - subscription->requestTime))
+        subscription = &s;
+    }
+    if (!subscription) {
+      ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::serverDeviceBusy, transactionId), TAG, "write exception frame failed");
+      return ESP_OK;
+    }
+    subscription->id = 0;
+
+    // IDs are not reused while the subscription is active, so a client of a replaced subscription gets an exception.
+    uint8_t id = changeSubscriptions->lastId;
+    bool idUsed;
+    do {
+      id = (id == 255) ? 1 : id + 1;
+      idUsed = false;
+      for (auto& s : subscriptions)
+        idUsed |= s.id == id;
+    } while (idUsed);
+    changeSubscriptions->lastId = id;
+
+    size_t memorySize = (memoryType == ModbusMemoryType::coils || memoryType == ModbusMemoryType::discreteInputs) ? (numberOfMemoryItems - 1) / 8 + 1 : numberOfMemoryItems * 2;
+    subscription->id = id;
+    subscription->stationAddress = stationAddress;
+    subscription->memoryType = memoryType;
+    subscription->address = memoryAddress;
+    subscription->numberOfItems = numberOfMemoryItems;
+    subscription->deadband = deadband;
+    subscription->sequence = 0;
+    subscription->requestTime = time;
+    subscription->reportedData.assign(memorySize, 0);
+    subscription->sentData.assign(memorySize, 0);
+    subscription->currentData.assign(memorySize, 0);
+    subscription->reportedItems.assign((numberOfMemoryItems - 1) / 8 + 1, 0);
+    subscription->sentItems.assign((numberOfMemoryItems - 1) / 8 + 1, 0);
+    data[1] = id;
+    ESP_RETURN_ON_ERROR(WriteFrame(stream, stationAddress, functionCode, 2, transactionId), TAG, "write frame failed");
+    return ESP_OK;
+  }
+
+  ChangeSubscription* subscription = NULL;
+  for (auto& s : subscriptions) {
+    if (s.id && s.id == data[1] && s.stationAddress == stationAddress)
+      subscription = &s;
+  }
+
+  if (command == ModbusChangeSubscriptionCommand::unsubscribe && dataSize == 2) {
+    if (!subscription) {
+      ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::illegalDataValue, transactionId), TAG, "write exception frame failed");
+      return ESP_OK;
+    }
+    *subscription = ChangeSubscription();
+    ESP_RETURN_ON_ERROR(WriteFrame(stream, stationAddress, functionCode, 2, transactionId), TAG, "write frame failed");
+    return ESP_OK;
+  }
+
+  if (command == ModbusChangeSubscriptionCommand::readChanges && dataSize == 3) {
+    if (!subscription) {
+      ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::illegalDataValue, transactionId), TAG, "write exception frame failed");
+      return ESP_OK;
+    }
+    subscription->requestTime = time;
+
+    // The request acknowledges the last response with its sequence number: the sent values are confirmed, otherwise they are sent again.
+    if (data[2] == subscription->sequence) {
+      for (size_t i = 0; i < subscription->numberOfItems; i++) {
+        if (!((subscription->sentItems[i / 8] >> (i % 8)) & 1))
+          continue;
+        if (subscription->memoryType == ModbusMemoryType::coils || subscription->memoryType == ModbusMemoryType::discreteInputs)
+          CopyBits(subscription->sentData.data(), i, subscription->reportedData.data(), i, 1);
+        else
+          memcpy(subscription->reportedData.data() + i * 2, subscription->sentData.data() + i * 2, 2);
+        subscription->reportedItems[i / 8] |= 1 << (i % 8);
+      }
+    }
+    std::fill(subscription->sentItems.begin(), subscription->sentItems.end(), 0);
+
+    esp_err_t error;
+    if (!FindMemoryAreas(stationAddress, subscription->memoryType, subscription->address, subscription->numberOfItems, memoryAreaRanges)) {
+      ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::illegalDataAddress, transactionId), TAG, "write exception frame failed");
+      return ESP_OK;
+    }
+    if ((error = ReadMemoryAreas(memoryAreaRanges, subscription->address, subscription->currentData.data())) != ESP_OK) {
+      ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, GetMemoryAreaException(error), transactionId), TAG, "write exception frame failed");
+      return ESP_OK;
+    }
+
+    // Response: command, ID, sequence number, flags (bit 0 - more changes), byte count, changed blocks (address, number of items, items)
+    bool moreChanges;
+    size_t size = ReadChanges(*subscription, data + 5, std::min(GetDataBuffer().size, (size_t)252) - 5, moreChanges);
+    if (size)
+      subscription->sequence++;
+    data[2] = subscription->sequence;
+    data[3] = moreChanges;
+    data[4] = size;
+    ESP_RETURN_ON_ERROR(WriteFrame(stream, stationAddress, functionCode, size + 5, transactionId), TAG, "write frame failed");
+    return ESP_OK;
+  }
+
+  ESP_RETURN_ON_ERROR(WriteExceptionFrame(stream, stationAddress, functionCode, ModbusException::illegalDataValue, transactionId), TAG, "write exception frame failed");
+  return ESP_OK;
+}
+
+//==============================================================================
+
+size_t ModbusServer::ReadChanges(ChangeSubscription& subscription, uint8_t* dest, size_t maxSize, bool& moreChanges) {
+  bool bits = subscription.memoryType == ModbusMemoryType::coils || subscription.memoryType == ModbusMemoryType::discreteInputs;
+  const uint8_t* current = subscription.currentData.data();
+  const uint8_t* reported = subscription.reportedData.data();
+  auto isChanged = [&](size_t i) {
+    if (!((subscription.reportedItems[i / 8] >> (i % 8)) & 1))
+      return true;
+    if (bits)
+      return (((current[i / 8] ^ reported[i / 8]) >> (i % 8)) & 1) != 0;
+    int difference = ((current[i * 2] << 8) | current[i * 2 + 1]) - ((reported[i * 2] << 8) | reported[i * 2 + 1]);
+    return abs(difference) > subscription.deadband;
+  };
+  // Unchanged items between two changes are sent in one block if they are not larger than a block header (4 bytes).
+  size_t maxGap = bits ? 32 : 2;
+
+  size_t size = 0;
+  moreChanges = false;
+  for (size_t i = 0; i < subscription.numberOfItems;) {
+    if (!isChanged(i)) {
+      i++;
+      continue;
+    }
+    size_t end = i + 1;
+    for (size_t j = end; j < subscription.numberOfItems && j - end <= maxGap; j++) {
+      if (isChanged(j))
+        end = j + 1;
+    }
+
+    size_t numberOfItems = end - i;
+    size_t maxNumberOfItems = (maxSize - size > 4) ? (bits ? (maxSize - size - 4) * 8 : (maxSize - size - 4) / 2) : 0;
+    if (numberOfItems > maxNumberOfItems) {
+      moreChanges = true;
+      if (!maxNumberOfItems)
+        break;
+      numberOfItems = maxNumberOfItems;
+    }
+
+    uint8_t* block = dest + size;
+    uint16_t address = subscription.address + i;
+    block[0] = address >> 8;
+    block[1] = address;
+    block[2] = numberOfItems >> 8;
+    block[3] = numberOfItems;
+    if (bits) {
+      size_t blockDataSize = (numberOfItems - 1) / 8 + 1;
+      memset(block + 4, 0, blockDataSize);
+      CopyBits(current, i, block + 4, 0, numberOfItems);
+      size += 4 + blockDataSize;
+    }
+    else {
+      memcpy(block + 4, current + i * 2, numberOfItems * 2);
+      size += 4 + numberOfItems * 2;
+    }
+    for (size_t j = i; j < i + numberOfItems; j++)
+      subscription.sentItems[j / 8] |= 1 << (j % 8);
+    i += numberOfItems;
+    if (moreChanges)
+      break;
+  }
+
+  if (size)
+    subscription.sentData = subscription.currentData;
+  return size;
+}
+
+//==============================================================================
+
+ModbusException ModbusServer::GetMemoryAreaException(esp_err_t error) {
+  // Memory areas that mirror other devices (e.g. ModbusConcentratorMemoryArea) return a timeout when the device does not respond
+  // and the device exception when it rejects the request.
+  if (error > ModbusMemoryArea::exceptionErrorBase && error <= ModbusMemoryArea::exceptionErrorBase + 0xFF)
+    return (ModbusException)(error - ModbusMemoryArea::exceptionErrorBase);
+  return (error == ESP_ERR_TIMEOUT) ? ModbusException::gatewayTargetDeviceFailedToRespond : ModbusException::serverDeviceFailure;
 }
 
 //==============================================================================
@@ -0,0 +1,77 @@
+#include "pl_modbus_statistics.h"
+#include <algorithm>
+
+//==============================================================================
+
+namespace PL {
+
+//==============================================================================
+
+size_t ModbusLatencyHistogram::GetBucketIndex(uint32_t time) {
+  if (time < 2)
+    return 0;
+  return std::min((size_t)(31 - __builtin_clz(time)), numberOfBuckets - 1);
+}
+
+//==============================================================================
+
+uint32_t ModbusLatencyHistogram::GetPercentile(float percentile) const {
+  if (!count)
+    return 0;
+  uint32_t rank = (uint32_t)(count * percentile / 100);
+  uint32_t sum = 0;
+  for (size_t i = 0; i < numberOfBuckets - 1; i++) {
+    sum += counts[i];
+    if (sum > rank)
+      return std::min(((uint32_t)2 << i) - 1, max);
+  }
+  return max;
+}
+
+//==============================================================================
+
+void ModbusLatencyHistogramRecorder::Add(uint32_t time) {
+  counts[ModbusLatencyHistogram::GetBucketIndex(time)].fetch_add(1, std::memory_order_relaxed);
+  count.fetch_add(1, std::memory_order_relaxed);
+  uint32_t currentMax = max.load(std::memory_order_relaxed);
+  while (time > currentMax && !max.compare_exchange_weak(currentMax, time, std::memory_order_relaxed));
+}
+
+//==============================================================================
+
+void ModbusLatencyHistogramRecorder::Get(ModbusLatencyHistogram& histogram) const {
+  for (size_t i = 0; i < ModbusLatencyHistogram::numberOfBuckets; i++)
+    histogram.counts[i] = counts[i].load(std::memory_order_relaxed);
+  histogram.count = count.load(std::memory_order_relaxed);
+  histogram.max = max.load(std::memory_order_relaxed);
+}
+
+//==============================================================================
+
+void ModbusLatencyHistogramRecorder::Reset() {
+  for (auto& bucketCount : counts)
+    bucketCount.store(0, std::memory_order_relaxed);
+  count.store(0, std::memory_order_relaxed);
+  max.store(0, std::memory_order_relaxed);
+}
+
+//==============================================================================
+
+size_t ModbusServerStatistics::GetFunctionCodeIndex(ModbusFunctionCode functionCode) {
+  functionCode = (ModbusFunctionCode)((uint8_t)functionCode & 0x7F);
+  for (size_t i = 0; i < numberOfFunctionCodes - 1; i++) {
+    if (functionCodes[i] == functionCode)
+      return i;
+  }
+  return numberOfFunctionCodes - 1;
+}
+
+//==============================================================================
+
+const ModbusServerStatistics::FunctionCodeStatistics& ModbusServerStatistics::GetFunctionCodeStatistics(ModbusFunctionCode functionCode) const {
+  return functionCodeStatistics[GetFunctionCodeIndex(functionCode)];
+}
+
+//==============================================================================
+
+}
\ No newline at end of file
@@ -43,6 +43,12 @@ private:
   uint16_t data;
 };
 
+class UptimeInputRegisters : public PL::ModbusMemoryArea {
+public:
+  UptimeInputRegisters(uint16_t address, size_t numberOfRegisters);
+  esp_err_t OnRead(uint16_t address, uint16_t numberOfItems) override;
+};
+
 //==============================================================================
 
 extern "C" void app_main(void) {
@@ -97,6 +103,10 @@ extern "C" void app_main(void) {
   auto secondCounterInputRegister = std::make_shared<SecondCounterInputRegister>(20);
   server.AddMemoryArea(secondCounterInputRegister);
 
+  // Dynamic input registers (addresses 100..1099) that contain the uptime value in seconds plus the register index.
+  // Only the requested registers are updated on each read.
+  server.AddMemoryArea(std::make_shared<UptimeInputRegisters>(100, 1000));
+
   server.Enable();
 
   while (1) {
@@ -115,3 +125,17 @@ esp_err_t SecondCounterInputRegister::OnRead() {
   data = xTaskGetTickCount() * portTICK_PERIOD_MS / 1000;
   return ESP_OK;
 }
+
+//==============================================================================
+
+UptimeInputRegisters::UptimeInputRegisters(uint16_t address, size_t numberOfRegisters) :
+  PL::ModbusMemoryArea(PL::ModbusMemoryType::inputRegisters, address, numberOfRegisters * 2) {}
+
+//==============================================================================
+
+esp_err_t UptimeInputRegisters::OnRead(uint16_t address, uint16_t numberOfItems) {
+  uint16_t uptime = xTaskGetTickCount() * portTICK_PERIOD_MS / 1000;
+  for (int i = address - this->address; i < address - this->address + numberOfItems; i++)
+    ((uint16_t*)data)[i] = uptime + i;
+  return ESP_OK;
+}
\ No newline at end of file
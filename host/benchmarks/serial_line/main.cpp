@@ -0,0 +1,142 @@
+#include "pl_modbus.h"
+#include "pl_serial_line.h"
+#include "esp_timer.h"
+#include <algorithm>
+
+//==============================================================================
+
+// RTU and ASCII client/server transactions over the simulated half-duplex serial line of the host build.
+// Scenarios:
+//   baud_rate      - read holding registers for each protocol, baud rate and number of registers
+//   turnaround     - server delay after read (ticks) before the response
+//   multi_drop     - client polling several stations on the same line in turn
+//   bit_errors     - line with data bit errors
+// Results are printed as CSV lines
+// (scenario,protocol,baud_rate,registers,stations,delay_after_read,bit_error_rate,transactions,errors,transactions_per_second,
+//  line_limit_transactions_per_second,efficiency,p50_us,p99_us,corrupted_characters,collisions).
+// line_limit_transactions_per_second is the rate if the request and response characters were sent back to back.
+
+const uint32_t baudRates[] = {9600, 115200, 921600};
+const uint16_t numbersOfRegisters[] = {1, 16, 125};
+const int numbersOfStations[] = {1, 4, 8};
+const TickType_t delaysAfterRead[] = {0, 1, 5};
+const double bitErrorRates[] = {0, 1e-5, 1e-4, 1e-3};
+const uint32_t defaultBaudRate = 115200;
+const uint16_t defaultNumberOfRegisters = 16;
+const int64_t caseDuration = 1000000;
+const uint32_t minNumberOfTransactions = 3;
+const uint8_t firstStationAddress = 1;
+// Transaction buffer for the maximum ASCII frame (2 characters per byte)
+const size_t bufferSize = PL::ModbusBase::defaultBufferSize * 2;
+
+uint16_t memory[PL::ModbusBase::maxNumberOfModbusRegistersToRead];
+
+struct Case {
+  const char* scenario;
+  PL::ModbusProtocol protocol;
+  uint32_t baudRate;
+  uint16_t numberOfRegisters;
+  int numberOfStations;
+  TickType_t delayAfterRead;
+  double bitErrorRate;
+};
+
+//==============================================================================
+
+void Run(const Case& testCase);
+size_t GetNumberOfCharacters(PL::ModbusProtocol protocol, size_t frameSize);
+const char* GetProtocolName(PL::ModbusProtocol protocol);
+
+//==============================================================================
+
+extern "C" void app_main(void) {
+  printf("scenario,protocol,baud_rate,registers,stations,delay_after_read,bit_error_rate,transactions,errors,transactions_per_second,"
+    "line_limit_transactions_per_second,efficiency,p50_us,p99_us,corrupted_characters,collisions\n");
+
+  for (auto protocol : {PL::ModbusProtocol::rtu, PL::ModbusProtocol::ascii}) {
+    for (auto baudRate : baudRates) {
+      for (auto numberOfRegisters : numbersOfRegisters)
+        Run({"baud_rate", protocol, baudRate, numberOfRegisters, 1, 0, 0});
+    }
+    for (auto delayAfterRead : delaysAfterRead)
+      Run({"turnaround", protocol, defaultBaudRate, defaultNumberOfRegisters, 1, delayAfterRead, 0});
+    for (auto numberOfStations : numbersOfStations)
+      Run({"multi_drop", protocol, defaultBaudRate, defaultNumberOfRegisters, numberOfStations, 0, 0});
+    for (auto bitErrorRate : bitErrorRates)
+      Run({"bit_errors", protocol, defaultBaudRate, defaultNumberOfRegisters, 1, 0, bitErrorRate});
+  }
+}
+
+//==============================================================================
+
+void Run(const Case& testCase) {
+  PL::SerialLine::Parameters parameters;
+  parameters.baudRate = testCase.baudRate;
+  parameters.bitErrorRate = testCase.bitErrorRate;
+  auto line = PL::SerialLine::Create(parameters);
+
+  std::vector<std::unique_ptr<PL::ModbusServer>> servers;
+  auto memoryArea = std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::holdingRegisters, 0, memory, sizeof(memory));
+  for (int i = 0; i < testCase.numberOfStations; i++) {
+    auto server = std::make_unique<PL::ModbusServer>(line->CreateEndpoint(), testCase.protocol, firstStationAddress + i, bufferSize);
+    server->AddMemoryArea(memoryArea);
+    server->SetDelayAfterRead(testCase.delayAfterRead);
+    ESP_ERROR_CHECK(server->Enable());
+    servers.push_back(std::move(server));
+  }
+  PL::ModbusClient client(line->CreateEndpoint(), testCase.protocol, firstStationAddress, bufferSize);
+  // Read timeout of the slowest response with a margin for the turnaround
+  size_t numberOfResponseCharacters = GetNumberOfCharacters(testCase.protocol, 5 + testCase.numberOfRegisters * 2);
+  client.SetReadTimeout(std::max<TickType_t>(PL::ModbusClient::defaultReadTimeout, numberOfResponseCharacters * line->GetCharacterTime() / 1000000 * 2));
+
+  uint16_t data[PL::ModbusBase::maxNumberOfModbusRegistersToRead];
+  std::vector<uint32_t> latencies;
+  uint32_t numberOfErrors = 0;
+  int64_t startTime = esp_timer_get_time();
+  int64_t duration = 0;
+  for (uint32_t i = 0; duration < caseDuration || i < minNumberOfTransactions; i++) {
+    client.SetStationAddress(firstStationAddress + i % testCase.numberOfStations);
+    int64_t transactionStartTime = esp_timer_get_time();
+    if (client.ReadHoldingRegisters(0, testCase.numberOfRegisters, data, NULL) == ESP_OK)
+      latencies.push_back(esp_timer_get_time() - transactionStartTime);
+    else
+      numberOfErrors++;
+    duration = esp_timer_get_time() - startTime;
+  }
+
+  for (auto& server : servers)
+    server->Disable();
+
+  uint32_t numberOfTransactions = latencies.size() + numberOfErrors;
+  std::sort(latencies.begin(), latencies.end());
+  uint32_t p50 = latencies.size() ? latencies[latencies.size() / 2] : 0;
+  uint32_t p99 = latencies.size() ? latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)] : 0;
+  float transactionsPerSecond = latencies.size() * 1000000.0f / duration;
+  size_t numberOfRequestCharacters = GetNumberOfCharacters(testCase.protocol, 8);
+  float lineLimitTransactionsPerSecond = 1e9f / ((numberOfRequestCharacters + numberOfResponseCharacters) * line->GetCharacterTime());
+  PL::SerialLine::Statistics lineStatistics = line->GetStatistics();
+  printf("%s,%s,%lu,%d,%d,%lu,%g,%lu,%lu,%.1f,%.1f,%.3f,%lu,%lu,%lu,%lu\n", testCase.scenario, GetProtocolName(testCase.protocol), (unsigned long)testCase.baudRate,
+    testCase.numberOfRegisters, testCase.numberOfStations, (unsigned long)testCase.delayAfterRead, testCase.bitErrorRate, (unsigned long)numberOfTransactions,
+    (unsigned long)numberOfErrors, transactionsPerSecond, lineLimitTransactionsPerSecond, transactionsPerSecond / lineLimitTransactionsPerSecond,
+    (unsigned long)p50, (unsigned long)p99, (unsigned long)lineStatistics.numberOfCorruptedCharacters, (unsigned long)lineStatistics.numberOfCollisions);
+}
+
+//==============================================================================
+
+size_t GetNumberOfCharacters(PL::ModbusProtocol protocol, size_t frameSize) {
+  // frameSize is the RTU frame size (station address, function code, data and 2-byte CRC).
+  // ASCII frame: start character, 2 characters per byte with a 1-byte LRC instead of the CRC, CR LF.
+  if (protocol == PL::ModbusProtocol::ascii)
+    return 1 + (frameSize - 1) * 2 + 2;
+  return frameSize;
+}
+
+//==============================================================================
+
+const char* GetProtocolName(PL::ModbusProtocol protocol) {
+  switch (protocol) {
+    case PL::ModbusProtocol::rtu: return "rtu";
+    case PL::ModbusProtocol::ascii: return "ascii";
+    default: return "tcp";
+  }
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include "esp_err.h"
+
+//==============================================================================
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// The host network stack needs no initialization.
+esp_err_t esp_netif_init(void);
+
+#ifdef __cplusplus
+}
+#endif
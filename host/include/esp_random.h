@@ -0,0 +1,16 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+//==============================================================================
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t esp_random(void);
+void esp_fill_random(void* buffer, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,15 @@
+#pragma once
+#include <stdint.h>
+
+//==============================================================================
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Microseconds since the start of the process (monotonic clock)
+int64_t esp_timer_get_time(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+//==============================================================================
+// FreeRTOS subset for the Linux host build (tasks are threads, one tick is one millisecond)
+//==============================================================================
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFFUL)
+#define portNUM_PROCESSORS 2
+#define pdMS_TO_TICKS(ms) ((TickType_t)((uint64_t)(ms) * configTICK_RATE_HZ / 1000))
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+#define errQUEUE_EMPTY pdFALSE
+#define errQUEUE_FULL pdFALSE
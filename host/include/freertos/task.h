@@ -0,0 +1,34 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+
+//==============================================================================
+
+#define tskIDLE_PRIORITY ((UBaseType_t)0)
+#define tskNO_AFFINITY ((BaseType_t)0x7FFFFFFF)
+
+typedef struct HostTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+typedef struct {
+  TickType_t timeOnEntering;
+} TimeOut_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t taskFunction, const char* name, uint32_t stackDepth, void* parameters, UBaseType_t priority, TaskHandle_t* createdTask, BaseType_t coreId);
+BaseType_t xTaskCreate(TaskFunction_t taskFunction, const char* name, uint32_t stackDepth, void* parameters, UBaseType_t priority, TaskHandle_t* createdTask);
+/// Only the calling task can be deleted (task = NULL): the task function is left and the thread ends.
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticksToDelay);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait);
+void vTaskSetTimeOutState(TimeOut_t* timeOut);
+BaseType_t xTaskCheckForTimeOut(TimeOut_t* timeOut, TickType_t* ticksToWait);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,253 @@
+#pragma once
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <string.h>
+
+//==============================================================================
+// pl_common subset for the Linux host build
+//==============================================================================
+
+namespace PL {
+
+//==============================================================================
+
+/// @brief Lockable object interface
+class Lockable {
+public:
+  virtual ~Lockable() {}
+
+  /// @brief Locks the object
+  /// @param timeout timeout in FreeRTOS ticks
+  /// @return error code
+  virtual esp_err_t Lock(TickType_t timeout = portMAX_DELAY) = 0;
+
+  /// @brief Unlocks the object
+  /// @return error code
+  virtual esp_err_t Unlock() = 0;
+};
+
+//==============================================================================
+
+/// @brief Locks the objects in the constructor and unlocks them in reverse order in the destructor
+class LockGuard {
+public:
+  static constexpr size_t maxNumberOfLockables = 4;
+
+  template <class... Lockables>
+  LockGuard(Lockables&... lockables) : lockables{&lockables...}, numberOfLockables(sizeof...(Lockables)) {
+    static_assert(sizeof...(Lockables) >= 1 && sizeof...(Lockables) <= maxNumberOfLockables);
+    for (size_t i = 0; i < numberOfLockables; i++)
+      this->lockables[i]->Lock();
+  }
+  ~LockGuard() {
+    for (size_t i = numberOfLockables; i > 0; i--)
+      lockables[i - 1]->Unlock();
+  }
+  LockGuard(const LockGuard&) = delete;
+  LockGuard& operator=(const LockGuard&) = delete;
+
+private:
+  Lockable* lockables[maxNumberOfLockables];
+  size_t numberOfLockables;
+};
+
+//==============================================================================
+
+/// @brief Recursive mutex
+class Mutex : public virtual Lockable {
+public:
+  esp_err_t Lock(TickType_t timeout = portMAX_DELAY) override;
+  esp_err_t Unlock() override;
+
+private:
+  std::recursive_timed_mutex mutex;
+};
+
+//==============================================================================
+
+/// @brief Memory buffer
+class Buffer : public virtual Lockable {
+public:
+  /// @brief buffer data
+  void* const data;
+  /// @brief buffer size
+  const size_t size;
+
+  /// @brief Allocates the buffer
+  /// @param size buffer size
+  Buffer(size_t size);
+
+  /// @brief Creates a buffer from preallocated memory
+  /// @param data data pointer
+  /// @param size data size
+  Buffer(void* data, size_t size);
+
+  /// @brief Creates a buffer from preallocated memory with shared lockable
+  /// @param data data pointer
+  /// @param size data size
+  /// @param lockable lockable object that is locked when this buffer is locked
+  Buffer(void* data, size_t size, std::shared_ptr<Lockable> lockable);
+  ~Buffer();
+  Buffer(const Buffer&) = delete;
+  Buffer& operator=(const Buffer&) = delete;
+
+  esp_err_t Lock(TickType_t timeout = portMAX_DELAY) override;
+  esp_err_t Unlock() override;
+
+private:
+  Mutex mutex;
+  std::shared_ptr<Lockable> lockable;
+  bool allocated;
+};
+
+//==============================================================================
+
+/// @brief Stream interface
+class Stream : public virtual Lockable {
+public:
+  /// @brief Default read timeout in FreeRTOS ticks
+  static constexpr TickType_t defaultReadTimeout = 300 / portTICK_PERIOD_MS;
+  /// @brief Default write timeout in FreeRTOS ticks
+  static constexpr TickType_t defaultWriteTimeout = 300 / portTICK_PERIOD_MS;
+
+  /// @brief Reads data from the stream (waits for the whole size up to the read timeout)
+  /// @param dest destination (NULL to discard the data)
+  /// @param size number of bytes to read
+  /// @return error code
+  virtual esp_err_t Read(void* dest, size_t size) = 0;
+
+  /// @brief Reads data from the stream into the buffer
+  /// @param dest destination buffer
+  /// @param offset destination buffer offset
+  /// @param size number of bytes to read
+  /// @return error code
+  esp_err_t Read(Buffer& dest, size_t offset, size_t size);
+
+  /// @brief Reads and discards the data up to and including the termination character
+  /// @param termChar termination character
+  /// @return error code
+  esp_err_t ReadUntil(char termChar);
+
+  /// @brief Writes data to the stream
+  /// @param src source
+  /// @param size number of bytes to write
+  /// @return error code
+  virtual esp_err_t Write(const void* src, size_t size) = 0;
+
+  /// @brief Writes data from the buffer to the stream
+  /// @param src source buffer
+  /// @param offset source buffer offset
+  /// @param size number of bytes to write
+  /// @return error code
+  esp_err_t Write(Buffer& src, size_t offset, size_t size);
+
+  /// @brief Discards the received data until no data is received during the timeout
+  /// @param timeout timeout in FreeRTOS ticks
+  /// @return error code
+  esp_err_t FlushReadBuffer(TickType_t timeout = 0);
+
+  /// @brief Gets the number of bytes that can be read without waiting
+  /// @return number of bytes
+  virtual size_t GetReadableSize() = 0;
+
+  virtual TickType_t GetReadTimeout() = 0;
+  virtual esp_err_t SetReadTimeout(TickType_t timeout) = 0;
+  virtual TickType_t GetWriteTimeout() = 0;
+  virtual esp_err_t SetWriteTimeout(TickType_t timeout) = 0;
+};
+
+//==============================================================================
+
+/// @brief Task parameters
+struct TaskParameters {
+  /// @brief stack depth (not used by the host build)
+  uint32_t stackDepth;
+  /// @brief priority (not used by the host build)
+  UBaseType_t priority;
+  /// @brief core ID (not used by the host build)
+  BaseType_t coreId;
+};
+
+//==============================================================================
+
+/// @brief Server interface
+class Server : public virtual Lockable {
+public:
+  /// @brief Default server task parameters
+  static constexpr TaskParameters defaultTaskParameters = {4096, tskIDLE_PRIORITY + 5, tskNO_AFFINITY};
+
+  virtual esp_err_t Enable() = 0;
+  virtual esp_err_t Disable() = 0;
+  virtual bool IsEnabled() = 0;
+
+  /// @brief Gets the server name
+  /// @return name
+  std::string GetName();
+
+  /// @brief Sets the server name
+  /// @param name name
+  /// @return error code
+  esp_err_t SetName(const std::string& name);
+
+private:
+  std::string name;
+};
+
+//==============================================================================
+
+/// @brief Server that handles the requests received by a stream
+class StreamServer : public Server {
+public:
+  /// @brief Creates a stream server
+  /// @param stream stream
+  StreamServer(std::shared_ptr<Stream> stream);
+  ~StreamServer();
+
+  esp_err_t Lock(TickType_t timeout = portMAX_DELAY) override;
+  esp_err_t Unlock() override;
+  esp_err_t Enable() override;
+  esp_err_t Disable() override;
+  bool IsEnabled() override;
+
+  /// @brief Sets the server task parameters
+  /// @param taskParameters task parameters
+  /// @return error code
+  esp_err_t SetTaskParameters(const TaskParameters& taskParameters);
+
+  /// @brief Gets the stream
+  /// @return stream
+  std::weak_ptr<Stream> GetStream();
+
+protected:
+  /// @brief Handles the request (called by the server task with the server and the stream locked when the stream has data to read)
+  /// @param stream stream
+  /// @return error code
+  virtual esp_err_t HandleRequest(Stream& stream) = 0;
+
+private:
+  Mutex mutex;
+  std::shared_ptr<Stream> stream;
+  TaskParameters taskParameters = defaultTaskParameters;
+  TaskHandle_t task = NULL;
+  std::atomic<bool> stopTask = false;
+  std::atomic<bool> taskStopped = false;
+
+  static void ServerTask(void* parameters);
+};
+
+//==============================================================================
+
+}
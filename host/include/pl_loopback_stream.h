@@ -0,0 +1,58 @@
+#pragma once
+#include "pl_common.h"
+#include <condition_variable>
+#include <utility>
+
+//==============================================================================
+
+namespace PL {
+
+//==============================================================================
+
+/// @brief In-memory stream endpoint: data written to one endpoint of a pair is read from the other one
+class LoopbackStream : public Stream {
+public:
+  /// @brief Default size of the receive buffer of each endpoint
+  static constexpr size_t defaultBufferSize = 4096;
+
+  /// @brief Creates a pair of connected endpoints
+  /// @param bufferSize receive buffer size of each endpoint (writes wait for space up to the write timeout)
+  /// @return endpoints
+  static std::pair<std::shared_ptr<LoopbackStream>, std::shared_ptr<LoopbackStream>> CreatePair(size_t bufferSize = defaultBufferSize);
+
+  esp_err_t Lock(TickType_t timeout = portMAX_DELAY) override;
+  esp_err_t Unlock() override;
+  using Stream::Read;
+  esp_err_t Read(void* dest, size_t size) override;
+  using Stream::Write;
+  esp_err_t Write(const void* src, size_t size) override;
+  size_t GetReadableSize() override;
+  TickType_t GetReadTimeout() override;
+  esp_err_t SetReadTimeout(TickType_t timeout) override;
+  TickType_t GetWriteTimeout() override;
+  esp_err_t SetWriteTimeout(TickType_t timeout) override;
+
+private:
+  // Receive buffer of one endpoint
+  struct Channel {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<uint8_t> data;
+    size_t readIndex = 0;
+    size_t size = 0;
+
+    Channel(size_t bufferSize) : data(bufferSize) {}
+  };
+
+  Mutex mutex;
+  std::shared_ptr<Channel> receiveChannel;
+  std::shared_ptr<Channel> transmitChannel;
+  std::atomic<TickType_t> readTimeout = defaultReadTimeout;
+  std::atomic<TickType_t> writeTimeout = defaultWriteTimeout;
+
+  LoopbackStream(std::shared_ptr<Channel> receiveChannel, std::shared_ptr<Channel> transmitChannel);
+};
+
+//==============================================================================
+
+}
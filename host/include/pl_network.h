@@ -0,0 +1,217 @@
+#pragma once
+#include "pl_common.h"
+#include "esp_netif.h"
+
+//==============================================================================
+// pl_network subset for the Linux host build (POSIX sockets)
+//==============================================================================
+
+namespace PL {
+
+//==============================================================================
+
+/// @brief IPv4 address
+struct IpV4Address {
+  /// @brief address in network byte order
+  uint32_t u32 = 0;
+
+  IpV4Address() = default;
+  IpV4Address(uint8_t a, uint8_t b, uint8_t c, uint8_t d);
+};
+
+//==============================================================================
+
+/// @brief IPv6 address
+struct IpV6Address {
+  /// @brief address bytes in network byte order
+  uint8_t u8[16] = {};
+
+  IpV6Address() = default;
+  IpV6Address(uint16_t a, uint16_t b, uint16_t c, uint16_t d, uint16_t e, uint16_t f, uint16_t g, uint16_t h);
+};
+
+//==============================================================================
+
+/// @brief TCP socket stream
+class NetworkStream : public Stream {
+public:
+  /// @brief Creates a closed network stream
+  NetworkStream();
+  ~NetworkStream();
+  NetworkStream(const NetworkStream&) = delete;
+  NetworkStream& operator=(const NetworkStream&) = delete;
+
+  esp_err_t Lock(TickType_t timeout = portMAX_DELAY) override;
+  esp_err_t Unlock() override;
+  using Stream::Read;
+  esp_err_t Read(void* dest, size_t size) override;
+  using Stream::Write;
+  esp_err_t Write(const void* src, size_t size) override;
+  size_t GetReadableSize() override;
+  TickType_t GetReadTimeout() override;
+  esp_err_t SetReadTimeout(TickType_t timeout) override;
+  TickType_t GetWriteTimeout() override;
+  esp_err_t SetWriteTimeout(TickType_t timeout) override;
+
+  /// @brief Closes the stream socket
+  /// @return error code
+  esp_err_t Close();
+
+  /// @brief Checks if the stream socket is open
+  /// @return true if the socket is open
+  bool IsOpen();
+
+  /// @brief Checks if the peer has closed the connection or the connection has failed (e.g. by TCP keep-alive)
+  /// @return true if the connection is closed
+  bool IsPeerClosed();
+
+  /// @brief Gets the number of bytes received from the socket but not read yet (no system call)
+  /// @return number of bytes
+  size_t GetBufferedSize();
+
+  /// @brief Gets the stream socket
+  /// @return socket (-1 if the stream is closed)
+  int GetSocket();
+
+  /// @brief Makes the stream use the connected socket (the previous socket is closed)
+  /// @param socket socket
+  void SetSocket(int socket);
+
+private:
+  Mutex mutex;
+  int socket = -1;
+  TickType_t readTimeout = defaultReadTimeout;
+  TickType_t writeTimeout = defaultWriteTimeout;
+  // Received data (the Modbus server reads frames byte by byte)
+  uint8_t readBuffer[1500];
+  size_t readBufferOffset = 0;
+  size_t readBufferSize = 0;
+
+  bool WaitForSocket(short events, int64_t deadline);
+};
+
+//==============================================================================
+
+/// @brief Socket options shared by the TCP client and server
+struct TcpSocketOptions {
+  bool nagleAlgorithm = true;
+  bool keepAlive = false;
+  int keepAliveIdleTime = 7200;
+  int keepAliveInterval = 75;
+  int keepAliveCount = 9;
+
+  void Apply(int socket) const;
+};
+
+//==============================================================================
+
+/// @brief TCP client
+class TcpClient : public virtual Lockable {
+public:
+  /// @brief Creates a TCP client with IPv4 remote address
+  /// @param address remote address
+  /// @param port remote port
+  TcpClient(IpV4Address address, uint16_t port);
+
+  /// @brief Creates a TCP client with IPv6 remote address
+  /// @param address remote address
+  /// @param port remote port
+  TcpClient(IpV6Address address, uint16_t port);
+  ~TcpClient();
+
+  esp_err_t Lock(TickType_t timeout = portMAX_DELAY) override;
+  esp_err_t Unlock() override;
+
+  /// @brief Connects to the server (does nothing if connected)
+  /// @return error code
+  esp_err_t Connect();
+
+  /// @brief Closes the connection
+  /// @return error code
+  esp_err_t Disconnect();
+
+  /// @brief Checks if the client is connected (the connection closed by the peer is detected)
+  /// @return true if connected
+  bool IsConnected();
+
+  /// @brief Gets the client stream
+  /// @return stream
+  std::shared_ptr<NetworkStream> GetStream();
+
+  esp_err_t EnableNagleAlgorithm();
+  esp_err_t DisableNagleAlgorithm();
+  esp_err_t EnableKeepAlive();
+  esp_err_t DisableKeepAlive();
+  esp_err_t SetKeepAliveIdleTime(int seconds);
+  esp_err_t SetKeepAliveInterval(int seconds);
+  esp_err_t SetKeepAliveCount(int count);
+
+private:
+  Mutex mutex;
+  bool ipV6;
+  IpV4Address ipV4Address;
+  IpV6Address ipV6Address;
+  uint16_t port;
+  TcpSocketOptions options;
+  std::shared_ptr<NetworkStream> stream;
+
+  esp_err_t ApplyOptions();
+};
+
+//==============================================================================
+
+/// @brief TCP server
+class TcpServer : public Server {
+public:
+  /// @brief Default maximum number of clients
+  static constexpr int defaultMaxNumberOfClients = 5;
+
+  /// @brief Creates a TCP server
+  /// @param port port
+  TcpServer(uint16_t port);
+  ~TcpServer();
+
+  esp_err_t Lock(TickType_t timeout = portMAX_DELAY) override;
+  esp_err_t Unlock() override;
+  esp_err_t Enable() override;
+  esp_err_t Disable() override;
+  bool IsEnabled() override;
+
+  uint16_t GetPort();
+  esp_err_t SetPort(uint16_t port);
+  int GetMaxNumberOfClients();
+  esp_err_t SetMaxNumberOfClients(int maxNumberOfClients);
+  esp_err_t SetTaskParameters(const TaskParameters& taskParameters);
+
+  esp_err_t EnableNagleAlgorithm();
+  esp_err_t DisableNagleAlgorithm();
+  esp_err_t EnableKeepAlive();
+  esp_err_t DisableKeepAlive();
+  esp_err_t SetKeepAliveIdleTime(int seconds);
+  esp_err_t SetKeepAliveInterval(int seconds);
+  esp_err_t SetKeepAliveCount(int count);
+
+protected:
+  /// @brief Handles the client request (called by the server task with the server and the stream locked when the stream has data to read)
+  /// @param stream client stream
+  /// @return error code
+  virtual esp_err_t HandleRequest(NetworkStream& stream) = 0;
+
+private:
+  Mutex mutex;
+  uint16_t port;
+  int maxNumberOfClients = defaultMaxNumberOfClients;
+  TcpSocketOptions options;
+  TaskParameters taskParameters = defaultTaskParameters;
+  int listenSocket = -1;
+  std::vector<std::unique_ptr<NetworkStream>> clients;
+  TaskHandle_t task = NULL;
+  std::atomic<bool> stopTask = false;
+  std::atomic<bool> taskStopped = false;
+
+  static void ServerTask(void* parameters);
+};
+
+//==============================================================================
+
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include "pl_common.h"
+#include <condition_variable>
+#include <deque>
+#include <random>
+
+//==============================================================================
+
+namespace PL {
+
+class SerialLineStream;
+
+//==============================================================================
+
+/// @brief Simulated half-duplex serial bus (e.g. RS-485) with baud-accurate character timing
+/// Characters written by one endpoint are received by all other endpoints one character time after each other.
+/// Transmissions of different endpoints that overlap in time collide and the overlapping characters are corrupted.
+class SerialLine : public std::enable_shared_from_this<SerialLine> {
+public:
+  /// @brief Line parameters
+  struct Parameters {
+    /// @brief baud rate
+    uint32_t baudRate = 115200;
+    /// @brief number of bits per character including start, parity and stop bits (11 for 8E1 and 8N2)
+    uint8_t bitsPerCharacter = 11;
+    /// @brief delay between the end of the character transmission and its reception in microseconds (transceivers, UART FIFO timeouts)
+    uint32_t latency = 0;
+    /// @brief probability of a data bit error
+    double bitErrorRate = 0;
+    /// @brief random generator seed (bit errors and collisions are reproducible)
+    uint32_t randomSeed = 1;
+  };
+
+  /// @brief Line statistics
+  struct Statistics {
+    /// @brief Number of transmitted characters
+    uint32_t numberOfCharacters;
+    /// @brief Number of transmissions that overlapped with the transmission of another endpoint
+    uint32_t numberOfCollisions;
+    /// @brief Number of characters with bit errors or corrupted by collisions
+    uint32_t numberOfCorruptedCharacters;
+  };
+
+  /// @brief Creates a serial line
+  /// @param parameters line parameters
+  /// @return serial line
+  static std::shared_ptr<SerialLine> Create(const Parameters& parameters);
+
+  /// @brief Creates an endpoint attached to the line
+  /// @return endpoint stream
+  std::shared_ptr<SerialLineStream> CreateEndpoint();
+
+  /// @brief Gets the line parameters
+  /// @return parameters
+  Parameters GetParameters();
+
+  /// @brief Gets the character transmission time
+  /// @return time in nanoseconds
+  int64_t GetCharacterTime();
+
+  /// @brief Gets the line statistics
+  /// @return statistics
+  Statistics GetStatistics();
+
+  /// @brief Resets the line statistics
+  void ResetStatistics();
+
+private:
+  friend class SerialLineStream;
+
+  // Received character
+  struct Character {
+    int64_t transmissionEndTime;
+    int64_t receptionTime;
+    uint8_t data;
+  };
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  Parameters parameters;
+  int64_t characterTime;
+  std::mt19937 randomGenerator;
+  std::bernoulli_distribution bitError;
+  std::vector<SerialLineStream*> endpoints;
+  SerialLineStream* transmitter = NULL;
+  int64_t busyUntil = 0;
+  Statistics statistics = {};
+
+  SerialLine(const Parameters& parameters);
+  void RemoveEndpoint(SerialLineStream* endpoint);
+  uint8_t Corrupt(uint8_t data);
+  static int64_t GetTime();
+};
+
+//==============================================================================
+
+/// @brief Endpoint of the simulated serial line
+class SerialLineStream : public Stream {
+public:
+  ~SerialLineStream();
+
+  esp_err_t Lock(TickType_t timeout = portMAX_DELAY) override;
+  esp_err_t Unlock() override;
+  using Stream::Read;
+  /// @brief Reads the received characters (waits up to the read timeout)
+  esp_err_t Read(void* dest, size_t size) override;
+  using Stream::Write;
+  /// @brief Transmits the characters (waits until the last character is transmitted)
+  esp_err_t Write(const void* src, size_t size) override;
+  size_t GetReadableSize() override;
+  TickType_t GetReadTimeout() override;
+  esp_err_t SetReadTimeout(TickType_t timeout) override;
+  TickType_t GetWriteTimeout() override;
+  esp_err_t SetWriteTimeout(TickType_t timeout) override;
+
+private:
+  friend class SerialLine;
+
+  Mutex mutex;
+  std::shared_ptr<SerialLine> line;
+  // Characters transmitted by the other endpoints (protected by the line mutex)
+  std::deque<SerialLine::Character> receivedCharacters;
+  std::atomic<TickType_t> readTimeout = defaultReadTimeout;
+  std::atomic<TickType_t> writeTimeout = defaultWriteTimeout;
+
+  SerialLineStream(std::shared_ptr<SerialLine> line);
+  size_t GetReceivedSize(int64_t time);
+};
+
+//==============================================================================
+
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+//==============================================================================
+// Configuration of the Linux host build (CMake options can override the component options)
+//==============================================================================
+
+#define CONFIG_IDF_TARGET_LINUX 1
+#define CONFIG_FREERTOS_HZ 1000
+#define CONFIG_LOG_DEFAULT_LEVEL 1
+#define CONFIG_LOG_MAXIMUM_LEVEL 1
+
+#ifndef CONFIG_PL_MODBUS_STATISTICS
+#define CONFIG_PL_MODBUS_STATISTICS 1
+#endif
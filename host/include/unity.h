@@ -0,0 +1,35 @@
+#pragma once
+#include <stdint.h>
+
+//==============================================================================
+// Unity subset for the Linux host build (a failed assertion ends the test function)
+//==============================================================================
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void UnityBegin(const char* fileName);
+int UnityEnd(void);
+void UnityDefaultTestRun(void (*function)(void), const char* name, int line);
+void UnityFail(const char* fileName, int line, const char* message);
+void UnityFailEqual(const char* fileName, int line, long long expected, long long actual);
+int UnityGetNumberOfFailures(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define UNITY_BEGIN() UnityBegin(__FILE__)
+#define UNITY_END() UnityEnd()
+#define RUN_TEST(function) UnityDefaultTestRun(function, #function, __LINE__)
+
+#define TEST_FAIL_MESSAGE(message) UnityFail(__FILE__, __LINE__, message)
+#define TEST_ASSERT(condition) do { if (!(condition)) UnityFail(__FILE__, __LINE__, "Expression Evaluated To FALSE"); } while (0)
+#define TEST_ASSERT_TRUE(condition) TEST_ASSERT(condition)
+#define TEST_ASSERT_FALSE(condition) TEST_ASSERT(!(condition))
+#define TEST_ASSERT_EQUAL(expected, actual) do {                                  \
+    long long expected_ = (long long)(expected), actual_ = (long long)(actual);   \
+    if (expected_ != actual_)                                                     \
+      UnityFailEqual(__FILE__, __LINE__, expected_, actual_);                     \
+  } while (0)
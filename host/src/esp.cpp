@@ -0,0 +1,101 @@
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_netif.h"
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <random>
+#include <stdarg.h>
+#include <string.h>
+
+//==============================================================================
+
+static std::atomic<esp_log_level_t> logLevel = (esp_log_level_t)CONFIG_LOG_DEFAULT_LEVEL;
+
+//==============================================================================
+
+static std::chrono::steady_clock::time_point GetStartTime() {
+  static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+  return startTime;
+}
+
+//==============================================================================
+
+const char* esp_err_to_name(esp_err_t code) {
+  switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE: return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_INVALID_VERSION: return "ESP_ERR_INVALID_VERSION";
+    case ESP_ERR_INVALID_MAC: return "ESP_ERR_INVALID_MAC";
+    case ESP_ERR_NOT_FINISHED: return "ESP_ERR_NOT_FINISHED";
+    default: return "UNKNOWN ERROR";
+  }
+}
+
+//==============================================================================
+
+void esp_log_level_set(const char* tag, esp_log_level_t level) {
+  if (strcmp(tag, "*") == 0)
+    logLevel = level;
+}
+
+//==============================================================================
+
+esp_log_level_t esp_log_level_get(const char* tag) {
+  return logLevel;
+}
+
+//==============================================================================
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...) {
+  va_list arguments;
+  va_start(arguments, format);
+  vfprintf(stderr, format, arguments);
+  va_end(arguments);
+}
+
+//==============================================================================
+
+uint32_t esp_log_timestamp(void) {
+  return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+//==============================================================================
+
+int64_t esp_timer_get_time(void) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - GetStartTime()).count();
+}
+
+//==============================================================================
+
+uint32_t esp_random(void) {
+  static thread_local std::mt19937 generator(std::random_device{}());
+  return generator();
+}
+
+//==============================================================================
+
+void esp_fill_random(void* buffer, size_t length) {
+  uint8_t* data = (uint8_t*)buffer;
+  for (size_t i = 0; i < length; i += sizeof(uint32_t)) {
+    uint32_t value = esp_random();
+    memcpy(data + i, &value, std::min(sizeof(uint32_t), length - i));
+  }
+}
+
+//==============================================================================
+
+esp_err_t esp_netif_init(void) {
+  return ESP_OK;
+}
@@ -0,0 +1,281 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//==============================================================================
+
+struct HostTask {
+  std::string name;
+  TaskFunction_t function;
+  void* parameters;
+  std::mutex mutex;
+  std::condition_variable notified;
+  uint32_t notificationValue = 0;
+};
+
+struct HostQueue {
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::vector<uint8_t> items;
+  size_t length;
+  size_t itemSize;
+  size_t readIndex = 0;
+  size_t numberOfItems = 0;
+};
+
+struct HostSemaphore {
+  std::mutex mutex;
+  std::condition_variable changed;
+  UBaseType_t maxCount;
+  UBaseType_t count;
+};
+
+// Thrown by vTaskDelete(NULL) to leave the task function (destroys the task function objects).
+struct HostTaskExit {};
+
+static thread_local HostTask* currentTask = NULL;
+
+//==============================================================================
+
+static std::chrono::steady_clock::time_point GetStartTime() {
+  static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+  return startTime;
+}
+
+//==============================================================================
+
+// Waits for the condition up to the timeout (portMAX_DELAY - no timeout). Returns the condition value.
+template <class Predicate>
+static bool WaitFor(std::condition_variable& conditionVariable, std::unique_lock<std::mutex>& lock, TickType_t ticksToWait, Predicate predicate) {
+  if (ticksToWait == portMAX_DELAY) {
+    conditionVariable.wait(lock, predicate);
+    return true;
+  }
+  return conditionVariable.wait_for(lock, std::chrono::milliseconds((uint64_t)ticksToWait * portTICK_PERIOD_MS), predicate);
+}
+
+//==============================================================================
+
+static void RunTask(HostTask* task) {
+  currentTask = task;
+  try {
+    task->function(task->parameters);
+  }
+  catch (HostTaskExit&) {}
+  currentTask = NULL;
+  delete task;
+}
+
+//==============================================================================
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t taskFunction, const char* name, uint32_t stackDepth, void* parameters, UBaseType_t priority, TaskHandle_t* createdTask, BaseType_t coreId) {
+  GetStartTime();
+  HostTask* task = new HostTask();
+  task->name = name ? name : "";
+  task->function = taskFunction;
+  task->parameters = parameters;
+  if (createdTask)
+    *createdTask = task;
+  std::thread(RunTask, task).detach();
+  return pdPASS;
+}
+
+//==============================================================================
+
+BaseType_t xTaskCreate(TaskFunction_t taskFunction, const char* name, uint32_t stackDepth, void* parameters, UBaseType_t priority, TaskHandle_t* createdTask) {
+  return xTaskCreatePinnedToCore(taskFunction, name, stackDepth, parameters, priority, createdTask, tskNO_AFFINITY);
+}
+
+//==============================================================================
+
+void vTaskDelete(TaskHandle_t task) {
+  if (task && task != currentTask) {
+    fprintf(stderr, "vTaskDelete: only the calling task can be deleted in the host build\n");
+    abort();
+  }
+  if (!currentTask || currentTask->function == NULL) {
+    fprintf(stderr, "vTaskDelete: the main task cannot be deleted in the host build\n");
+    abort();
+  }
+  throw HostTaskExit();
+}
+
+//==============================================================================
+
+void vTaskDelay(TickType_t ticksToDelay) {
+  if (ticksToDelay)
+    std::this_thread::sleep_for(std::chrono::milliseconds((uint64_t)ticksToDelay * portTICK_PERIOD_MS));
+  else
+    std::this_thread::yield();
+}
+
+//==============================================================================
+
+TickType_t xTaskGetTickCount(void) {
+  return (TickType_t)(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - GetStartTime()).count() / portTICK_PERIOD_MS);
+}
+
+//==============================================================================
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+  // Threads that are not created by xTaskCreate (e.g. the main thread) get a task for the notifications.
+  if (!currentTask) {
+    static thread_local std::unique_ptr<HostTask> threadTask;
+    threadTask = std::make_unique<HostTask>();
+    threadTask->name = "main";
+    threadTask->function = NULL;
+    currentTask = threadTask.get();
+  }
+  return currentTask;
+}
+
+//==============================================================================
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  {
+    std::lock_guard<std::mutex> lock(task->mutex);
+    task->notificationValue++;
+  }
+  task->notified.notify_one();
+  return pdPASS;
+}
+
+//==============================================================================
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait) {
+  HostTask* task = xTaskGetCurrentTaskHandle();
+  std::unique_lock<std::mutex> lock(task->mutex);
+  WaitFor(task->notified, lock, ticksToWait, [task] { return task->notificationValue != 0; });
+  uint32_t value = task->notificationValue;
+  if (value)
+    task->notificationValue = clearCountOnExit ? 0 : value - 1;
+  return value;
+}
+
+//==============================================================================
+
+void vTaskSetTimeOutState(TimeOut_t* timeOut) {
+  timeOut->timeOnEntering = xTaskGetTickCount();
+}
+
+//==============================================================================
+
+BaseType_t xTaskCheckForTimeOut(TimeOut_t* timeOut, TickType_t* ticksToWait) {
+  if (*ticksToWait == portMAX_DELAY)
+    return pdFALSE;
+  TickType_t currentTime = xTaskGetTickCount();
+  TickType_t elapsedTime = currentTime - timeOut->timeOnEntering;
+  if (elapsedTime >= *ticksToWait) {
+    *ticksToWait = 0;
+    return pdTRUE;
+  }
+  *ticksToWait -= elapsedTime;
+  timeOut->timeOnEntering = currentTime;
+  return pdFALSE;
+}
+
+//==============================================================================
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  HostQueue* queue = new HostQueue();
+  queue->length = length;
+  queue->itemSize = itemSize;
+  queue->items.resize((size_t)length * itemSize);
+  return queue;
+}
+
+//==============================================================================
+
+void vQueueDelete(QueueHandle_t queue) {
+  delete queue;
+}
+
+//==============================================================================
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticksToWait) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  if (!WaitFor(queue->changed, lock, ticksToWait, [queue] { return queue->numberOfItems < queue->length; }))
+    return errQUEUE_FULL;
+  size_t index = (queue->readIndex + queue->numberOfItems) % queue->length;
+  memcpy(queue->items.data() + index * queue->itemSize, item, queue->itemSize);
+  queue->numberOfItems++;
+  lock.unlock();
+  queue->changed.notify_all();
+  return pdPASS;
+}
+
+//==============================================================================
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticksToWait) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  if (!WaitFor(queue->changed, lock, ticksToWait, [queue] { return queue->numberOfItems > 0; }))
+    return errQUEUE_EMPTY;
+  memcpy(item, queue->items.data() + queue->readIndex * queue->itemSize, queue->itemSize);
+  queue->readIndex = (queue->readIndex + 1) % queue->length;
+  queue->numberOfItems--;
+  lock.unlock();
+  queue->changed.notify_all();
+  return pdPASS;
+}
+
+//==============================================================================
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  std::lock_guard<std::mutex> lock(queue->mutex);
+  return queue->numberOfItems;
+}
+
+//==============================================================================
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount) {
+  HostSemaphore* semaphore = new HostSemaphore();
+  semaphore->maxCount = maxCount;
+  semaphore->count = initialCount;
+  return semaphore;
+}
+
+//==============================================================================
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+  return xSemaphoreCreateCounting(1, 0);
+}
+
+//==============================================================================
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+  delete semaphore;
+}
+
+//==============================================================================
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait) {
+  std::unique_lock<std::mutex> lock(semaphore->mutex);
+  if (!WaitFor(semaphore->changed, lock, ticksToWait, [semaphore] { return semaphore->count > 0; }))
+    return pdFALSE;
+  semaphore->count--;
+  return pdTRUE;
+}
+
+//==============================================================================
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  {
+    std::lock_guard<std::mutex> lock(semaphore->mutex);
+    if (semaphore->count >= semaphore->maxCount)
+      return pdFALSE;
+    semaphore->count++;
+  }
+  semaphore->changed.notify_one();
+  return pdTRUE;
+}
@@ -0,0 +1,13 @@
+#include "unity.h"
+
+//==============================================================================
+
+extern "C" void app_main(void);
+
+//==============================================================================
+
+// The ESP-IDF application entry point is called by the host executable: the exit code is nonzero if any test has failed.
+int main() {
+  app_main();
+  return UnityGetNumberOfFailures() ? 1 : 0;
+}
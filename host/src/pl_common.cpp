@@ -0,0 +1,218 @@
+#include "pl_common.h"
+#include "esp_check.h"
+#include <chrono>
+#include <thread>
+
+//==============================================================================
+
+static const char* TAG = "pl_common";
+
+//==============================================================================
+
+namespace PL {
+
+//==============================================================================
+
+esp_err_t Mutex::Lock(TickType_t timeout) {
+  if (timeout == portMAX_DELAY) {
+    mutex.lock();
+    return ESP_OK;
+  }
+  if (timeout == 0)
+    return mutex.try_lock() ? ESP_OK : ESP_ERR_TIMEOUT;
+  return mutex.try_lock_for(std::chrono::milliseconds((uint64_t)timeout * portTICK_PERIOD_MS)) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+//==============================================================================
+
+esp_err_t Mutex::Unlock() {
+  mutex.unlock();
+  return ESP_OK;
+}
+
+//==============================================================================
+
+Buffer::Buffer(size_t size) : data(malloc(size)), size(data ? size : 0), allocated(true) {
+  if (data)
+    memset(data, 0, size);
+}
+
+//==============================================================================
+
+Buffer::Buffer(void* data, size_t size) : data(data), size(size), allocated(false) {}
+
+//==============================================================================
+
+Buffer::Buffer(void* data, size_t size, std::shared_ptr<Lockable> lockable) : data(data), size(size), lockable(lockable), allocated(false) {}
+
+//==============================================================================
+
+Buffer::~Buffer() {
+  if (allocated)
+    free(data);
+}
+
+//==============================================================================
+
+esp_err_t Buffer::Lock(TickType_t timeout) {
+  if (lockable)
+    return lockable->Lock(timeout);
+  return mutex.Lock(timeout);
+}
+
+//==============================================================================
+
+esp_err_t Buffer::Unlock() {
+  if (lockable)
+    return lockable->Unlock();
+  return mutex.Unlock();
+}
+
+//==============================================================================
+
+esp_err_t Stream::Read(Buffer& dest, size_t offset, size_t size) {
+  LockGuard lg(dest);
+  ESP_RETURN_ON_FALSE(offset + size <= dest.size, ESP_ERR_INVALID_SIZE, TAG, "invalid size");
+  return Read((uint8_t*)dest.data + offset, size);
+}
+
+//==============================================================================
+
+esp_err_t Stream::ReadUntil(char termChar) {
+  char c;
+  do {
+    ESP_RETURN_ON_ERROR(Read(&c, 1), TAG, "read failed");
+  } while (c != termChar);
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t Stream::Write(Buffer& src, size_t offset, size_t size) {
+  LockGuard lg(src);
+  ESP_RETURN_ON_FALSE(offset + size <= src.size, ESP_ERR_INVALID_SIZE, TAG, "invalid size");
+  return Write((uint8_t*)src.data + offset, size);
+}
+
+//==============================================================================
+
+esp_err_t Stream::FlushReadBuffer(TickType_t timeout) {
+  do {
+    size_t readableSize;
+    while ((readableSize = GetReadableSize()))
+      ESP_RETURN_ON_ERROR(Read(NULL, readableSize), TAG, "read failed");
+    if (timeout)
+      vTaskDelay(timeout);
+  } while (timeout && GetReadableSize());
+  return ESP_OK;
+}
+
+//==============================================================================
+
+std::string Server::GetName() {
+  LockGuard lg(*this);
+  return name;
+}
+
+//==============================================================================
+
+esp_err_t Server::SetName(const std::string& name) {
+  LockGuard lg(*this);
+  this->name = name;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+StreamServer::StreamServer(std::shared_ptr<Stream> stream) : stream(stream) {}
+
+//==============================================================================
+
+StreamServer::~StreamServer() {
+  Disable();
+}
+
+//==============================================================================
+
+esp_err_t StreamServer::Lock(TickType_t timeout) {
+  return mutex.Lock(timeout);
+}
+
+//==============================================================================
+
+esp_err_t StreamServer::Unlock() {
+  return mutex.Unlock();
+}
+
+//==============================================================================
+
+esp_err_t StreamServer::Enable() {
+  LockGuard lg(*this);
+  if (task)
+    return ESP_OK;
+  stopTask = false;
+  taskStopped = false;
+  ESP_RETURN_ON_FALSE(xTaskCreatePinnedToCore(ServerTask, GetName().c_str(), taskParameters.stackDepth, this, taskParameters.priority, &task, taskParameters.coreId) == pdPASS,
+                      ESP_FAIL, TAG, "task create failed");
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t StreamServer::Disable() {
+  {
+    LockGuard lg(*this);
+    if (!task)
+      return ESP_OK;
+    stopTask = true;
+  }
+  // The server is not locked while waiting: the task locks it to handle the last request.
+  while (!taskStopped)
+    vTaskDelay(1);
+  LockGuard lg(*this);
+  task = NULL;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+bool StreamServer::IsEnabled() {
+  LockGuard lg(*this);
+  return task != NULL;
+}
+
+//==============================================================================
+
+esp_err_t StreamServer::SetTaskParameters(const TaskParameters& taskParameters) {
+  LockGuard lg(*this);
+  this->taskParameters = taskParameters;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+std::weak_ptr<Stream> StreamServer::GetStream() {
+  return stream;
+}
+
+//==============================================================================
+
+void StreamServer::ServerTask(void* parameters) {
+  StreamServer& server = *(StreamServer*)parameters;
+  while (!server.stopTask) {
+    if (server.stream->GetReadableSize()) {
+      LockGuard lg(server, *server.stream);
+      server.HandleRequest(*server.stream);
+    }
+    else {
+      // The host scheduler has no idle task: poll the stream without busy waiting.
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+  server.taskStopped = true;
+  vTaskDelete(NULL);
+}
+
+//==============================================================================
+
+}
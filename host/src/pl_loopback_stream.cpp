@@ -0,0 +1,138 @@
+#include "pl_loopback_stream.h"
+#include <chrono>
+
+//==============================================================================
+
+namespace PL {
+
+//==============================================================================
+
+// Waits for the condition up to the timeout in FreeRTOS ticks. Returns the condition value.
+template <class Predicate>
+static bool WaitFor(std::condition_variable& conditionVariable, std::unique_lock<std::mutex>& lock, TickType_t timeout, Predicate predicate) {
+  if (timeout == portMAX_DELAY) {
+    conditionVariable.wait(lock, predicate);
+    return true;
+  }
+  return conditionVariable.wait_for(lock, std::chrono::milliseconds((uint64_t)timeout * portTICK_PERIOD_MS), predicate);
+}
+
+//==============================================================================
+
+std::pair<std::shared_ptr<LoopbackStream>, std::shared_ptr<LoopbackStream>> LoopbackStream::CreatePair(size_t bufferSize) {
+  auto channel1 = std::make_shared<Channel>(bufferSize);
+  auto channel2 = std::make_shared<Channel>(bufferSize);
+  return {std::shared_ptr<LoopbackStream>(new LoopbackStream(channel1, channel2)), std::shared_ptr<LoopbackStream>(new LoopbackStream(channel2, channel1))};
+}
+
+//==============================================================================
+
+LoopbackStream::LoopbackStream(std::shared_ptr<Channel> receiveChannel, std::shared_ptr<Channel> transmitChannel) :
+  receiveChannel(receiveChannel), transmitChannel(transmitChannel) {}
+
+//==============================================================================
+
+esp_err_t LoopbackStream::Lock(TickType_t timeout) {
+  return mutex.Lock(timeout);
+}
+
+//==============================================================================
+
+esp_err_t LoopbackStream::Unlock() {
+  return mutex.Unlock();
+}
+
+//==============================================================================
+
+esp_err_t LoopbackStream::Read(void* dest, size_t size) {
+  Channel& channel = *receiveChannel;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds((uint64_t)readTimeout * portTICK_PERIOD_MS);
+  uint8_t* data = (uint8_t*)dest;
+  std::unique_lock<std::mutex> lock(channel.mutex);
+  while (size) {
+    if (!channel.size) {
+      TickType_t timeout = readTimeout;
+      if (timeout != portMAX_DELAY) {
+        auto remainingTime = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        timeout = remainingTime > 0 ? (TickType_t)(remainingTime / portTICK_PERIOD_MS) : 0;
+      }
+      if (!WaitFor(channel.changed, lock, timeout, [&channel] { return channel.size != 0; }))
+        return ESP_ERR_TIMEOUT;
+    }
+    size_t chunkSize = std::min({size, channel.size, channel.data.size() - channel.readIndex});
+    if (data) {
+      memcpy(data, channel.data.data() + channel.readIndex, chunkSize);
+      data += chunkSize;
+    }
+    channel.readIndex = (channel.readIndex + chunkSize) % channel.data.size();
+    channel.size -= chunkSize;
+    size -= chunkSize;
+    channel.changed.notify_all();
+  }
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t LoopbackStream::Write(const void* src, size_t size) {
+  Channel& channel = *transmitChannel;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds((uint64_t)writeTimeout * portTICK_PERIOD_MS);
+  const uint8_t* data = (const uint8_t*)src;
+  std::unique_lock<std::mutex> lock(channel.mutex);
+  while (size) {
+    if (channel.size == channel.data.size()) {
+      TickType_t timeout = writeTimeout;
+      if (timeout != portMAX_DELAY) {
+        auto remainingTime = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        timeout = remainingTime > 0 ? (TickType_t)(remainingTime / portTICK_PERIOD_MS) : 0;
+      }
+      if (!WaitFor(channel.changed, lock, timeout, [&channel] { return channel.size != channel.data.size(); }))
+        return ESP_ERR_TIMEOUT;
+    }
+    size_t writeIndex = (channel.readIndex + channel.size) % channel.data.size();
+    size_t chunkSize = std::min({size, channel.data.size() - channel.size, channel.data.size() - writeIndex});
+    memcpy(channel.data.data() + writeIndex, data, chunkSize);
+    data += chunkSize;
+    channel.size += chunkSize;
+    size -= chunkSize;
+    channel.changed.notify_all();
+  }
+  return ESP_OK;
+}
+
+//==============================================================================
+
+size_t LoopbackStream::GetReadableSize() {
+  std::lock_guard<std::mutex> lock(receiveChannel->mutex);
+  return receiveChannel->size;
+}
+
+//==============================================================================
+
+TickType_t LoopbackStream::GetReadTimeout() {
+  return readTimeout;
+}
+
+//==============================================================================
+
+esp_err_t LoopbackStream::SetReadTimeout(TickType_t timeout) {
+  readTimeout = timeout;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+TickType_t LoopbackStream::GetWriteTimeout() {
+  return writeTimeout;
+}
+
+//==============================================================================
+
+esp_err_t LoopbackStream::SetWriteTimeout(TickType_t timeout) {
+  writeTimeout = timeout;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+}
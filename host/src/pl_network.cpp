@@ -0,0 +1,635 @@
+#include "pl_network.h"
+#include "esp_check.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+//==============================================================================
+
+static const char* TAG = "pl_network";
+
+//==============================================================================
+
+namespace PL {
+
+//==============================================================================
+
+IpV4Address::IpV4Address(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+  uint8_t bytes[4] = {a, b, c, d};
+  memcpy(&u32, bytes, sizeof(u32));
+}
+
+//==============================================================================
+
+IpV6Address::IpV6Address(uint16_t a, uint16_t b, uint16_t c, uint16_t d, uint16_t e, uint16_t f, uint16_t g, uint16_t h) {
+  uint16_t words[8] = {a, b, c, d, e, f, g, h};
+  for (int i = 0; i < 8; i++) {
+    u8[i * 2] = words[i] >> 8;
+    u8[i * 2 + 1] = words[i] & 0xFF;
+  }
+}
+
+//==============================================================================
+
+NetworkStream::NetworkStream() {}
+
+//==============================================================================
+
+NetworkStream::~NetworkStream() {
+  Close();
+}
+
+//==============================================================================
+
+esp_err_t NetworkStream::Lock(TickType_t timeout) {
+  return mutex.Lock(timeout);
+}
+
+//==============================================================================
+
+esp_err_t NetworkStream::Unlock() {
+  return mutex.Unlock();
+}
+
+//==============================================================================
+
+esp_err_t NetworkStream::Read(void* dest, size_t size) {
+  LockGuard lg(*this);
+  ESP_RETURN_ON_FALSE(socket >= 0, ESP_ERR_INVALID_STATE, TAG, "stream is closed");
+  int64_t deadline = (readTimeout == portMAX_DELAY) ? INT64_MAX : esp_timer_get_time() + (int64_t)readTimeout * portTICK_PERIOD_MS * 1000;
+  uint8_t* data = (uint8_t*)dest;
+  while (size) {
+    if (!readBufferSize) {
+      if (!WaitForSocket(POLLIN, deadline))
+        return ESP_ERR_TIMEOUT;
+      ssize_t receivedSize = recv(socket, readBuffer, sizeof(readBuffer), MSG_DONTWAIT);
+      if (receivedSize < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        continue;
+      ESP_RETURN_ON_FALSE(receivedSize > 0, ESP_FAIL, TAG, "connection closed");
+      readBufferOffset = 0;
+      readBufferSize = receivedSize;
+    }
+    size_t chunkSize = std::min(size, readBufferSize);
+    if (data) {
+      memcpy(data, readBuffer + readBufferOffset, chunkSize);
+      data += chunkSize;
+    }
+    readBufferOffset += chunkSize;
+    readBufferSize -= chunkSize;
+    size -= chunkSize;
+  }
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t NetworkStream::Write(const void* src, size_t size) {
+  LockGuard lg(*this);
+  ESP_RETURN_ON_FALSE(socket >= 0, ESP_ERR_INVALID_STATE, TAG, "stream is closed");
+  int64_t deadline = (writeTimeout == portMAX_DELAY) ? INT64_MAX : esp_timer_get_time() + (int64_t)writeTimeout * portTICK_PERIOD_MS * 1000;
+  const uint8_t* data = (const uint8_t*)src;
+  while (size) {
+    ssize_t sentSize = send(socket, data, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (sentSize < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+      if (!WaitForSocket(POLLOUT, deadline))
+        return ESP_ERR_TIMEOUT;
+      continue;
+    }
+    ESP_RETURN_ON_FALSE(sentSize > 0, ESP_FAIL, TAG, "send failed");
+    data += sentSize;
+    size -= sentSize;
+  }
+  return ESP_OK;
+}
+
+//==============================================================================
+
+size_t NetworkStream::GetReadableSize() {
+  LockGuard lg(*this);
+  if (socket < 0)
+    return 0;
+  int socketSize = 0;
+  if (ioctl(socket, FIONREAD, &socketSize) < 0)
+    socketSize = 0;
+  return readBufferSize + socketSize;
+}
+
+//==============================================================================
+
+TickType_t NetworkStream::GetReadTimeout() {
+  LockGuard lg(*this);
+  return readTimeout;
+}
+
+//==============================================================================
+
+esp_err_t NetworkStream::SetReadTimeout(TickType_t timeout) {
+  LockGuard lg(*this);
+  readTimeout = timeout;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+TickType_t NetworkStream::GetWriteTimeout() {
+  LockGuard lg(*this);
+  return writeTimeout;
+}
+
+//==============================================================================
+
+esp_err_t NetworkStream::SetWriteTimeout(TickType_t timeout) {
+  LockGuard lg(*this);
+  writeTimeout = timeout;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t NetworkStream::Close() {
+  LockGuard lg(*this);
+  if (socket >= 0) {
+    shutdown(socket, SHUT_RDWR);
+    close(socket);
+  }
+  socket = -1;
+  readBufferOffset = 0;
+  readBufferSize = 0;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+bool NetworkStream::IsOpen() {
+  LockGuard lg(*this);
+  return socket >= 0;
+}
+
+//==============================================================================
+
+bool NetworkStream::IsPeerClosed() {
+  LockGuard lg(*this);
+  if (socket < 0)
+    return true;
+  if (readBufferSize)
+    return false;
+  pollfd pollFd = {socket, POLLIN, 0};
+  if (poll(&pollFd, 1, 0) <= 0)
+    return false;
+  if (pollFd.revents & (POLLERR | POLLHUP | POLLNVAL))
+    return true;
+  uint8_t data;
+  ssize_t receivedSize = recv(socket, &data, 1, MSG_PEEK | MSG_DONTWAIT);
+  return receivedSize == 0 || (receivedSize < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+}
+
+//==============================================================================
+
+size_t NetworkStream::GetBufferedSize() {
+  LockGuard lg(*this);
+  return readBufferSize;
+}
+
+//==============================================================================
+
+int NetworkStream::GetSocket() {
+  LockGuard lg(*this);
+  return socket;
+}
+
+//==============================================================================
+
+void NetworkStream::SetSocket(int socket) {
+  LockGuard lg(*this);
+  Close();
+  this->socket = socket;
+}
+
+//==============================================================================
+
+bool NetworkStream::WaitForSocket(short events, int64_t deadline) {
+  while (true) {
+    int timeout = -1;
+    if (deadline != INT64_MAX) {
+      int64_t remainingTime = deadline - esp_timer_get_time();
+      if (remainingTime < 0)
+        remainingTime = 0;
+      timeout = (int)((remainingTime + 999) / 1000);
+    }
+    pollfd pollFd = {socket, events, 0};
+    int result = poll(&pollFd, 1, timeout);
+    if (result > 0)
+      return true;
+    if (result == 0 || errno != EINTR)
+      return false;
+  }
+}
+
+//==============================================================================
+
+void TcpSocketOptions::Apply(int socket) const {
+  int value = nagleAlgorithm ? 0 : 1;
+  setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value));
+  value = keepAlive ? 1 : 0;
+  setsockopt(socket, SOL_SOCKET, SO_KEEPALIVE, &value, sizeof(value));
+  if (keepAlive) {
+    setsockopt(socket, IPPROTO_TCP, TCP_KEEPIDLE, &keepAliveIdleTime, sizeof(keepAliveIdleTime));
+    setsockopt(socket, IPPROTO_TCP, TCP_KEEPINTVL, &keepAliveInterval, sizeof(keepAliveInterval));
+    setsockopt(socket, IPPROTO_TCP, TCP_KEEPCNT, &keepAliveCount, sizeof(keepAliveCount));
+  }
+}
+
+//==============================================================================
+
+TcpClient::TcpClient(IpV4Address address, uint16_t port) : ipV6(false), ipV4Address(address), port(port), stream(std::make_shared<NetworkStream>()) {}
+
+//==============================================================================
+
+TcpClient::TcpClient(IpV6Address address, uint16_t port) : ipV6(true), ipV6Address(address), port(port), stream(std::make_shared<NetworkStream>()) {}
+
+//==============================================================================
+
+TcpClient::~TcpClient() {
+  Disconnect();
+}
+
+//==============================================================================
+
+esp_err_t TcpClient::Lock(TickType_t timeout) {
+  return mutex.Lock(timeout);
+}
+
+//==============================================================================
+
+esp_err_t TcpClient::Unlock() {
+  return mutex.Unlock();
+}
+
+//==============================================================================
+
+esp_err_t TcpClient::Connect() {
+  LockGuard lg(*this);
+  if (IsConnected())
+    return ESP_OK;
+  Disconnect();
+
+  int clientSocket = socket(ipV6 ? AF_INET6 : AF_INET, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+  ESP_RETURN_ON_FALSE(clientSocket >= 0, ESP_FAIL, TAG, "socket create failed");
+  int result;
+  if (ipV6) {
+    sockaddr_in6 address = {};
+    address.sin6_family = AF_INET6;
+    address.sin6_port = htons(port);
+    memcpy(&address.sin6_addr, ipV6Address.u8, sizeof(ipV6Address.u8));
+    result = connect(clientSocket, (sockaddr*)&address, sizeof(address));
+  }
+  else {
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = ipV4Address.u32;
+    result = connect(clientSocket, (sockaddr*)&address, sizeof(address));
+  }
+  if (result != 0) {
+    close(clientSocket);
+    ESP_RETURN_ON_FALSE(false, ESP_FAIL, TAG, "connect failed");
+  }
+  options.Apply(clientSocket);
+  stream->SetSocket(clientSocket);
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t TcpClient::Disconnect() {
+  LockGuard lg(*this);
+  return stream->Close();
+}
+
+//==============================================================================
+
+bool TcpClient::IsConnected() {
+  LockGuard lg(*this);
+  return stream->IsOpen() && !stream->IsPeerClosed();
+}
+
+//==============================================================================
+
+std::shared_ptr<NetworkStream> TcpClient::GetStream() {
+  return stream;
+}
+
+//==============================================================================
+
+esp_err_t TcpClient::EnableNagleAlgorithm() {
+  LockGuard lg(*this);
+  options.nagleAlgorithm = true;
+  return ApplyOptions();
+}
+
+//==============================================================================
+
+esp_err_t TcpClient::DisableNagleAlgorithm() {
+  LockGuard lg(*this);
+  options.nagleAlgorithm = false;
+  return ApplyOptions();
+}
+
+//==============================================================================
+
+esp_err_t TcpClient::EnableKeepAlive() {
+  LockGuard lg(*this);
+  options.keepAlive = true;
+  return ApplyOptions();
+}
+
+//==============================================================================
+
+esp_err_t TcpClient::DisableKeepAlive() {
+  LockGuard lg(*this);
+  options.keepAlive = false;
+  return ApplyOptions();
+}
+
+//==============================================================================
+
+esp_err_t TcpClient::SetKeepAliveIdleTime(int seconds) {
+  LockGuard lg(*this);
+  ESP_RETURN_ON_FALSE(seconds > 0, ESP_ERR_INVALID_ARG, TAG, "invalid keep-alive idle time");
+  options.keepAliveIdleTime = seconds;
+  return ApplyOptions();
+}
+
+//==============================================================================
+
+esp_err_t TcpClient::SetKeepAliveInterval(int seconds) {
+  LockGuard lg(*this);
+  ESP_RETURN_ON_FALSE(seconds > 0, ESP_ERR_INVALID_ARG, TAG, "invalid keep-alive interval");
+  options.keepAliveInterval = seconds;
+  return ApplyOptions();
+}
+
+//==============================================================================
+
+esp_err_t TcpClient::SetKeepAliveCount(int count) {
+  LockGuard lg(*this);
+  ESP_RETURN_ON_FALSE(count > 0, ESP_ERR_INVALID_ARG, TAG, "invalid keep-alive count");
+  options.keepAliveCount = count;
+  return ApplyOptions();
+}
+
+//==============================================================================
+
+esp_err_t TcpClient::ApplyOptions() {
+  int clientSocket = stream->GetSocket();
+  if (clientSocket >= 0)
+    options.Apply(clientSocket);
+  return ESP_OK;
+}
+
+//==============================================================================
+
+TcpServer::TcpServer(uint16_t port) : port(port) {}
+
+//==============================================================================
+
+TcpServer::~TcpServer() {
+  Disable();
+}
+
+//==============================================================================
+
+esp_err_t TcpServer::Lock(TickType_t timeout) {
+  return mutex.Lock(timeout);
+}
+
+//==============================================================================
+
+esp_err_t TcpServer::Unlock() {
+  return mutex.Unlock();
+}
+
+//==============================================================================
+
+esp_err_t TcpServer::Enable() {
+  LockGuard lg(*this);
+  if (task)
+    return ESP_OK;
+
+  listenSocket = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+  ESP_RETURN_ON_FALSE(listenSocket >= 0, ESP_FAIL, TAG, "socket create failed");
+  int value = 1;
+  setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(value));
+  // Dual-stack socket: IPv4 clients are accepted as IPv4-mapped IPv6 addresses.
+  value = 0;
+  setsockopt(listenSocket, IPPROTO_IPV6, IPV6_V6ONLY, &value, sizeof(value));
+  sockaddr_in6 address = {};
+  address.sin6_family = AF_INET6;
+  address.sin6_port = htons(port);
+  address.sin6_addr = in6addr_any;
+  if (bind(listenSocket, (sockaddr*)&address, sizeof(address)) != 0 || listen(listenSocket, maxNumberOfClients) != 0) {
+    close(listenSocket);
+    listenSocket = -1;
+    ESP_RETURN_ON_FALSE(false, ESP_FAIL, TAG, "bind/listen on port %d failed (errno %d)", port, errno);
+  }
+
+  stopTask = false;
+  taskStopped = false;
+  if (xTaskCreatePinnedToCore(ServerTask, GetName().c_str(), taskParameters.stackDepth, this, taskParameters.priority, &task, taskParameters.coreId) != pdPASS) {
+    close(listenSocket);
+    listenSocket = -1;
+    task = NULL;
+    ESP_RETURN_ON_FALSE(false, ESP_FAIL, TAG, "task create failed");
+  }
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t TcpServer::Disable() {
+  {
+    LockGuard lg(*this);
+    if (!task)
+      return ESP_OK;
+    stopTask = true;
+  }
+  // The server is not locked while waiting: the task locks it to handle the last request.
+  while (!taskStopped)
+    vTaskDelay(1);
+  LockGuard lg(*this);
+  task = NULL;
+  clients.clear();
+  close(listenSocket);
+  listenSocket = -1;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+bool TcpServer::IsEnabled() {
+  LockGuard lg(*this);
+  return task != NULL;
+}
+
+//==============================================================================
+
+uint16_t TcpServer::GetPort() {
+  LockGuard lg(*this);
+  return port;
+}
+
+//==============================================================================
+
+esp_err_t TcpServer::SetPort(uint16_t port) {
+  LockGuard lg(*this);
+  ESP_RETURN_ON_FALSE(!task, ESP_ERR_INVALID_STATE, TAG, "server is enabled");
+  this->port = port;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+int TcpServer::GetMaxNumberOfClients() {
+  LockGuard lg(*this);
+  return maxNumberOfClients;
+}
+
+//==============================================================================
+
+esp_err_t TcpServer::SetMaxNumberOfClients(int maxNumberOfClients) {
+  LockGuard lg(*this);
+  ESP_RETURN_ON_FALSE(maxNumberOfClients > 0, ESP_ERR_INVALID_ARG, TAG, "invalid max number of clients");
+  this->maxNumberOfClients = maxNumberOfClients;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t TcpServer::SetTaskParameters(const TaskParameters& taskParameters) {
+  LockGuard lg(*this);
+  this->taskParameters = taskParameters;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t TcpServer::EnableNagleAlgorithm() {
+  LockGuard lg(*this);
+  options.nagleAlgorithm = true;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t TcpServer::DisableNagleAlgorithm() {
+  LockGuard lg(*this);
+  options.nagleAlgorithm = false;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t TcpServer::EnableKeepAlive() {
+  LockGuard lg(*this);
+  options.keepAlive = true;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t TcpServer::DisableKeepAlive() {
+  LockGuard lg(*this);
+  options.keepAlive = false;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t TcpServer::SetKeepAliveIdleTime(int seconds) {
+  LockGuard lg(*this);
+  ESP_RETURN_ON_FALSE(seconds > 0, ESP_ERR_INVALID_ARG, TAG, "invalid keep-alive idle time");
+  options.keepAliveIdleTime = seconds;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t TcpServer::SetKeepAliveInterval(int seconds) {
+  LockGuard lg(*this);
+  ESP_RETURN_ON_FALSE(seconds > 0, ESP_ERR_INVALID_ARG, TAG, "invalid keep-alive interval");
+  options.keepAliveInterval = seconds;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t TcpServer::SetKeepAliveCount(int count) {
+  LockGuard lg(*this);
+  ESP_RETURN_ON_FALSE(count > 0, ESP_ERR_INVALID_ARG, TAG, "invalid keep-alive count");
+  options.keepAliveCount = count;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+void TcpServer::ServerTask(void* parameters) {
+  TcpServer& server = *(TcpServer*)parameters;
+  std::vector<pollfd> pollFds;
+
+  while (!server.stopTask) {
+    // Data already read from a socket into the stream buffer is not signaled by poll.
+    bool buffered = false;
+    pollFds.clear();
+    {
+      LockGuard lg(server);
+      pollFds.push_back({server.listenSocket, POLLIN, 0});
+      for (auto& client : server.clients) {
+        pollFds.push_back({client->GetSocket(), POLLIN, 0});
+        buffered |= client->GetBufferedSize() != 0;
+      }
+    }
+    if (poll(pollFds.data(), pollFds.size(), buffered ? 0 : 10) < 0 && errno != EINTR)
+      break;
+
+    LockGuard lg(server);
+    for (size_t i = 0; i < server.clients.size();) {
+      NetworkStream& stream = *server.clients[i];
+      bool readable = i + 1 < pollFds.size() && (pollFds[i + 1].revents || stream.GetBufferedSize());
+      if (readable && stream.IsPeerClosed()) {
+        server.clients.erase(server.clients.begin() + i);
+        pollFds.erase(pollFds.begin() + i + 1);
+        continue;
+      }
+      if (readable && stream.GetReadableSize()) {
+        LockGuard streamLg(stream);
+        server.HandleRequest(stream);
+      }
+      i++;
+    }
+
+    if (pollFds[0].revents & POLLIN) {
+      int clientSocket = accept4(server.listenSocket, NULL, NULL, SOCK_CLOEXEC);
+      if (clientSocket >= 0) {
+        if ((int)server.clients.size() < server.maxNumberOfClients) {
+          server.options.Apply(clientSocket);
+          server.clients.push_back(std::make_unique<NetworkStream>());
+          server.clients.back()->SetSocket(clientSocket);
+        }
+        else
+          close(clientSocket);
+      }
+    }
+  }
+  server.taskStopped = true;
+  vTaskDelete(NULL);
+}
+
+//==============================================================================
+
+}
@@ -0,0 +1,258 @@
+#include "pl_serial_line.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+//==============================================================================
+
+namespace PL {
+
+//==============================================================================
+
+// Converts the line time in nanoseconds to the steady clock time point
+static std::chrono::steady_clock::time_point ToTimePoint(int64_t time) {
+  return std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(time)));
+}
+
+//==============================================================================
+
+// Returns a non-zero pattern that corrupts the character ending at the specified time (the same for all receivers)
+static uint8_t GetCollisionPattern(int64_t transmissionEndTime) {
+  return (uint8_t)(((uint64_t)transmissionEndTime * 2654435761u) >> 24) | 1;
+}
+
+//==============================================================================
+
+std::shared_ptr<SerialLine> SerialLine::Create(const Parameters& parameters) {
+  return std::shared_ptr<SerialLine>(new SerialLine(parameters));
+}
+
+//==============================================================================
+
+SerialLine::SerialLine(const Parameters& parameters) : parameters(parameters),
+  characterTime((int64_t)parameters.bitsPerCharacter * 1000000000 / parameters.baudRate), randomGenerator(parameters.randomSeed),
+  bitError(std::clamp(parameters.bitErrorRate, 0.0, 1.0)) {}
+
+//==============================================================================
+
+std::shared_ptr<SerialLineStream> SerialLine::CreateEndpoint() {
+  auto endpoint = std::shared_ptr<SerialLineStream>(new SerialLineStream(shared_from_this()));
+  std::lock_guard<std::mutex> lock(mutex);
+  endpoints.push_back(endpoint.get());
+  return endpoint;
+}
+
+//==============================================================================
+
+SerialLine::Parameters SerialLine::GetParameters() {
+  return parameters;
+}
+
+//==============================================================================
+
+int64_t SerialLine::GetCharacterTime() {
+  return characterTime;
+}
+
+//==============================================================================
+
+SerialLine::Statistics SerialLine::GetStatistics() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return statistics;
+}
+
+//==============================================================================
+
+void SerialLine::ResetStatistics() {
+  std::lock_guard<std::mutex> lock(mutex);
+  statistics = {};
+}
+
+//==============================================================================
+
+void SerialLine::RemoveEndpoint(SerialLineStream* endpoint) {
+  std::lock_guard<std::mutex> lock(mutex);
+  endpoints.erase(std::remove(endpoints.begin(), endpoints.end(), endpoint), endpoints.end());
+  if (transmitter == endpoint)
+    transmitter = NULL;
+}
+
+//==============================================================================
+
+uint8_t SerialLine::Corrupt(uint8_t data) {
+  if (parameters.bitErrorRate <= 0)
+    return data;
+  for (int bit = 0; bit < 8; bit++) {
+    if (bitError(randomGenerator))
+      data ^= 1 << bit;
+  }
+  return data;
+}
+
+//==============================================================================
+
+int64_t SerialLine::GetTime() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//==============================================================================
+
+SerialLineStream::SerialLineStream(std::shared_ptr<SerialLine> line) : line(line) {}
+
+//==============================================================================
+
+SerialLineStream::~SerialLineStream() {
+  line->RemoveEndpoint(this);
+}
+
+//==============================================================================
+
+esp_err_t SerialLineStream::Lock(TickType_t timeout) {
+  return mutex.Lock(timeout);
+}
+
+//==============================================================================
+
+esp_err_t SerialLineStream::Unlock() {
+  return mutex.Unlock();
+}
+
+//==============================================================================
+
+esp_err_t SerialLineStream::Read(void* dest, size_t size) {
+  SerialLine& line = *this->line;
+  TickType_t timeout = readTimeout;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds((uint64_t)timeout * portTICK_PERIOD_MS);
+  uint8_t* data = (uint8_t*)dest;
+  std::unique_lock<std::mutex> lock(line.mutex);
+  while (size) {
+    if (!receivedCharacters.empty() && receivedCharacters.front().receptionTime <= SerialLine::GetTime()) {
+      if (data)
+        *(data++) = receivedCharacters.front().data;
+      receivedCharacters.pop_front();
+      size--;
+      continue;
+    }
+    if (timeout != portMAX_DELAY && std::chrono::steady_clock::now() >= deadline)
+      return ESP_ERR_TIMEOUT;
+    // Waits for the next character reception, a new transmission or the timeout
+    if (!receivedCharacters.empty()) {
+      auto receptionTime = ToTimePoint(receivedCharacters.front().receptionTime);
+      line.changed.wait_until(lock, timeout == portMAX_DELAY ? receptionTime : std::min(receptionTime, deadline));
+    }
+    else if (timeout == portMAX_DELAY)
+      line.changed.wait(lock);
+    else
+      line.changed.wait_until(lock, deadline);
+  }
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t SerialLineStream::Write(const void* src, size_t size) {
+  SerialLine& line = *this->line;
+  const uint8_t* data = (const uint8_t*)src;
+  std::unique_lock<std::mutex> lock(line.mutex);
+
+  int64_t startTime = SerialLine::GetTime();
+  int64_t collisionEndTime = 0;
+  if (line.busyUntil > startTime) {
+    if (line.transmitter == this) {
+      // Transmitter FIFO: the characters follow the ones that are being transmitted
+      startTime = line.busyUntil;
+    }
+    else {
+      // Collision: the characters of the other endpoint that overlap with this transmission are corrupted
+      collisionEndTime = line.busyUntil;
+      line.statistics.numberOfCollisions++;
+      line.statistics.numberOfCorruptedCharacters += (collisionEndTime - startTime + line.characterTime - 1) / line.characterTime;
+      for (auto endpoint : line.endpoints) {
+        for (auto& character : endpoint->receivedCharacters) {
+          if (character.transmissionEndTime > startTime)
+            character.data ^= GetCollisionPattern(character.transmissionEndTime);
+        }
+      }
+    }
+  }
+
+  for (size_t i = 0; i < size; i++) {
+    SerialLine::Character character;
+    character.transmissionEndTime = startTime + (int64_t)(i + 1) * line.characterTime;
+    character.receptionTime = character.transmissionEndTime + (int64_t)line.parameters.latency * 1000;
+    character.data = line.Corrupt(data[i]);
+    if (character.transmissionEndTime - line.characterTime < collisionEndTime)
+      character.data ^= GetCollisionPattern(character.transmissionEndTime);
+    if (character.data != data[i])
+      line.statistics.numberOfCorruptedCharacters++;
+    for (auto endpoint : line.endpoints) {
+      if (endpoint == this)
+        continue;
+      // Characters are kept in the order of reception (collided transmissions interleave)
+      auto& characters = endpoint->receivedCharacters;
+      auto position = std::upper_bound(characters.begin(), characters.end(), character.receptionTime,
+        [](int64_t receptionTime, const SerialLine::Character& c) { return receptionTime < c.receptionTime; });
+      characters.insert(position, character);
+    }
+  }
+
+  int64_t endTime = startTime + (int64_t)size * line.characterTime;
+  line.statistics.numberOfCharacters += size;
+  line.busyUntil = std::max(line.busyUntil, endTime);
+  line.transmitter = this;
+  line.changed.notify_all();
+  lock.unlock();
+
+  // Half-duplex driver: returns when the last character is on the line
+  std::this_thread::sleep_until(ToTimePoint(endTime));
+  return ESP_OK;
+}
+
+//==============================================================================
+
+size_t SerialLineStream::GetReadableSize() {
+  std::lock_guard<std::mutex> lock(line->mutex);
+  return GetReceivedSize(SerialLine::GetTime());
+}
+
+//==============================================================================
+
+TickType_t SerialLineStream::GetReadTimeout() {
+  return readTimeout;
+}
+
+//==============================================================================
+
+esp_err_t SerialLineStream::SetReadTimeout(TickType_t timeout) {
+  readTimeout = timeout;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+TickType_t SerialLineStream::GetWriteTimeout() {
+  return writeTimeout;
+}
+
+//==============================================================================
+
+esp_err_t SerialLineStream::SetWriteTimeout(TickType_t timeout) {
+  writeTimeout = timeout;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+size_t SerialLineStream::GetReceivedSize(int64_t time) {
+  size_t size = 0;
+  for (auto& character : receivedCharacters) {
+    if (character.receptionTime > time)
+      break;
+    size++;
+  }
+  return size;
+}
+
+//==============================================================================
+
+}
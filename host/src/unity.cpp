@@ -0,0 +1,73 @@
+#include "unity.h"
+#include <atomic>
+#include <thread>
+#include <stdio.h>
+
+//==============================================================================
+
+// Thrown by a failed assertion in the test function to end the test.
+struct UnityTestFailed {};
+
+static std::atomic<int> numberOfTests = 0;
+static std::atomic<int> numberOfFailures = 0;
+static std::atomic<bool> currentTestFailed = false;
+static std::thread::id testThreadId;
+static const char* testFileName = "";
+
+//==============================================================================
+
+void UnityBegin(const char* fileName) {
+  testFileName = fileName;
+  numberOfTests = 0;
+  numberOfFailures = 0;
+}
+
+//==============================================================================
+
+int UnityEnd(void) {
+  printf("\n-----------------------\n%d Tests %d Failures 0 Ignored\n%s\n", (int)numberOfTests, (int)numberOfFailures, numberOfFailures ? "FAIL" : "OK");
+  fflush(stdout);
+  return numberOfFailures;
+}
+
+//==============================================================================
+
+void UnityDefaultTestRun(void (*function)(void), const char* name, int line) {
+  numberOfTests++;
+  currentTestFailed = false;
+  testThreadId = std::this_thread::get_id();
+  try {
+    function();
+  }
+  catch (UnityTestFailed&) {}
+  testThreadId = std::thread::id();
+  if (currentTestFailed)
+    numberOfFailures++;
+  printf("%s:%d:%s:%s\n", testFileName, line, name, currentTestFailed ? "FAIL" : "PASS");
+  fflush(stdout);
+}
+
+//==============================================================================
+
+void UnityFail(const char* fileName, int line, const char* message) {
+  printf("%s:%d:FAIL: %s\n", fileName, line, message);
+  fflush(stdout);
+  currentTestFailed = true;
+  // Assertions in other tasks (e.g. server callbacks) only mark the test as failed.
+  if (std::this_thread::get_id() == testThreadId)
+    throw UnityTestFailed();
+}
+
+//==============================================================================
+
+void UnityFailEqual(const char* fileName, int line, long long expected, long long actual) {
+  char message[96];
+  snprintf(message, sizeof(message), "Expected %lld Was %lld", expected, actual);
+  UnityFail(fileName, line, message);
+}
+
+//==============================================================================
+
+int UnityGetNumberOfFailures(void) {
+  return numberOfFailures;
+}
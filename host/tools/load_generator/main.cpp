@@ -0,0 +1,454 @@
+#include "pl_modbus.h"
+#include "esp_timer.h"
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <getopt.h>
+#include <random>
+#include <thread>
+
+//==============================================================================
+
+// Modbus TCP load generator: opens several connections to a server and sends a weighted mix of requests
+// at a target rate or at full speed, then reports the throughput, latency percentiles, exceptions and errors.
+// Pipelining depth 1 uses one ModbusClient per connection. Deeper pipelines keep several requests with different
+// transaction IDs in flight on the connection (ModbusClient waits for each response), so they are sent directly over the TCP client stream.
+// With a target rate the latency is measured from the scheduled send time (queueing behind slow responses is included).
+
+const char* usage =
+  "Usage: pl_modbus_load_generator [options]\n"
+  "  -a, --address A.B.C.D         server IPv4 address (127.0.0.1)\n"
+  "  -p, --port PORT               server port (502)\n"
+  "  -u, --unit ID                 unit identifier (255)\n"
+  "  -c, --connections N           number of connections (1)\n"
+  "  -d, --depth N                 requests in flight per connection (1)\n"
+  "  -r, --rate N                  target rate of all connections in requests per second (0: full speed)\n"
+  "  -t, --duration SECONDS        test duration (10)\n"
+  "  -q, --request FC:FIRST[-LAST]:COUNT[:WEIGHT]\n"
+  "                                request with a random first address in the range (repeatable, 3:0:10 by default)\n"
+  "                                FC: 1, 2, 3, 4, 5, 6, 15 or 16\n"
+  "  -T, --timeout MS              response timeout (1000)\n"
+  "  -l, --local-server            starts a local server on the port (all addresses of all memory types)\n"
+  "  -h, --help                    prints this help\n";
+
+struct RequestType {
+  PL::ModbusFunctionCode functionCode;
+  uint16_t firstAddress;
+  uint16_t lastAddress;
+  uint16_t numberOfItems;
+  uint32_t weight;
+};
+
+struct Options {
+  PL::IpV4Address address = PL::IpV4Address(127, 0, 0, 1);
+  uint16_t port = 502;
+  uint8_t unitId = PL::ModbusBase::defaultNetworkStationAddress;
+  int numberOfConnections = 1;
+  int depth = 1;
+  double rate = 0;
+  double duration = 10;
+  std::vector<RequestType> requestTypes;
+  TickType_t timeout = 1000 / portTICK_PERIOD_MS;
+  bool localServer = false;
+};
+
+struct ConnectionResult {
+  std::vector<uint32_t> latencies;
+  uint32_t numberOfRequests = 0;
+  uint32_t numberOfExceptions[256] = {};
+  uint32_t numberOfErrors = 0;
+  uint32_t numberOfConnectionErrors = 0;
+};
+
+// Request protocol data unit without the function code
+struct Request {
+  PL::ModbusFunctionCode functionCode;
+  uint8_t data[PL::ModbusBase::defaultBufferSize];
+  size_t size;
+};
+
+const size_t mbapHeaderSize = 7;
+const TickType_t reconnectDelay = 100 / portTICK_PERIOD_MS;
+
+Options options;
+std::atomic<bool> running;
+
+//==============================================================================
+
+bool ParseOptions(int argc, char** argv);
+bool ParseRequestType(const char* text, RequestType& requestType);
+std::shared_ptr<PL::ModbusServer> CreateLocalServer();
+void RunConnection(int connectionIndex, ConnectionResult& result);
+void RunClientConnection(std::mt19937& random, ConnectionResult& result);
+void RunPipelinedConnection(std::mt19937& random, ConnectionResult& result);
+void CreateRequest(std::mt19937& random, Request& request);
+int64_t GetNextSendTime(int64_t& sendTime);
+void WaitUntil(int64_t time);
+void PrintReport(std::vector<ConnectionResult>& results, int64_t duration);
+
+//==============================================================================
+
+int main(int argc, char** argv) {
+  if (!ParseOptions(argc, argv))
+    return 2;
+  ESP_ERROR_CHECK(esp_netif_init());
+
+  std::shared_ptr<PL::ModbusServer> server;
+  if (options.localServer && !(server = CreateLocalServer()))
+    return 1;
+
+  std::vector<ConnectionResult> results(options.numberOfConnections);
+  std::vector<std::thread> threads;
+  running = true;
+  int64_t startTime = esp_timer_get_time();
+  for (int i = 0; i < options.numberOfConnections; i++)
+    threads.emplace_back(RunConnection, i, std::ref(results[i]));
+  std::this_thread::sleep_for(std::chrono::microseconds((int64_t)(options.duration * 1000000)));
+  running = false;
+  for (auto& thread : threads)
+    thread.join();
+  int64_t duration = esp_timer_get_time() - startTime;
+
+  if (server)
+    server->Disable();
+  PrintReport(results, duration);
+  return 0;
+}
+
+//==============================================================================
+
+bool ParseOptions(int argc, char** argv) {
+  const option longOptions[] = {
+    {"address", required_argument, NULL, 'a'},
+    {"port", required_argument, NULL, 'p'},
+    {"unit", required_argument, NULL, 'u'},
+    {"connections", required_argument, NULL, 'c'},
+    {"depth", required_argument, NULL, 'd'},
+    {"rate", required_argument, NULL, 'r'},
+    {"duration", required_argument, NULL, 't'},
+    {"request", required_argument, NULL, 'q'},
+    {"timeout", required_argument, NULL, 'T'},
+    {"local-server", no_argument, NULL, 'l'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+
+  int option;
+  while ((option = getopt_long(argc, argv, "a:p:u:c:d:r:t:q:T:lh", longOptions, NULL)) != -1) {
+    switch (option) {
+      case 'a': {
+        unsigned int a, b, c, d;
+        if (sscanf(optarg, "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || a > 255 || b > 255 || c > 255 || d > 255) {
+          fprintf(stderr, "invalid address %s\n", optarg);
+          return false;
+        }
+        options.address = PL::IpV4Address(a, b, c, d);
+        break;
+      }
+      case 'p': options.port = atoi(optarg); break;
+      case 'u': options.unitId = atoi(optarg); break;
+      case 'c': options.numberOfConnections = std::max(atoi(optarg), 1); break;
+      case 'd': options.depth = std::max(atoi(optarg), 1); break;
+      case 'r': options.rate = std::max(atof(optarg), 0.0); break;
+      case 't': options.duration = std::max(atof(optarg), 0.0); break;
+      case 'q': {
+        RequestType requestType;
+        if (!ParseRequestType(optarg, requestType)) {
+          fprintf(stderr, "invalid request %s\n", optarg);
+          return false;
+        }
+        options.requestTypes.push_back(requestType);
+        break;
+      }
+      case 'T': options.timeout = std::max(atoi(optarg), 1) / portTICK_PERIOD_MS; break;
+      case 'l': options.localServer = true; break;
+      default:
+        fputs(usage, option == 'h' ? stdout : stderr);
+        return false;
+    }
+  }
+  if (options.requestTypes.empty())
+    options.requestTypes.push_back({PL::ModbusFunctionCode::readHoldingRegisters, 0, 0, 10, 1});
+  return true;
+}
+
+//==============================================================================
+
+bool ParseRequestType(const char* text, RequestType& requestType) {
+  unsigned int functionCode, firstAddress, lastAddress, numberOfItems, weight = 1;
+  int firstEnd = 0;
+  if (sscanf(text, "%u:%u%n", &functionCode, &firstAddress, &firstEnd) != 2)
+    return false;
+  const char* rest = text + firstEnd;
+  lastAddress = firstAddress;
+  if (*rest == '-' && sscanf(rest, "-%u%n", &lastAddress, &firstEnd) == 1)
+    rest += firstEnd;
+  if (sscanf(rest, ":%u:%u", &numberOfItems, &weight) < 1)
+    return false;
+
+  uint16_t maxNumberOfItems;
+  switch (functionCode) {
+    case 1: case 2: maxNumberOfItems = PL::ModbusBase::maxNumberOfModbusBitsToRead; break;
+    case 3: case 4: maxNumberOfItems = PL::ModbusBase::maxNumberOfModbusRegistersToRead; break;
+    case 5: case 6: maxNumberOfItems = 1; break;
+    case 15: maxNumberOfItems = PL::ModbusBase::maxNumberOfModbusBitsToWrite; break;
+    case 16: maxNumberOfItems = PL::ModbusBase::maxNumberOfModbusRegistersToWrite; break;
+    default: return false;
+  }
+  if (numberOfItems < 1 || numberOfItems > maxNumberOfItems || lastAddress < firstAddress || lastAddress + numberOfItems > 0x10000 || !weight)
+    return false;
+  requestType = {(PL::ModbusFunctionCode)functionCode, (uint16_t)firstAddress, (uint16_t)lastAddress, (uint16_t)numberOfItems, weight};
+  return true;
+}
+
+//==============================================================================
+
+std::shared_ptr<PL::ModbusServer> CreateLocalServer() {
+  static uint8_t bits[0x10000 / 8];
+  static uint16_t registers[0x10000];
+  auto server = std::make_shared<PL::ModbusServer>(options.port);
+  server->SetStationAddress(options.unitId);
+  server->AddMemoryArea(std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::coils, 0, bits, sizeof(bits)));
+  server->AddMemoryArea(std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::discreteInputs, 0, bits, sizeof(bits)));
+  server->AddMemoryArea(std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::holdingRegisters, 0, registers, sizeof(registers)));
+  server->AddMemoryArea(std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::inputRegisters, 0, registers, sizeof(registers)));
+  if (auto baseServer = std::dynamic_pointer_cast<PL::TcpServer>(server->GetBaseServer().lock())) {
+    baseServer->SetMaxNumberOfClients(options.numberOfConnections);
+    // Pipelined responses are not delayed until the client acknowledges the previous ones.
+    baseServer->DisableNagleAlgorithm();
+  }
+  if (server->Enable() != ESP_OK) {
+    fprintf(stderr, "local server on port %d cannot be enabled\n", options.port);
+    return NULL;
+  }
+  return server;
+}
+
+//==============================================================================
+
+void RunConnection(int connectionIndex, ConnectionResult& result) {
+  std::mt19937 random(connectionIndex + 1);
+  if (options.depth == 1)
+    RunClientConnection(random, result);
+  else
+    RunPipelinedConnection(random, result);
+}
+
+//==============================================================================
+
+void RunClientConnection(std::mt19937& random, ConnectionResult& result) {
+  PL::ModbusClient client(options.address, options.port);
+  client.SetStationAddress(options.unitId);
+  client.SetReadTimeout(options.timeout);
+  Request request;
+  uint8_t responseData[PL::ModbusBase::defaultBufferSize];
+  int64_t sendTime = esp_timer_get_time();
+
+  while (running) {
+    int64_t scheduledTime = GetNextSendTime(sendTime);
+    if (!running)
+      break;
+    CreateRequest(random, request);
+    PL::ModbusException exception = PL::ModbusException::noException;
+    size_t responseDataSize;
+    esp_err_t error = client.Command(request.functionCode, request.data, request.size, responseData, sizeof(responseData), &responseDataSize, &exception);
+    result.numberOfRequests++;
+    if (error == ESP_OK)
+      result.latencies.push_back(esp_timer_get_time() - scheduledTime);
+    else if (exception != PL::ModbusException::noException)
+      result.numberOfExceptions[(uint8_t)exception]++;
+    else {
+      result.numberOfErrors++;
+      if (!client.IsConnected()) {
+        result.numberOfConnectionErrors++;
+        vTaskDelay(reconnectDelay);
+      }
+    }
+  }
+}
+
+//==============================================================================
+
+void RunPipelinedConnection(std::mt19937& random, ConnectionResult& result) {
+  struct PendingRequest {
+    uint16_t transactionId;
+    int64_t scheduledTime;
+  };
+
+  auto tcpClient = std::make_shared<PL::TcpClient>(options.address, options.port);
+  tcpClient->DisableNagleAlgorithm();
+  Request request;
+  uint8_t frame[mbapHeaderSize + 1 + PL::ModbusBase::defaultBufferSize];
+  std::deque<PendingRequest> pendingRequests;
+  uint16_t transactionId = 0;
+  int64_t sendTime = esp_timer_get_time();
+
+  while (running) {
+    if (!tcpClient->IsConnected()) {
+      result.numberOfErrors += pendingRequests.size();
+      pendingRequests.clear();
+      if (tcpClient->Connect() != ESP_OK) {
+        result.numberOfConnectionErrors++;
+        vTaskDelay(reconnectDelay);
+        continue;
+      }
+      tcpClient->GetStream()->SetReadTimeout(options.timeout);
+    }
+    auto stream = tcpClient->GetStream();
+
+    // Fills the pipeline with the requests that are due.
+    while ((int)pendingRequests.size() < options.depth && (options.rate <= 0 || sendTime <= esp_timer_get_time())) {
+      int64_t scheduledTime = options.rate > 0 ? sendTime : esp_timer_get_time();
+      if (options.rate > 0)
+        sendTime += (int64_t)(1000000 * options.numberOfConnections / options.rate);
+      CreateRequest(random, request);
+      size_t pduSize = 1 + request.size;
+      transactionId++;
+      frame[0] = transactionId >> 8;
+      frame[1] = transactionId;
+      frame[2] = frame[3] = 0;
+      frame[4] = (pduSize + 1) >> 8;
+      frame[5] = pduSize + 1;
+      frame[6] = options.unitId;
+      frame[7] = (uint8_t)request.functionCode;
+      memcpy(frame + 8, request.data, request.size);
+      if (stream->Write(frame, mbapHeaderSize + pduSize) != ESP_OK) {
+        result.numberOfErrors++;
+        tcpClient->Disconnect();
+        break;
+      }
+      result.numberOfRequests++;
+      pendingRequests.push_back({transactionId, scheduledTime});
+    }
+    if (!tcpClient->IsConnected())
+      continue;
+    if (pendingRequests.empty()) {
+      WaitUntil(sendTime);
+      continue;
+    }
+    // Waits for a due request or a response.
+    if ((int)pendingRequests.size() < options.depth && !stream->GetReadableSize()) {
+      std::this_thread::sleep_for(std::chrono::microseconds(std::clamp<int64_t>(sendTime - esp_timer_get_time(), 1, 100)));
+      continue;
+    }
+
+    uint16_t pduSize;
+    if (stream->Read(frame, mbapHeaderSize) != ESP_OK || (pduSize = ((frame[4] << 8) | frame[5]) - 1) < 2 || pduSize > sizeof(frame) - mbapHeaderSize ||
+        stream->Read(frame + mbapHeaderSize, pduSize) != ESP_OK) {
+      result.numberOfErrors++;
+      tcpClient->Disconnect();
+      continue;
+    }
+    uint16_t responseTransactionId = (frame[0] << 8) | frame[1];
+    auto pendingRequest = std::find_if(pendingRequests.begin(), pendingRequests.end(), [responseTransactionId](auto& r) { return r.transactionId == responseTransactionId; });
+    if (pendingRequest == pendingRequests.end()) {
+      result.numberOfErrors++;
+      continue;
+    }
+    // The requests sent before the matching one have no response.
+    result.numberOfErrors += pendingRequest - pendingRequests.begin();
+    if (frame[7] & 0x80)
+      result.numberOfExceptions[frame[8]]++;
+    else
+      result.latencies.push_back(esp_timer_get_time() - pendingRequest->scheduledTime);
+    pendingRequests.erase(pendingRequests.begin(), pendingRequest + 1);
+  }
+}
+
+//==============================================================================
+
+void CreateRequest(std::mt19937& random, Request& request) {
+  uint32_t totalWeight = 0;
+  for (auto& requestType : options.requestTypes)
+    totalWeight += requestType.weight;
+  uint32_t value = random() % totalWeight;
+  auto requestType = options.requestTypes.begin();
+  while (value >= requestType->weight)
+    value -= (requestType++)->weight;
+
+  uint16_t address = requestType->firstAddress + random() % (requestType->lastAddress - requestType->firstAddress + 1);
+  uint16_t numberOfItems = requestType->numberOfItems;
+  request.functionCode = requestType->functionCode;
+  request.data[0] = address >> 8;
+  request.data[1] = address;
+  request.data[2] = numberOfItems >> 8;
+  request.data[3] = numberOfItems;
+  request.size = 4;
+  switch (request.functionCode) {
+    case PL::ModbusFunctionCode::writeSingleCoil:
+      request.data[2] = (random() & 1) ? 0xFF : 0x00;
+      request.data[3] = 0;
+      break;
+    case PL::ModbusFunctionCode::writeSingleHoldingRegister:
+      request.data[2] = random();
+      request.data[3] = random();
+      break;
+    case PL::ModbusFunctionCode::writeMultipleCoils:
+    case PL::ModbusFunctionCode::writeMultipleHoldingRegisters:
+      request.data[4] = (request.functionCode == PL::ModbusFunctionCode::writeMultipleCoils) ? (numberOfItems + 7) / 8 : numberOfItems * 2;
+      for (int i = 0; i < request.data[4]; i++)
+        request.data[5 + i] = random();
+      request.size = 5 + request.data[4];
+      break;
+    default:
+      break;
+  }
+}
+
+//==============================================================================
+
+int64_t GetNextSendTime(int64_t& sendTime) {
+  // Full speed: the request is sent immediately. Target rate: waits for the schedule of this connection.
+  if (options.rate <= 0)
+    return esp_timer_get_time();
+  int64_t scheduledTime = sendTime;
+  sendTime += (int64_t)(1000000 * options.numberOfConnections / options.rate);
+  WaitUntil(scheduledTime);
+  return scheduledTime;
+}
+
+//==============================================================================
+
+void WaitUntil(int64_t time) {
+  // Short sleeps: the test end is not delayed by a low rate.
+  while (running && esp_timer_get_time() < time)
+    std::this_thread::sleep_for(std::chrono::microseconds(std::min<int64_t>(time - esp_timer_get_time(), 10000)));
+}
+
+//==============================================================================
+
+void PrintReport(std::vector<ConnectionResult>& results, int64_t duration) {
+  std::vector<uint32_t> latencies;
+  uint32_t numberOfRequests = 0, numberOfErrors = 0, numberOfConnectionErrors = 0;
+  uint32_t numberOfExceptions[256] = {};
+  for (auto& result : results) {
+    latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+    numberOfRequests += result.numberOfRequests;
+    numberOfErrors += result.numberOfErrors;
+    numberOfConnectionErrors += result.numberOfConnectionErrors;
+    for (int i = 0; i < 256; i++)
+      numberOfExceptions[i] += result.numberOfExceptions[i];
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&latencies](double p) { return latencies.empty() ? 0 : latencies[std::min(latencies.size() - 1, (size_t)(latencies.size() * p))]; };
+
+  printf("connections: %d\n", options.numberOfConnections);
+  printf("depth: %d\n", options.depth);
+  printf("target_rate: %.1f\n", options.rate);
+  printf("duration_s: %.3f\n", duration / 1000000.0);
+  printf("requests: %lu\n", (unsigned long)numberOfRequests);
+  printf("responses: %lu\n", (unsigned long)latencies.size());
+  printf("throughput_tps: %.1f\n", latencies.size() * 1000000.0 / duration);
+  printf("latency_us: p50 %lu p90 %lu p99 %lu p99.9 %lu max %lu\n", (unsigned long)percentile(0.5), (unsigned long)percentile(0.9),
+    (unsigned long)percentile(0.99), (unsigned long)percentile(0.999), (unsigned long)(latencies.empty() ? 0 : latencies.back()));
+  uint32_t totalNumberOfExceptions = 0;
+  for (int i = 0; i < 256; i++)
+    totalNumberOfExceptions += numberOfExceptions[i];
+  printf("exceptions: %lu\n", (unsigned long)totalNumberOfExceptions);
+  for (int i = 0; i < 256; i++) {
+    if (numberOfExceptions[i])
+      printf("exception_%d: %lu\n", i, (unsigned long)numberOfExceptions[i]);
+  }
+  printf("errors: %lu\n", (unsigned long)numberOfErrors);
+  printf("connection_errors: %lu\n", (unsigned long)numberOfConnectionErrors);
+}
@@ -0,0 +1,680 @@
+#include "pl_modbus.h"
+#include "pl_loopback_stream.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <algorithm>
+#include <deque>
+#include <getopt.h>
+#include <map>
+#include <mutex>
+#include <thread>
+
+//==============================================================================
+
+// Modbus traffic replay: reads the request and response frames of a pcap capture (ModbusCapture::WritePcap of any format
+// or a Modbus TCP capture with Ethernet, Linux cooked or raw IPv4 link type), sends the requests to a server
+// at the original timing (scaled by the speed factor) or as fast as possible, checks the responses against the captured ones
+// and reports the throughput, latency percentiles and how late the requests have been sent.
+// Each captured connection is replayed by its own client in the original order, so concurrent connections load the server concurrently.
+// Over a loopback stream all connections share one client (as on a serial line).
+
+const char* usage =
+  "Usage: pl_modbus_replay [options] CAPTURE.pcap\n"
+  "  -a, --address A.B.C.D         server IPv4 address (127.0.0.1)\n"
+  "  -p, --port PORT               server port (502), also the Modbus TCP port of the captured connections\n"
+  "  -l, --local-server            starts a local TCP server on the port (all addresses of all memory types of the captured stations)\n"
+  "  -L, --loopback PROTOCOL       replays over a loopback stream to a local stream server: rtu, ascii or tcp\n"
+  "  -s, --speed FACTOR            replay speed relative to the captured timing (1, 0: as fast as possible)\n"
+  "  -u, --unit ID                 replaces the captured station addresses/unit identifiers\n"
+  "  -C, --check MODE              response check: none, exception (exception codes match, default) or data (responses match)\n"
+  "  -T, --timeout MS              response timeout (1000)\n"
+  "  -h, --help                    prints this help\n";
+
+enum class Check {
+  none,
+  exception,
+  data
+};
+
+struct Options {
+  const char* fileName = NULL;
+  PL::IpV4Address address = PL::IpV4Address(127, 0, 0, 1);
+  uint16_t port = 502;
+  bool localServer = false;
+  bool loopback = false;
+  PL::ModbusProtocol loopbackProtocol = PL::ModbusProtocol::rtu;
+  double speed = 1;
+  int unitId = -1;
+  Check check = Check::exception;
+  TickType_t timeout = 1000 / portTICK_PERIOD_MS;
+};
+
+// Captured frame (protocol data unit: function code and data)
+struct Frame {
+  int64_t time;
+  uint32_t connection;
+  bool serverFrame;
+  bool tcp;
+  uint16_t transactionId;
+  uint8_t unitId;
+  std::vector<uint8_t> pdu;
+};
+
+// Captured request with its response
+struct Transaction {
+  int64_t time;
+  uint32_t connection;
+  uint8_t unitId;
+  std::vector<uint8_t> request;
+  bool hasResponse = false;
+  std::vector<uint8_t> response;
+};
+
+struct Capture {
+  std::vector<Transaction> transactions;
+  uint32_t numberOfConnections = 0;
+  uint32_t numberOfInvalidFrames = 0;
+  uint32_t numberOfUnmatchedResponses = 0;
+};
+
+struct ReplayResult {
+  std::vector<uint32_t> latencies;
+  std::vector<uint32_t> lags;
+  uint32_t numberOfRequests = 0;
+  uint32_t numberOfExceptions[256] = {};
+  uint32_t numberOfErrors = 0;
+  uint32_t numberOfChecks = 0;
+  uint32_t numberOfMismatches = 0;
+};
+
+// Modbus TCP stream of one direction of a captured connection
+struct TcpStream {
+  bool synchronized = false;
+  uint32_t nextSequence = 0;
+  std::vector<uint8_t> data;
+};
+
+const uint32_t pcapLinkTypeEthernet = 1;
+const uint32_t pcapLinkTypeRaw = 101;
+const uint32_t pcapLinkTypeLinuxSll = 113;
+const uint32_t pcapLinkTypeUser0 = 147;
+const size_t mbapHeaderSize = 7;
+const size_t maxNumberOfPrintedMismatches = 10;
+
+Options options;
+std::mutex printMutex;
+
+//==============================================================================
+
+bool ParseOptions(int argc, char** argv);
+bool ReadCapture(const char* fileName, Capture& capture);
+void AddUserFrame(const uint8_t* data, size_t size, int64_t time, std::vector<Frame>& frames, Capture& capture);
+void AddIpFrames(const uint8_t* data, size_t size, int64_t time, std::map<uint64_t, uint32_t>& connections,
+  std::map<std::pair<uint32_t, bool>, TcpStream>& tcpStreams, std::vector<Frame>& frames, Capture& capture);
+void MatchTransactions(std::vector<Frame>& frames, Capture& capture);
+std::shared_ptr<PL::ModbusServer> CreateLocalServer(Capture& capture, std::shared_ptr<PL::Stream> stream, uint32_t numberOfConnections);
+void Replay(PL::ModbusClient& client, Capture& capture, const std::vector<size_t>& transactionIndexes, int64_t startTime, ReplayResult& result);
+void WaitUntil(int64_t time);
+void PrintMismatch(size_t transactionIndex, const Transaction& transaction, const std::vector<uint8_t>& response);
+void PrintReport(Capture& capture, std::vector<ReplayResult>& results, int64_t duration);
+
+//==============================================================================
+
+int main(int argc, char** argv) {
+  if (!ParseOptions(argc, argv))
+    return 2;
+  Capture capture;
+  if (!ReadCapture(options.fileName, capture))
+    return 1;
+  if (capture.transactions.empty()) {
+    fprintf(stderr, "no requests in %s\n", options.fileName);
+    return 1;
+  }
+  ESP_ERROR_CHECK(esp_netif_init());
+  // Captured exceptions and errors are expected: the replay reports them instead of the component log.
+  esp_log_level_set("*", ESP_LOG_NONE);
+
+  // Requests of each replayed connection in the captured order
+  std::map<uint32_t, std::vector<size_t>> connectionTransactions;
+  for (size_t i = 0; i < capture.transactions.size(); i++)
+    connectionTransactions[options.loopback ? 0 : capture.transactions[i].connection].push_back(i);
+
+  std::shared_ptr<PL::ModbusServer> server;
+  std::vector<std::shared_ptr<PL::ModbusClient>> clients;
+  if (options.loopback) {
+    auto streams = PL::LoopbackStream::CreatePair();
+    if (!(server = CreateLocalServer(capture, streams.first, 1)))
+      return 1;
+    clients.push_back(std::make_shared<PL::ModbusClient>(streams.second, options.loopbackProtocol, 1));
+  }
+  else {
+    if (options.localServer && !(server = CreateLocalServer(capture, NULL, connectionTransactions.size())))
+      return 1;
+    for (size_t i = 0; i < connectionTransactions.size(); i++) {
+      auto tcpClient = std::make_shared<PL::TcpClient>(options.address, options.port);
+      tcpClient->DisableNagleAlgorithm();
+      clients.push_back(std::make_shared<PL::ModbusClient>(tcpClient));
+    }
+  }
+  for (auto& client : clients)
+    client->SetReadTimeout(options.timeout);
+
+  std::vector<ReplayResult> results(connectionTransactions.size());
+  std::vector<std::thread> threads;
+  int64_t startTime = esp_timer_get_time();
+  size_t connectionIndex = 0;
+  for (auto& connection : connectionTransactions) {
+    threads.emplace_back(Replay, std::ref(*clients[connectionIndex]), std::ref(capture), std::cref(connection.second), startTime, std::ref(results[connectionIndex]));
+    connectionIndex++;
+  }
+  for (auto& thread : threads)
+    thread.join();
+  int64_t duration = esp_timer_get_time() - startTime;
+
+  clients.clear();
+  if (server)
+    server->Disable();
+  PrintReport(capture, results, duration);
+  return 0;
+}
+
+//==============================================================================
+
+bool ParseOptions(int argc, char** argv) {
+  const option longOptions[] = {
+    {"address", required_argument, NULL, 'a'},
+    {"port", required_argument, NULL, 'p'},
+    {"local-server", no_argument, NULL, 'l'},
+    {"loopback", required_argument, NULL, 'L'},
+    {"speed", required_argument, NULL, 's'},
+    {"unit", required_argument, NULL, 'u'},
+    {"check", required_argument, NULL, 'C'},
+    {"timeout", required_argument, NULL, 'T'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+
+  int option;
+  while ((option = getopt_long(argc, argv, "a:p:lL:s:u:C:T:h", longOptions, NULL)) != -1) {
+    switch (option) {
+      case 'a': {
+        unsigned int a, b, c, d;
+        if (sscanf(optarg, "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || a > 255 || b > 255 || c > 255 || d > 255) {
+          fprintf(stderr, "invalid address %s\n", optarg);
+          return false;
+        }
+        options.address = PL::IpV4Address(a, b, c, d);
+        break;
+      }
+      case 'p': options.port = atoi(optarg); break;
+      case 'l': options.localServer = true; break;
+      case 'L':
+        options.loopback = true;
+        if (!strcmp(optarg, "rtu"))
+          options.loopbackProtocol = PL::ModbusProtocol::rtu;
+        else if (!strcmp(optarg, "ascii"))
+          options.loopbackProtocol = PL::ModbusProtocol::ascii;
+        else if (!strcmp(optarg, "tcp"))
+          options.loopbackProtocol = PL::ModbusProtocol::tcp;
+        else {
+          fprintf(stderr, "invalid protocol %s\n", optarg);
+          return false;
+        }
+        break;
+      case 's': options.speed = std::max(atof(optarg), 0.0); break;
+      case 'u': options.unitId = std::clamp(atoi(optarg), 0, 255); break;
+      case 'C':
+        if (!strcmp(optarg, "none"))
+          options.check = Check::none;
+        else if (!strcmp(optarg, "exception"))
+          options.check = Check::exception;
+        else if (!strcmp(optarg, "data"))
+          options.check = Check::data;
+        else {
+          fprintf(stderr, "invalid check mode %s\n", optarg);
+          return false;
+        }
+        break;
+      case 'T': options.timeout = std::max(atoi(optarg), 1) / portTICK_PERIOD_MS; break;
+      default:
+        fputs(usage, option == 'h' ? stdout : stderr);
+        return false;
+    }
+  }
+  if (optind != argc - 1) {
+    fputs(usage, stderr);
+    return false;
+  }
+  options.fileName = argv[optind];
+  return true;
+}
+
+//==============================================================================
+
+bool ReadCapture(const char* fileName, Capture& capture) {
+  FILE* file = fopen(fileName, "rb");
+  if (!file) {
+    fprintf(stderr, "%s cannot be opened\n", fileName);
+    return false;
+  }
+
+  uint32_t header[6];
+  bool swapped = false, nanoseconds = false;
+  if (fread(header, sizeof(header), 1, file) == 1) {
+    swapped = header[0] == 0xD4C3B2A1 || header[0] == 0x4D3CB2A1;
+    uint32_t magic = swapped ? __builtin_bswap32(header[0]) : header[0];
+    nanoseconds = magic == 0xA1B23C4D;
+    if (magic != 0xA1B2C3D4 && !nanoseconds)
+      header[0] = 0;
+  }
+  else
+    header[0] = 0;
+  if (!header[0]) {
+    fprintf(stderr, "%s is not a pcap file\n", fileName);
+    fclose(file);
+    return false;
+  }
+  uint32_t linkType = swapped ? __builtin_bswap32(header[5]) : header[5];
+  if (linkType != pcapLinkTypeEthernet && linkType != pcapLinkTypeRaw && linkType != pcapLinkTypeLinuxSll && linkType != pcapLinkTypeUser0) {
+    fprintf(stderr, "unsupported pcap link type %lu\n", (unsigned long)linkType);
+    fclose(file);
+    return false;
+  }
+
+  std::vector<Frame> frames;
+  std::map<uint64_t, uint32_t> connections;
+  std::map<std::pair<uint32_t, bool>, TcpStream> tcpStreams;
+  std::vector<uint8_t> packet;
+  uint32_t recordHeader[4];
+  while (fread(recordHeader, sizeof(recordHeader), 1, file) == 1) {
+    for (auto& value : recordHeader)
+      value = swapped ? __builtin_bswap32(value) : value;
+    int64_t time = (int64_t)recordHeader[0] * 1000000 + (nanoseconds ? recordHeader[1] / 1000 : recordHeader[1]);
+    packet.resize(recordHeader[2]);
+    if (fread(packet.data(), 1, packet.size(), file) != packet.size())
+      break;
+    // Truncated packets (snapshot length) are skipped.
+    if (recordHeader[2] < recordHeader[3]) {
+      capture.numberOfInvalidFrames++;
+      continue;
+    }
+
+    switch (linkType) {
+      case pcapLinkTypeUser0:
+        AddUserFrame(packet.data(), packet.size(), time, frames, capture);
+        break;
+      case pcapLinkTypeRaw:
+        AddIpFrames(packet.data(), packet.size(), time, connections, tcpStreams, frames, capture);
+        break;
+      case pcapLinkTypeEthernet: {
+        // Ethernet header with optional VLAN tags
+        size_t offset = 12;
+        while (offset + 4 <= packet.size() && ((packet[offset] << 8) | packet[offset + 1]) == 0x8100)
+          offset += 4;
+        if (offset + 2 <= packet.size() && ((packet[offset] << 8) | packet[offset + 1]) == 0x0800)
+          AddIpFrames(packet.data() + offset + 2, packet.size() - offset - 2, time, connections, tcpStreams, frames, capture);
+        break;
+      }
+      case pcapLinkTypeLinuxSll:
+        if (packet.size() >= 16 && ((packet[14] << 8) | packet[15]) == 0x0800)
+          AddIpFrames(packet.data() + 16, packet.size() - 16, time, connections, tcpStreams, frames, capture);
+        break;
+    }
+  }
+  fclose(file);
+
+  MatchTransactions(frames, capture);
+  return true;
+}
+
+//==============================================================================
+
+void AddUserFrame(const uint8_t* data, size_t size, int64_t time, std::vector<Frame>& frames, Capture& capture) {
+  // ModbusCapture DLT_USER0 header: direction, protocol, server frame flag, 0, connection ID
+  if (size < 8) {
+    capture.numberOfInvalidFrames++;
+    return;
+  }
+  PL::ModbusProtocol protocol = (PL::ModbusProtocol)data[1];
+  Frame frame;
+  frame.time = time;
+  frame.serverFrame = data[2];
+  frame.connection = (data[4] << 24) | (data[5] << 16) | (data[6] << 8) | data[7];
+  frame.tcp = protocol == PL::ModbusProtocol::tcp;
+  frame.transactionId = 0;
+  data += 8;
+  size -= 8;
+
+  switch (protocol) {
+    case PL::ModbusProtocol::rtu:
+      if (size < 4 || PL::ModbusBase::Crc(data, size - 2) != (data[size - 2] | (data[size - 1] << 8))) {
+        capture.numberOfInvalidFrames++;
+        return;
+      }
+      frame.unitId = data[0];
+      frame.pdu.assign(data + 1, data + size - 2);
+      break;
+
+    case PL::ModbusProtocol::ascii: {
+      std::vector<uint8_t> bytes((size >= 5) ? (size - 3) / 2 : 0);
+      bool valid = size >= 9 && (size & 1) && data[0] == ':' && data[size - 2] == '\r' && data[size - 1] == '\n';
+      for (size_t i = 0; valid && i < bytes.size(); i++)
+        valid = PL::ModbusBase::DecodeAscii(data + 1 + i * 2, bytes[i]);
+      if (!valid || PL::ModbusBase::Lrc(bytes.data(), bytes.size() - 1) != bytes.back()) {
+        capture.numberOfInvalidFrames++;
+        return;
+      }
+      frame.unitId = bytes[0];
+      frame.pdu.assign(bytes.begin() + 1, bytes.end() - 1);
+      break;
+    }
+
+    case PL::ModbusProtocol::tcp: {
+      // MBAP length covers the unit ID and the PDU (at least the function code)
+      int length = (size >= mbapHeaderSize) ? ((data[4] << 8) | data[5]) : 0;
+      if (length < 2 || (size_t)length - 1 > size - mbapHeaderSize) {
+        capture.numberOfInvalidFrames++;
+        return;
+      }
+      size_t pduSize = length - 1;
+      frame.transactionId = (data[0] << 8) | data[1];
+      frame.unitId = data[6];
+      frame.pdu.assign(data + mbapHeaderSize, data + mbapHeaderSize + pduSize);
+      break;
+    }
+
+    default:
+      capture.numberOfInvalidFrames++;
+      return;
+  }
+  frames.push_back(std::move(frame));
+}
+
+//==============================================================================
+
+void AddIpFrames(const uint8_t* data, size_t size, int64_t time, std::map<uint64_t, uint32_t>& connections,
+    std::map<std::pair<uint32_t, bool>, TcpStream>& tcpStreams, std::vector<Frame>& frames, Capture& capture) {
+  // IPv4 and TCP headers (fragments are not reassembled)
+  if (size < 20 || (data[0] >> 4) != 4 || data[9] != 6 || ((data[6] & 0x1F) | data[7]))
+    return;
+  size_t ipHeaderSize = (data[0] & 0x0F) * 4;
+  size_t ipSize = std::min((size_t)((data[2] << 8) | data[3]), size);
+  if (ipHeaderSize < 20 || ipSize < ipHeaderSize + 20)
+    return;
+  const uint8_t* tcp = data + ipHeaderSize;
+  size_t tcpHeaderSize = (tcp[12] >> 4) * 4;
+  if (tcpHeaderSize < 20 || ipSize < ipHeaderSize + tcpHeaderSize)
+    return;
+  uint16_t sourcePort = (tcp[0] << 8) | tcp[1];
+  uint16_t destinationPort = (tcp[2] << 8) | tcp[3];
+  bool serverFrame = sourcePort == options.port;
+  if (!serverFrame && destinationPort != options.port)
+    return;
+
+  // Connection of the client address and port
+  const uint8_t* clientAddress = data + (serverFrame ? 16 : 12);
+  uint16_t clientPort = serverFrame ? destinationPort : sourcePort;
+  uint64_t clientKey = ((uint64_t)((clientAddress[0] << 24) | (clientAddress[1] << 16) | (clientAddress[2] << 8) | clientAddress[3]) << 16) | clientPort;
+  auto connection = connections.find(clientKey);
+  if (connection == connections.end())
+    connection = connections.insert({clientKey, capture.numberOfConnections++}).first;
+  TcpStream& stream = tcpStreams[{connection->second, serverFrame}];
+
+  uint32_t sequence = (tcp[4] << 24) | (tcp[5] << 16) | (tcp[6] << 8) | tcp[7];
+  const uint8_t* payload = tcp + tcpHeaderSize;
+  size_t payloadSize = ipSize - ipHeaderSize - tcpHeaderSize;
+  // SYN: new connection with the same client port
+  if (tcp[13] & 0x02) {
+    stream.synchronized = true;
+    stream.nextSequence = sequence + 1;
+    stream.data.clear();
+    return;
+  }
+  if (!payloadSize)
+    return;
+  if (!stream.synchronized) {
+    stream.synchronized = true;
+    stream.nextSequence = sequence;
+  }
+  int32_t offset = stream.nextSequence - sequence;
+  if (offset < 0) {
+    // Lost segment: the frames of the stream are resynchronized at this segment.
+    stream.data.clear();
+    stream.nextSequence = sequence;
+    offset = 0;
+  }
+  // Retransmitted data is skipped.
+  if ((size_t)offset >= payloadSize)
+    return;
+  stream.data.insert(stream.data.end(), payload + offset, payload + payloadSize);
+  stream.nextSequence += payloadSize - offset;
+
+  size_t frameOffset = 0;
+  while (stream.data.size() - frameOffset >= mbapHeaderSize) {
+    const uint8_t* mbap = stream.data.data() + frameOffset;
+    size_t pduSize = ((mbap[4] << 8) | mbap[5]) - 1;
+    if (pduSize < 1 || pduSize > PL::ModbusBase::defaultBufferSize || mbap[2] || mbap[3]) {
+      capture.numberOfInvalidFrames++;
+      frameOffset = stream.data.size();
+      break;
+    }
+    if (stream.data.size() - frameOffset < mbapHeaderSize + pduSize)
+      break;
+    Frame frame;
+    frame.time = time;
+    frame.connection = connection->second;
+    frame.serverFrame = serverFrame;
+    frame.tcp = true;
+    frame.transactionId = (mbap[0] << 8) | mbap[1];
+    frame.unitId = mbap[6];
+    frame.pdu.assign(mbap + mbapHeaderSize, mbap + mbapHeaderSize + pduSize);
+    frames.push_back(std::move(frame));
+    frameOffset += mbapHeaderSize + pduSize;
+  }
+  stream.data.erase(stream.data.begin(), stream.data.begin() + frameOffset);
+}
+
+//==============================================================================
+
+void MatchTransactions(std::vector<Frame>& frames, Capture& capture) {
+  // Requests waiting for a response on each connection. Modbus TCP responses are matched by the transaction ID,
+  // RTU and ASCII responses by the station address. Requests before the matching one have no response.
+  std::map<uint32_t, std::deque<std::pair<size_t, uint16_t>>> pendingRequests;
+  std::map<uint32_t, uint32_t> connectionIndexes;
+
+  for (auto& frame : frames) {
+    auto& pending = pendingRequests[frame.connection];
+    if (!frame.serverFrame) {
+      Transaction transaction;
+      transaction.time = frame.time;
+      transaction.connection = connectionIndexes.insert({frame.connection, connectionIndexes.size()}).first->second;
+      transaction.unitId = frame.unitId;
+      transaction.request = std::move(frame.pdu);
+      pending.push_back({capture.transactions.size(), frame.transactionId});
+      capture.transactions.push_back(std::move(transaction));
+      continue;
+    }
+
+    auto request = std::find_if(pending.begin(), pending.end(), [&](auto& r) {
+      return frame.tcp ? r.second == frame.transactionId : capture.transactions[r.first].unitId == frame.unitId; });
+    if (request == pending.end()) {
+      capture.numberOfUnmatchedResponses++;
+      continue;
+    }
+    Transaction& transaction = capture.transactions[request->first];
+    transaction.hasResponse = true;
+    transaction.response = std::move(frame.pdu);
+    pending.erase(pending.begin(), request + 1);
+  }
+  capture.numberOfConnections = connectionIndexes.size();
+}
+
+//==============================================================================
+
+std::shared_ptr<PL::ModbusServer> CreateLocalServer(Capture& capture, std::shared_ptr<PL::Stream> stream, uint32_t numberOfConnections) {
+  static uint8_t bits[0x10000 / 8];
+  static uint16_t registers[0x10000];
+  auto coils = std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::coils, 0, bits, sizeof(bits));
+  auto discreteInputs = std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::discreteInputs, 0, bits, sizeof(bits));
+  auto holdingRegisters = std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::holdingRegisters, 0, registers, sizeof(registers));
+  auto inputRegisters = std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::inputRegisters, 0, registers, sizeof(registers));
+
+  // Captured stations (the first one is the server station, the others are additional stations with the same memory areas)
+  std::vector<uint8_t> stationAddresses;
+  for (auto& transaction : capture.transactions) {
+    uint8_t stationAddress = (options.unitId >= 0) ? options.unitId : transaction.unitId;
+    if (stationAddress && std::find(stationAddresses.begin(), stationAddresses.end(), stationAddress) == stationAddresses.end())
+      stationAddresses.push_back(stationAddress);
+  }
+  if (stationAddresses.empty())
+    stationAddresses.push_back(1);
+
+  std::shared_ptr<PL::ModbusServer> server;
+  if (stream)
+    server = std::make_shared<PL::ModbusServer>(stream, options.loopbackProtocol, stationAddresses[0]);
+  else
+    server = std::make_shared<PL::ModbusServer>(options.port);
+  server->SetStationAddress(stationAddresses[0]);
+  for (auto& memoryArea : {coils, discreteInputs, holdingRegisters, inputRegisters}) {
+    server->AddMemoryArea(memoryArea);
+    for (size_t i = 1; i < stationAddresses.size(); i++)
+      server->AddMemoryArea(stationAddresses[i], memoryArea);
+  }
+  if (!stream) {
+    if (auto baseServer = std::dynamic_pointer_cast<PL::TcpServer>(server->GetBaseServer().lock())) {
+      baseServer->SetMaxNumberOfClients(numberOfConnections);
+      baseServer->DisableNagleAlgorithm();
+    }
+  }
+  if (server->Enable() != ESP_OK) {
+    fprintf(stderr, "local server cannot be enabled\n");
+    return NULL;
+  }
+  return server;
+}
+
+//==============================================================================
+
+void Replay(PL::ModbusClient& client, Capture& capture, const std::vector<size_t>& transactionIndexes, int64_t startTime, ReplayResult& result) {
+  int64_t firstTime = capture.transactions.front().time;
+  uint8_t responseData[PL::ModbusBase::defaultBufferSize];
+  std::vector<uint8_t> response;
+
+  for (size_t transactionIndex : transactionIndexes) {
+    Transaction& transaction = capture.transactions[transactionIndex];
+    if (options.speed > 0) {
+      int64_t scheduledTime = startTime + (int64_t)((transaction.time - firstTime) / options.speed);
+      WaitUntil(scheduledTime);
+      result.lags.push_back(std::max<int64_t>(esp_timer_get_time() - scheduledTime, 0));
+    }
+
+    client.SetStationAddress((options.unitId >= 0) ? options.unitId : transaction.unitId);
+    PL::ModbusException exception = PL::ModbusException::noException;
+    size_t responseDataSize = 0;
+    int64_t sendTime = esp_timer_get_time();
+    esp_err_t error = client.Command((PL::ModbusFunctionCode)transaction.request[0], transaction.request.data() + 1, transaction.request.size() - 1,
+      responseData, sizeof(responseData), &responseDataSize, &exception);
+    int64_t latency = esp_timer_get_time() - sendTime;
+    result.numberOfRequests++;
+
+    if (error == ESP_OK) {
+      result.latencies.push_back(latency);
+      response.assign(1, transaction.request[0]);
+      response.insert(response.end(), responseData, responseData + responseDataSize);
+    }
+    else if (exception != PL::ModbusException::noException) {
+      result.latencies.push_back(latency);
+      result.numberOfExceptions[(uint8_t)exception]++;
+      response = {(uint8_t)(transaction.request[0] | 0x80), (uint8_t)exception};
+    }
+    else {
+      result.numberOfErrors++;
+      continue;
+    }
+
+    if (options.check == Check::none || !transaction.hasResponse)
+      continue;
+    result.numberOfChecks++;
+    bool match;
+    if (options.check == Check::data)
+      match = response == transaction.response;
+    else {
+      bool exceptionResponse = transaction.response[0] & 0x80;
+      match = exceptionResponse == (exception != PL::ModbusException::noException) &&
+        (!exceptionResponse || (transaction.response.size() >= 2 && transaction.response[1] == (uint8_t)exception));
+    }
+    if (!match) {
+      if (result.numberOfMismatches++ < maxNumberOfPrintedMismatches)
+        PrintMismatch(transactionIndex, transaction, response);
+    }
+  }
+}
+
+//==============================================================================
+
+void WaitUntil(int64_t time) {
+  while (esp_timer_get_time() < time)
+    std::this_thread::sleep_for(std::chrono::microseconds(std::min<int64_t>(time - esp_timer_get_time(), 10000)));
+}
+
+//==============================================================================
+
+void PrintMismatch(size_t transactionIndex, const Transaction& transaction, const std::vector<uint8_t>& response) {
+  std::lock_guard<std::mutex> lg(printMutex);
+  fprintf(stderr, "mismatch: request %zu, connection %lu, station %d, time %.6f s\n  captured:", transactionIndex,
+    (unsigned long)transaction.connection, transaction.unitId, transaction.time / 1000000.0);
+  for (auto value : transaction.response)
+    fprintf(stderr, " %02X", value);
+  fprintf(stderr, "\n  replayed:");
+  for (auto value : response)
+    fprintf(stderr, " %02X", value);
+  fprintf(stderr, "\n");
+}
+
+//==============================================================================
+
+void PrintReport(Capture& capture, std::vector<ReplayResult>& results, int64_t duration) {
+  std::vector<uint32_t> latencies, lags;
+  uint32_t numberOfRequests = 0, numberOfErrors = 0, numberOfChecks = 0, numberOfMismatches = 0;
+  uint32_t numberOfExceptions[256] = {};
+  for (auto& result : results) {
+    latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+    lags.insert(lags.end(), result.lags.begin(), result.lags.end());
+    numberOfRequests += result.numberOfRequests;
+    numberOfErrors += result.numberOfErrors;
+    numberOfChecks += result.numberOfChecks;
+    numberOfMismatches += result.numberOfMismatches;
+    for (int i = 0; i < 256; i++)
+      numberOfExceptions[i] += result.numberOfExceptions[i];
+  }
+  std::sort(latencies.begin(), latencies.end());
+  std::sort(lags.begin(), lags.end());
+  auto percentile = [](std::vector<uint32_t>& values, double p) { return values.empty() ? 0 : values[std::min(values.size() - 1, (size_t)(values.size() * p))]; };
+  int64_t capturedDuration = capture.transactions.back().time - capture.transactions.front().time;
+
+  printf("captured_connections: %lu\n", (unsigned long)capture.numberOfConnections);
+  printf("captured_duration_s: %.3f\n", capturedDuration / 1000000.0);
+  printf("invalid_frames: %lu\n", (unsigned long)capture.numberOfInvalidFrames);
+  printf("unmatched_responses: %lu\n", (unsigned long)capture.numberOfUnmatchedResponses);
+  printf("connections: %zu\n", results.size());
+  printf("speed: %.3f\n", options.speed);
+  printf("duration_s: %.3f\n", duration / 1000000.0);
+  printf("requests: %lu\n", (unsigned long)numberOfRequests);
+  printf("responses: %lu\n", (unsigned long)latencies.size());
+  printf("throughput_tps: %.1f\n", latencies.size() * 1000000.0 / duration);
+  printf("latency_us: p50 %lu p90 %lu p99 %lu p99.9 %lu max %lu\n", (unsigned long)percentile(latencies, 0.5), (unsigned long)percentile(latencies, 0.9),
+    (unsigned long)percentile(latencies, 0.99), (unsigned long)percentile(latencies, 0.999), (unsigned long)(latencies.empty() ? 0 : latencies.back()));
+  if (options.speed > 0)
+    printf("send_lag_us: p50 %lu p99 %lu max %lu\n", (unsigned long)percentile(lags, 0.5), (unsigned long)percentile(lags, 0.99), (unsigned long)(lags.empty() ? 0 : lags.back()));
+  uint32_t totalNumberOfExceptions = 0;
+  for (int i = 0; i < 256; i++)
+    totalNumberOfExceptions += numberOfExceptions[i];
+  printf("exceptions: %lu\n", (unsigned long)totalNumberOfExceptions);
+  for (int i = 0; i < 256; i++) {
+    if (numberOfExceptions[i])
+      printf("exception_%d: %lu\n", i, (unsigned long)numberOfExceptions[i]);
+  }
+  printf("errors: %lu\n", (unsigned long)numberOfErrors);
+  printf("checked: %lu\n", (unsigned long)numberOfChecks);
+  printf("mismatches: %lu\n", (unsigned long)numberOfMismatches);
+}
@@ -1,5 +1,10 @@
 #include "unity.h"
 #include "pl_modbus.h"
+#include "esp_timer.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include "pl_loopback_stream.h"
+#include "pl_serial_line.h"
+#endif
 
 //==============================================================================
 
@@ -22,9 +27,37 @@ public:
 
 //==============================================================================
 
+class RangeMemoryArea : public PL::ModbusMemoryArea {
+public:
+  using PL::ModbusMemoryArea::ModbusMemoryArea;
+
+  uint16_t readAddress = 0, readNumberOfItems = 0;
+  uint16_t writeAddress = 0, writeNumberOfItems = 0;
+  TickType_t onWriteDelay = 0;
+
+  esp_err_t OnRead(uint16_t address, uint16_t numberOfItems) override;
+  esp_err_t OnWrite(uint16_t address, uint16_t numberOfItems) override;
+};
+
+//==============================================================================
+
+class CounterMemoryArea : public PL::ModbusRefreshedMemoryArea {
+public:
+  using PL::ModbusRefreshedMemoryArea::ModbusRefreshedMemoryArea;
+  ~CounterMemoryArea();
+
+  std::atomic<uint16_t> counter = 0;
+
+protected:
+  esp_err_t OnRefresh(void* snapshot) override;
+};
+
+//==============================================================================
+
 const uint16_t port = 502;
 const size_t serverBufferSize = 1000;
 const uint8_t stationAddress = 100;
+const uint8_t additionalStationAddress = 102;
 
 Server server(port, serverBufferSize);
 Client client(PL::IpV4Address(127, 0, 0, 1), port, serverBufferSize);
@@ -36,6 +69,32 @@ std::vector<std::string> protocolNames = {"RTU", "ASCII", "TCP"};
 const size_t numberOfRegisters = 250;
 const size_t numberOfBits = numberOfRegisters * 16;
 auto serverHR = std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::holdingRegisters, 0, numberOfRegisters * 2);
+const size_t numberOfAdditionalStationRegisters = 10;
+auto additionalStationHR = std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::holdingRegisters, 0, numberOfAdditionalStationRegisters * 2);
+const uint16_t seqLockHRAddress = 100;
+auto seqLockHR = std::make_shared<PL::ModbusSeqLockMemoryArea>(PL::ModbusMemoryType::holdingRegisters, seqLockHRAddress, numberOfAdditionalStationRegisters * 2);
+std::atomic<bool> seqLockWriterRunning;
+std::atomic<bool> seqLockWriterDone;
+const uint16_t rangeHRAddress = 200;
+auto rangeHR = std::make_shared<RangeMemoryArea>(PL::ModbusMemoryType::holdingRegisters, rangeHRAddress, numberOfAdditionalStationRegisters * 2);
+// Memory areas adjacent to rangeHR and to each other
+const uint16_t adjacentHRAddress = rangeHRAddress + numberOfAdditionalStationRegisters;
+auto adjacentHR = std::make_shared<RangeMemoryArea>(PL::ModbusMemoryType::holdingRegisters, adjacentHRAddress, numberOfAdditionalStationRegisters * 2);
+const uint16_t adjacentCoilsAddress = 1000;
+const size_t numberOfAdjacentCoilsBytes = 2;
+auto adjacentCoils1 = std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::coils, adjacentCoilsAddress, numberOfAdjacentCoilsBytes);
+auto adjacentCoils2 = std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::coils, adjacentCoilsAddress + numberOfAdjacentCoilsBytes * 8, numberOfAdjacentCoilsBytes);
+using RegisterMapInt16 = PL::ModbusRegister<300, int16_t>;
+using RegisterMapFloat = PL::ModbusRegister<301, float>;
+using RegisterMapUInt32CDAB = PL::ModbusRegister<303, uint32_t, PL::ModbusWordOrder::cdab>;
+using RegisterMapUInt32BADC = PL::ModbusRegister<305, uint32_t, PL::ModbusWordOrder::badc>;
+using RegisterMapUInt32DCBA = PL::ModbusRegister<307, uint32_t, PL::ModbusWordOrder::dcba>;
+using RegisterMapDouble = PL::ModbusRegister<310, double, PL::ModbusWordOrder::cdab>;
+using RegisterMap = PL::ModbusRegisterMap<PL::ModbusMemoryType::holdingRegisters, 300, RegisterMapInt16, RegisterMapFloat, RegisterMapUInt32CDAB, RegisterMapUInt32BADC, RegisterMapUInt32DCBA, RegisterMapDouble>;
+static_assert(RegisterMap::numberOfRegisters == 14);
+auto registerMapHR = std::make_shared<RegisterMap::MemoryArea>();
+// Input registers with the refresh counter
+auto counterIR = std::make_shared<CounterMemoryArea>(PL::ModbusMemoryType::inputRegisters, 0, numberOfAdditionalStationRegisters * 2);
 const size_t numberOfIterations = 100;
 
 const PL::ModbusFunctionCode userDefinedFunctionCode = (PL::ModbusFunctionCode)100;
@@ -49,11 +108,34 @@ void TestReadCoils();
 void TestReadDiscreteInputs();
 void TestReadHoldingRegisters();
 void TestReadInputRegisters();
+void TestRead32BitValues();
 void TestWriteSingleCoil();
 void TestWriteSingleHoldingRegister();
 void TestWriteMultipleCoils();
 void TestWriteMultipleHoldingRegisters();
 void TestUserDefinedFunctionCode();
+void TestAdditionalStation();
+void TestSeqLockMemoryArea();
+void SeqLockWriterTask(void* parameters);
+void TestMemoryAreaRangeCallbacks();
+void TestAdjacentMemoryAreas();
+void TestRegisterMap();
+void TestWorkerConnectionClose();
+void TestDeferredOnWrite();
+void TestRefreshedMemoryArea();
+void TestServerStatistics();
+void TestClientStatistics();
+void TestCapture();
+void TestChangeSubscriptions();
+void TestStationPolicy();
+void TestConnectionManagement();
+#if CONFIG_IDF_TARGET_LINUX
+void TestLoopbackStream();
+void TestSerialLine();
+void TestForeignFrames();
+void TestMonitor();
+void TestConcentrator();
+#endif
 
 //==============================================================================
 
@@ -94,11 +176,29 @@ extern "C" void app_main(void) {
   TEST_ASSERT(server.SetDelayAfterRead(0) == ESP_OK);
   TEST_ASSERT(client.SetDelayAfterRead(0) == ESP_OK);
 
+  PL::ModbusClient rtuOverTcpClient(PL::IpV4Address(127, 0, 0, 1), port, PL::ModbusProtocol::rtu);
+  TEST_ASSERT_EQUAL(PL::ModbusInterface::network, rtuOverTcpClient.GetInterface());
+  TEST_ASSERT_EQUAL(PL::ModbusProtocol::rtu, rtuOverTcpClient.GetProtocol());
+
   esp_fill_random(serverHR->data, numberOfRegisters * 2);
   server.AddMemoryArea(std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::coils, 0, serverHR->data, serverHR->size, serverHR));
   server.AddMemoryArea(std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::discreteInputs, 0, serverHR->data, serverHR->size, serverHR));
   server.AddMemoryArea(serverHR);
   server.AddMemoryArea(std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::inputRegisters, 0, serverHR->data, serverHR->size, serverHR));
+  TEST_ASSERT(server.AddMemoryArea(additionalStationAddress, additionalStationHR) == ESP_OK);
+  TEST_ASSERT(server.AddMemoryArea(0, additionalStationHR) == ESP_ERR_INVALID_ARG);
+  TEST_ASSERT(server.AddMemoryArea(additionalStationAddress, seqLockHR) == ESP_OK);
+  TEST_ASSERT(server.AddMemoryArea(additionalStationAddress, rangeHR) == ESP_OK);
+  TEST_ASSERT(server.AddMemoryArea(additionalStationAddress, adjacentHR) == ESP_OK);
+  TEST_ASSERT(server.AddMemoryArea(additionalStationAddress, adjacentCoils2) == ESP_OK);
+  TEST_ASSERT(server.AddMemoryArea(additionalStationAddress, adjacentCoils1) == ESP_OK);
+  TEST_ASSERT(server.AddMemoryArea(additionalStationAddress, registerMapHR) == ESP_OK);
+  TEST_ASSERT(server.AddMemoryArea(additionalStationAddress, counterIR) == ESP_OK);
+  TEST_ASSERT(counterIR->RequestRefresh() == ESP_ERR_INVALID_STATE);
+  TEST_ASSERT_EQUAL(-1, counterIR->GetRefreshAge());
+  TEST_ASSERT(counterIR->EnableRefresh({4096, tskIDLE_PRIORITY + 5, tskNO_AFFINITY}, 0) == ESP_OK);
+  TEST_ASSERT(server.EnableChangeSubscriptions(0, 0) == ESP_ERR_INVALID_ARG);
+  TEST_ASSERT(server.EnableChangeSubscriptions(4, 0) == ESP_OK);
   TEST_ASSERT(server.Enable() == ESP_OK);
   vTaskDelay(10);
   TEST_ASSERT(server.IsEnabled());
@@ -113,15 +213,64 @@ extern "C" void app_main(void) {
     RUN_TEST(TestReadDiscreteInputs);
     RUN_TEST(TestReadHoldingRegisters);
     RUN_TEST(TestReadInputRegisters);
+    RUN_TEST(TestRead32BitValues);
     RUN_TEST(TestWriteSingleCoil);
     RUN_TEST(TestWriteSingleHoldingRegister);
     RUN_TEST(TestWriteMultipleCoils);
     RUN_TEST(TestWriteMultipleHoldingRegisters);
     RUN_TEST(TestUserDefinedFunctionCode);
+    RUN_TEST(TestAdditionalStation);
+    RUN_TEST(TestSeqLockMemoryArea);
+    RUN_TEST(TestMemoryAreaRangeCallbacks);
+    RUN_TEST(TestAdjacentMemoryAreas);
+    RUN_TEST(TestRegisterMap);
+    RUN_TEST(TestRefreshedMemoryArea);
+    RUN_TEST(TestServerStatistics);
+    RUN_TEST(TestClientStatistics);
+    RUN_TEST(TestCapture);
+    RUN_TEST(TestChangeSubscriptions);
   }
+  RUN_TEST(TestStationPolicy);
+  RUN_TEST(TestConnectionManagement);
+#if CONFIG_IDF_TARGET_LINUX
+  RUN_TEST(TestLoopbackStream);
+  RUN_TEST(TestSerialLine);
+  RUN_TEST(TestForeignFrames);
+  RUN_TEST(TestMonitor);
+  RUN_TEST(TestConcentrator);
+#endif
+
+  std::vector<PL::TaskParameters> workerTaskParameters = {{4096, tskIDLE_PRIORITY + 5, tskNO_AFFINITY}, {4096, tskIDLE_PRIORITY + 5, tskNO_AFFINITY}};
+  TEST_ASSERT(server.SetWorkerTaskParameters(workerTaskParameters) == ESP_ERR_INVALID_STATE);
+  TEST_ASSERT(server.Disable() == ESP_OK);
+  TEST_ASSERT(server.SetWorkerTaskParameters(workerTaskParameters) == ESP_OK);
+  TEST_ASSERT(server.Enable() == ESP_OK);
+  vTaskDelay(10);
+  for (int i = 0; i < protocols.size(); i++) {
+    printf("%s protocol with worker tasks:\n", protocolNames[i].c_str());
+    TEST_ASSERT(server.SetProtocol(protocols[i]) == ESP_OK);
+    TEST_ASSERT(client.SetProtocol(protocols[i]) == ESP_OK);
+
+    RUN_TEST(TestReadHoldingRegisters);
+    RUN_TEST(TestWriteMultipleHoldingRegisters);
+    RUN_TEST(TestUserDefinedFunctionCode);
+    RUN_TEST(TestAdjacentMemoryAreas);
+    RUN_TEST(TestCapture);
+  }
+  RUN_TEST(TestWorkerConnectionClose);
+
+  PL::TaskParameters deferredOnWriteTaskParameters = {4096, tskIDLE_PRIORITY + 5, tskNO_AFFINITY};
+  TEST_ASSERT(server.EnableDeferredOnWrite(deferredOnWriteTaskParameters, 4) == ESP_ERR_INVALID_STATE);
+  TEST_ASSERT(server.Disable() == ESP_OK);
+  TEST_ASSERT(server.EnableDeferredOnWrite(deferredOnWriteTaskParameters, 4) == ESP_OK);
+  TEST_ASSERT(server.Enable() == ESP_OK);
+  vTaskDelay(10);
+  RUN_TEST(TestDeferredOnWrite);
 
   TEST_ASSERT(server.Disable() == ESP_OK);
   TEST_ASSERT(!server.IsEnabled());
+  TEST_ASSERT(server.DisableDeferredOnWrite() == ESP_OK);
+  TEST_ASSERT(counterIR->DisableRefresh() == ESP_OK);
 
   UNITY_END();
 }
@@ -228,6 +377,40 @@ void TestReadInputRegisters() {
 
 //==============================================================================
 
+void TestRead32BitValues() {
+  PL::ModbusWordOrder wordOrders[] = {PL::ModbusWordOrder::abcd, PL::ModbusWordOrder::cdab, PL::ModbusWordOrder::badc, PL::ModbusWordOrder::dcba};
+  for (int i = 0; i < numberOfIterations; i++) {
+    uint16_t testNumberOfValues = esp_random() % (numberOfRegisters / 2) + 1;
+    uint16_t testAddress = esp_random() % (numberOfRegisters - testNumberOfValues * 2 + 1);
+    PL::ModbusWordOrder wordOrder = wordOrders[i % 4];
+    uint32_t* dest = new uint32_t[testNumberOfValues];
+    float* floatDest = new float[testNumberOfValues];
+    PL::ModbusException exception;
+    if (i % 2)
+      TEST_ASSERT(client.ReadHoldingRegisters(testAddress, testNumberOfValues, dest, wordOrder, &exception) == ESP_OK);
+    else
+      TEST_ASSERT(client.ReadInputRegisters(testAddress, testNumberOfValues, dest, wordOrder, &exception) == ESP_OK);
+    TEST_ASSERT(client.ReadHoldingRegisters(testAddress, testNumberOfValues, floatDest, wordOrder, &exception) == ESP_OK);
+    TEST_ASSERT_EQUAL(PL::ModbusException::noException, exception);
+    for (int j = 0; j < testNumberOfValues; j++) {
+      uint16_t* registers = (uint16_t*)serverHR->data + testAddress + j * 2;
+      uint32_t value;
+      switch (wordOrder) {
+        case PL::ModbusWordOrder::abcd: value = ((uint32_t)registers[0] << 16) | registers[1]; break;
+        case PL::ModbusWordOrder::cdab: value = ((uint32_t)registers[1] << 16) | registers[0]; break;
+        case PL::ModbusWordOrder::badc: value = ((uint32_t)__builtin_bswap16(registers[0]) << 16) | __builtin_bswap16(registers[1]); break;
+        default: value = ((uint32_t)__builtin_bswap16(registers[1]) << 16) | __builtin_bswap16(registers[0]); break;
+      }
+      TEST_ASSERT_EQUAL(value, dest[j]);
+      TEST_ASSERT(memcmp(&value, floatDest + j, 4) == 0);
+    }
+    delete[] dest;
+    delete[] floatDest;
+  }
+}
+
+//==============================================================================
+
 void TestWriteSingleCoil() {
   for (int i = 0; i < numberOfIterations; i++) {
     uint16_t testAddress = esp_random() % numberOfBits;
@@ -301,6 +484,674 @@ void TestUserDefinedFunctionCode() {
 
 //==============================================================================
 
+void TestAdditionalStation() {
+  uint16_t src[numberOfAdditionalStationRegisters];
+  uint16_t dest[numberOfAdditionalStationRegisters];
+  esp_fill_random(src, sizeof(src));
+  PL::ModbusException exception;
+  
+  TEST_ASSERT(client.SetStationAddress(additionalStationAddress) == ESP_OK);
+  TEST_ASSERT(client.WriteMultipleHoldingRegisters(0, numberOfAdditionalStationRegisters, src, &exception) == ESP_OK);
+  TEST_ASSERT(client.ReadHoldingRegisters(0, numberOfAdditionalStationRegisters, dest, &exception) == ESP_OK);
+  TEST_ASSERT(client.ReadHoldingRegisters(numberOfAdditionalStationRegisters, 1, NULL, &exception) == ESP_FAIL);
+  TEST_ASSERT_EQUAL(PL::ModbusException::illegalDataAddress, exception);
+  TEST_ASSERT(client.ReadCoils(0, 1, NULL, &exception) == ESP_FAIL);
+  TEST_ASSERT_EQUAL(PL::ModbusException::illegalDataAddress, exception);
+  TEST_ASSERT(client.SetStationAddress(stationAddress) == ESP_OK);
+
+  for (int i = 0; i < numberOfAdditionalStationRegisters; i++) {
+    TEST_ASSERT_EQUAL(src[i], ((uint16_t*)additionalStationHR->data)[i]);
+    TEST_ASSERT_EQUAL(src[i], dest[i]);
+  }
+}
+
+//==============================================================================
+
+void TestSeqLockMemoryArea() {
+  uint16_t src[numberOfAdditionalStationRegisters];
+  uint16_t dest[numberOfAdditionalStationRegisters];
+  esp_fill_random(src, sizeof(src));
+  PL::ModbusException exception;
+  
+  TEST_ASSERT(client.SetStationAddress(additionalStationAddress) == ESP_OK);
+  TEST_ASSERT(client.WriteMultipleHoldingRegisters(seqLockHRAddress, numberOfAdditionalStationRegisters, src, &exception) == ESP_OK);
+  TEST_ASSERT(client.ReadHoldingRegisters(seqLockHRAddress, numberOfAdditionalStationRegisters, dest, &exception) == ESP_OK);
+  TEST_ASSERT(client.SetStationAddress(stationAddress) == ESP_OK);
+
+  for (int i = 0; i < numberOfAdditionalStationRegisters; i++)
+    TEST_ASSERT_EQUAL(src[i], dest[i]);
+
+  // Read by the task that holds the lock does not wait: the data is read under the recursive lock.
+  TEST_ASSERT(seqLockHR->Lock() == ESP_OK);
+  uint32_t sequence;
+  TEST_ASSERT(seqLockHR->BeginRead(sequence) == ESP_OK);
+  TEST_ASSERT(seqLockHR->EndRead(sequence));
+  TEST_ASSERT(seqLockHR->Unlock() == ESP_OK);
+  TEST_ASSERT(seqLockHR->BeginRead(sequence) == ESP_OK);
+  TEST_ASSERT_EQUAL(0, sequence % 2);
+  TEST_ASSERT(seqLockHR->EndRead(sequence));
+
+  // Reads during the writes of another task (lock-free reads with retries and reads that wait for the lock) are never torn.
+  seqLockWriterRunning = true;
+  seqLockWriterDone = false;
+  TEST_ASSERT(xTaskCreate(SeqLockWriterTask, "seqlock_writer", 4096, NULL, tskIDLE_PRIORITY + 5, NULL) == pdPASS);
+  TEST_ASSERT(client.SetStationAddress(additionalStationAddress) == ESP_OK);
+  // The reads continue until several writes have been seen.
+  int numberOfChanges = 0;
+  uint16_t lastValue = 0;
+  for (int i = 0; i < 1000 && numberOfChanges < 5; i++) {
+    TEST_ASSERT(client.ReadHoldingRegisters(seqLockHRAddress, numberOfAdditionalStationRegisters, dest, &exception) == ESP_OK);
+    for (int j = 1; j < numberOfAdditionalStationRegisters; j++)
+      TEST_ASSERT_EQUAL(dest[0], dest[j]);
+    numberOfChanges += i && dest[0] != lastValue;
+    lastValue = dest[0];
+
+    do {
+      TEST_ASSERT(seqLockHR->BeginRead(sequence) == ESP_OK);
+      memcpy(dest, seqLockHR->data, sizeof(dest));
+    } while (!seqLockHR->EndRead(sequence));
+    for (int j = 1; j < numberOfAdditionalStationRegisters; j++)
+      TEST_ASSERT_EQUAL(dest[0], dest[j]);
+  }
+  TEST_ASSERT(client.SetStationAddress(stationAddress) == ESP_OK);
+  seqLockWriterRunning = false;
+  while (!seqLockWriterDone)
+    vTaskDelay(1);
+  TEST_ASSERT_EQUAL(5, numberOfChanges);
+}
+
+//==============================================================================
+
+void SeqLockWriterTask(void* parameters) {
+  // The registers are written in two halves with a delay in between, so reads start and end during the write.
+  uint16_t* data = (uint16_t*)seqLockHR->data;
+  for (uint16_t value = 1; seqLockWriterRunning; value++) {
+    seqLockHR->Lock();
+    for (int i = 0; i < numberOfAdditionalStationRegisters; i++) {
+      if (i == numberOfAdditionalStationRegisters / 2)
+        vTaskDelay(1);
+      data[i] = value;
+    }
+    seqLockHR->Unlock();
+    vTaskDelay(1);
+  }
+  seqLockWriterDone = true;
+  vTaskDelete(NULL);
+}
+
+//==============================================================================
+
+void TestMemoryAreaRangeCallbacks() {
+  uint16_t data[2] = {1, 2};
+  PL::ModbusException exception;
+
+  TEST_ASSERT(client.SetStationAddress(additionalStationAddress) == ESP_OK);
+  TEST_ASSERT(client.ReadHoldingRegisters(rangeHRAddress + 3, 2, data, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(rangeHRAddress + 3, rangeHR->readAddress);
+  TEST_ASSERT_EQUAL(2, rangeHR->readNumberOfItems);
+  TEST_ASSERT(client.WriteMultipleHoldingRegisters(rangeHRAddress + 5, 2, data, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(rangeHRAddress + 5, rangeHR->writeAddress);
+  TEST_ASSERT_EQUAL(2, rangeHR->writeNumberOfItems);
+  TEST_ASSERT(client.WriteSingleHoldingRegister(rangeHRAddress + 1, 0, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(rangeHRAddress + 1, rangeHR->writeAddress);
+  TEST_ASSERT_EQUAL(1, rangeHR->writeNumberOfItems);
+  TEST_ASSERT(client.SetStationAddress(stationAddress) == ESP_OK);
+}
+
+//==============================================================================
+
+void TestAdjacentMemoryAreas() {
+  uint16_t src[6];
+  uint16_t dest[6];
+  esp_fill_random(src, sizeof(src));
+  PL::ModbusException exception;
+
+  TEST_ASSERT(client.SetStationAddress(additionalStationAddress) == ESP_OK);
+  TEST_ASSERT(client.WriteMultipleHoldingRegisters(adjacentHRAddress - 3, 6, src, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(adjacentHRAddress - 3, rangeHR->writeAddress);
+  TEST_ASSERT_EQUAL(3, rangeHR->writeNumberOfItems);
+  TEST_ASSERT_EQUAL(adjacentHRAddress, adjacentHR->writeAddress);
+  TEST_ASSERT_EQUAL(3, adjacentHR->writeNumberOfItems);
+  TEST_ASSERT(client.ReadHoldingRegisters(adjacentHRAddress - 3, 6, dest, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(adjacentHRAddress - 3, rangeHR->readAddress);
+  TEST_ASSERT_EQUAL(3, rangeHR->readNumberOfItems);
+  TEST_ASSERT_EQUAL(adjacentHRAddress, adjacentHR->readAddress);
+  TEST_ASSERT_EQUAL(3, adjacentHR->readNumberOfItems);
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_EQUAL(src[i], ((uint16_t*)rangeHR->data)[numberOfAdditionalStationRegisters - 3 + i]);
+    TEST_ASSERT_EQUAL(src[i + 3], ((uint16_t*)adjacentHR->data)[i]);
+  }
+  for (int i = 0; i < 6; i++)
+    TEST_ASSERT_EQUAL(src[i], dest[i]);
+  TEST_ASSERT(client.ReadHoldingRegisters(adjacentHRAddress + numberOfAdditionalStationRegisters - 3, 6, NULL, &exception) == ESP_FAIL);
+  TEST_ASSERT_EQUAL(PL::ModbusException::illegalDataAddress, exception);
+
+  const uint16_t numberOfCoils = numberOfAdjacentCoilsBytes * 16 - 6;
+  uint8_t srcCoils[(numberOfCoils - 1) / 8 + 1];
+  uint8_t destCoils[(numberOfCoils - 1) / 8 + 1];
+  esp_fill_random(srcCoils, sizeof(srcCoils));
+  for (int i = 0; i < numberOfIterations; i++) {
+    uint16_t testNumberOfCoils = esp_random() % numberOfCoils + 1;
+    uint16_t testAddress = adjacentCoilsAddress + esp_random() % (numberOfAdjacentCoilsBytes * 16 - testNumberOfCoils + 1);
+    TEST_ASSERT(client.WriteMultipleCoils(testAddress, testNumberOfCoils, srcCoils, &exception) == ESP_OK);
+    TEST_ASSERT(client.ReadCoils(testAddress, testNumberOfCoils, destCoils, &exception) == ESP_OK);
+    for (int j = 0; j < testNumberOfCoils; j++) {
+      TEST_ASSERT_EQUAL((srcCoils[j / 8] >> (j % 8)) & 1, (destCoils[j / 8] >> (j % 8)) & 1);
+      uint16_t coilIndex = testAddress - adjacentCoilsAddress + j;
+      auto& memoryArea = (coilIndex < numberOfAdjacentCoilsBytes * 8) ? adjacentCoils1 : adjacentCoils2;
+      coilIndex %= numberOfAdjacentCoilsBytes * 8;
+      TEST_ASSERT_EQUAL((srcCoils[j / 8] >> (j % 8)) & 1, (((uint8_t*)memoryArea->data)[coilIndex / 8] >> (coilIndex % 8)) & 1);
+    }
+  }
+  TEST_ASSERT(client.SetStationAddress(stationAddress) == ESP_OK);
+}
+
+//==============================================================================
+
+void TestRegisterMap() {
+  uint16_t registers[RegisterMap::numberOfRegisters];
+  PL::ModbusException exception;
+
+  registerMapHR->Set<RegisterMapInt16>(-12345);
+  registerMapHR->Set<RegisterMapFloat>(1.5f);
+  registerMapHR->Set<RegisterMapUInt32CDAB>(0x11223344);
+  registerMapHR->Set<RegisterMapUInt32BADC>(0x11223344);
+  registerMapHR->Set<RegisterMapUInt32DCBA>(0x11223344);
+  registerMapHR->Set<RegisterMapDouble>(-2.25);
+
+  TEST_ASSERT(client.SetStationAddress(additionalStationAddress) == ESP_OK);
+  TEST_ASSERT(RegisterMap::Read(client, registers, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(-12345, RegisterMap::Get<RegisterMapInt16>(registers));
+  TEST_ASSERT_EQUAL(1.5f, RegisterMap::Get<RegisterMapFloat>(registers));
+  TEST_ASSERT_EQUAL(0x3FC0, registers[1]);
+  TEST_ASSERT_EQUAL(0x0000, registers[2]);
+  TEST_ASSERT_EQUAL(0x3344, registers[3]);
+  TEST_ASSERT_EQUAL(0x1122, registers[4]);
+  TEST_ASSERT_EQUAL(0x2211, registers[5]);
+  TEST_ASSERT_EQUAL(0x4433, registers[6]);
+  TEST_ASSERT_EQUAL(0x4433, registers[7]);
+  TEST_ASSERT_EQUAL(0x2211, registers[8]);
+  TEST_ASSERT_EQUAL(0x11223344, RegisterMap::Get<RegisterMapUInt32CDAB>(registers));
+  TEST_ASSERT_EQUAL(0x11223344, RegisterMap::Get<RegisterMapUInt32BADC>(registers));
+  TEST_ASSERT_EQUAL(0x11223344, RegisterMap::Get<RegisterMapUInt32DCBA>(registers));
+  TEST_ASSERT_EQUAL(-2.25, RegisterMap::Get<RegisterMapDouble>(registers));
+
+  TEST_ASSERT(RegisterMap::Write<RegisterMapFloat>(client, -0.5f, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(-0.5f, registerMapHR->Get<RegisterMapFloat>());
+  RegisterMap::Set<RegisterMapUInt32DCBA>(registers, 0x55667788);
+  TEST_ASSERT(RegisterMap::Write(client, registers, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(0x55667788, registerMapHR->Get<RegisterMapUInt32DCBA>());
+  TEST_ASSERT(client.SetStationAddress(stationAddress) == ESP_OK);
+}
+
+//==============================================================================
+
+void TestWorkerConnectionClose() {
+  uint16_t data = 0;
+  PL::ModbusException exception;
+
+  // The connection is closed while a worker handles its request: the server task removes the connection and the worker writes the response.
+  adjacentHR->onWriteDelay = 50;
+  {
+    PL::ModbusClient closingClient(PL::IpV4Address(127, 0, 0, 1), port);
+    TEST_ASSERT(closingClient.SetStationAddress(additionalStationAddress) == ESP_OK);
+    TEST_ASSERT(closingClient.SetReadTimeout(10) == ESP_OK);
+    TEST_ASSERT(closingClient.WriteSingleHoldingRegister(adjacentHRAddress, 1, &exception) == ESP_ERR_TIMEOUT);
+  }
+
+  // The server lock waits until the request is answered.
+  int64_t startTime = esp_timer_get_time();
+  TEST_ASSERT(server.Lock() == ESP_OK);
+  int64_t lockTime = esp_timer_get_time() - startTime;
+  TEST_ASSERT(server.Unlock() == ESP_OK);
+  TEST_ASSERT(lockTime >= 20 * 1000);
+  adjacentHR->onWriteDelay = 0;
+
+  TEST_ASSERT(client.SetStationAddress(additionalStationAddress) == ESP_OK);
+  TEST_ASSERT(client.ReadHoldingRegisters(adjacentHRAddress, 1, &data, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(1, data);
+  TEST_ASSERT(client.SetStationAddress(stationAddress) == ESP_OK);
+}
+
+//==============================================================================
+
+void TestDeferredOnWrite() {
+  uint16_t data[3] = {};
+  PL::ModbusException exception;
+
+  TEST_ASSERT(client.SetStationAddress(additionalStationAddress) == ESP_OK);
+  server.ResetDeferredOnWriteStatistics();
+  rangeHR->writeAddress = rangeHR->writeNumberOfItems = 0;
+  // The slow adjacentHR notification keeps the rangeHR notification pending.
+  adjacentHR->onWriteDelay = 50;
+  TEST_ASSERT(client.WriteSingleHoldingRegister(adjacentHRAddress, 0, &exception) == ESP_OK);
+  TEST_ASSERT(client.WriteSingleHoldingRegister(rangeHRAddress + 1, 0, &exception) == ESP_OK);
+  TEST_ASSERT(client.WriteMultipleHoldingRegisters(rangeHRAddress + 2, 3, data, &exception) == ESP_OK);
+  TEST_ASSERT(client.WriteMultipleHoldingRegisters(rangeHRAddress + 2, 1, data, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(0, rangeHR->writeNumberOfItems);
+  auto statistics = server.GetDeferredOnWriteStatistics();
+  TEST_ASSERT_EQUAL(4, statistics.numberOfWrites);
+  TEST_ASSERT_EQUAL(2, statistics.numberOfCoalescedWrites);
+  TEST_ASSERT_EQUAL(0, statistics.numberOfOverflows);
+
+  for (int i = 0; i < 100 && server.GetDeferredOnWriteStatistics().numberOfNotifications < 2; i++)
+    vTaskDelay(2);
+  statistics = server.GetDeferredOnWriteStatistics();
+  TEST_ASSERT_EQUAL(2, statistics.numberOfNotifications);
+  TEST_ASSERT_EQUAL(0, statistics.queueDepth);
+  TEST_ASSERT(statistics.maxLag >= statistics.lastLag);
+  TEST_ASSERT_EQUAL(rangeHRAddress + 1, rangeHR->writeAddress);
+  TEST_ASSERT_EQUAL(4, rangeHR->writeNumberOfItems);
+  adjacentHR->onWriteDelay = 0;
+  TEST_ASSERT(client.SetStationAddress(stationAddress) == ESP_OK);
+}
+
+//==============================================================================
+
+void TestRefreshedMemoryArea() {
+  uint16_t data[numberOfAdditionalStationRegisters];
+  PL::ModbusException exception;
+
+  TEST_ASSERT(client.SetStationAddress(additionalStationAddress) == ESP_OK);
+  uint16_t counter = counterIR->counter;
+  TEST_ASSERT(counterIR->RequestRefresh() == ESP_OK);
+  for (int i = 0; i < 100 && counterIR->counter == counter; i++)
+    vTaskDelay(1);
+  vTaskDelay(1);
+  TEST_ASSERT(counterIR->GetRefreshAge() >= 0);
+  TEST_ASSERT(client.ReadInputRegisters(0, numberOfAdditionalStationRegisters, data, &exception) == ESP_OK);
+  for (int i = 0; i < numberOfAdditionalStationRegisters; i++)
+    TEST_ASSERT_EQUAL((uint16_t)(counter + 1), data[i]);
+  TEST_ASSERT_EQUAL(0, counterIR->GetNumberOfRefreshErrors());
+  TEST_ASSERT(client.SetStationAddress(stationAddress) == ESP_OK);
+}
+
+//==============================================================================
+
+void TestServerStatistics() {
+  uint16_t data[1];
+  PL::ModbusException exception;
+  PL::ModbusServerStatistics statistics;
+
+  server.ResetStatistics();
+  TEST_ASSERT(client.ReadHoldingRegisters(0, 1, data, &exception) == ESP_OK);
+  TEST_ASSERT(client.ReadHoldingRegisters(numberOfRegisters, 1, data, &exception) == ESP_FAIL);
+  TEST_ASSERT_EQUAL(PL::ModbusException::illegalDataAddress, exception);
+  // The handle time is recorded after the response is sent.
+  vTaskDelay(2);
+  TEST_ASSERT(server.GetStatistics(statistics) == ESP_OK);
+  auto& functionCodeStatistics = statistics.GetFunctionCodeStatistics(PL::ModbusFunctionCode::readHoldingRegisters);
+  TEST_ASSERT_EQUAL(2, functionCodeStatistics.numberOfRequests);
+  TEST_ASSERT_EQUAL(1, functionCodeStatistics.numberOfExceptions[(uint8_t)PL::ModbusException::illegalDataAddress]);
+  TEST_ASSERT_EQUAL(2, functionCodeStatistics.readFrameTime.count);
+  TEST_ASSERT_EQUAL(2, functionCodeStatistics.handleTime.count);
+  TEST_ASSERT_EQUAL(2, functionCodeStatistics.writeFrameTime.count);
+  TEST_ASSERT_EQUAL(functionCodeStatistics.handleTime.max, functionCodeStatistics.handleTime.GetPercentile(100));
+  TEST_ASSERT_EQUAL(0, statistics.GetFunctionCodeStatistics(PL::ModbusFunctionCode::writeSingleCoil).numberOfRequests);
+  TEST_ASSERT_EQUAL(0, statistics.numberOfCrcErrors);
+  TEST_ASSERT(statistics.numberOfBytesReceived > 0);
+  TEST_ASSERT(statistics.numberOfBytesSent > 0);
+}
+
+//==============================================================================
+
+void TestClientStatistics() {
+  uint16_t data[1];
+  PL::ModbusException exception;
+  PL::ModbusClientStatistics statistics;
+
+  client.ResetStatistics();
+  TEST_ASSERT(client.ReadHoldingRegisters(0, 1, data, &exception) == ESP_OK);
+  TEST_ASSERT(client.ReadHoldingRegisters(numberOfRegisters, 1, data, &exception) == ESP_FAIL);
+  TEST_ASSERT(client.SetStationAddress(additionalStationAddress) == ESP_OK);
+  TEST_ASSERT(client.ReadHoldingRegisters(0, 1, data, &exception) == ESP_OK);
+  TEST_ASSERT(client.SetStationAddress(stationAddress) == ESP_OK);
+
+  TEST_ASSERT(client.GetStatistics(statistics) == ESP_OK);
+  TEST_ASSERT_EQUAL(3, statistics.numberOfRequests);
+  TEST_ASSERT_EQUAL(2, statistics.numberOfResponses);
+  TEST_ASSERT_EQUAL(1, statistics.numberOfExceptions[(uint8_t)PL::ModbusException::illegalDataAddress]);
+  TEST_ASSERT_EQUAL(0, statistics.numberOfTimeouts);
+  TEST_ASSERT_EQUAL(0, statistics.numberOfCrcErrors);
+  TEST_ASSERT_EQUAL(0, statistics.numberOfInvalidResponses);
+  TEST_ASSERT_EQUAL(3, statistics.roundTripTime.count);
+  TEST_ASSERT(statistics.numberOfBytesSent > 0);
+  TEST_ASSERT(statistics.numberOfBytesReceived > 0);
+
+  TEST_ASSERT(client.GetStatistics(stationAddress, statistics) == ESP_OK);
+  TEST_ASSERT_EQUAL(2, statistics.numberOfRequests);
+  TEST_ASSERT_EQUAL(1, statistics.numberOfExceptions[(uint8_t)PL::ModbusException::illegalDataAddress]);
+  TEST_ASSERT(client.GetStatistics(additionalStationAddress, statistics) == ESP_OK);
+  TEST_ASSERT_EQUAL(1, statistics.numberOfRequests);
+  TEST_ASSERT_EQUAL(1, statistics.numberOfResponses);
+  TEST_ASSERT(client.GetStatistics(additionalStationAddress + 1, statistics) == ESP_ERR_NOT_FOUND);
+}
+
+//==============================================================================
+
+void TestCapture() {
+  uint16_t data[2];
+  PL::ModbusException exception;
+  std::vector<PL::ModbusCaptureRecord> records;
+  auto capture = std::make_shared<PL::ModbusCapture>(4);
+  PL::ModbusProtocol protocol = client.GetProtocol();
+  size_t requestSize = (protocol == PL::ModbusProtocol::tcp) ? 12 : ((protocol == PL::ModbusProtocol::rtu) ? 8 : 7);
+
+  TEST_ASSERT(server.SetCapture(capture) == ESP_OK);
+  TEST_ASSERT(client.SetCapture(capture) == ESP_OK);
+  TEST_ASSERT(client.GetCapture() == capture);
+  TEST_ASSERT(client.ReadHoldingRegisters(0, 2, data, &exception) == ESP_OK);
+  // The server can record its response after the client has received it.
+  vTaskDelay(10);
+  capture->Read(records);
+  TEST_ASSERT_EQUAL(4, capture->GetNumberOfFrames());
+  TEST_ASSERT_EQUAL(4, records.size());
+
+  // Request and response are recorded by both sides with the same content (each side has its own connection ID).
+  uint32_t clientConnectionIds[2] = {};
+  for (bool serverFrame : {false, true}) {
+    std::vector<PL::ModbusCaptureRecord*> frames;
+    for (auto& record : records) {
+      if (record.serverFrame == serverFrame)
+        frames.push_back(&record);
+    }
+    TEST_ASSERT_EQUAL(2, frames.size());
+    TEST_ASSERT(frames[0]->direction != frames[1]->direction);
+    TEST_ASSERT_EQUAL(protocol, frames[0]->protocol);
+    TEST_ASSERT_EQUAL(requestSize + serverFrame, frames[0]->size);
+    TEST_ASSERT(frames[0]->data == frames[1]->data);
+    TEST_ASSERT(frames[0]->connectionId != 0 && frames[1]->connectionId != 0);
+    TEST_ASSERT(frames[0]->connectionId != frames[1]->connectionId);
+    // The client transmits the request and receives the response.
+    auto clientDirection = serverFrame ? PL::ModbusCaptureDirection::received : PL::ModbusCaptureDirection::transmitted;
+    clientConnectionIds[serverFrame] = frames[frames[1]->direction == clientDirection]->connectionId;
+  }
+  TEST_ASSERT_EQUAL(clientConnectionIds[0], clientConnectionIds[1]);
+
+  // The oldest frames are overwritten.
+  TEST_ASSERT(client.ReadHoldingRegisters(0, 2, data, &exception) == ESP_OK);
+  vTaskDelay(10);
+  capture->Read(records);
+  TEST_ASSERT_EQUAL(8, capture->GetNumberOfFrames());
+  TEST_ASSERT_EQUAL(4, records.size());
+  TEST_ASSERT_EQUAL(4, records[0].number);
+
+#if CONFIG_IDF_TARGET_LINUX
+  for (auto format : {PL::ModbusCapturePcapFormat::user, PL::ModbusCapturePcapFormat::modbusTcp}) {
+    auto streams = PL::LoopbackStream::CreatePair();
+    TEST_ASSERT(capture->WritePcap(*streams.first, format) == ESP_OK);
+    uint32_t globalHeader[6];
+    TEST_ASSERT(streams.second->Read(globalHeader, sizeof(globalHeader)) == ESP_OK);
+    TEST_ASSERT_EQUAL(0xA1B2C3D4, globalHeader[0]);
+    TEST_ASSERT_EQUAL((format == PL::ModbusCapturePcapFormat::user) ? 147 : 101, globalHeader[5]);
+    for (auto& record : records) {
+      uint32_t recordHeader[4];
+      uint8_t packet[100];
+      TEST_ASSERT(streams.second->Read(recordHeader, sizeof(recordHeader)) == ESP_OK);
+      TEST_ASSERT(recordHeader[2] <= sizeof(packet));
+      TEST_ASSERT_EQUAL(recordHeader[2], recordHeader[3]);
+      TEST_ASSERT(streams.second->Read(packet, recordHeader[2]) == ESP_OK);
+      if (format == PL::ModbusCapturePcapFormat::user) {
+        TEST_ASSERT_EQUAL(record.direction, (PL::ModbusCaptureDirection)packet[0]);
+        TEST_ASSERT_EQUAL(protocol, (PL::ModbusProtocol)packet[1]);
+        TEST_ASSERT_EQUAL(8 + ((protocol == PL::ModbusProtocol::ascii) ? record.size * 2 + 3 : record.size), recordHeader[2]);
+      }
+      else {
+        // IPv4, TCP, MBAP header and function code
+        TEST_ASSERT_EQUAL(0x45, packet[0]);
+        TEST_ASSERT_EQUAL(6, packet[9]);
+        TEST_ASSERT_EQUAL(502, (packet[record.serverFrame ? 20 : 22] << 8) | packet[record.serverFrame ? 21 : 23]);
+        TEST_ASSERT_EQUAL(PL::ModbusFunctionCode::readHoldingRegisters, (PL::ModbusFunctionCode)packet[47]);
+      }
+    }
+    TEST_ASSERT_EQUAL(0, streams.second->GetReadableSize());
+  }
+#endif
+
+  // A new connection gets a new ID, also if the server reuses the socket of a closed connection.
+  uint32_t serverConnectionIds[2] = {};
+  for (auto& serverConnectionId : serverConnectionIds) {
+    {
+      PL::ModbusClient newClient(PL::IpV4Address(127, 0, 0, 1), port);
+      TEST_ASSERT(newClient.SetProtocol(protocol) == ESP_OK);
+      TEST_ASSERT(newClient.SetStationAddress(stationAddress) == ESP_OK);
+      TEST_ASSERT(newClient.ReadHoldingRegisters(0, 2, data, &exception) == ESP_OK);
+    }
+    vTaskDelay(20);
+    capture->Read(records);
+    for (auto& record : records) {
+      if (record.serverFrame && record.direction == PL::ModbusCaptureDirection::transmitted)
+        serverConnectionId = record.connectionId;
+    }
+  }
+  TEST_ASSERT(serverConnectionIds[0] != 0 && serverConnectionIds[1] != 0);
+  TEST_ASSERT(serverConnectionIds[0] != serverConnectionIds[1]);
+
+  // The capture can be replaced while the server is still recording its response.
+  for (int i = 0; i < 10; i++) {
+    TEST_ASSERT(server.SetCapture(std::make_shared<PL::ModbusCapture>(4)) == ESP_OK);
+    TEST_ASSERT(client.ReadHoldingRegisters(0, 2, data, &exception) == ESP_OK);
+  }
+
+  TEST_ASSERT(client.SetCapture(NULL) == ESP_OK);
+  TEST_ASSERT(server.SetCapture(NULL) == ESP_OK);
+  capture->Clear();
+  TEST_ASSERT_EQUAL(0, capture->GetNumberOfFrames());
+  capture->Read(records);
+  TEST_ASSERT_EQUAL(0, records.size());
+}
+
+//==============================================================================
+
+void TestChangeSubscriptions() {
+  PL::ModbusClient::ChangeSubscription subscriptions[5];
+  std::vector<PL::ModbusClient::AddressRange> changedRanges;
+  bool moreChanges;
+  PL::ModbusException exception;
+  uint16_t* serverRegisters = (uint16_t*)serverHR->data;
+  TEST_ASSERT(server.EnableChangeSubscriptions(4, 0) == ESP_ERR_INVALID_STATE);
+
+  // Invalid subscriptions
+  TEST_ASSERT(client.Subscribe(PL::ModbusMemoryType::holdingRegisters, numberOfRegisters, 1, 0, subscriptions[0], &exception) == ESP_FAIL);
+  TEST_ASSERT_EQUAL(PL::ModbusException::illegalDataAddress, exception);
+  TEST_ASSERT(client.Subscribe(PL::ModbusMemoryType::coils, 0, PL::ModbusServer::maxNumberOfSubscribedItems + 1, 0, subscriptions[0], &exception) == ESP_FAIL);
+  TEST_ASSERT_EQUAL(PL::ModbusException::illegalDataValue, exception);
+  for (int i = 0; i < 4; i++)
+    TEST_ASSERT(client.Subscribe(PL::ModbusMemoryType::inputRegisters, i, 1, 0, subscriptions[i], &exception) == ESP_OK);
+  TEST_ASSERT(client.Subscribe(PL::ModbusMemoryType::inputRegisters, 0, 1, 0, subscriptions[4], &exception) == ESP_FAIL);
+  TEST_ASSERT_EQUAL(PL::ModbusException::serverDeviceBusy, exception);
+  TEST_ASSERT_EQUAL(4, server.GetNumberOfChangeSubscriptions());
+  for (int i = 0; i < 4; i++)
+    TEST_ASSERT(client.Unsubscribe(subscriptions[i], &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(0, server.GetNumberOfChangeSubscriptions());
+
+  // Registers: all items on the first reads (more than one response), then only the changes beyond the deadband
+  uint16_t registers[numberOfRegisters] = {};
+  PL::ModbusClient::ChangeSubscription& registerSubscription = subscriptions[0];
+  TEST_ASSERT(client.Subscribe(PL::ModbusMemoryType::holdingRegisters, 0, numberOfRegisters, 10, registerSubscription, &exception) == ESP_OK);
+  int numberOfReads = 0;
+  do {
+    TEST_ASSERT(client.ReadChanges(registerSubscription, registers, changedRanges, moreChanges, &exception) == ESP_OK);
+    numberOfReads++;
+  } while (moreChanges);
+  TEST_ASSERT(numberOfReads > 1);
+  TEST_ASSERT(memcmp(serverRegisters, registers, sizeof(registers)) == 0);
+  TEST_ASSERT(client.ReadChanges(registerSubscription, registers, changedRanges, moreChanges, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(0, changedRanges.size());
+
+  serverHR->Lock();
+  uint16_t unchangedRegister = serverRegisters[10];
+  serverRegisters[10] += 10;
+  serverRegisters[20] += 100;
+  serverRegisters[21] -= 100;
+  serverRegisters[23] += 100;
+  serverRegisters[26] += 100;
+  serverRegisters[30] += 100;
+  serverRegisters[100] += 11;
+  serverHR->Unlock();
+  // Gaps of up to 2 unchanged registers are merged into one block.
+  TEST_ASSERT(client.ReadChanges(registerSubscription, registers, changedRanges, moreChanges, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(3, changedRanges.size());
+  TEST_ASSERT_EQUAL(20, changedRanges[0].address);
+  TEST_ASSERT_EQUAL(7, changedRanges[0].numberOfItems);
+  TEST_ASSERT_EQUAL(30, changedRanges[1].address);
+  TEST_ASSERT_EQUAL(1, changedRanges[1].numberOfItems);
+  TEST_ASSERT_EQUAL(100, changedRanges[2].address);
+  TEST_ASSERT_EQUAL(1, changedRanges[2].numberOfItems);
+  TEST_ASSERT_EQUAL(unchangedRegister, registers[10]);
+  TEST_ASSERT(memcmp(serverRegisters + 20, registers + 20, 7 * 2) == 0);
+  TEST_ASSERT_EQUAL(serverRegisters[30], registers[30]);
+  TEST_ASSERT_EQUAL(serverRegisters[100], registers[100]);
+
+  // Changes of a lost response are returned again
+  uint8_t sequence = registerSubscription.sequence;
+  TEST_ASSERT(client.WriteSingleHoldingRegister(200, serverRegisters[200] + 1000, &exception) == ESP_OK);
+  TEST_ASSERT(client.ReadChanges(registerSubscription, registers, changedRanges, moreChanges, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(1, changedRanges.size());
+  registerSubscription.sequence = sequence;
+  TEST_ASSERT(client.ReadChanges(registerSubscription, registers, changedRanges, moreChanges, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(1, changedRanges.size());
+  TEST_ASSERT_EQUAL(200, changedRanges[0].address);
+  TEST_ASSERT_EQUAL(serverRegisters[200], registers[200]);
+  TEST_ASSERT(client.ReadChanges(registerSubscription, registers, changedRanges, moreChanges, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(0, changedRanges.size());
+
+  // Coils
+  const uint16_t numberOfSubscribedBits = 1000;
+  uint8_t bits[numberOfSubscribedBits / 8] = {};
+  PL::ModbusClient::ChangeSubscription& bitSubscription = subscriptions[1];
+  TEST_ASSERT(client.Subscribe(PL::ModbusMemoryType::coils, 8, numberOfSubscribedBits, 0, bitSubscription, &exception) == ESP_OK);
+  TEST_ASSERT(client.ReadChanges(bitSubscription, bits, changedRanges, moreChanges, &exception) == ESP_OK);
+  TEST_ASSERT(!moreChanges);
+  TEST_ASSERT(memcmp((uint8_t*)serverHR->data + 1, bits, sizeof(bits)) == 0);
+  serverHR->Lock();
+  ((uint8_t*)serverHR->data)[1] ^= 0x20;
+  ((uint8_t*)serverHR->data)[2] ^= 0x01;
+  ((uint8_t*)serverHR->data)[101] ^= 0x80;
+  serverHR->Unlock();
+  TEST_ASSERT(client.ReadChanges(bitSubscription, bits, changedRanges, moreChanges, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(2, changedRanges.size());
+  TEST_ASSERT_EQUAL(13, changedRanges[0].address);
+  TEST_ASSERT_EQUAL(4, changedRanges[0].numberOfItems);
+  TEST_ASSERT_EQUAL(815, changedRanges[1].address);
+  TEST_ASSERT_EQUAL(1, changedRanges[1].numberOfItems);
+  TEST_ASSERT(memcmp((uint8_t*)serverHR->data + 1, bits, sizeof(bits)) == 0);
+
+  for (int i = 0; i < 2; i++)
+    TEST_ASSERT(client.Unsubscribe(subscriptions[i], &exception) == ESP_OK);
+  TEST_ASSERT(client.ReadChanges(registerSubscription, registers, changedRanges, moreChanges, &exception) == ESP_FAIL);
+  TEST_ASSERT_EQUAL(PL::ModbusException::illegalDataValue, exception);
+}
+
+//==============================================================================
+
+void TestStationPolicy() {
+  uint16_t data[1];
+  PL::ModbusException exception;
+  PL::ModbusClient::StationState state;
+  const uint8_t offlineStationAddress = additionalStationAddress + 1;
+
+  PL::ModbusClient::StationPolicy policy = {};
+  policy.adaptiveTimeout = true;
+  policy.minTimeout = 1;
+  policy.maxTimeout = 50 / portTICK_PERIOD_MS;
+  TEST_ASSERT(client.SetStationPolicy(0, policy) == ESP_ERR_INVALID_ARG);
+  TEST_ASSERT(client.GetStationState(stationAddress, state) == ESP_ERR_NOT_FOUND);
+  TEST_ASSERT(client.SetStationPolicy(stationAddress, policy) == ESP_OK);
+  for (int i = 0; i < 10; i++)
+    TEST_ASSERT(client.ReadHoldingRegisters(0, 1, data, &exception) == ESP_OK);
+  TEST_ASSERT(client.GetStationState(stationAddress, state) == ESP_OK);
+  TEST_ASSERT(state.smoothedRoundTripTime > 0);
+  TEST_ASSERT(state.timeout >= policy.minTimeout && state.timeout <= policy.maxTimeout);
+  TEST_ASSERT_EQUAL(0, state.numberOfFailures);
+  TEST_ASSERT(client.RemoveStationPolicy(stationAddress) == ESP_OK);
+  TEST_ASSERT(client.GetStationState(stationAddress, state) == ESP_ERR_NOT_FOUND);
+
+  // The station is not hosted by the server: every transaction times out.
+  policy.maxNumberOfRetries = 1;
+  policy.retryDelay = 1;
+  policy.offlineThreshold = 2;
+  policy.offlineProbeInterval = 1000 / portTICK_PERIOD_MS;
+  TEST_ASSERT(client.SetStationPolicy(offlineStationAddress, policy) == ESP_OK);
+  TEST_ASSERT(client.SetStationAddress(offlineStationAddress) == ESP_OK);
+  client.ResetStatistics();
+  TEST_ASSERT(client.ReadHoldingRegisters(0, 1, data, &exception) == ESP_ERR_TIMEOUT);
+  TEST_ASSERT(!client.IsStationOffline(offlineStationAddress));
+  TEST_ASSERT(client.ReadHoldingRegisters(0, 1, data, &exception) == ESP_ERR_TIMEOUT);
+  TEST_ASSERT(client.IsStationOffline(offlineStationAddress));
+  PL::ModbusClientStatistics statistics;
+  TEST_ASSERT(client.GetStatistics(statistics) == ESP_OK);
+  TEST_ASSERT_EQUAL(4, statistics.numberOfRequests);
+  TEST_ASSERT(client.ReadHoldingRegisters(0, 1, data, &exception) == ESP_ERR_INVALID_STATE);
+  TEST_ASSERT(client.GetStatistics(statistics) == ESP_OK);
+  TEST_ASSERT_EQUAL(4, statistics.numberOfRequests);
+  TEST_ASSERT(client.GetStationState(offlineStationAddress, state) == ESP_OK);
+  TEST_ASSERT_EQUAL(2, state.numberOfFailures);
+  TEST_ASSERT(client.ResetStationState(offlineStationAddress) == ESP_OK);
+  TEST_ASSERT(!client.IsStationOffline(offlineStationAddress));
+  TEST_ASSERT(client.RemoveStationPolicy(offlineStationAddress) == ESP_OK);
+  TEST_ASSERT(client.SetStationAddress(stationAddress) == ESP_OK);
+}
+
+//==============================================================================
+
+void TestConnectionManagement() {
+  uint16_t data[1];
+  PL::ModbusException exception;
+  PL::ModbusClient managedClient(PL::IpV4Address(127, 0, 0, 1), port);
+  TEST_ASSERT(managedClient.SetStationAddress(stationAddress) == ESP_OK);
+
+  PL::ModbusClient::ConnectionPolicy policy = {};
+  policy.minReconnectDelay = 500 / portTICK_PERIOD_MS;
+  policy.maxReconnectDelay = 2000 / portTICK_PERIOD_MS;
+  policy.idleCheckInterval = 100 / portTICK_PERIOD_MS;
+  policy.maxNumberOfTimeouts = 2;
+  policy.keepAliveIdleTime = 1;
+  policy.keepAliveInterval = 1;
+  policy.keepAliveCount = 3;
+  TEST_ASSERT(managedClient.EnableConnectionManagement({4096, tskIDLE_PRIORITY + 5, tskNO_AFFINITY}, policy) == ESP_OK);
+  vTaskDelay(100 / portTICK_PERIOD_MS);
+  TEST_ASSERT(managedClient.IsConnected());
+  TEST_ASSERT(managedClient.ReadHoldingRegisters(0, 1, data, &exception) == ESP_OK);
+
+  // The station is not hosted by the server: the timeouts close the connection as half-open.
+  TEST_ASSERT(managedClient.SetStationAddress(additionalStationAddress + 1) == ESP_OK);
+  TEST_ASSERT(managedClient.ReadHoldingRegisters(0, 1, data, &exception) == ESP_ERR_TIMEOUT);
+  TEST_ASSERT(managedClient.IsConnected());
+  TEST_ASSERT(managedClient.ReadHoldingRegisters(0, 1, data, &exception) == ESP_ERR_TIMEOUT);
+  TEST_ASSERT(!managedClient.IsConnected());
+  TEST_ASSERT(managedClient.SetStationAddress(stationAddress) == ESP_OK);
+  TickType_t startTime = xTaskGetTickCount();
+  TEST_ASSERT(managedClient.ReadHoldingRegisters(0, 1, data, &exception) == ESP_ERR_INVALID_STATE);
+  TEST_ASSERT(xTaskGetTickCount() - startTime < policy.minReconnectDelay / 2);
+
+  vTaskDelay(policy.minReconnectDelay + 100 / portTICK_PERIOD_MS);
+  TEST_ASSERT(managedClient.IsConnected());
+  TEST_ASSERT(managedClient.ReadHoldingRegisters(0, 1, data, &exception) == ESP_OK);
+  TEST_ASSERT(managedClient.DisableConnectionManagement() == ESP_OK);
+  TEST_ASSERT(managedClient.ReadHoldingRegisters(0, 1, data, &exception) == ESP_OK);
+}
+
+//==============================================================================
+
+esp_err_t RangeMemoryArea::OnRead(uint16_t address, uint16_t numberOfItems) {
+  readAddress = address;
+  readNumberOfItems = numberOfItems;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+esp_err_t RangeMemoryArea::OnWrite(uint16_t address, uint16_t numberOfItems) {
+  writeAddress = address;
+  writeNumberOfItems = numberOfItems;
+  if (onWriteDelay)
+    vTaskDelay(onWriteDelay);
+  return ESP_OK;
+}
+
+//==============================================================================
+
 esp_err_t Server::ReadRtuData(PL::Stream& stream, PL::ModbusFunctionCode functionCode, size_t& dataSize) {
   PL::Buffer& dataBuffer = GetDataBuffer();
 
@@ -354,4 +1205,408 @@ esp_err_t Client::ReadRtuData(PL::Stream& stream, PL::ModbusFunctionCode functio
   }
 
   return PL::ModbusClient::ReadRtuData(stream, functionCode, dataSize);
-}
\ No newline at end of file
+}
+
+//==============================================================================
+
+CounterMemoryArea::~CounterMemoryArea() {
+  DisableRefresh();
+}
+
+//==============================================================================
+
+esp_err_t CounterMemoryArea::OnRefresh(void* snapshot) {
+  uint16_t value = counter + 1;
+  for (int i = 0; i < numberOfItems; i++)
+    ((uint16_t*)snapshot)[i] = value;
+  counter = value;
+  return ESP_OK;
+}
+
+//==============================================================================
+
+#if CONFIG_IDF_TARGET_LINUX
+void TestLoopbackStream() {
+  uint16_t data[numberOfAdditionalStationRegisters];
+  PL::ModbusException exception;
+
+  // Serial line protocols over the in-memory stream pair of the host build
+  for (auto protocol : {PL::ModbusProtocol::rtu, PL::ModbusProtocol::ascii}) {
+    auto streams = PL::LoopbackStream::CreatePair();
+    PL::ModbusServer loopbackServer(streams.first, protocol, stationAddress);
+    PL::ModbusClient loopbackClient(streams.second, protocol, stationAddress);
+    auto loopbackHR = std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::holdingRegisters, 0, sizeof(data));
+    loopbackServer.AddMemoryArea(loopbackHR);
+    TEST_ASSERT(loopbackServer.Enable() == ESP_OK);
+
+    for (int i = 0; i < numberOfAdditionalStationRegisters; i++)
+      data[i] = i * 3 + 1;
+    TEST_ASSERT(loopbackClient.WriteMultipleHoldingRegisters(0, numberOfAdditionalStationRegisters, data, &exception) == ESP_OK);
+    memset(data, 0, sizeof(data));
+    TEST_ASSERT(loopbackClient.ReadHoldingRegisters(0, numberOfAdditionalStationRegisters, data, &exception) == ESP_OK);
+    for (int i = 0; i < numberOfAdditionalStationRegisters; i++)
+      TEST_ASSERT_EQUAL(i * 3 + 1, data[i]);
+    TEST_ASSERT(loopbackClient.ReadHoldingRegisters(numberOfAdditionalStationRegisters, 1, data, &exception) == ESP_FAIL);
+    TEST_ASSERT_EQUAL(PL::ModbusException::illegalDataAddress, exception);
+
+    TEST_ASSERT(loopbackServer.Disable() == ESP_OK);
+  }
+}
+
+//==============================================================================
+
+void TestSerialLine() {
+  uint16_t data[numberOfAdditionalStationRegisters];
+  uint16_t lineHRData[numberOfAdditionalStationRegisters];
+  uint16_t additionalLineHRData[numberOfAdditionalStationRegisters];
+  PL::ModbusException exception;
+
+  // Multi-drop line with two stations: both servers receive all requests, only the addressed one responds.
+  for (auto protocol : {PL::ModbusProtocol::rtu, PL::ModbusProtocol::ascii}) {
+    PL::SerialLine::Parameters parameters;
+    parameters.baudRate = 115200;
+    auto line = PL::SerialLine::Create(parameters);
+    PL::ModbusServer lineServer(line->CreateEndpoint(), protocol, stationAddress);
+    PL::ModbusServer additionalLineServer(line->CreateEndpoint(), protocol, additionalStationAddress);
+    PL::ModbusClient lineClient(line->CreateEndpoint(), protocol, stationAddress);
+    memset(lineHRData, 0, sizeof(lineHRData));
+    memset(additionalLineHRData, 0, sizeof(additionalLineHRData));
+    auto lineHR = std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::holdingRegisters, 0, lineHRData, sizeof(lineHRData));
+    auto additionalLineHR = std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::holdingRegisters, 0, additionalLineHRData, sizeof(additionalLineHRData));
+    lineServer.AddMemoryArea(lineHR);
+    additionalLineServer.AddMemoryArea(additionalLineHR);
+    TEST_ASSERT(lineServer.Enable() == ESP_OK);
+    TEST_ASSERT(additionalLineServer.Enable() == ESP_OK);
+
+    for (int i = 0; i < numberOfAdditionalStationRegisters; i++)
+      data[i] = i * 5 + 2;
+    TEST_ASSERT(lineClient.SetStationAddress(additionalStationAddress) == ESP_OK);
+    TEST_ASSERT(lineClient.WriteMultipleHoldingRegisters(0, numberOfAdditionalStationRegisters, data, &exception) == ESP_OK);
+    TEST_ASSERT_EQUAL(2, additionalLineHRData[0]);
+    TEST_ASSERT_EQUAL(0, lineHRData[0]);
+
+    // The transaction cannot be faster than the request and response characters on the line.
+    TEST_ASSERT(lineClient.SetStationAddress(stationAddress) == ESP_OK);
+    size_t numberOfCharacters = 8 + 5 + numberOfAdditionalStationRegisters * 2;
+    if (protocol == PL::ModbusProtocol::ascii)
+      numberOfCharacters = numberOfCharacters * 2 + 2;
+    int64_t startTime = esp_timer_get_time();
+    TEST_ASSERT(lineClient.ReadHoldingRegisters(0, numberOfAdditionalStationRegisters, data, &exception) == ESP_OK);
+    TEST_ASSERT(esp_timer_get_time() - startTime >= (int64_t)numberOfCharacters * line->GetCharacterTime() / 1000);
+    TEST_ASSERT_EQUAL(0, data[0]);
+    TEST_ASSERT_EQUAL(0, line->GetStatistics().numberOfCorruptedCharacters);
+
+    TEST_ASSERT(lineServer.Disable() == ESP_OK);
+    TEST_ASSERT(additionalLineServer.Disable() == ESP_OK);
+  }
+
+  // Line where all bits are corrupted: the server never receives a valid request.
+  PL::SerialLine::Parameters parameters;
+  parameters.bitErrorRate = 1;
+  auto line = PL::SerialLine::Create(parameters);
+  PL::ModbusServer lineServer(line->CreateEndpoint(), PL::ModbusProtocol::rtu, stationAddress);
+  PL::ModbusClient lineClient(line->CreateEndpoint(), PL::ModbusProtocol::rtu, stationAddress);
+  auto lineHR = std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::holdingRegisters, 0, sizeof(data));
+  lineServer.AddMemoryArea(lineHR);
+  TEST_ASSERT(lineServer.Enable() == ESP_OK);
+  TEST_ASSERT(lineClient.SetReadTimeout(50) == ESP_OK);
+  TEST_ASSERT(lineClient.ReadHoldingRegisters(0, 1, data, &exception) == ESP_ERR_TIMEOUT);
+  TEST_ASSERT(line->GetStatistics().numberOfCorruptedCharacters > 0);
+  TEST_ASSERT(lineServer.Disable() == ESP_OK);
+}
+
+//==============================================================================
+
+void TestForeignFrames() {
+  uint16_t data[numberOfAdditionalStationRegisters];
+  uint16_t lineHRData[numberOfAdditionalStationRegisters] = {};
+  uint16_t additionalLineHRData[numberOfAdditionalStationRegisters] = {};
+  const uint8_t foreignStationAddress = additionalStationAddress + 1;
+  PL::ModbusException exception;
+
+  // Server, server of another station, client and an endpoint that writes raw frames on the same line
+  auto line = PL::SerialLine::Create(PL::SerialLine::Parameters());
+  PL::ModbusServer lineServer(line->CreateEndpoint(), PL::ModbusProtocol::rtu, stationAddress);
+  PL::ModbusServer additionalLineServer(line->CreateEndpoint(), PL::ModbusProtocol::rtu, additionalStationAddress);
+  PL::ModbusClient lineClient(line->CreateEndpoint(), PL::ModbusProtocol::rtu, stationAddress);
+  auto rawStream = line->CreateEndpoint();
+  lineServer.AddMemoryArea(std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::holdingRegisters, 0, lineHRData, sizeof(lineHRData)));
+  additionalLineServer.AddMemoryArea(std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::holdingRegisters, 0, additionalLineHRData, sizeof(additionalLineHRData)));
+  TEST_ASSERT(lineServer.Enable() == ESP_OK);
+  TEST_ASSERT(additionalLineServer.Enable() == ESP_OK);
+  TEST_ASSERT(lineClient.SetReadTimeout(20) == ESP_OK);
+  vTaskDelay(10);
+
+  // Response to a request that the server has not seen: its data looks like a request to the server if the response is skipped as a request.
+  uint8_t frame[3 + numberOfAdditionalStationRegisters * 2 + 2];
+  frame[0] = foreignStationAddress;
+  frame[1] = (uint8_t)PL::ModbusFunctionCode::readHoldingRegisters;
+  frame[2] = numberOfAdditionalStationRegisters * 2;
+  memset(frame + 3, stationAddress, numberOfAdditionalStationRegisters * 2);
+  uint16_t crc = PL::ModbusBase::Crc(frame, sizeof(frame) - 2);
+  memcpy(frame + sizeof(frame) - 2, &crc, 2);
+  TEST_ASSERT(rawStream->Write(frame, sizeof(frame)) == ESP_OK);
+  vTaskDelay(10);
+
+  // Read and write transactions of another station and a request to a station without a server
+  for (int i = 0; i < numberOfAdditionalStationRegisters; i++)
+    data[i] = i + 1;
+  TEST_ASSERT(lineClient.SetStationAddress(additionalStationAddress) == ESP_OK);
+  TEST_ASSERT(lineClient.WriteMultipleHoldingRegisters(0, numberOfAdditionalStationRegisters, data, &exception) == ESP_OK);
+  TEST_ASSERT(lineClient.ReadHoldingRegisters(0, numberOfAdditionalStationRegisters, data, &exception) == ESP_OK);
+  TEST_ASSERT(lineClient.SetStationAddress(foreignStationAddress) == ESP_OK);
+  TEST_ASSERT(lineClient.ReadHoldingRegisters(0, 1, data, &exception) == ESP_ERR_TIMEOUT);
+
+  // The next request to the server is answered.
+  TEST_ASSERT(lineClient.SetStationAddress(stationAddress) == ESP_OK);
+  TEST_ASSERT(lineClient.ReadHoldingRegisters(0, numberOfAdditionalStationRegisters, data, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(0, data[0]);
+  TEST_ASSERT_EQUAL(numberOfAdditionalStationRegisters, additionalLineHRData[numberOfAdditionalStationRegisters - 1]);
+
+  PL::ModbusServerStatistics statistics;
+  TEST_ASSERT(lineServer.GetStatistics(statistics) == ESP_OK);
+  TEST_ASSERT_EQUAL(6, statistics.numberOfForeignFrames);
+  TEST_ASSERT_EQUAL(0, statistics.numberOfCrcErrors);
+  TEST_ASSERT_EQUAL(0, statistics.numberOfFrameErrors);
+  TEST_ASSERT_EQUAL(1, statistics.GetFunctionCodeStatistics(PL::ModbusFunctionCode::readHoldingRegisters).numberOfRequests);
+  TEST_ASSERT_EQUAL(0, line->GetStatistics().numberOfCollisions);
+
+  TEST_ASSERT(lineServer.Disable() == ESP_OK);
+  TEST_ASSERT(additionalLineServer.Disable() == ESP_OK);
+}
+
+//==============================================================================
+
+void TestMonitor() {
+  uint16_t data[numberOfAdditionalStationRegisters] = {};
+  uint16_t lineHRData[numberOfAdditionalStationRegisters] = {};
+  PL::ModbusException exception;
+
+  // Client, server and monitor on the same line: the monitor only reads the frames of the others.
+  auto line = PL::SerialLine::Create(PL::SerialLine::Parameters());
+  PL::ModbusServer lineServer(line->CreateEndpoint(), PL::ModbusProtocol::rtu, stationAddress);
+  PL::ModbusClient lineClient(line->CreateEndpoint(), PL::ModbusProtocol::rtu, stationAddress);
+  PL::ModbusMonitor monitor(line->CreateEndpoint());
+  auto capture = std::make_shared<PL::ModbusCapture>();
+  TEST_ASSERT(monitor.SetCapture(capture) == ESP_OK);
+  TEST_ASSERT(monitor.SetProtocol(PL::ModbusProtocol::ascii) == ESP_ERR_NOT_SUPPORTED);
+  TEST_ASSERT_EQUAL(PL::ModbusMonitor::defaultResponseTimeout, monitor.GetResponseTimeout());
+  lineServer.AddMemoryArea(std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::holdingRegisters, 0, lineHRData, sizeof(lineHRData)));
+  TEST_ASSERT(lineServer.Enable() == ESP_OK);
+  TEST_ASSERT(monitor.Enable() == ESP_OK);
+  TEST_ASSERT(lineClient.SetReadTimeout(20) == ESP_OK);
+
+  // Response, exception, write, timeout (station without a server), broadcast and response transactions.
+  TEST_ASSERT(lineClient.ReadHoldingRegisters(0, numberOfAdditionalStationRegisters, data, &exception) == ESP_OK);
+  TEST_ASSERT(lineClient.ReadHoldingRegisters(numberOfAdditionalStationRegisters, 1, data, &exception) != ESP_OK);
+  TEST_ASSERT_EQUAL(PL::ModbusException::illegalDataAddress, exception);
+  TEST_ASSERT(lineClient.WriteMultipleHoldingRegisters(0, numberOfAdditionalStationRegisters, data, &exception) == ESP_OK);
+  TEST_ASSERT(lineClient.SetStationAddress(additionalStationAddress) == ESP_OK);
+  TEST_ASSERT(lineClient.ReadHoldingRegisters(0, 1, data, &exception) == ESP_ERR_TIMEOUT);
+  TEST_ASSERT(lineClient.SetStationAddress(0) == ESP_OK);
+  TEST_ASSERT(lineClient.WriteSingleHoldingRegister(1, 5, &exception) == ESP_OK);
+  TEST_ASSERT(lineClient.SetStationAddress(stationAddress) == ESP_OK);
+  vTaskDelay(10);
+  TEST_ASSERT(lineClient.ReadHoldingRegisters(0, 2, data, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(5, data[1]);
+  vTaskDelay(10);
+
+  PL::ModbusMonitorStatistics statistics;
+  monitor.GetStatistics(statistics);
+  TEST_ASSERT_EQUAL(10, statistics.numberOfFrames);
+  TEST_ASSERT_EQUAL(6, statistics.numberOfRequests);
+  TEST_ASSERT_EQUAL(4, statistics.numberOfResponses);
+  TEST_ASSERT_EQUAL(1, statistics.numberOfBroadcasts);
+  TEST_ASSERT_EQUAL(1, statistics.numberOfTimeouts);
+  TEST_ASSERT_EQUAL(0, statistics.numberOfCrcErrors);
+  TEST_ASSERT_EQUAL(0, statistics.numberOfFrameErrors);
+
+  std::vector<uint8_t> stationAddresses;
+  monitor.GetStationAddresses(stationAddresses);
+  TEST_ASSERT(stationAddresses == std::vector<uint8_t>({stationAddress, additionalStationAddress}));
+  PL::ModbusMonitorStationStatistics stationStatistics;
+  TEST_ASSERT(monitor.GetStationStatistics(stationAddress, stationStatistics) == ESP_OK);
+  TEST_ASSERT_EQUAL(4, stationStatistics.numberOfRequests);
+  TEST_ASSERT_EQUAL(4, stationStatistics.numberOfResponses);
+  TEST_ASSERT_EQUAL(1, stationStatistics.numberOfExceptions[(int)PL::ModbusException::illegalDataAddress]);
+  TEST_ASSERT_EQUAL(0, stationStatistics.numberOfTimeouts);
+  TEST_ASSERT_EQUAL(4, stationStatistics.responseTime.count);
+  // The last response time includes at least the response characters on the line.
+  TEST_ASSERT(stationStatistics.lastResponseTime >= (uint32_t)(9 * line->GetCharacterTime() / 1000));
+  TEST_ASSERT(monitor.GetStationStatistics(additionalStationAddress, stationStatistics) == ESP_OK);
+  TEST_ASSERT_EQUAL(1, stationStatistics.numberOfRequests);
+  TEST_ASSERT_EQUAL(0, stationStatistics.numberOfResponses);
+  TEST_ASSERT_EQUAL(1, stationStatistics.numberOfTimeouts);
+  TEST_ASSERT(monitor.GetStationStatistics(stationAddress + 1, stationStatistics) == ESP_ERR_NOT_FOUND);
+
+  std::vector<PL::ModbusMonitorTransaction> log;
+  monitor.GetLog(log);
+  TEST_ASSERT_EQUAL(6, log.size());
+  const PL::ModbusMonitorTransactionStatus statuses[] = {PL::ModbusMonitorTransactionStatus::response, PL::ModbusMonitorTransactionStatus::exception,
+    PL::ModbusMonitorTransactionStatus::response, PL::ModbusMonitorTransactionStatus::timeout, PL::ModbusMonitorTransactionStatus::broadcast,
+    PL::ModbusMonitorTransactionStatus::response};
+  for (int i = 0; i < 6; i++)
+    TEST_ASSERT(statuses[i] == log[i].status);
+  TEST_ASSERT(log[0].functionCode == PL::ModbusFunctionCode::readHoldingRegisters);
+  TEST_ASSERT_EQUAL(0, log[0].address);
+  TEST_ASSERT_EQUAL(numberOfAdditionalStationRegisters, log[0].numberOfItems);
+  TEST_ASSERT(log[0].responseTime > 0);
+  TEST_ASSERT(log[1].exception == PL::ModbusException::illegalDataAddress);
+  TEST_ASSERT_EQUAL(additionalStationAddress, log[3].stationAddress);
+  TEST_ASSERT_EQUAL(1, log[4].address);
+  TEST_ASSERT_EQUAL(1, log[4].numberOfItems);
+
+  // All captured frames are received, the responses are server frames.
+  std::vector<PL::ModbusCaptureRecord> records;
+  capture->Read(records);
+  TEST_ASSERT_EQUAL(10, records.size());
+  int numberOfServerFrames = 0;
+  for (auto& record : records) {
+    TEST_ASSERT(record.direction == PL::ModbusCaptureDirection::received);
+    numberOfServerFrames += record.serverFrame;
+  }
+  TEST_ASSERT_EQUAL(4, numberOfServerFrames);
+  TEST_ASSERT_EQUAL(0, line->GetStatistics().numberOfCollisions);
+
+  monitor.ResetStatistics();
+  monitor.GetStatistics(statistics);
+  TEST_ASSERT_EQUAL(0, statistics.numberOfFrames);
+  monitor.GetLog(log);
+  TEST_ASSERT_EQUAL(0, log.size());
+  TEST_ASSERT(monitor.GetStationStatistics(stationAddress, stationStatistics) == ESP_ERR_NOT_FOUND);
+
+  TEST_ASSERT(monitor.Disable() == ESP_OK);
+  TEST_ASSERT(lineServer.Disable() == ESP_OK);
+}
+
+//==============================================================================
+
+void TestConcentrator() {
+  uint16_t data[numberOfAdditionalStationRegisters];
+  uint16_t downstreamHRData[numberOfAdditionalStationRegisters] = {};
+  uint8_t downstreamCoilData[2] = {};
+  uint16_t downstreamIRData[numberOfAdditionalStationRegisters];
+  PL::ModbusException exception;
+
+  // Two downstream stations on a serial line polled by one client
+  auto line = PL::SerialLine::Create(PL::SerialLine::Parameters());
+  PL::ModbusServer downstreamServer(line->CreateEndpoint(), PL::ModbusProtocol::rtu, stationAddress);
+  PL::ModbusServer additionalDownstreamServer(line->CreateEndpoint(), PL::ModbusProtocol::rtu, additionalStationAddress);
+  auto downstreamClient = std::make_shared<PL::ModbusClient>(line->CreateEndpoint(), PL::ModbusProtocol::rtu, 1);
+  for (int i = 0; i < numberOfAdditionalStationRegisters; i++)
+    downstreamIRData[i] = i + 10;
+  downstreamServer.AddMemoryArea(std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::holdingRegisters, 0, downstreamHRData, sizeof(downstreamHRData)));
+  downstreamServer.AddMemoryArea(std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::coils, 0, downstreamCoilData, sizeof(downstreamCoilData)));
+  additionalDownstreamServer.AddMemoryArea(std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::inputRegisters, 0, downstreamIRData, sizeof(downstreamIRData)));
+  TEST_ASSERT(downstreamClient->SetReadTimeout(20) == ESP_OK);
+  TEST_ASSERT(downstreamServer.Enable() == ESP_OK);
+  TEST_ASSERT(additionalDownstreamServer.Enable() == ESP_OK);
+
+  // Upstream server with the mirrored memory of both stations and a quality flag of the second station
+  auto upstreamStreams = PL::LoopbackStream::CreatePair();
+  PL::ModbusServer upstreamServer(upstreamStreams.first, PL::ModbusProtocol::tcp, stationAddress);
+  PL::ModbusClient upstreamClient(upstreamStreams.second, PL::ModbusProtocol::tcp, stationAddress);
+  auto concentratorHR = std::make_shared<PL::ModbusConcentratorMemoryArea>(PL::ModbusMemoryType::holdingRegisters, 0, sizeof(downstreamHRData), downstreamClient, stationAddress);
+  auto concentratorCoils = std::make_shared<PL::ModbusConcentratorMemoryArea>(PL::ModbusMemoryType::coils, 0, sizeof(downstreamCoilData), downstreamClient, stationAddress);
+  auto concentratorIR = std::make_shared<PL::ModbusConcentratorMemoryArea>(PL::ModbusMemoryType::inputRegisters, 100, 4 * 2, downstreamClient, additionalStationAddress, 2);
+  auto qualityDI = std::make_shared<PL::ModbusMemoryArea>(PL::ModbusMemoryType::discreteInputs, 0, 1);
+  memset(qualityDI->data, 0, 1);
+  TEST_ASSERT(concentratorIR->SetQualityFlag(qualityDI, 8) == ESP_ERR_INVALID_ARG);
+  TEST_ASSERT(concentratorIR->SetQualityFlag(qualityDI, 0) == ESP_OK);
+  TEST_ASSERT(concentratorHR->SetStaleDataLimit(50, PL::ModbusStaleDataAction::exception) == ESP_OK);
+  TEST_ASSERT(concentratorIR->SetStaleDataLimit(50, PL::ModbusStaleDataAction::qualityFlag) == ESP_OK);
+  upstreamServer.AddMemoryArea(concentratorHR);
+  upstreamServer.AddMemoryArea(concentratorCoils);
+  upstreamServer.AddMemoryArea(additionalStationAddress, concentratorIR);
+  upstreamServer.AddMemoryArea(additionalStationAddress, qualityDI);
+  // Mirror of registers that the downstream station does not have (not refreshed)
+  auto concentratorInvalidHR = std::make_shared<PL::ModbusConcentratorMemoryArea>(PL::ModbusMemoryType::holdingRegisters, 1000, 2 * 2, downstreamClient, stationAddress);
+  memset(concentratorInvalidHR->data, 0, concentratorInvalidHR->size);
+  upstreamServer.AddMemoryArea(concentratorInvalidHR);
+  // The write-through is not deferred.
+  TEST_ASSERT(upstreamServer.EnableDeferredOnWrite({4096, tskIDLE_PRIORITY + 5, tskNO_AFFINITY}, 4) == ESP_OK);
+  TEST_ASSERT(upstreamServer.Enable() == ESP_OK);
+
+  // Requests before the first refresh
+  TEST_ASSERT(concentratorHR->IsStale());
+  TEST_ASSERT(upstreamClient.ReadHoldingRegisters(0, 1, data, &exception) == ESP_FAIL);
+  TEST_ASSERT_EQUAL(PL::ModbusException::gatewayTargetDeviceFailedToRespond, exception);
+
+  PL::TaskParameters refreshTaskParameters = {4096, tskIDLE_PRIORITY + 5, tskNO_AFFINITY};
+  TEST_ASSERT(concentratorHR->EnableRefresh(refreshTaskParameters, 10) == ESP_OK);
+  TEST_ASSERT(concentratorCoils->EnableRefresh(refreshTaskParameters, 10) == ESP_OK);
+  TEST_ASSERT(concentratorIR->EnableRefresh(refreshTaskParameters, 10) == ESP_OK);
+  vTaskDelay(30);
+  TEST_ASSERT(!concentratorHR->IsStale());
+
+  // Downstream data is served from the mirrored memory
+  TEST_ASSERT(upstreamClient.SetStationAddress(additionalStationAddress) == ESP_OK);
+  TEST_ASSERT(upstreamClient.ReadInputRegisters(100, 4, data, &exception) == ESP_OK);
+  for (int i = 0; i < 4; i++)
+    TEST_ASSERT_EQUAL(i + 12, data[i]);
+  uint8_t quality = 0;
+  TEST_ASSERT(upstreamClient.ReadDiscreteInputs(0, 1, &quality, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(1, quality);
+  downstreamIRData[2] = 1000;
+  vTaskDelay(30);
+  TEST_ASSERT(upstreamClient.ReadInputRegisters(100, 1, data, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(1000, data[0]);
+
+  // Writes are written through to the downstream station
+  TEST_ASSERT(upstreamClient.SetStationAddress(stationAddress) == ESP_OK);
+  for (int i = 0; i < numberOfAdditionalStationRegisters; i++)
+    data[i] = i * 7 + 3;
+  TEST_ASSERT(upstreamClient.WriteMultipleHoldingRegisters(0, numberOfAdditionalStationRegisters, data, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(3, downstreamHRData[0]);
+  TEST_ASSERT_EQUAL((numberOfAdditionalStationRegisters - 1) * 7 + 3, downstreamHRData[numberOfAdditionalStationRegisters - 1]);
+  TEST_ASSERT(upstreamClient.WriteSingleHoldingRegister(5, 555, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(555, downstreamHRData[5]);
+  TEST_ASSERT(upstreamClient.WriteSingleCoil(9, true, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(0x02, downstreamCoilData[1]);
+  uint8_t coils = 0x05;
+  TEST_ASSERT(upstreamClient.WriteMultipleCoils(1, 3, &coils, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(0x0A, downstreamCoilData[0]);
+  vTaskDelay(30);
+  TEST_ASSERT(upstreamClient.ReadHoldingRegisters(5, 1, data, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(555, data[0]);
+  TEST_ASSERT_EQUAL(0, concentratorHR->GetNumberOfWriteErrors());
+  TEST_ASSERT_EQUAL(0, upstreamServer.GetDeferredOnWriteStatistics().numberOfWrites);
+
+  // Downstream exceptions are forwarded to the client.
+  TEST_ASSERT(upstreamClient.WriteSingleHoldingRegister(1000, 1, &exception) == ESP_FAIL);
+  TEST_ASSERT_EQUAL(PL::ModbusException::illegalDataAddress, exception);
+  TEST_ASSERT_EQUAL(1, concentratorInvalidHR->GetNumberOfWriteErrors());
+  {
+    PL::LockGuard lg(*concentratorInvalidHR);
+    TEST_ASSERT_EQUAL(0, ((uint16_t*)concentratorInvalidHR->data)[0]);
+  }
+
+  // Downstream stations stop responding: exception or cleared quality flag after the stale data limit
+  TEST_ASSERT(downstreamServer.Disable() == ESP_OK);
+  TEST_ASSERT(additionalDownstreamServer.Disable() == ESP_OK);
+  TEST_ASSERT(upstreamClient.WriteSingleHoldingRegister(5, 1, &exception) == ESP_FAIL);
+  TEST_ASSERT_EQUAL(PL::ModbusException::gatewayTargetDeviceFailedToRespond, exception);
+  TEST_ASSERT_EQUAL(1, concentratorHR->GetNumberOfWriteErrors());
+  // The value not accepted by the downstream station is not kept in the mirrored memory.
+  {
+    PL::LockGuard lg(*concentratorHR);
+    TEST_ASSERT_EQUAL(555, ((uint16_t*)concentratorHR->data)[5]);
+  }
+  vTaskDelay(100);
+  TEST_ASSERT(concentratorHR->IsStale());
+  TEST_ASSERT(concentratorHR->GetNumberOfRefreshErrors() > 0);
+  TEST_ASSERT(upstreamClient.ReadHoldingRegisters(0, 1, data, &exception) == ESP_FAIL);
+  TEST_ASSERT_EQUAL(PL::ModbusException::gatewayTargetDeviceFailedToRespond, exception);
+  TEST_ASSERT(upstreamClient.SetStationAddress(additionalStationAddress) == ESP_OK);
+  TEST_ASSERT(upstreamClient.ReadInputRegisters(100, 1, data, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(1000, data[0]);
+  TEST_ASSERT(upstreamClient.ReadDiscreteInputs(0, 1, &quality, &exception) == ESP_OK);
+  TEST_ASSERT_EQUAL(0, quality);
+
+  TEST_ASSERT(upstreamServer.Disable() == ESP_OK);
+  TEST_ASSERT(upstreamServer.DisableDeferredOnWrite() == ESP_OK);
+  TEST_ASSERT(concentratorHR->DisableRefresh() == ESP_OK);
+  TEST_ASSERT(concentratorCoils->DisableRefresh() == ESP_OK);
+  TEST_ASSERT(concentratorIR->DisableRefresh() == ESP_OK);
+}
+#endif